@@ -0,0 +1,649 @@
+#pragma once
+
+#include "date_time_utils.h"
+#include "model.h"
+#include "packet_bitmap.h"
+#include "payload_decoders.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+// Kinds of glitches in decoded payload values
+enum struct anomaly_kind
+{
+    // A marker value rather than a measurement: all bits set (e.g. `0xFFFFFFFF'FFFFFFFF` timestamps), the minimum of a
+    // signed type, or a non-finite floating point value
+    invalid_value,
+    // A `file_time` value outside the plausible range (see `is_plausible_timestamp()`)
+    out_of_range,
+    // A decrease in a field that otherwise never decreases (a counter reset, or time going backwards)
+    counter_reset,
+    // A short excursion far off the rolling median of the preceding values
+    spike,
+
+    last_value = spike
+};
+
+
+[[nodiscard]] inline constexpr wchar_t const* to_string(anomaly_kind const kind) noexcept
+{
+    switch (kind)
+    {
+    case anomaly_kind::invalid_value:
+        return L"invalid value";
+    case anomaly_kind::out_of_range:
+        return L"out of range";
+    case anomaly_kind::counter_reset:
+        return L"counter reset";
+    case anomaly_kind::spike:
+    default:
+        return L"spike";
+    }
+}
+
+
+struct anomaly_options
+{
+    // Number of preceding values the rolling median and median absolute deviation (MAD) are computed over
+    size_t window { 31 };
+    // Spikes are only detected once the window holds this many values
+    size_t min_samples { 8 };
+    // Values further off the rolling median than this many (robust) standard deviations are spike candidates
+    double spike_threshold { 8.0 };
+    // Runs of more consecutive candidates than this are a level shift rather than a spike
+    size_t max_spike_length { 3 };
+    // Number of transitions after which a field is classified as monotonic (or not)
+    size_t monotonic_warmup { 64 };
+    // Maximum number of anomalies reported individually (see `anomaly_index::events`)
+    size_t max_events { 10'000 };
+};
+
+
+// A numeric payload element checked for anomalies
+struct anomaly_field
+{
+    unsigned char type;
+    // Index into `packet_description::elements`
+    size_t element;
+    ::payload_element description;
+};
+
+
+// A single anomalous value
+struct anomaly_event
+{
+    // Packet index (natural order)
+    size_t index;
+    // Index into `anomaly_index::fields`
+    size_t field;
+    anomaly_kind kind;
+    // The decoded value (the raw value for `file_time` elements)
+    double value;
+};
+
+
+// Anomalies of a single field
+struct field_anomalies
+{
+    anomaly_field field;
+    // Packets whose value of this field is anomalous
+    packet_bitmap packets {};
+    ::std::array<uint64_t, static_cast<size_t>(anomaly_kind::last_value) + 1> counts {};
+    // Number of packets that contain the field
+    uint64_t samples { 0 };
+    // Whether the field was classified as monotonic (spikes are detected in its increments)
+    bool monotonic { false };
+};
+
+
+// Result of `detect_anomalies()`
+struct anomaly_index
+{
+    ::std::vector<field_anomalies> fields;
+    // The first `anomaly_options::max_events` anomalies in natural order
+    ::std::vector<anomaly_event> events;
+    uint64_t dropped_events { 0 };
+
+    // Returns the anomalies of a field, or `nullptr` if the field wasn't checked
+    [[nodiscard]] field_anomalies const* find(unsigned char const type, size_t const element) const noexcept
+    {
+        auto const it { ::std::find_if(begin(fields), end(fields), [&](field_anomalies const& f) {
+            return f.field.type == type && f.field.element == element;
+        }) };
+        return it == end(fields) ? nullptr : &*it;
+    }
+
+    //! \brief Returns all packets with at least one anomalous value.
+    //!
+    //! \remark To hide them from the list and from exports, select the
+    //!         complement (see `model::select()`).
+    //!
+    [[nodiscard]] packet_bitmap packets() const
+    {
+        packet_bitmap result {};
+        for (auto const& f : fields)
+        {
+            result = result | f.packets;
+        }
+        return result;
+    }
+};
+
+
+// Streaming anomaly detector for the values of a single field, in natural order. Memory is constant per field (the
+// rolling window, plus a few candidate values).
+//
+// Spikes are detected with a Hampel filter: values further off the rolling median than `spike_threshold` times the
+// scaled MAD are candidates. Candidates aren't added to the window. A run of up to `max_spike_length` candidates is
+// reported as spikes once a regular value follows; a longer run is a level shift, and the window restarts from it.
+// Spike reports are therefore delayed by up to `max_spike_length` values, and a run at the end of the log isn't
+// reported. The deviation threshold is at least one quantization step of the element, so that noise-free signals (with
+// a MAD of 0) don't report every change.
+//
+// Fields that increase in at least half and decrease in at most 2% of the transitions observed during the warm-up are
+// classified as monotonic (e.g. counters and timestamps). From then on, values are checked against the last accepted
+// value (spike candidates aren't accepted): a decrease is a counter reset, and spikes are detected in the increments
+// per value, so that a single value far ahead of its neighbors is a spike rather than a counter reset on the following
+// value.
+struct field_anomaly_detector
+{
+    field_anomaly_detector(::payload_element const& element, anomaly_options const& options)
+        : element_ { element }
+        , raw_element_ { element }
+        , options_ { options }
+    {
+        raw_element_.scale = 1.0;
+        raw_element_.bias = 0.0;
+        options_.window = ::std::max(options_.window, size_t { 1 });
+        options_.min_samples = ::std::clamp(options_.min_samples, size_t { 1 }, options_.window);
+        ring_.reserve(options_.window);
+        sorted_.reserve(options_.window);
+        deviations_.reserve(options_.window);
+        pending_.reserve(options_.max_spike_length + 1);
+        quantum_ = is_floating_point() ? 0.0 : ::std::abs(element.scale);
+    }
+
+    // Returns whether the detector checks values of this element type
+    [[nodiscard]] static bool is_supported(payload_type const type) noexcept
+    {
+        return type != payload_type::unknown && type != payload_type::bitfield && type != payload_type::enumeration
+               && type <= payload_type::last_value;
+    }
+
+    //! \brief Checks the field's value in a packet.
+    //!
+    //! \param[in] index   The packet index (natural order).
+    //! \param[in] payload The packet's payload.
+    //! \param[in] report  Invoked as `report(index, kind, value)` for every
+    //!                    anomaly. Spikes are reported with a delay, so
+    //!                    indices aren't necessarily ascending.
+    //!
+    //! \return `false` if the payload doesn't contain the field.
+    //!
+    template <typename F>
+    bool add(size_t const index, ::std::span<unsigned char const> const payload, F&& report)
+    {
+        double raw {};
+        if (element_.type == payload_type::file_time)
+        {
+            if (element_.offset + sizeof(uint64_t) > payload.size())
+            {
+                return false;
+            }
+            uint64_t time {};
+            ::std::memcpy(&time, payload.data() + element_.offset, sizeof(time));
+            raw = static_cast<double>(time);
+            if (time == ::std::numeric_limits<uint64_t>::max())
+            {
+                report(index, anomaly_kind::invalid_value, raw);
+                return true;
+            }
+            if (!::is_plausible_timestamp(time))
+            {
+                report(index, anomaly_kind::out_of_range, raw);
+                return true;
+            }
+        }
+        else
+        {
+            auto const value { ::decode_element(payload, raw_element_) };
+            if (!value)
+            {
+                return false;
+            }
+            raw = *value;
+            if (is_marker(raw))
+            {
+                report(index, anomaly_kind::invalid_value, raw * element_.scale + element_.bias);
+                return true;
+            }
+        }
+
+        auto const value { element_.type == payload_type::file_time ? raw : raw * element_.scale + element_.bias };
+        if (check_monotonic(value))
+        {
+            report(index, anomaly_kind::counter_reset, value);
+            // The field counts on from the reset value
+            last_accepted_ = value;
+            return true;
+        }
+        if (!monotonic_)
+        {
+            check_spike(index, value, value, report);
+        }
+        else
+        {
+            // Increments are averaged over the values since the last accepted one, so the value following a spike
+            // candidate isn't a candidate just for spanning two steps
+            auto const increment { (value - *last_accepted_) / static_cast<double>(pending_.size() + 1) };
+            if (check_spike(index, value, increment, report))
+            {
+                last_accepted_ = value;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool monotonic() const noexcept { return monotonic_; }
+
+private:
+    [[nodiscard]] bool is_floating_point() const noexcept
+    {
+        return element_.type == payload_type::f32 || element_.type == payload_type::f64;
+    }
+
+    // Returns whether a raw value is a marker rather than a measurement
+    [[nodiscard]] bool is_marker(double const raw) const noexcept
+    {
+        switch (element_.type)
+        {
+        case payload_type::f32:
+        case payload_type::f64:
+            return !::std::isfinite(raw);
+        case payload_type::ui16:
+        case payload_type::ui16_be:
+            return raw == 65'535.0;
+        case payload_type::ui32:
+        case payload_type::ui32_be:
+            return raw == 4'294'967'295.0;
+        case payload_type::ui64:
+            // 2^64 - 1 rounds to 2^64
+            return raw >= 18'446'744'073'709'551'615.0;
+        case payload_type::i16:
+        case payload_type::i16_be:
+            return raw == -32'768.0;
+        case payload_type::i32:
+        case payload_type::i32_be:
+            return raw == -2'147'483'648.0;
+        case payload_type::i64:
+            return raw == -9'223'372'036'854'775'808.0;
+        default:
+            // All 8-bit values are common measurements
+            return false;
+        }
+    }
+
+    // Updates the monotonicity classification; returns whether `value` is a counter reset
+    [[nodiscard]] bool check_monotonic(double const value) noexcept
+    {
+        if (monotonic_)
+        {
+            return value < *last_accepted_;
+        }
+        auto const previous { previous_ };
+        previous_ = value;
+        if (!previous)
+        {
+            return false;
+        }
+        if (transitions_ < options_.monotonic_warmup)
+        {
+            ++transitions_;
+            increases_ += value > *previous ? 1 : 0;
+            decreases_ += value < *previous ? 1 : 0;
+            if (transitions_ == options_.monotonic_warmup)
+            {
+                monotonic_ = increases_ * 2 >= transitions_ && decreases_ * 50 <= transitions_;
+                if (monotonic_)
+                {
+                    // The window holds values so far; it holds increments from now on
+                    restart_window();
+                    pending_.clear();
+                    last_accepted_ = value;
+                }
+            }
+        }
+        return false;
+    }
+
+    //! \brief Runs the Hampel filter on a sample.
+    //!
+    //! \param[in] value  The value reported if the sample is a spike.
+    //! \param[in] sample The value itself, or its increment per value since
+    //!                   the last accepted one for monotonic fields.
+    //!
+    //! \return `false` if the sample is held back as a spike candidate.
+    //!
+    template <typename F>
+    bool check_spike(size_t const index, double const value, double const sample, F&& report)
+    {
+        if (sorted_.size() < options_.min_samples || !deviates(sample))
+        {
+            // A regular value ends a run of candidates; the run was a spike
+            for (auto const& candidate : pending_)
+            {
+                report(candidate.index, anomaly_kind::spike, candidate.value);
+            }
+            pending_.clear();
+            push(sample);
+            return true;
+        }
+
+        pending_.push_back({ index, value, sample });
+        if (pending_.size() <= options_.max_spike_length)
+        {
+            return false;
+        }
+        // Level shift: restart the window from the new level
+        restart_window();
+        for (size_t i { 0 }; i < pending_.size(); ++i)
+        {
+            if (!monotonic_)
+            {
+                push(pending_[i].sample);
+            }
+            else if (i != 0)
+            {
+                // The first increment is the shift itself
+                push(pending_[i].value - pending_[i - 1].value);
+            }
+        }
+        pending_.clear();
+        return true;
+    }
+
+    void restart_window() noexcept
+    {
+        ring_.clear();
+        sorted_.clear();
+        next_ = 0;
+    }
+
+    [[nodiscard]] bool deviates(double const value)
+    {
+        auto const median { median_of(sorted_) };
+        auto const floor { ::std::max(quantum_, 1e-9 * ::std::abs(median)) };
+        if (::std::abs(value - median) <= options_.spike_threshold * floor)
+        {
+            // Within the threshold for any MAD; most values take this path
+            return false;
+        }
+        deviations_.clear();
+        for (auto const v : sorted_)
+        {
+            deviations_.push_back(::std::abs(v - median));
+        }
+        ::std::nth_element(begin(deviations_), begin(deviations_) + deviations_.size() / 2, end(deviations_));
+        // 1.4826 * MAD estimates the standard deviation of normally distributed values
+        auto const sigma { ::std::max(1.4826 * deviations_[deviations_.size() / 2], floor) };
+        return ::std::abs(value - median) > options_.spike_threshold * sigma;
+    }
+
+    [[nodiscard]] static double median_of(::std::vector<double> const& sorted) noexcept
+    {
+        auto const n { sorted.size() };
+        return n % 2 == 1 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    }
+
+    // Adds a value to the rolling window, evicting the oldest one
+    void push(double const value)
+    {
+        if (ring_.size() < options_.window)
+        {
+            ring_.push_back(value);
+        }
+        else
+        {
+            auto const evicted { ring_[next_] };
+            sorted_.erase(::std::lower_bound(begin(sorted_), end(sorted_), evicted));
+            ring_[next_] = value;
+            next_ = (next_ + 1) % options_.window;
+        }
+        sorted_.insert(::std::upper_bound(begin(sorted_), end(sorted_), value), value);
+    }
+
+    ::payload_element element_;
+    // `element_` without scale and bias, to check for markers
+    ::payload_element raw_element_;
+    anomaly_options options_;
+    double quantum_ { 0.0 };
+
+    // Monotonicity
+    bool monotonic_ { false };
+    ::std::optional<double> previous_ {};
+    // Most recent value of a monotonic field that wasn't a spike candidate
+    ::std::optional<double> last_accepted_ {};
+    size_t transitions_ { 0 };
+    size_t increases_ { 0 };
+    size_t decreases_ { 0 };
+
+    // Rolling window in insertion order (`next_` is the oldest value once full), and sorted
+    ::std::vector<double> ring_ {};
+    size_t next_ { 0 };
+    ::std::vector<double> sorted_ {};
+    ::std::vector<double> deviations_ {};
+
+    struct spike_candidate
+    {
+        // Packet index (natural order)
+        size_t index;
+        double value;
+        // What the filter saw (see `check_spike()`)
+        double sample;
+    };
+    // Current run of spike candidates
+    ::std::vector<spike_candidate> pending_ {};
+};
+
+
+//! \brief Returns all numeric elements of the described packet types that
+//!        `field_anomaly_detector` supports.
+//!
+[[nodiscard]] inline ::std::vector<anomaly_field> anomaly_fields(::payload_container const& descriptions)
+{
+    ::std::vector<anomaly_field> fields {};
+    for (auto const& [type, description] : descriptions)
+    {
+        for (size_t element { 0 }; element < description.elements.size(); ++element)
+        {
+            if (field_anomaly_detector::is_supported(description.elements[element].type))
+            {
+                fields.push_back({ type, element, description.elements[element] });
+            }
+        }
+    }
+    return fields;
+}
+
+
+//! \brief Detects anomalies of payload fields in a single pass over a sensor
+//!        log.
+//!
+//! \param[in] directory All packets of a sensor log in natural order.
+//! \param[in] fields    The fields to check (see `anomaly_fields()`).
+//! \param[in] options   Detection parameters.
+//!
+//! \return The anomalies per field, in the order of `fields`.
+//!
+[[nodiscard]] inline anomaly_index detect_anomalies(::std::span<data_proxy const> const directory,
+                                                    ::std::span<anomaly_field const> const fields,
+                                                    anomaly_options const& options = {})
+{
+    trace_span const span { "detect_anomalies" };
+
+    ::std::array<::std::vector<size_t>, 256> fields_by_type {};
+    ::std::vector<field_anomaly_detector> detectors {};
+    detectors.reserve(fields.size());
+    anomaly_index result {};
+    for (size_t i { 0 }; i < fields.size(); ++i)
+    {
+        fields_by_type[fields[i].type].push_back(i);
+        detectors.emplace_back(fields[i].description, options);
+        result.fields.push_back(field_anomalies { .field = fields[i] });
+    }
+
+    // Anomalous indices per field; spikes are reported out of order, so bitmaps are built at the end
+    ::std::vector<::std::vector<size_t>> anomalous(fields.size());
+    for (size_t index { 0 }; index < directory.size(); ++index)
+    {
+        auto const& packet { directory[index] };
+        auto const& slots { fields_by_type[packet.type()] };
+        if (slots.empty())
+        {
+            continue;
+        }
+        ::std::span<unsigned char const> const payload { packet.data() + packet.header_size(), packet.payload_size() };
+        for (auto const i : slots)
+        {
+            auto const report = [&](size_t const at, anomaly_kind const kind, double const value) {
+                anomalous[i].push_back(at);
+                ++result.fields[i].counts[static_cast<size_t>(kind)];
+                result.events.push_back({ at, i, kind, value });
+            };
+            if (detectors[i].add(index, payload, report))
+            {
+                ++result.fields[i].samples;
+            }
+        }
+
+        // Keep the event list bounded; delayed spikes may still precede retained events, so trim with some slack
+        if (result.events.size() > 2 * options.max_events + 1024)
+        {
+            ::std::sort(begin(result.events), end(result.events),
+                        [](auto const& lhs, auto const& rhs) { return lhs.index < rhs.index; });
+            result.dropped_events += result.events.size() - options.max_events;
+            result.events.resize(options.max_events);
+        }
+    }
+
+    for (size_t i { 0 }; i < fields.size(); ++i)
+    {
+        result.fields[i].monotonic = detectors[i].monotonic();
+
+        auto& indices { anomalous[i] };
+        ::std::sort(begin(indices), end(indices));
+        indices.erase(::std::unique(begin(indices), end(indices)), end(indices));
+        for (auto const index : indices)
+        {
+            result.fields[i].packets.push_back(index);
+        }
+    }
+
+    ::std::stable_sort(begin(result.events), end(result.events),
+                       [](auto const& lhs, auto const& rhs) { return lhs.index < rhs.index; });
+    if (result.events.size() > options.max_events)
+    {
+        result.dropped_events += result.events.size() - options.max_events;
+        result.events.resize(options.max_events);
+    }
+    return result;
+}
+
+
+//! \brief Detects anomalies of all supported fields of a model's described
+//!        packet types.
+//!
+[[nodiscard]] inline anomaly_index detect_anomalies(::model const& m, anomaly_options const& options = {})
+{
+    auto const fields { ::anomaly_fields(m.packet_descriptions()) };
+    return ::detect_anomalies(m.directory(), fields, options);
+}
+
+
+// Caches the anomalies of a model's fields, so that consumers recreated for the same log (e.g. the diagram renderer
+// after a resize or a change of graphs) don't scan it again. Entries are keyed by field and the description generation
+// of its packet type (see `model::description_generation()`), so fields whose descriptions changed are detected again.
+// The model must outlive the cache, and its descriptions must not change during `find()`.
+struct anomaly_cache
+{
+    explicit anomaly_cache(::model const& m, anomaly_options const& options = {}) : model_ { m }, options_ { options }
+    {
+    }
+
+    anomaly_cache(anomaly_cache const&) = delete;
+    anomaly_cache& operator=(anomaly_cache const&) = delete;
+
+    //! \brief Returns the anomalies of fields, in the order of `fields`.
+    //!
+    //! \remark Fields that aren't cached are detected in a single pass over
+    //!         the log. Only per-field results are cached, not the events.
+    //!
+    [[nodiscard]] ::std::vector<::std::shared_ptr<field_anomalies const>> find(
+        ::std::span<anomaly_field const> const fields)
+    {
+        ::std::scoped_lock lock { lock_ };
+
+        // Drop the entries of descriptions that changed since
+        ::std::erase_if(entries_, [&](entry const& e) {
+            return e.generation != model_.description_generation(e.anomalies->field.type);
+        });
+
+        ::std::vector<::std::shared_ptr<field_anomalies const>> result(fields.size());
+        ::std::vector<anomaly_field> missing {};
+        ::std::vector<size_t> missing_slots {};
+        for (size_t i { 0 }; i < fields.size(); ++i)
+        {
+            auto const it { ::std::find_if(begin(entries_), end(entries_), [&](entry const& e) {
+                return e.anomalies->field.type == fields[i].type
+                       && e.anomalies->field.description == fields[i].description;
+            }) };
+            if (it != end(entries_))
+            {
+                result[i] = it->anomalies;
+            }
+            else
+            {
+                missing.push_back(fields[i]);
+                missing_slots.push_back(i);
+            }
+        }
+        if (missing.empty())
+        {
+            return result;
+        }
+
+        auto detected { ::detect_anomalies(model_.directory(), missing, options_) };
+        for (size_t j { 0 }; j < missing.size(); ++j)
+        {
+            auto anomalies { ::std::make_shared<field_anomalies const>(::std::move(detected.fields[j])) };
+            entries_.push_back({ model_.description_generation(missing[j].type), anomalies });
+            result[missing_slots[j]] = ::std::move(anomalies);
+        }
+        return result;
+    }
+
+private:
+    struct entry
+    {
+        // Description generation of the field's packet type the anomalies were detected with
+        uint32_t generation;
+        ::std::shared_ptr<field_anomalies const> anomalies;
+    };
+
+    ::model const& model_;
+    anomaly_options options_;
+    ::std::mutex lock_;
+    ::std::vector<entry> entries_;
+};
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "char_encoding_utils.h"
+#include "chunk_utils.h"
+#include "hash_utils.h"
+#include "model.h"
+#include "tracing.h"
+
+#include <nlohmann/json.hpp>
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <compare>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// Identifies a chunk by content
+struct chunk_id
+{
+    uint64_t hash;
+    uint64_t size;
+
+    [[nodiscard]] friend constexpr auto operator<=>(chunk_id const&, chunk_id const&) noexcept = default;
+};
+
+
+struct ingest_result
+{
+    ::std::filesystem::path source;
+    size_t chunk_count;
+    // Chunks that weren't part of the store before
+    size_t new_chunk_count;
+    uint64_t bytes;
+    uint64_t new_bytes;
+};
+
+
+// Content-addressed chunk store for sensor logs.
+//
+// Every ingested log is split into chunks (terminated by [SEQUENCE_ID] packets). Each chunk is hashed and stored once
+// under `<root>/objects`, no matter how many logs contain it. A manifest per log lists the chunks in order, so the
+// original file can be reconstructed byte for byte. Bytes following the final complete chunk (including a truncated
+// final packet) are stored as a chunk of their own. Manifests are keyed by the log's full path
+// (`<root>/manifests/<filename>-<path hash>.json`), so equally named logs from different folders don't collide.
+//
+// Chunks are identified by their XXH64 hash and size; byte-level collisions are not verified on ingest. `verify()`
+// checks a reconstruction against the whole-file hash recorded in the manifest.
+struct chunk_store
+{
+    explicit chunk_store(::std::filesystem::path root) : root_ { ::std::move(root) }
+    {
+        ::std::filesystem::create_directories(root_ / L"objects");
+        ::std::filesystem::create_directories(root_ / L"manifests");
+
+        // Rebuild index from existing objects
+        for (auto const& entry : ::std::filesystem::recursive_directory_iterator(root_ / L"objects"))
+        {
+            if (!entry.is_regular_file())
+            {
+                continue;
+            }
+            if (auto const id { parse_object_name(entry.path().filename().wstring()) }; id)
+            {
+                auto& s { shards_[id->hash % shards_.size()] };
+                s.ids.insert(*id);
+            }
+        }
+    }
+
+    chunk_store(chunk_store const&) = delete;
+    chunk_store& operator=(chunk_store const&) = delete;
+
+    // Ingests a single sensor log
+    ingest_result ingest(::std::filesystem::path const& log_path)
+    {
+        raw_data const data { log_path.c_str() };
+        auto const bytes { data.bytes() };
+        auto const& directory { data.directory() };
+
+        ingest_result result { log_path, 0, 0, 0, 0 };
+        ::nlohmann::json chunks = ::nlohmann::json::array();
+
+        auto const store_range = [&](size_t const first, size_t const last) {
+            auto const content { bytes.subspan(first, last - first) };
+            chunk_id const id { ::xxhash64(content), content.size() };
+            if (store_object(id, content))
+            {
+                ++result.new_chunk_count;
+                result.new_bytes += content.size();
+            }
+            ++result.chunk_count;
+            result.bytes += content.size();
+            chunks.push_back(::to_utf8(object_name(id)));
+        };
+
+        size_t offset { 0 };
+        for (auto const& chunk : ::split_into_chunks(directory))
+        {
+            if (!chunk.is_complete())
+            {
+                break;
+            }
+            auto const& last_packet { directory[chunk.end - 1] };
+            auto const end_offset { static_cast<size_t>(last_packet.data() - bytes.data()) + last_packet.size() };
+            store_range(offset, end_offset);
+            offset = end_offset;
+        }
+        if (offset < bytes.size())
+        {
+            store_range(offset, bytes.size());
+        }
+
+        ::nlohmann::json const manifest { { "source", ::to_utf8(source_key(log_path)) },
+                                          { "size", bytes.size() },
+                                          { "hash", ::std::format("{:016x}", ::xxhash64(bytes)) },
+                                          { "chunks", ::std::move(chunks) } };
+        write_file(manifest_path(log_path), manifest.dump(1));
+
+        return result;
+    }
+
+    // Ingests multiple sensor logs in parallel. A `thread_count` of 0 selects the number of hardware threads.
+    ::std::vector<ingest_result> ingest(::std::span<::std::filesystem::path const> const log_paths,
+                                        size_t thread_count = 0)
+    {
+        if (thread_count == 0)
+        {
+            thread_count = ::std::max(1u, ::std::thread::hardware_concurrency());
+        }
+
+        ::std::vector<ingest_result> results(log_paths.size());
+        ::std::vector<::std::exception_ptr> errors(log_paths.size());
+        ::std::atomic<size_t> next { 0 };
+        {
+            ::std::vector<::std::jthread> workers {};
+            for (size_t t { 0 }; t < ::std::min(thread_count, log_paths.size()); ++t)
+            {
+                workers.emplace_back([&] {
+                    for (auto index { next++ }; index < log_paths.size(); index = next++)
+                    {
+                        try
+                        {
+                            results[index] = ingest(log_paths[index]);
+                        }
+                        catch (...)
+                        {
+                            errors[index] = ::std::current_exception();
+                        }
+                    }
+                });
+            }
+        }
+
+        for (auto const& error : errors)
+        {
+            if (error)
+            {
+                ::std::rethrow_exception(error);
+            }
+        }
+        return results;
+    }
+
+    // Returns the chunk IDs of a log in order, as recorded in its manifest. `log_path` is the path the log was ingested
+    // from.
+    [[nodiscard]] ::std::vector<chunk_id> manifest(::std::filesystem::path const& log_path) const
+    {
+        auto const j = read_manifest(log_path);
+        ::std::vector<chunk_id> result {};
+        for (auto const& name : j.at("chunks"))
+        {
+            auto const id { parse_object_name(::to_utf16(name.get<::std::string>())) };
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, !id);
+            result.push_back(*id);
+        }
+        return result;
+    }
+
+    // Recreates the original log file from its manifest
+    void reconstruct(::std::filesystem::path const& log_path, ::std::filesystem::path const& target) const
+    {
+        trace_span const span { "chunk_store::reconstruct" };
+        ::std::ofstream out { target, ::std::ios::binary | ::std::ios::trunc };
+        THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+        for (auto const& id : manifest(log_path))
+        {
+            auto const content { read_chunk(id) };
+            out.write(reinterpret_cast<char const*>(content.data()), static_cast<::std::streamsize>(content.size()));
+        }
+        THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+    }
+
+    // Verifies that a log can be reconstructed; returns `false` on size or hash mismatch
+    [[nodiscard]] bool verify(::std::filesystem::path const& log_path) const
+    {
+        auto const j = read_manifest(log_path);
+        ::std::vector<unsigned char> content {};
+        for (auto const& id : manifest(log_path))
+        {
+            auto const chunk { read_chunk(id) };
+            content.insert(end(content), begin(chunk), end(chunk));
+        }
+        return content.size() == j.at("size").get<size_t>()
+               && ::std::format("{:016x}", ::xxhash64(content)) == j.at("hash").get<::std::string>();
+    }
+
+    [[nodiscard]] ::std::vector<unsigned char> read_chunk(chunk_id const& id) const
+    {
+        ::std::ifstream in { object_path(id), ::std::ios::binary };
+        THROW_WIN32_IF(ERROR_READ_FAULT, !in);
+        ::std::vector<unsigned char> content(static_cast<size_t>(id.size));
+        in.read(reinterpret_cast<char*>(content.data()), static_cast<::std::streamsize>(content.size()));
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, static_cast<size_t>(in.gcount()) != content.size());
+        return content;
+    }
+
+    // Returns every unique chunk exactly once (e.g. for analytics that must not count re-uploaded chunks twice)
+    [[nodiscard]] ::std::vector<chunk_id> chunks() const
+    {
+        ::std::vector<chunk_id> result {};
+        for (auto const& s : shards_)
+        {
+            ::std::scoped_lock lock { s.lock };
+            result.insert(end(result), begin(s.ids), end(s.ids));
+        }
+        ::std::sort(begin(result), end(result));
+        return result;
+    }
+
+private:
+    // Objects are named `<hash>-<size>` (both hexadecimal)
+    [[nodiscard]] static ::std::wstring object_name(chunk_id const& id)
+    {
+        return ::std::format(L"{:016x}-{:x}", id.hash, id.size);
+    }
+
+    [[nodiscard]] static ::std::optional<chunk_id> parse_object_name(::std::wstring const& name)
+    {
+        if (name.size() < 18 || name[16] != L'-')
+        {
+            return {};
+        }
+        try
+        {
+            size_t hash_len {};
+            size_t size_len {};
+            auto const hash { ::std::stoull(name.substr(0, 16), &hash_len, 16) };
+            auto const size { ::std::stoull(name.substr(17), &size_len, 16) };
+            if (hash_len != 16 || size_len != name.size() - 17)
+            {
+                return {};
+            }
+            return chunk_id { hash, size };
+        }
+        catch (::std::exception const&)
+        {
+            return {};
+        }
+    }
+
+    [[nodiscard]] ::std::filesystem::path object_path(chunk_id const& id) const
+    {
+        auto const name { object_name(id) };
+        // Fan out into subdirectories by the first two hex digits
+        return root_ / L"objects" / name.substr(0, 2) / name;
+    }
+
+    // Returns the absolute, normalized, and lower-cased (file names are case-insensitive) path of a log
+    [[nodiscard]] static ::std::wstring source_key(::std::filesystem::path const& log_path)
+    {
+        auto key { ::std::filesystem::absolute(log_path).lexically_normal().wstring() };
+        ::CharLowerBuffW(key.data(), static_cast<DWORD>(key.size()));
+        return key;
+    }
+
+    [[nodiscard]] ::std::filesystem::path manifest_path(::std::filesystem::path const& log_path) const
+    {
+        auto const key { ::to_utf8(source_key(log_path)) };
+        auto const hash { ::xxhash64({ reinterpret_cast<unsigned char const*>(key.data()), key.size() }) };
+        return root_ / L"manifests" / ::std::format(L"{}-{:016x}.json", log_path.filename().wstring(), hash);
+    }
+
+    [[nodiscard]] ::nlohmann::json read_manifest(::std::filesystem::path const& log_path) const
+    {
+        ::std::ifstream in { manifest_path(log_path) };
+        THROW_WIN32_IF(ERROR_FILE_NOT_FOUND, !in);
+        ::nlohmann::json j {};
+        in >> j;
+        return j;
+    }
+
+    static void write_file(::std::filesystem::path const& path, ::std::span<unsigned char const> const content)
+    {
+        // Write to a temporary file first, so that readers never observe partially written files
+        auto tmp_path { path };
+        tmp_path += ::std::format(L".{}.{}.tmp", ::GetCurrentProcessId(), ::GetCurrentThreadId());
+        {
+            ::std::ofstream out { tmp_path, ::std::ios::binary | ::std::ios::trunc };
+            out.write(reinterpret_cast<char const*>(content.data()), static_cast<::std::streamsize>(content.size()));
+            THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+        }
+        ::std::filesystem::rename(tmp_path, path);
+    }
+
+    static void write_file(::std::filesystem::path const& path, ::std::string const& content)
+    {
+        write_file(path, { reinterpret_cast<unsigned char const*>(content.data()), content.size() });
+    }
+
+    // Stores an object unless it exists already. Returns `true` if the object was added.
+    bool store_object(chunk_id const& id, ::std::span<unsigned char const> const content)
+    {
+        auto& s { shards_[id.hash % shards_.size()] };
+        {
+            ::std::scoped_lock lock { s.lock };
+            if (s.ids.contains(id))
+            {
+                return false;
+            }
+        }
+
+        // The ID is only published once the object is complete, so that a concurrent ingest never records a manifest
+        // referencing an object that's still being written. Concurrent ingests of the same chunk may both write it;
+        // the renames replace identical content, and only the first one to register counts it as new.
+        auto const path { object_path(id) };
+        ::std::filesystem::create_directories(path.parent_path());
+        write_file(path, content);
+
+        ::std::scoped_lock lock { s.lock };
+        return s.ids.insert(id).second;
+    }
+
+    // The index is sharded by hash to reduce lock contention during parallel ingest
+    struct shard
+    {
+        mutable ::std::mutex lock;
+        ::std::set<chunk_id> ids;
+    };
+
+    ::std::filesystem::path root_;
+    ::std::array<shard, 64> shards_;
+};
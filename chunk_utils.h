@@ -0,0 +1,60 @@
+#pragma once
+
+#include "model.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+//! \brief Describes a single chunk of a sensor log.
+//!
+//! \remark A chunk is a contiguous range of packets that is terminated by a
+//!         [SEQUENCE_ID] packet. Consecutive chunks carry consecutive sequence
+//!         IDs.
+//!
+struct chunk_info
+{
+    // Index of the first packet in natural order
+    size_t begin;
+    // Index one past the final packet (the [SEQUENCE_ID] packet for complete chunks)
+    size_t end;
+    // Sequence ID stored in the terminating packet; `nullopt` for an incomplete trailing chunk
+    ::std::optional<uint32_t> sequence_id;
+
+    [[nodiscard]] auto packet_count() const noexcept { return end - begin; }
+    [[nodiscard]] auto is_complete() const noexcept { return sequence_id.has_value(); }
+};
+
+
+//! \brief Splits a packet directory into chunks.
+//!
+//! \param[in] directory All packets of a sensor log in natural order.
+//!
+//! \return The list of chunks in natural order. Packets following the final
+//!         [SEQUENCE_ID] packet are reported as an incomplete chunk. If the
+//!         directory is empty, this function returns an empty list.
+//!
+[[nodiscard]] inline ::std::vector<chunk_info> split_into_chunks(::std::span<data_proxy const> const directory)
+{
+    ::std::vector<chunk_info> chunks {};
+
+    size_t begin { 0 };
+    for (size_t index { 0 }; index < directory.size(); ++index)
+    {
+        auto const& packet { directory[index] };
+        if (packet.type() == k_packet_type_sequence_id && packet.payload_size() >= sizeof(uint32_t))
+        {
+            chunks.push_back({ begin, index + 1, packet.value<uint32_t>(0) });
+            begin = index + 1;
+        }
+    }
+
+    if (begin < directory.size())
+    {
+        chunks.push_back({ begin, directory.size(), ::std::nullopt });
+    }
+
+    return chunks;
+}
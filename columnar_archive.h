@@ -0,0 +1,739 @@
+#pragma once
+
+#include "chunk_utils.h"
+#include "encoding_utils.h"
+#include "model.h"
+#include "tracing.h"
+
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+// Encodings available for a single column. The encoder picks the smallest one per column and chunk.
+enum struct column_encoding : uint8_t
+{
+    // Fixed width little endian values
+    raw,
+    // (value, run length) pairs, e.g. for [DEVICE_STATE] flags
+    run_length,
+    // Zigzag encoded differences between consecutive values, e.g. for counters
+    delta,
+    // Zigzag encoded differences between consecutive deltas, e.g. for timestamps
+    delta_of_delta,
+    // Offsets from the minimum value using the minimal number of bits, e.g. for sensor samples
+    bit_packed,
+    // Bit-packed zigzag encoded differences, e.g. for slowly changing heart rate samples
+    delta_bit_packed,
+
+    last_value = delta_bit_packed
+};
+
+
+//! \brief Appends an encoded column of values.
+//!
+//! \param[in,out] buffer The buffer to append to.
+//! \param[in]     values The column values.
+//! \param[in]     width  The size of each value in bytes (1 through 8). This is
+//!                       used by the `raw` encoding only.
+//!
+//! \remark Every encoding is tried, and the smallest output is kept. The column
+//!         is prefixed by its encoding and the size of the encoded data.
+//!
+inline void encode_column(::std::vector<uint8_t>& buffer, ::std::span<uint64_t const> const values, size_t const width)
+{
+    assert(width >= 1 && width <= sizeof(uint64_t));
+
+    ::std::vector<uint8_t> best {};
+    auto best_encoding { column_encoding::raw };
+    ::std::vector<uint8_t> candidate {};
+    auto const keep = [&](column_encoding const encoding) {
+        if (best.empty() || candidate.size() < best.size())
+        {
+            best.swap(candidate);
+            best_encoding = encoding;
+        }
+        candidate.clear();
+    };
+
+    // raw
+    for (auto const value : values)
+    {
+        for (size_t b { 0 }; b < width; ++b)
+        {
+            candidate.push_back(static_cast<uint8_t>(value >> (b * 8)));
+        }
+    }
+    keep(column_encoding::raw);
+
+    // run_length
+    for (size_t first { 0 }; first < values.size();)
+    {
+        auto last { first + 1 };
+        while (last < values.size() && values[last] == values[first])
+        {
+            ++last;
+        }
+        ::write_varint(candidate, values[first]);
+        ::write_varint(candidate, last - first);
+        first = last;
+    }
+    keep(column_encoding::run_length);
+
+    // delta
+    uint64_t previous { 0 };
+    for (auto const value : values)
+    {
+        ::write_varint(candidate, ::zigzag_encode(static_cast<int64_t>(value - previous)));
+        previous = value;
+    }
+    keep(column_encoding::delta);
+
+    // delta_of_delta
+    previous = 0;
+    uint64_t previous_delta { 0 };
+    for (auto const value : values)
+    {
+        auto const delta { value - previous };
+        ::write_varint(candidate, ::zigzag_encode(static_cast<int64_t>(delta - previous_delta)));
+        previous = value;
+        previous_delta = delta;
+    }
+    keep(column_encoding::delta_of_delta);
+
+    // bit_packed; limited to 56 bits so that decoding can use a single unaligned 64-bit load per value
+    auto const pack_bits = [&](::std::span<uint64_t const> const packed) {
+        if (packed.empty())
+        {
+            return true;
+        }
+        auto const [min_it, max_it] { ::std::minmax_element(begin(packed), end(packed)) };
+        auto const bits { static_cast<unsigned>(::std::bit_width(*max_it - *min_it)) };
+        if (bits > 56)
+        {
+            return false;
+        }
+        ::write_varint(candidate, *min_it);
+        candidate.push_back(static_cast<uint8_t>(bits));
+        uint64_t accumulator { 0 };
+        unsigned accumulated_bits { 0 };
+        for (auto const value : packed)
+        {
+            accumulator |= (value - *min_it) << accumulated_bits;
+            accumulated_bits += bits;
+            for (; accumulated_bits >= 8; accumulated_bits -= 8)
+            {
+                candidate.push_back(static_cast<uint8_t>(accumulator));
+                accumulator >>= 8;
+            }
+        }
+        if (accumulated_bits > 0)
+        {
+            candidate.push_back(static_cast<uint8_t>(accumulator));
+        }
+        return true;
+    };
+
+    if (pack_bits(values))
+    {
+        keep(column_encoding::bit_packed);
+    }
+    candidate.clear();
+
+    // delta_bit_packed
+    if (!values.empty())
+    {
+        ::std::vector<uint64_t> deltas(values.size() - 1);
+        for (size_t index { 1 }; index < values.size(); ++index)
+        {
+            deltas[index - 1] = ::zigzag_encode(static_cast<int64_t>(values[index] - values[index - 1]));
+        }
+        ::write_varint(candidate, values.front());
+        if (pack_bits(deltas))
+        {
+            keep(column_encoding::delta_bit_packed);
+        }
+        candidate.clear();
+    }
+
+    buffer.push_back(static_cast<uint8_t>(best_encoding));
+    ::write_varint(buffer, best.size());
+    buffer.insert(end(buffer), begin(best), end(best));
+}
+
+
+//! \brief Decodes a column written by `encode_column`.
+//!
+//! \param[in,out] pos    Pointer to the encoded column. On return this points
+//!                       one past the encoded column.
+//! \param[in]     end    End of the readable buffer.
+//! \param[out]    values Receives the decoded values. The size of this span
+//!                       determines the number of values to decode.
+//! \param[in]     width  The size of each value in bytes (1 through 8).
+//!
+//! \remark Throws if the column exceeds the buffer. Decoding may read up to 8
+//!         bytes past the end of the column; the buffer needs to be padded
+//!         accordingly.
+//!
+inline void decode_column(uint8_t const*& pos, uint8_t const* const end, ::std::span<uint64_t> const values,
+                          size_t const width)
+{
+    THROW_WIN32_IF(ERROR_FILE_CORRUPT, end - pos < 2);
+    auto const encoding { static_cast<column_encoding>(*pos++) };
+    auto const size { ::read_varint(pos) };
+    THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos > end || size > static_cast<uint64_t>(end - pos));
+    auto const column_end { pos + size };
+
+    auto const unpack_bits = [&](::std::span<uint64_t> const unpacked) {
+        if (unpacked.empty())
+        {
+            return;
+        }
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos >= column_end);
+        auto const min { ::read_varint(pos) };
+        auto const bits { static_cast<unsigned>(*pos++) };
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT,
+                       bits > 56 || pos > column_end
+                           || (unpacked.size() * bits + 7) / 8 > static_cast<size_t>(column_end - pos));
+        auto const mask { (uint64_t { 1 } << bits) - 1 };
+        for (size_t index { 0 }; index < unpacked.size(); ++index)
+        {
+            auto const bit_pos { index * bits };
+            uint64_t word {};
+            ::std::memcpy(&word, pos + bit_pos / 8, sizeof(word));
+            unpacked[index] = min + ((word >> (bit_pos % 8)) & mask);
+        }
+        pos += (unpacked.size() * bits + 7) / 8;
+    };
+
+    switch (encoding)
+    {
+    case column_encoding::raw:
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, size != values.size() * width);
+        for (auto& value : values)
+        {
+            value = 0;
+            ::std::memcpy(&value, pos, width);
+            pos += width;
+        }
+        break;
+
+    case column_encoding::run_length:
+        for (size_t index { 0 }; index < values.size();)
+        {
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos >= column_end);
+            auto const value { ::read_varint(pos) };
+            auto const run { ::read_varint(pos) };
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, run == 0 || run > values.size() - index);
+            ::std::fill_n(values.begin() + index, run, value);
+            index += run;
+        }
+        break;
+
+    case column_encoding::delta: {
+        uint64_t previous { 0 };
+        for (auto& value : values)
+        {
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos >= column_end);
+            previous += static_cast<uint64_t>(::zigzag_decode(::read_varint(pos)));
+            value = previous;
+        }
+        break;
+    }
+
+    case column_encoding::delta_of_delta: {
+        uint64_t previous { 0 };
+        uint64_t previous_delta { 0 };
+        for (auto& value : values)
+        {
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos >= column_end);
+            previous_delta += static_cast<uint64_t>(::zigzag_decode(::read_varint(pos)));
+            previous += previous_delta;
+            value = previous;
+        }
+        break;
+    }
+
+    case column_encoding::bit_packed:
+        unpack_bits(values);
+        break;
+
+    case column_encoding::delta_bit_packed:
+        if (!values.empty())
+        {
+            values.front() = ::read_varint(pos);
+            auto const deltas { values.subspan(1) };
+            unpack_bits(deltas);
+            auto previous { values.front() };
+            for (auto& value : deltas)
+            {
+                previous += static_cast<uint64_t>(::zigzag_decode(value));
+                value = previous;
+            }
+        }
+        break;
+
+    default:
+        THROW_WIN32(ERROR_FILE_CORRUPT);
+    }
+
+    THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos > column_end);
+    pos = column_end;
+}
+
+
+// Columnar archive of a sensor log.
+//
+// The archive stores one block per chunk (see `split_into_chunks`), followed by a block index and a footer:
+//
+//   "MSBA" version:u8 | block... | index | index_offset:u64 "MSBA"
+//
+// Inside a block, packets are grouped into streams of equal type and payload size. Each stream's payload is split
+// into fields: described `ui8`/`ui16`/`ui32`/`file_time` elements become a column of their own, any remaining bytes
+// become single-byte columns. A stream ID column restores the original packet order. The field layout is stored
+// alongside each block, so archives remain readable after `packet_descriptions.json` changes.
+//
+// Bytes following the final complete packet (a truncated packet) are stored verbatim with the final block, so that an
+// archive decodes to the original log byte for byte.
+struct columnar_archive
+{
+    struct block_info
+    {
+        // Position and size of the encoded block inside the archive
+        uint64_t offset;
+        uint64_t size;
+        size_t packet_count;
+        // Size of the decoded block
+        uint64_t raw_size;
+        // `nullopt` for an incomplete trailing chunk
+        ::std::optional<uint32_t> sequence_id;
+    };
+
+    explicit columnar_archive(::std::filesystem::path const& path)
+    {
+        ::std::ifstream in { path, ::std::ios::binary | ::std::ios::ate };
+        THROW_WIN32_IF(ERROR_READ_FAULT, !in);
+        auto const file_size { static_cast<size_t>(in.tellg()) };
+        in.seekg(0);
+        // Padding allows decoders to perform unaligned 64-bit loads at the end of the final column
+        data_.resize(file_size + k_padding);
+        in.read(reinterpret_cast<char*>(data_.data()), static_cast<::std::streamsize>(file_size));
+        THROW_WIN32_IF(ERROR_READ_FAULT, static_cast<size_t>(in.gcount()) != file_size);
+
+        // Header and footer
+        THROW_WIN32_IF(ERROR_BAD_FORMAT, file_size < k_magic.size() + 1 + sizeof(uint64_t) + k_magic.size());
+        THROW_WIN32_IF(ERROR_BAD_FORMAT, !::std::equal(begin(k_magic), end(k_magic), data_.data())
+                                             || data_[k_magic.size()] != k_version
+                                             || !::std::equal(begin(k_magic), end(k_magic),
+                                                              data_.data() + file_size - k_magic.size()));
+        uint64_t index_offset {};
+        ::std::memcpy(&index_offset, data_.data() + file_size - k_magic.size() - sizeof(index_offset),
+                      sizeof(index_offset));
+        auto const index_end { data_.data() + file_size - k_magic.size() - sizeof(index_offset) };
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, index_offset > static_cast<uint64_t>(index_end - data_.data()));
+
+        // Block index
+        uint8_t const* pos { data_.data() + index_offset };
+        auto const block_count { ::read_varint(pos) };
+        for (uint64_t b { 0 }; b < block_count; ++b)
+        {
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos >= index_end);
+            block_info info {};
+            info.offset = ::read_varint(pos);
+            info.size = ::read_varint(pos);
+            info.packet_count = static_cast<size_t>(::read_varint(pos));
+            info.raw_size = ::read_varint(pos);
+            if (auto const sequence_id { ::read_varint(pos) }; sequence_id != 0)
+            {
+                info.sequence_id = static_cast<uint32_t>(sequence_id - 1);
+                block_by_sequence_id_.try_emplace(*info.sequence_id, blocks_.size());
+            }
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, info.offset > index_offset || info.size > index_offset - info.offset);
+            raw_size_ += info.raw_size;
+            blocks_.push_back(info);
+        }
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos > index_end);
+    }
+
+    [[nodiscard]] auto const& blocks() const noexcept { return blocks_; }
+    // Returns the size of the original sensor log
+    [[nodiscard]] auto raw_size() const noexcept { return raw_size_; }
+
+    // Returns the index of the block holding the chunk with the given sequence ID
+    [[nodiscard]] ::std::optional<size_t> find_block(uint32_t const sequence_id) const
+    {
+        if (auto const it { block_by_sequence_id_.find(sequence_id) }; it != end(block_by_sequence_id_))
+        {
+            return it->second;
+        }
+        return {};
+    }
+
+    // Decodes a single block, appending the original bytes to `buffer`
+    void decode_block(size_t const index, ::std::vector<unsigned char>& buffer) const
+    {
+        auto const& info { blocks_.at(index) };
+        uint8_t const* pos { data_.data() + info.offset };
+        auto const block_end { pos + info.size };
+        auto const output_begin { buffer.size() };
+
+        auto const packet_count { static_cast<size_t>(::read_varint(pos)) };
+        auto const stream_count { static_cast<size_t>(::read_varint(pos)) };
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, packet_count != info.packet_count || stream_count > packet_count);
+
+        ::std::vector<stream> streams(stream_count);
+        for (auto& s : streams)
+        {
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, block_end - pos < 3);
+            s.type = *pos++;
+            s.payload_size = *pos++;
+            s.fields.resize(static_cast<size_t>(::read_varint(pos)));
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, s.fields.size() > s.payload_size);
+            for (auto& field : s.fields)
+            {
+                THROW_WIN32_IF(ERROR_FILE_CORRUPT, block_end - pos < 2);
+                field.offset = *pos++;
+                field.width = *pos++;
+                THROW_WIN32_IF(ERROR_FILE_CORRUPT, field.width == 0 || field.width > sizeof(uint64_t)
+                                                       || field.offset + field.width > s.payload_size);
+            }
+        }
+
+        // Packet order
+        ::std::vector<uint64_t> stream_ids(packet_count);
+        decode_column(pos, block_end, stream_ids, stream_id_width(stream_count));
+        for (auto const id : stream_ids)
+        {
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, id >= stream_count);
+            ++streams[static_cast<size_t>(id)].packet_count;
+        }
+
+        // Field columns
+        for (auto& s : streams)
+        {
+            s.values.resize(s.fields.size() * s.packet_count);
+            for (size_t f { 0 }; f < s.fields.size(); ++f)
+            {
+                decode_column(pos, block_end,
+                              ::std::span { s.values }.subspan(f * s.packet_count, s.packet_count),
+                              s.fields[f].width);
+            }
+        }
+
+        // Trailing bytes
+        auto const tail_size { static_cast<size_t>(::read_varint(pos)) };
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, pos > block_end || tail_size != static_cast<size_t>(block_end - pos));
+
+        // Reassemble packets
+        buffer.resize(output_begin + static_cast<size_t>(info.raw_size));
+        auto out { buffer.data() + output_begin };
+        auto const out_end { buffer.data() + buffer.size() };
+        for (auto const id : stream_ids)
+        {
+            auto& s { streams[static_cast<size_t>(id)] };
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, out_end - out < static_cast<ptrdiff_t>(s.payload_size) + 2);
+            *out++ = s.type;
+            *out++ = s.payload_size;
+            for (size_t f { 0 }; f < s.fields.size(); ++f)
+            {
+                auto const value { s.values[f * s.packet_count + s.cursor] };
+                // Sensor logs and archives are little endian
+                ::std::memcpy(out + s.fields[f].offset, &value, s.fields[f].width);
+            }
+            out += s.payload_size;
+            ++s.cursor;
+        }
+        THROW_WIN32_IF(ERROR_FILE_CORRUPT, out_end - out != static_cast<ptrdiff_t>(tail_size));
+        ::std::memcpy(out, pos, tail_size);
+    }
+
+    [[nodiscard]] ::std::vector<unsigned char> decode_block(size_t const index) const
+    {
+        ::std::vector<unsigned char> buffer {};
+        decode_block(index, buffer);
+        return buffer;
+    }
+
+    // Decodes the entire archive into the original sensor log
+    [[nodiscard]] ::std::vector<unsigned char> decode() const
+    {
+        ::std::vector<unsigned char> buffer {};
+        buffer.reserve(static_cast<size_t>(raw_size_));
+        for (size_t index { 0 }; index < blocks_.size(); ++index)
+        {
+            decode_block(index, buffer);
+        }
+        return buffer;
+    }
+
+    // Decodes the entire archive into a model, without going through a temporary file
+    [[nodiscard]] ::model to_model() const { return ::model { decode() }; }
+
+private:
+    friend uint64_t write_columnar_archive(::std::span<unsigned char const>, ::std::span<data_proxy const>,
+                                           ::payload_container const&, ::std::filesystem::path const&);
+
+    static constexpr ::std::array<uint8_t, 4> k_magic { 'M', 'S', 'B', 'A' };
+    static constexpr uint8_t k_version { 1 };
+    static constexpr size_t k_padding { 16 };
+
+    struct field
+    {
+        uint8_t offset;
+        uint8_t width;
+    };
+
+    struct stream
+    {
+        uint8_t type;
+        uint8_t payload_size;
+        ::std::vector<field> fields;
+        size_t packet_count;
+        // Field values, one column of `packet_count` values per field
+        ::std::vector<uint64_t> values;
+        size_t cursor;
+    };
+
+    [[nodiscard]] static constexpr size_t stream_id_width(size_t const stream_count) noexcept
+    {
+        return stream_count <= 0x100 ? 1 : 2;
+    }
+
+    // Splits a payload into fields. Described elements of width 1, 2, 4, or 8 become fields of their own (overlapping
+    // elements are skipped), all other bytes become single-byte fields.
+    [[nodiscard]] static ::std::vector<field> field_layout(size_t const payload_size,
+                                                           ::payload_elements_container const* elements)
+    {
+        ::std::vector<::payload_element const*> candidates {};
+        if (elements)
+        {
+            for (auto const& el : *elements)
+            {
+                if (el.type != payload_type::unknown && ::std::has_single_bit(el.size) && el.size <= sizeof(uint64_t)
+                    && el.offset + el.size <= payload_size)
+                {
+                    candidates.push_back(&el);
+                }
+            }
+            ::std::stable_sort(begin(candidates), end(candidates),
+                               [](auto const* lhs, auto const* rhs) { return lhs->offset < rhs->offset; });
+        }
+
+        ::std::vector<field> fields {};
+        size_t offset { 0 };
+        auto const fill_to = [&](size_t const to) {
+            for (; offset < to; ++offset)
+            {
+                fields.push_back({ static_cast<uint8_t>(offset), 1 });
+            }
+        };
+        for (auto const* el : candidates)
+        {
+            if (el->offset < offset)
+            {
+                continue;
+            }
+            fill_to(el->offset);
+            fields.push_back({ static_cast<uint8_t>(el->offset), static_cast<uint8_t>(el->size) });
+            offset = el->offset + el->size;
+        }
+        fill_to(payload_size);
+        return fields;
+    }
+
+    [[nodiscard]] static uint64_t load_field(data_proxy const& packet, field const& f) noexcept
+    {
+        uint64_t value { 0 };
+        ::std::memcpy(&value, packet.data() + data_proxy::header_size() + f.offset, f.width);
+        return value;
+    }
+
+    ::std::vector<uint8_t> data_;
+    ::std::vector<block_info> blocks_;
+    ::std::map<uint32_t, size_t> block_by_sequence_id_;
+    uint64_t raw_size_ { 0 };
+};
+
+
+//! \brief Writes a sensor log as a columnar archive.
+//!
+//! \param[in] bytes        The entire sensor log.
+//! \param[in] directory    All packets of the sensor log in natural order.
+//! \param[in] descriptions The packet descriptions. These determine how
+//!                         payloads are split into columns only; packet types
+//!                         without a description are stored byte by byte.
+//! \param[in] target       Path of the archive to create.
+//!
+//! \return The size of the archive in bytes.
+//!
+//! \remark The archive is written to a temporary file first and renamed into
+//!         place, so readers never observe a partially written archive.
+//!
+inline uint64_t write_columnar_archive(::std::span<unsigned char const> const bytes,
+                                       ::std::span<data_proxy const> const directory,
+                                       ::payload_container const& descriptions,
+                                       ::std::filesystem::path const& target)
+{
+    trace_span const span { "write_columnar_archive" };
+    using field = columnar_archive::field;
+
+    ::std::vector<uint8_t> archive { begin(columnar_archive::k_magic), end(columnar_archive::k_magic) };
+    archive.push_back(columnar_archive::k_version);
+    ::std::vector<columnar_archive::block_info> blocks {};
+
+    // Field layouts only depend on type and payload size
+    ::std::map<::std::pair<uint8_t, uint8_t>, ::std::vector<field>> layouts {};
+    auto const layout_of = [&](uint8_t const type, uint8_t const payload_size) -> auto const& {
+        auto [it, inserted] { layouts.try_emplace({ type, payload_size }) };
+        if (inserted)
+        {
+            auto const description { descriptions.find(type) };
+            it->second = columnar_archive::field_layout(
+                payload_size, description != end(descriptions) ? &description->second.elements : nullptr);
+        }
+        return it->second;
+    };
+
+    auto chunks { ::split_into_chunks(directory) };
+    auto const packets_end { directory.empty() ? size_t { 0 }
+                                               : static_cast<size_t>(directory.back().data() - bytes.data())
+                                                     + directory.back().size() };
+    if (chunks.empty() && packets_end < bytes.size())
+    {
+        // Trailing bytes only
+        chunks.push_back({ 0, 0, ::std::nullopt });
+    }
+
+    ::std::vector<uint64_t> stream_ids {};
+    ::std::vector<uint64_t> values {};
+    for (size_t c { 0 }; c < chunks.size(); ++c)
+    {
+        auto const& chunk { chunks[c] };
+        auto const packets { directory.subspan(chunk.begin, chunk.packet_count()) };
+        auto const is_last { c + 1 == chunks.size() };
+
+        // Assign streams in order of first appearance
+        ::std::map<::std::pair<uint8_t, uint8_t>, size_t> stream_index {};
+        ::std::vector<::std::pair<uint8_t, uint8_t>> streams {};
+        ::std::vector<::std::vector<data_proxy const*>> stream_packets {};
+        stream_ids.clear();
+        for (auto const& packet : packets)
+        {
+            ::std::pair const key { static_cast<uint8_t>(packet.type()), static_cast<uint8_t>(packet.payload_size()) };
+            auto const [it, inserted] { stream_index.try_emplace(key, streams.size()) };
+            if (inserted)
+            {
+                streams.push_back(key);
+                stream_packets.emplace_back();
+            }
+            stream_ids.push_back(it->second);
+            stream_packets[it->second].push_back(&packet);
+        }
+
+        ::std::vector<uint8_t> block {};
+        ::write_varint(block, packets.size());
+        ::write_varint(block, streams.size());
+        for (auto const& [type, payload_size] : streams)
+        {
+            auto const& fields { layout_of(type, payload_size) };
+            block.push_back(type);
+            block.push_back(payload_size);
+            ::write_varint(block, fields.size());
+            for (auto const& f : fields)
+            {
+                block.push_back(f.offset);
+                block.push_back(f.width);
+            }
+        }
+
+        ::encode_column(block, stream_ids, columnar_archive::stream_id_width(streams.size()));
+
+        for (size_t s { 0 }; s < streams.size(); ++s)
+        {
+            for (auto const& f : layout_of(streams[s].first, streams[s].second))
+            {
+                values.clear();
+                for (auto const* packet : stream_packets[s])
+                {
+                    values.push_back(columnar_archive::load_field(*packet, f));
+                }
+                ::encode_column(block, values, f.width);
+            }
+        }
+
+        auto const chunk_begin { packets.empty() ? packets_end
+                                                 : static_cast<size_t>(packets.front().data() - bytes.data()) };
+        auto const chunk_end { packets.empty() ? packets_end
+                                               : static_cast<size_t>(packets.back().data() - bytes.data())
+                                                     + packets.back().size() };
+        auto const tail { is_last ? bytes.subspan(packets_end) : ::std::span<unsigned char const> {} };
+        ::write_varint(block, tail.size());
+        block.insert(end(block), begin(tail), end(tail));
+
+        blocks.push_back({ archive.size(), block.size(), packets.size(), chunk_end - chunk_begin + tail.size(),
+                           chunk.sequence_id });
+        archive.insert(end(archive), begin(block), end(block));
+    }
+
+    // Block index and footer
+    uint64_t const index_offset { archive.size() };
+    ::write_varint(archive, blocks.size());
+    for (auto const& info : blocks)
+    {
+        ::write_varint(archive, info.offset);
+        ::write_varint(archive, info.size);
+        ::write_varint(archive, info.packet_count);
+        ::write_varint(archive, info.raw_size);
+        ::write_varint(archive, info.sequence_id ? uint64_t { *info.sequence_id } + 1 : 0);
+    }
+    for (size_t b { 0 }; b < sizeof(index_offset); ++b)
+    {
+        archive.push_back(static_cast<uint8_t>(index_offset >> (b * 8)));
+    }
+    archive.insert(end(archive), begin(columnar_archive::k_magic), end(columnar_archive::k_magic));
+
+    // The temporary name is unique per writer, so concurrent writers targeting the same archive don't interfere; the
+    // last rename wins
+    auto tmp_path { target };
+    tmp_path += ::std::format(L".{}.{}.tmp", ::GetCurrentProcessId(), ::GetCurrentThreadId());
+    try
+    {
+        {
+            ::std::ofstream out { tmp_path, ::std::ios::binary | ::std::ios::trunc };
+            out.write(reinterpret_cast<char const*>(archive.data()), static_cast<::std::streamsize>(archive.size()));
+            THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+        }
+        ::std::filesystem::rename(tmp_path, target);
+    }
+    catch (...)
+    {
+        ::std::error_code ec {};
+        ::std::filesystem::remove(tmp_path, ec);
+        throw;
+    }
+
+    return archive.size();
+}
+
+
+//! \brief Writes the sensor log of a model as a columnar archive.
+//!
+inline uint64_t write_columnar_archive(::model const& model, ::std::filesystem::path const& target)
+{
+    return ::write_columnar_archive(model.bytes(), model.directory(), model.packet_descriptions(), target);
+}
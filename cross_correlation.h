@@ -0,0 +1,564 @@
+#pragma once
+
+#include "date_time_utils.h"
+#include "model.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// Identifies a numeric field: a payload element of a described packet type
+struct field_ref
+{
+    unsigned char type;
+    // Index into `packet_description::elements`
+    size_t element;
+
+    [[nodiscard]] friend constexpr bool operator==(field_ref const&, field_ref const&) noexcept = default;
+};
+
+
+struct correlation_options
+{
+    // Width of a bin on the common time base
+    uint64_t resolution { 60 * k_filetime_ticks_per_second };
+    // Lags are evaluated in the range [-max_lag, max_lag] (in bins)
+    size_t max_lag { 60 };
+    // Correlations with fewer overlapping bins are reported as NaN
+    size_t min_overlap { 16 };
+    // Number of worker threads for `correlation_matrix`; 0 selects the number of hardware threads
+    size_t thread_count { 0 };
+    // Share of packet times ignored at either end when deriving the time base, so that a few implausible anchors
+    // don't stretch it
+    double range_trim { 0.001 };
+    // Upper bound for the number of bins of the time base (samples past it are ignored)
+    size_t max_bins { size_t { 1 } << 21 };
+};
+
+
+struct lag_correlation
+{
+    // Offset (in bins) of the second series relative to the first; a positive lag means the second series follows
+    int64_t lag;
+    double pearson;
+    double spearman;
+    size_t overlap;
+};
+
+
+struct correlation_result
+{
+    field_ref lhs;
+    field_ref rhs;
+    // One entry per lag, ordered from -max_lag to max_lag
+    ::std::vector<lag_correlation> lags;
+    // Entry with the largest absolute Pearson coefficient
+    lag_correlation best;
+};
+
+
+// A field resampled onto a regular time grid
+struct resampled_series
+{
+    uint64_t start;
+    uint64_t resolution;
+    // Mean value per bin. Bins without samples hold the preceding value (the first bins hold the first value).
+    ::std::vector<double> values;
+    // Bin range [first_sample, last_sample] that actually received samples
+    size_t first_sample;
+    size_t last_sample;
+};
+
+
+//! \brief Resamples a numeric field onto a regular time grid.
+//!
+//! \param[in] m            The model holding the sensor log.
+//! \param[in] times        The time column of the model.
+//! \param[in] descriptions The packet descriptions `times` was built from.
+//! \param[in] field        The field to extract.
+//! \param[in] start        Start of the time grid (raw FILETIME value).
+//! \param[in] bin_count    Number of bins.
+//! \param[in] resolution   Width of a bin in FILETIME ticks.
+//!
+//! \return The resampled series, or `nullopt` if the field isn't numeric or
+//!         doesn't have any samples inside the time grid.
+//!
+//! \remark `times` and `descriptions` needn't be the model's own, e.g. when
+//!         working on snapshots while the model's descriptions change.
+//!
+[[nodiscard]] inline ::std::optional<resampled_series> resample_field(model const& m, ::time_column const& times,
+                                                                      ::payload_container const& descriptions,
+                                                                      field_ref const field, uint64_t const start,
+                                                                      size_t const bin_count,
+                                                                      uint64_t const resolution)
+{
+    auto const description_it { descriptions.find(field.type) };
+    if (bin_count == 0 || description_it == end(descriptions)
+        || field.element >= description_it->second.elements.size())
+    {
+        return {};
+    }
+    auto const& element { description_it->second.elements[field.element] };
+
+    ::std::vector<double> sums(bin_count, 0.0);
+    ::std::vector<uint32_t> counts(bin_count, 0);
+    auto const& directory { m.directory() };
+    for (size_t index { 0 }; index < directory.size(); ++index)
+    {
+        auto const& packet { directory[index] };
+        if (packet.type() != field.type)
+        {
+            continue;
+        }
+        auto const value { ::element_value(packet, element) };
+        auto const time { times[index] };
+        if (!value || time < start)
+        {
+            continue;
+        }
+        auto const bin { (time - start) / resolution };
+        if (bin < bin_count)
+        {
+            sums[bin] += *value;
+            ++counts[bin];
+        }
+    }
+
+    auto const first_it { ::std::find_if(begin(counts), end(counts), [](auto const c) { return c > 0; }) };
+    if (first_it == end(counts))
+    {
+        return {};
+    }
+
+    resampled_series result { start, resolution, ::std::move(sums), 0, 0 };
+    result.first_sample = static_cast<size_t>(::std::distance(begin(counts), first_it));
+    auto held { result.values[result.first_sample] / counts[result.first_sample] };
+    for (size_t bin { 0 }; bin < bin_count; ++bin)
+    {
+        if (counts[bin] > 0)
+        {
+            held = result.values[bin] / counts[bin];
+            result.last_sample = bin;
+        }
+        result.values[bin] = held;
+    }
+    return result;
+}
+
+
+//! \brief Resamples a numeric field onto a regular time grid, using the
+//!        model's time column and packet descriptions.
+//!
+//! \return The resampled series, or `nullopt` if the model doesn't have a
+//!         time column, or the field isn't numeric or doesn't have any
+//!         samples inside the time grid.
+//!
+[[nodiscard]] inline ::std::optional<resampled_series> resample_field(model const& m, field_ref const field,
+                                                                      uint64_t const start, size_t const bin_count,
+                                                                      uint64_t const resolution)
+{
+    if (!m.time_column())
+    {
+        return {};
+    }
+    return ::resample_field(m, *m.time_column(), m.packet_descriptions(), field, start, bin_count, resolution);
+}
+
+
+// In-place iterative radix-2 FFT. The size of `data` must be a power of 2.
+inline void fft(::std::vector<::std::complex<double>>& data, bool const inverse)
+{
+    auto const n { data.size() };
+    for (size_t i { 1 }, j { 0 }; i < n; ++i)
+    {
+        auto bit { n >> 1 };
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            ::std::swap(data[i], data[j]);
+        }
+    }
+
+    for (size_t len { 2 }; len <= n; len <<= 1)
+    {
+        auto const angle { 2 * ::std::numbers::pi / static_cast<double>(len) * (inverse ? 1 : -1) };
+        ::std::complex<double> const step { ::std::cos(angle), ::std::sin(angle) };
+        for (size_t i { 0 }; i < n; i += len)
+        {
+            ::std::complex<double> w { 1.0, 0.0 };
+            for (size_t k { 0 }; k < len / 2; ++k)
+            {
+                auto const u { data[i + k] };
+                auto const v { data[i + k + len / 2] * w };
+                data[i + k] = u + v;
+                data[i + k + len / 2] = u - v;
+                w *= step;
+            }
+        }
+    }
+
+    if (inverse)
+    {
+        for (auto& value : data)
+        {
+            value /= static_cast<double>(n);
+        }
+    }
+}
+
+
+// Replaces values by their (average) ranks
+[[nodiscard]] inline ::std::vector<double> to_ranks(::std::span<double const> const values)
+{
+    ::std::vector<size_t> order(values.size());
+    ::std::iota(begin(order), end(order), 0);
+    ::std::stable_sort(begin(order), end(order),
+                       [&](auto const lhs, auto const rhs) { return values[lhs] < values[rhs]; });
+
+    ::std::vector<double> ranks(values.size());
+    for (size_t i { 0 }; i < order.size();)
+    {
+        auto j { i };
+        while (j + 1 < order.size() && values[order[j + 1]] == values[order[i]])
+        {
+            ++j;
+        }
+        auto const rank { (static_cast<double>(i) + static_cast<double>(j)) / 2 };
+        for (auto k { i }; k <= j; ++k)
+        {
+            ranks[order[k]] = rank;
+        }
+        i = j + 1;
+    }
+    return ranks;
+}
+
+
+//! \brief Computes the Pearson correlation of two equally sized series for
+//!        every lag in the range [-max_lag, max_lag].
+//!
+//! \return The coefficients (NaN where undefined) and overlap per lag, ordered
+//!         from -max_lag to max_lag.
+//!
+//! \remark The sums of products are computed directly for small problems, and
+//!         through FFT-based cross-correlation otherwise. Per-lag means and
+//!         variances are derived from prefix sums over the overlapping range,
+//!         so the result is exact either way (up to rounding).
+//!
+[[nodiscard]] inline ::std::vector<::std::pair<double, size_t>> lagged_pearson(::std::span<double const> const x,
+                                                                               ::std::span<double const> const y,
+                                                                               size_t const max_lag,
+                                                                               size_t const min_overlap)
+{
+    assert(x.size() == y.size());
+    auto const n { x.size() };
+    auto const lag_count { 2 * max_lag + 1 };
+
+    // Center both series to improve numerical stability
+    auto const center = [](::std::span<double const> const s) {
+        auto const mean { ::std::accumulate(begin(s), end(s), 0.0)
+                          / static_cast<double>(::std::max<size_t>(s.size(), 1)) };
+        ::std::vector<double> result(s.size());
+        ::std::transform(begin(s), end(s), begin(result), [mean](auto const v) { return v - mean; });
+        return result;
+    };
+    auto const cx { center(x) };
+    auto const cy { center(y) };
+
+    // Sums of products per lag
+    ::std::vector<double> sxy(lag_count, 0.0);
+    if (n * lag_count <= (1u << 20))
+    {
+        for (size_t l { 0 }; l < lag_count; ++l)
+        {
+            auto const lag { static_cast<int64_t>(l) - static_cast<int64_t>(max_lag) };
+            for (int64_t i { ::std::max<int64_t>(0, -lag) }; i < ::std::min<int64_t>(n, n - lag); ++i)
+            {
+                sxy[l] += cx[i] * cy[i + lag];
+            }
+        }
+    }
+    else
+    {
+        size_t fft_size { 1 };
+        while (fft_size < 2 * n)
+        {
+            fft_size <<= 1;
+        }
+        ::std::vector<::std::complex<double>> fx(fft_size), fy(fft_size);
+        ::std::copy(begin(cx), end(cx), begin(fx));
+        ::std::copy(begin(cy), end(cy), begin(fy));
+        ::fft(fx, false);
+        ::fft(fy, false);
+        for (size_t i { 0 }; i < fft_size; ++i)
+        {
+            fx[i] = ::std::conj(fx[i]) * fy[i];
+        }
+        ::fft(fx, true);
+        for (size_t l { 0 }; l < lag_count; ++l)
+        {
+            auto const lag { static_cast<int64_t>(l) - static_cast<int64_t>(max_lag) };
+            if (::std::abs(lag) < static_cast<int64_t>(n))
+            {
+                sxy[l] = fx[static_cast<size_t>(lag >= 0 ? lag : static_cast<int64_t>(fft_size) + lag)].real();
+            }
+        }
+    }
+
+    // Prefix sums for per-lag moments
+    auto const prefix = [n](::std::vector<double> const& s, bool const squared) {
+        ::std::vector<double> result(n + 1, 0.0);
+        for (size_t i { 0 }; i < n; ++i)
+        {
+            result[i + 1] = result[i] + (squared ? s[i] * s[i] : s[i]);
+        }
+        return result;
+    };
+    auto const px { prefix(cx, false) };
+    auto const pxx { prefix(cx, true) };
+    auto const py { prefix(cy, false) };
+    auto const pyy { prefix(cy, true) };
+
+    ::std::vector<::std::pair<double, size_t>> result(lag_count, { ::std::numeric_limits<double>::quiet_NaN(), 0 });
+    for (size_t l { 0 }; l < lag_count; ++l)
+    {
+        auto const lag { static_cast<int64_t>(l) - static_cast<int64_t>(max_lag) };
+        if (::std::abs(lag) >= static_cast<int64_t>(n))
+        {
+            continue;
+        }
+        auto const x_begin { static_cast<size_t>(::std::max<int64_t>(0, -lag)) };
+        auto const x_end { static_cast<size_t>(::std::min<int64_t>(n, n - lag)) };
+        auto const y_begin { x_begin + lag };
+        auto const y_end { x_end + lag };
+        auto const m { static_cast<double>(x_end - x_begin) };
+        result[l].second = x_end - x_begin;
+        if (result[l].second < min_overlap)
+        {
+            continue;
+        }
+
+        auto const sx { px[x_end] - px[x_begin] };
+        auto const sxx { pxx[x_end] - pxx[x_begin] };
+        auto const sy { py[y_end] - py[y_begin] };
+        auto const syy { pyy[y_end] - pyy[y_begin] };
+        auto const denominator { (m * sxx - sx * sx) * (m * syy - sy * sy) };
+        if (denominator > 0.0)
+        {
+            result[l].first = (m * sxy[l] - sx * sy) / ::std::sqrt(denominator);
+        }
+    }
+    return result;
+}
+
+
+// Correlates two series resampled onto the same time grid
+[[nodiscard]] inline correlation_result correlate_series(field_ref const lhs, resampled_series const& x,
+                                                         field_ref const rhs, resampled_series const& y,
+                                                         correlation_options const& options)
+{
+    assert(x.start == y.start && x.resolution == y.resolution && x.values.size() == y.values.size());
+
+    correlation_result result { lhs, rhs, {}, { 0, ::std::numeric_limits<double>::quiet_NaN(),
+                                                ::std::numeric_limits<double>::quiet_NaN(), 0 } };
+
+    // Restrict to the range where both series actually have samples
+    auto const first { ::std::max(x.first_sample, y.first_sample) };
+    auto const last { ::std::min(x.last_sample, y.last_sample) };
+    if (first > last)
+    {
+        return result;
+    }
+    auto const xs { ::std::span { x.values }.subspan(first, last - first + 1) };
+    auto const ys { ::std::span { y.values }.subspan(first, last - first + 1) };
+
+    auto const pearson { ::lagged_pearson(xs, ys, options.max_lag, options.min_overlap) };
+    // Spearman is the Pearson correlation of ranks; ranks are computed once over the common range rather than per lag
+    auto const spearman { ::lagged_pearson(::to_ranks(xs), ::to_ranks(ys), options.max_lag, options.min_overlap) };
+
+    result.lags.reserve(pearson.size());
+    for (size_t l { 0 }; l < pearson.size(); ++l)
+    {
+        lag_correlation const entry { static_cast<int64_t>(l) - static_cast<int64_t>(options.max_lag), pearson[l].first,
+                                      spearman[l].first, pearson[l].second };
+        result.lags.push_back(entry);
+        if (!::std::isnan(entry.pearson)
+            && (::std::isnan(result.best.pearson) || ::std::abs(entry.pearson) > ::std::abs(result.best.pearson)))
+        {
+            result.best = entry;
+        }
+    }
+    return result;
+}
+
+
+// Returns the time range [first, last] covered by a time column, ignoring the earliest and latest `trim` share of
+// packet times. The bounds are estimated from an evenly spaced sample of at most `k_max_samples` packets.
+[[nodiscard]] inline ::std::optional<::std::pair<uint64_t, uint64_t>> time_range(::time_column const& times,
+                                                                                double const trim)
+{
+    constexpr size_t k_max_samples { size_t { 1 } << 20 };
+
+    if (times.empty())
+    {
+        return {};
+    }
+    auto const stride { (times.size() + k_max_samples - 1) / k_max_samples };
+    ::std::vector<uint64_t> samples {};
+    samples.reserve(times.size() / stride + 1);
+    ::std::vector<uint64_t> block(time_column::k_checkpoint_interval);
+    for (size_t index { 0 }; index < times.size(); index += block.size())
+    {
+        auto const count { ::std::min(block.size(), times.size() - index) };
+        times.decode(index, ::std::span { block }.first(count));
+        for (auto i { (stride - index % stride) % stride }; i < count; i += stride)
+        {
+            samples.push_back(block[i]);
+        }
+    }
+
+    auto const clamped_trim { ::std::clamp(trim, 0.0, 0.5) };
+    auto const skip { static_cast<size_t>(clamped_trim * static_cast<double>(samples.size() - 1)) };
+    auto const low { begin(samples) + static_cast<ptrdiff_t>(skip) };
+    auto const high { end(samples) - 1 - static_cast<ptrdiff_t>(skip) };
+    ::std::nth_element(begin(samples), low, end(samples));
+    if (high > low)
+    {
+        ::std::nth_element(::std::next(low), high, end(samples));
+    }
+    return ::std::pair { *low, *high };
+}
+
+
+// Returns the number of bins of the time base for a time range
+[[nodiscard]] inline size_t time_base_bins(::std::pair<uint64_t, uint64_t> const& range,
+                                           correlation_options const& options) noexcept
+{
+    auto const bins { (range.second - range.first) / ::std::max(options.resolution, uint64_t { 1 }) + 1 };
+    return static_cast<size_t>(::std::min<uint64_t>(bins, ::std::max(options.max_bins, size_t { 1 })));
+}
+
+
+//! \brief Computes the lagged correlation between two numeric fields, using
+//!        a time column and packet descriptions other than the model's (see
+//!        `resample_field()`).
+//!
+//! \return The correlation result, or `nullopt` if either field isn't numeric,
+//!         or `times` is empty.
+//!
+[[nodiscard]] inline ::std::optional<correlation_result> correlate(model const& m, ::time_column const& times,
+                                                                   ::payload_container const& descriptions,
+                                                                   field_ref const lhs, field_ref const rhs,
+                                                                   correlation_options const& options = {})
+{
+    auto const range { ::time_range(times, options.range_trim) };
+    if (!range)
+    {
+        return {};
+    }
+    auto const bins { ::time_base_bins(*range, options) };
+    auto const x { ::resample_field(m, times, descriptions, lhs, range->first, bins, options.resolution) };
+    auto const y { ::resample_field(m, times, descriptions, rhs, range->first, bins, options.resolution) };
+    if (!x || !y)
+    {
+        return {};
+    }
+    return ::correlate_series(lhs, *x, rhs, *y, options);
+}
+
+
+//! \brief Computes the lagged correlation between two numeric fields.
+//!
+//! \return The correlation result, or `nullopt` if either field isn't numeric,
+//!         or the log doesn't have time information.
+//!
+[[nodiscard]] inline ::std::optional<correlation_result> correlate(model const& m, field_ref const lhs,
+                                                                   field_ref const rhs,
+                                                                   correlation_options const& options = {})
+{
+    if (!m.time_column())
+    {
+        return {};
+    }
+    return ::correlate(m, *m.time_column(), m.packet_descriptions(), lhs, rhs, options);
+}
+
+
+//! \brief Computes the lagged correlation between all pairs of numeric fields
+//!        described in the packet descriptions.
+//!
+//! \return One result per unordered pair of fields. The work is distributed
+//!         across `options.thread_count` worker threads.
+//!
+[[nodiscard]] inline ::std::vector<correlation_result> correlation_matrix(model const& m,
+                                                                          correlation_options const& options = {})
+{
+    if (!m.time_column())
+    {
+        return {};
+    }
+    auto const range { ::time_range(*m.time_column(), options.range_trim) };
+    if (!range)
+    {
+        return {};
+    }
+    auto const bins { ::time_base_bins(*range, options) };
+
+    // Resample all numeric fields onto the common time base
+    ::std::vector<::std::pair<field_ref, resampled_series>> series {};
+    for (auto const& [type, description] : m.packet_descriptions())
+    {
+        for (size_t element { 0 }; element < description.elements.size(); ++element)
+        {
+            field_ref const field { type, element };
+            if (auto resampled { ::resample_field(m, field, range->first, bins, options.resolution) }; resampled)
+            {
+                series.emplace_back(field, ::std::move(*resampled));
+            }
+        }
+    }
+
+    ::std::vector<::std::pair<size_t, size_t>> pairs {};
+    for (size_t i { 0 }; i < series.size(); ++i)
+    {
+        for (auto j { i + 1 }; j < series.size(); ++j)
+        {
+            pairs.emplace_back(i, j);
+        }
+    }
+
+    ::std::vector<correlation_result> results(pairs.size());
+    ::std::atomic<size_t> next { 0 };
+    auto const thread_count { options.thread_count != 0 ? options.thread_count
+                                                        : ::std::max(1u, ::std::thread::hardware_concurrency()) };
+    {
+        ::std::vector<::std::jthread> workers {};
+        for (size_t t { 0 }; t < ::std::min(thread_count, pairs.size()); ++t)
+        {
+            workers.emplace_back([&] {
+                for (auto index { next++ }; index < pairs.size(); index = next++)
+                {
+                    auto const& [lhs, x] { series[pairs[index].first] };
+                    auto const& [rhs, y] { series[pairs[index].second] };
+                    results[index] = ::correlate_series(lhs, x, rhs, y, options);
+                }
+            });
+        }
+    }
+    return results;
+}
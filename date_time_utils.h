@@ -8,6 +8,11 @@
 #include <cstdint>
 
 
+// FILETIME values count 100-nanosecond intervals
+constexpr uint64_t k_filetime_ticks_per_second { 10'000'000 };
+constexpr uint64_t k_filetime_ticks_per_day { 86'400 * k_filetime_ticks_per_second };
+
+
 [[nodiscard]] consteval inline auto invalid_filetime() noexcept
 {
     return ::FILETIME { .dwLowDateTime = 0xFFFFFFFF, .dwHighDateTime = 0xFFFFFFFF };
@@ -55,3 +60,21 @@
     THROW_IF_WIN32_BOOL_FALSE(::FileTimeToSystemTime(&ft, &st));
     return st;
 }
+
+
+//! \brief Verifies whether a raw timestamp value represents an actual point in
+//!        time.
+//!
+//! \param[in] timestamp The raw `FILETIME` value as stored in a sensor log.
+//!
+//! \return Returns `true` if the value falls between the years 1900 and 2200,
+//!         `false` otherwise. This rejects the `0xFFFFFFFF'FFFFFFFF` markers
+//!         found in some [TIMESTAMP] packets.
+//!
+[[nodiscard]] constexpr inline bool is_plausible_timestamp(uint64_t const timestamp) noexcept
+{
+    // 1900-01-01T00:00:00Z and 2200-01-01T00:00:00Z respectively
+    constexpr uint64_t datetime_min { 94'354'848'000'000'000 };
+    constexpr uint64_t datetime_max { 189'025'920'000'000'000 };
+    return timestamp >= datetime_min && timestamp <= datetime_max;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "packet_descriptions.h"
+
+#include <wil/resource.h>
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+
+// Watches `packet_descriptions.json` and reloads it in the background whenever it changes.
+//
+// The callback runs on the watcher thread and receives the newly loaded descriptions. GUI clients typically stash the
+// descriptions and post a message to the UI thread, which then calls `model::update_packet_descriptions()`. Edits that
+// leave the file in an invalid state (e.g. while an editor is still saving) are ignored; the next valid save is picked
+// up as usual.
+struct description_watcher
+{
+    using callback_type = ::std::function<void(::payload_container)>;
+
+    description_watcher(::std::filesystem::path json_path, callback_type callback)
+        : json_path_ { ::std::move(json_path) }, callback_ { ::std::move(callback) }
+    {
+        stop_event_.reset(::CreateEventW(nullptr, TRUE, FALSE, nullptr));
+        THROW_LAST_ERROR_IF_NULL(stop_event_.get());
+        change_.reset(::FindFirstChangeNotificationW(json_path_.parent_path().c_str(), FALSE,
+                                                     FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME));
+        THROW_LAST_ERROR_IF(!change_);
+
+        last_write_time_ = last_write_time();
+        worker_ = ::std::jthread { [this] { run(); } };
+    }
+
+    ~description_watcher()
+    {
+        ::SetEvent(stop_event_.get());
+        // `worker_` joins on destruction
+    }
+
+    description_watcher(description_watcher const&) = delete;
+    description_watcher& operator=(description_watcher const&) = delete;
+
+private:
+    // Editors frequently save in several steps; wait for the file to settle before reloading
+    static constexpr DWORD k_settle_time_ms { 100 };
+
+    [[nodiscard]] ::std::filesystem::file_time_type last_write_time() const noexcept
+    {
+        ::std::error_code ec {};
+        auto const time { ::std::filesystem::last_write_time(json_path_, ec) };
+        return ec ? ::std::filesystem::file_time_type {} : time;
+    }
+
+    void run() noexcept
+    {
+        ::std::array const handles { stop_event_.get(), change_.get() };
+        for (;;)
+        {
+            auto const result { ::WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE,
+                                                         INFINITE) };
+            if (result != WAIT_OBJECT_0 + 1)
+            {
+                // Stop requested (or waiting failed)
+                return;
+            }
+            if (!::FindNextChangeNotification(change_.get()))
+            {
+                return;
+            }
+            // Any change in the directory signals the notification; debounce and filter on the file of interest
+            if (::WaitForSingleObject(stop_event_.get(), k_settle_time_ms) == WAIT_OBJECT_0)
+            {
+                return;
+            }
+            auto const time { last_write_time() };
+            if (time == last_write_time_)
+            {
+                continue;
+            }
+
+            try
+            {
+                auto descriptions { ::load_packet_descriptions_cached(json_path_) };
+                last_write_time_ = time;
+                callback_(::std::move(descriptions));
+            }
+            CATCH_LOG();
+        }
+    }
+
+    ::std::filesystem::path json_path_;
+    callback_type callback_;
+    ::wil::unique_event stop_event_;
+    ::wil::unique_hfind_change change_;
+    ::std::filesystem::file_time_type last_write_time_;
+    // Declared last so that it stops before any of the resources it uses are destroyed
+    ::std::jthread worker_;
+};
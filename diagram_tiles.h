@@ -0,0 +1,765 @@
+#pragma once
+
+#include "anomaly_detection.h"
+#include "graph_definitions.h"
+#include "hash_utils.h"
+#include "model.h"
+#include "packet_descriptions.h"
+#include "payload_decoders.h"
+#include "tracing.h"
+
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// A graph in the diagram area: a numeric payload element of a packet type
+struct diagram_series
+{
+    unsigned char packet_type;
+    ::payload_element element;
+    // Line color (0x00BBGGRR, as a `COLORREF`)
+    uint32_t color;
+    // Series with the same scale group share a vertical scale
+    size_t scale_group;
+    // Whether anomalous values (see `detect_anomalies()`) are left out, so glitches don't distort the scale
+    bool mask_anomalies { true };
+};
+
+
+//! \brief Resolves graph definitions against the packet descriptions.
+//!
+//! \return One series per definition that refers to an existing element.
+//!         Definitions of undescribed packet types or elements are skipped.
+//!
+[[nodiscard]] inline ::std::vector<diagram_series> resolve_diagram_series(::graph_definitions const& definitions,
+                                                                          ::payload_container const& descriptions)
+{
+    ::std::vector<diagram_series> result {};
+    ::std::vector<::std::string> groups {};
+    for (auto const& definition : definitions)
+    {
+        auto const description { descriptions.find(definition.type) };
+        if (description == end(descriptions) || definition.element >= description->second.elements.size())
+        {
+            continue;
+        }
+
+        // Ungrouped series get a scale group of their own
+        auto scale_group { groups.size() };
+        if (!definition.group.empty())
+        {
+            scale_group = static_cast<size_t>(::std::find(begin(groups), end(groups), definition.group)
+                                              - begin(groups));
+        }
+        if (scale_group == groups.size())
+        {
+            groups.push_back(definition.group);
+        }
+        result.push_back({ definition.type, description->second.elements[definition.element], definition.color,
+                           scale_group, !definition.show_anomalies });
+    }
+    return result;
+}
+
+
+// Horizontal axis of the diagram area
+enum struct diagram_axis
+{
+    // Rows of the current view (filtered and sorted)
+    index,
+    // Reconstructed packet timestamps; falls back to `index` if the log doesn't contain any time information
+    time
+};
+
+
+// A rasterized tile of the diagram area
+struct diagram_tile
+{
+    int level;
+    int64_t column;
+    int width;
+    int height;
+    // Top-down rows of 0x00RRGGBB pixels (the layout of a 32-bit DIB)
+    ::std::vector<uint32_t> pixels;
+};
+
+
+// Renders the diagram area in fixed-size tiles, so that zooming and panning only needs to blit cached tiles.
+//
+// At zoom level 0 the entire log spans `width` pixels; every level doubles that. Each level is split into columns of
+// `k_tile_width` pixels. Every pixel column of a tile shows the minimum and maximum of all values it covers, connected
+// to its neighbors, so tiles look the same as a polyline through all values, regardless of the zoom level.
+//
+// Rendered tiles are kept in a bounded cache (least recently used tiles are evicted first). `request()` renders missing
+// tiles on a background thread and invokes the callback (on that thread) whenever one becomes available. `render()`
+// renders a tile synchronously, for headless use.
+//
+// A renderer is bound to a single view of the model and a fixed size; create a new one whenever either changes. The
+// model must outlive the renderer.
+struct diagram_tiles
+{
+    static constexpr int k_tile_width { 256 };
+    static constexpr size_t k_default_capacity { 128 };
+    static constexpr int k_max_level { 24 };
+    // Background of tiles (white)
+    static constexpr uint32_t k_background { 0x00FF'FFFF };
+
+    using callback_type = ::std::function<void()>;
+
+    // Pass an `anomalies` cache shared with previous renderers of the same model to avoid detecting anomalies again
+    diagram_tiles(::model const& m, ::std::shared_ptr<model_view const> view, ::std::vector<diagram_series> series,
+                  diagram_axis const axis, int const width, int const height, callback_type callback = {},
+                  size_t const capacity = k_default_capacity, ::std::shared_ptr<anomaly_cache> anomalies = {})
+        : model_ { m }
+        , view_ { ::std::move(view) }
+        , series_ { ::std::move(series) }
+        , axis_ { m.time_column() ? axis : diagram_axis::index }
+        , width_ { ::std::max(width, 1) }
+        , height_ { ::std::max(height, 1) }
+        , callback_ { ::std::move(callback) }
+        , capacity_ { ::std::max(capacity, size_t { 1 }) }
+        , anomalies_ { anomalies ? ::std::move(anomalies) : ::std::make_shared<anomaly_cache>(m) }
+    {
+        worker_ = ::std::jthread { [this](::std::stop_token const stop) { run(stop); } };
+    }
+
+    ~diagram_tiles()
+    {
+        worker_.request_stop();
+        // `worker_` joins on destruction
+    }
+
+    diagram_tiles(diagram_tiles const&) = delete;
+    diagram_tiles& operator=(diagram_tiles const&) = delete;
+
+    [[nodiscard]] auto const& view() const noexcept { return view_; }
+    [[nodiscard]] diagram_axis axis() const noexcept { return axis_; }
+    [[nodiscard]] int width() const noexcept { return width_; }
+    [[nodiscard]] int height() const noexcept { return height_; }
+
+    // Returns the width of the entire log at `level` in pixels
+    [[nodiscard]] int64_t level_width(int const level) const noexcept { return int64_t { width_ } << level; }
+
+    [[nodiscard]] int64_t column_count(int const level) const noexcept
+    {
+        return (level_width(level) + k_tile_width - 1) / k_tile_width;
+    }
+
+    // Returns the deepest useful zoom level, at which every row takes up a few pixels
+    [[nodiscard]] int max_level() const noexcept
+    {
+        constexpr int64_t k_pixels_per_row { 8 };
+        auto const rows { static_cast<int64_t>(view_->packet_count()) };
+        int level { 0 };
+        while (level < k_max_level && level_width(level) < rows * k_pixels_per_row)
+        {
+            ++level;
+        }
+        return level;
+    }
+
+    // Returns the tile if it has been rendered already
+    [[nodiscard]] ::std::shared_ptr<diagram_tile const> cached(int const level, int64_t const column)
+    {
+        ::std::scoped_lock lock { lock_ };
+        return lookup(key(level, column));
+    }
+
+    // Renders the given range of columns in the background, skipping tiles that are cached already. Replaces any
+    // pending request.
+    void request(int const level, int64_t first_column, int64_t last_column)
+    {
+        first_column = ::std::max(first_column, int64_t { 0 });
+        last_column = ::std::min(last_column, column_count(level) - 1);
+        {
+            ::std::scoped_lock lock { lock_ };
+            pending_.clear();
+            for (auto column { first_column }; column <= last_column; ++column)
+            {
+                if (!lookup(key(level, column)))
+                {
+                    pending_.emplace_back(level, column);
+                }
+            }
+            ++request_;
+        }
+        request_available_.notify_one();
+    }
+
+    // Renders a tile (without caching it)
+    [[nodiscard]] ::std::shared_ptr<diagram_tile const> render(int const level, int64_t const column) const
+    {
+        trace_span const span { "diagram_tiles::render" };
+
+        auto tile { ::std::make_shared<diagram_tile>() };
+        tile->level = level;
+        tile->column = column;
+        tile->width = k_tile_width;
+        tile->height = height_;
+        tile->pixels.assign(static_cast<size_t>(k_tile_width) * height_, k_background);
+
+        auto const& data { prepare() };
+        if (data.domain_end <= data.domain_begin)
+        {
+            return tile;
+        }
+        auto const scale { static_cast<double>(level_width(level)) / (data.domain_end - data.domain_begin) };
+        auto const origin { static_cast<double>(column * k_tile_width) };
+        // Domain covered by the tile
+        auto const tile_begin { data.domain_begin + origin / scale };
+        auto const tile_end { data.domain_begin + (origin + k_tile_width) / scale };
+
+        for (auto const& s : data.series)
+        {
+            if (s.values.empty() || s.max_value <= s.min_value)
+            {
+                continue;
+            }
+            auto const to_x = [&](double const x) {
+                return static_cast<int64_t>(::std::floor((x - data.domain_begin) * scale - origin));
+            };
+            auto const to_y = [&](double const value) {
+                return (height_ - 1) - (value - s.min_value) / (s.max_value - s.min_value) * (height_ - 1);
+            };
+
+            // Fills the pixel column `x` between two (fractional) rows
+            auto const plot = [&](int64_t const x, double const y0, double const y1) {
+                if (x < 0 || x >= k_tile_width)
+                {
+                    return;
+                }
+                auto const top { ::std::clamp(static_cast<int>(::std::lround(::std::min(y0, y1))), 0, height_ - 1) };
+                auto const bottom { ::std::clamp(static_cast<int>(::std::lround(::std::max(y0, y1))), 0,
+                                                 height_ - 1) };
+                for (auto y { top }; y <= bottom; ++y)
+                {
+                    tile->pixels[static_cast<size_t>(y) * k_tile_width + static_cast<size_t>(x)] = s.color;
+                }
+            };
+            // Connects two points (`x0` < `x1`), clipped to the tile
+            auto const connect = [&](int64_t const x0, double const y0, int64_t const x1, double const y1) {
+                auto const dx { static_cast<double>(x1 - x0) };
+                for (auto x { ::std::max(x0, int64_t { 0 }) }; x <= ::std::min(x1, int64_t { k_tile_width - 1 }); ++x)
+                {
+                    auto const t0 { ::std::clamp((static_cast<double>(x - x0) - 0.5) / dx, 0.0, 1.0) };
+                    auto const t1 { ::std::clamp((static_cast<double>(x - x0) + 0.5) / dx, 0.0, 1.0) };
+                    plot(x, y0 + (y1 - y0) * t0, y0 + (y1 - y0) * t1);
+                }
+            };
+
+            // Include the nearest values outside of the tile, so that lines leading into and out of it are drawn
+            auto const& positions { data.positions[s.positions] };
+            auto first { ::std::lower_bound(begin(positions), end(positions), tile_begin) };
+            if (first != begin(positions))
+            {
+                --first;
+            }
+            auto last { ::std::lower_bound(first, end(positions), tile_end) };
+            if (last != end(positions))
+            {
+                ++last;
+            }
+
+            // Values are aggregated per pixel column
+            ::std::optional<int64_t> current_x {};
+            double current_min {};
+            double current_max {};
+            double current_last {};
+            for (auto it { first }; it != last; ++it)
+            {
+                auto const i { static_cast<size_t>(it - begin(positions)) };
+                if (::std::isnan(s.values[i]))
+                {
+                    continue;
+                }
+                auto const x { to_x(*it) };
+                auto const y { to_y(s.values[i]) };
+                if (current_x && *current_x == x)
+                {
+                    current_min = ::std::min(current_min, y);
+                    current_max = ::std::max(current_max, y);
+                    current_last = y;
+                    continue;
+                }
+                if (current_x)
+                {
+                    plot(*current_x, current_min, current_max);
+                    connect(*current_x, current_last, x, y);
+                }
+                current_x = x;
+                current_min = current_max = current_last = y;
+            }
+            if (current_x)
+            {
+                plot(*current_x, current_min, current_max);
+            }
+        }
+        return tile;
+    }
+
+    // Returns the row (in the view) displayed at `x` pixels from the left edge of the entire log at `level`
+    [[nodiscard]] ::std::optional<size_t> row_at(int const level, int64_t const x) const
+    {
+        auto const& data { prepare() };
+        if (view_->packet_count() == 0 || data.domain_end <= data.domain_begin)
+        {
+            return {};
+        }
+        auto const position { data.domain_begin
+                              + (static_cast<double>(x) + 0.5) / static_cast<double>(level_width(level))
+                                    * (data.domain_end - data.domain_begin) };
+        if (axis_ == diagram_axis::index)
+        {
+            return static_cast<size_t>(
+                ::std::clamp(position, 0.0, static_cast<double>(view_->packet_count() - 1)));
+        }
+        // First row at or after the position in time
+        auto const it { ::std::lower_bound(begin(data.row_times), end(data.row_times), position,
+                                           [](auto const& entry, double const value) { return entry.first < value; }) };
+        return it == end(data.row_times) ? data.row_times.back().second : it->second;
+    }
+
+private:
+    struct prepared_series
+    {
+        // Index into `prepared_data::positions`; series of the same packet type share their positions
+        size_t positions { 0 };
+        // One value per position; NaN where the packet doesn't contain the element
+        ::std::vector<double> values;
+        double min_value { 0.0 };
+        double max_value { 0.0 };
+        // 0x00RRGGBB
+        uint32_t color { 0 };
+    };
+
+    struct prepared_data
+    {
+        double domain_begin { 0.0 };
+        double domain_end { 0.0 };
+        // Horizontal positions (ascending) of all packets of a type that has series
+        ::std::vector<::std::vector<double>> positions;
+        ::std::vector<prepared_series> series;
+        // Timestamps and rows (time axis only), ascending in time
+        ::std::vector<::std::pair<double, size_t>> row_times;
+    };
+
+    // Extracts all series from the view on first use
+    [[nodiscard]] prepared_data const& prepare() const
+    {
+        ::std::call_once(prepared_once_, [this] {
+            trace_span const span { "diagram_tiles::prepare" };
+
+            auto const& directory { model_.directory() };
+            auto const& view { *view_ };
+            auto const rows { view.packet_count() };
+
+            prepared_data data {};
+            if (axis_ == diagram_axis::time)
+            {
+                auto const& times { *model_.time_column() };
+                data.row_times.reserve(rows);
+                for (size_t row { 0 }; row < rows; ++row)
+                {
+                    data.row_times.emplace_back(static_cast<double>(times[view.packet_index(row)]), row);
+                }
+                ::std::stable_sort(begin(data.row_times), end(data.row_times),
+                                   [](auto const& lhs, auto const& rhs) { return lhs.first < rhs.first; });
+                if (!data.row_times.empty())
+                {
+                    data.domain_begin = data.row_times.front().first;
+                    // Leave room for the final packet
+                    data.domain_end = data.row_times.back().first + 1.0;
+                }
+            }
+            else
+            {
+                data.domain_begin = 0.0;
+                data.domain_end = static_cast<double>(rows);
+            }
+
+            // All series are extracted in a single pass over the view, which only gathers the payloads (and
+            // positions) of the packet types that have series. Values are then decoded one series at a time, with the
+            // element type resolved once per series.
+            ::std::array<::std::vector<size_t>, 256> series_by_type {};
+            ::std::array<size_t, 256> slot_by_type {};
+            ::std::vector<::std::vector<::std::span<unsigned char const>>> payloads {};
+            // Anomalies of the masked series, detected over all packets in natural order (regardless of the view)
+            ::std::vector<anomaly_field> masked_fields {};
+            ::std::vector<::std::optional<size_t>> mask_by_series(series_.size());
+            for (size_t i { 0 }; i < series_.size(); ++i)
+            {
+                auto const& series { series_[i] };
+                if (static_cast<size_t>(series.element.type) >= k_element_decoders.size())
+                {
+                    continue;
+                }
+                auto& slots { series_by_type[series.packet_type] };
+                if (slots.empty())
+                {
+                    slot_by_type[series.packet_type] = payloads.size();
+                    payloads.emplace_back();
+                }
+                slots.push_back(i);
+                if (series.mask_anomalies && field_anomaly_detector::is_supported(series.element.type))
+                {
+                    mask_by_series[i] = masked_fields.size();
+                    masked_fields.push_back({ series.packet_type, 0, series.element });
+                }
+            }
+            data.positions.resize(payloads.size());
+            auto const anomalies { anomalies_->find(masked_fields) };
+            // Packet indices per slot, to look up anomalies
+            ::std::vector<::std::vector<size_t>> indices(masked_fields.empty() ? 0 : payloads.size());
+
+            auto const add = [&](double const position, size_t const index) {
+                auto const& packet { directory[index] };
+                auto const type { packet.type() };
+                if (series_by_type[type].empty())
+                {
+                    return;
+                }
+                auto const slot { slot_by_type[type] };
+                data.positions[slot].push_back(position);
+                payloads[slot].emplace_back(packet.data() + packet.header_size(), packet.payload_size());
+                if (!indices.empty())
+                {
+                    indices[slot].push_back(index);
+                }
+            };
+            if (axis_ == diagram_axis::time)
+            {
+                for (auto const& [time, row] : data.row_times)
+                {
+                    add(time, view.packet_index(row));
+                }
+            }
+            else
+            {
+                for (size_t row { 0 }; row < rows; ++row)
+                {
+                    add(static_cast<double>(row), view.packet_index(row));
+                }
+            }
+
+            data.series.resize(series_.size());
+            for (size_t i { 0 }; i < series_.size(); ++i)
+            {
+                auto const& series { series_[i] };
+                auto& s { data.series[i] };
+                s.color = ((series.color & 0xFF) << 16) | (series.color & 0xFF00) | ((series.color >> 16) & 0xFF);
+                s.min_value = ::std::numeric_limits<double>::infinity();
+                s.max_value = -::std::numeric_limits<double>::infinity();
+                if (static_cast<size_t>(series.element.type) >= k_element_decoders.size())
+                {
+                    continue;
+                }
+
+                s.positions = slot_by_type[series.packet_type];
+                auto const& column { payloads[s.positions] };
+                s.values.resize(column.size());
+                k_element_decoders[static_cast<size_t>(series.element.type)].decode_numeric_column(
+                    column, series.element, s.values.data());
+                if (mask_by_series[i])
+                {
+                    auto const& mask { anomalies[*mask_by_series[i]]->packets };
+                    auto const& column_indices { indices[s.positions] };
+                    for (size_t j { 0 }; j < s.values.size(); ++j)
+                    {
+                        if (mask.contains(column_indices[j]))
+                        {
+                            s.values[j] = ::std::numeric_limits<double>::quiet_NaN();
+                        }
+                    }
+                }
+                // Comparisons with NaN are false, so those are skipped
+                auto min_value { s.min_value };
+                auto max_value { s.max_value };
+                for (auto const value : s.values)
+                {
+                    min_value = value < min_value ? value : min_value;
+                    max_value = value > max_value ? value : max_value;
+                }
+                s.min_value = min_value;
+                s.max_value = max_value;
+            }
+
+            // Series of a scale group share the combined range
+            for (size_t i { 0 }; i < series_.size(); ++i)
+            {
+                for (size_t j { 0 }; j < series_.size(); ++j)
+                {
+                    if (series_[j].scale_group == series_[i].scale_group)
+                    {
+                        data.series[i].min_value = ::std::min(data.series[i].min_value, data.series[j].min_value);
+                        data.series[i].max_value = ::std::max(data.series[i].max_value, data.series[j].max_value);
+                    }
+                }
+            }
+            for (auto& s : data.series)
+            {
+                if (s.min_value > s.max_value)
+                {
+                    s.min_value = s.max_value = 0.0;
+                }
+            }
+            prepared_ = ::std::move(data);
+        });
+        return prepared_;
+    }
+
+    [[nodiscard]] static uint64_t key(int const level, int64_t const column) noexcept
+    {
+        return (static_cast<uint64_t>(level) << 48) | static_cast<uint64_t>(column);
+    }
+
+    // Requires `lock_` to be held
+    [[nodiscard]] ::std::shared_ptr<diagram_tile const> lookup(uint64_t const k)
+    {
+        auto const it { index_.find(k) };
+        if (it == end(index_))
+        {
+            return {};
+        }
+        // Move to front (most recently used)
+        tiles_.splice(begin(tiles_), tiles_, it->second);
+        return it->second->second;
+    }
+
+    // Requires `lock_` to be held
+    void insert(uint64_t const k, ::std::shared_ptr<diagram_tile const> tile)
+    {
+        if (index_.contains(k))
+        {
+            return;
+        }
+        tiles_.emplace_front(k, ::std::move(tile));
+        index_.emplace(k, begin(tiles_));
+        while (tiles_.size() > capacity_)
+        {
+            index_.erase(tiles_.back().first);
+            tiles_.pop_back();
+        }
+    }
+
+    void run(::std::stop_token const stop)
+    {
+        ::std::unique_lock lock { lock_ };
+        while (!stop.stop_requested())
+        {
+            request_available_.wait(lock, stop, [&] { return !pending_.empty(); });
+            if (stop.stop_requested())
+            {
+                return;
+            }
+
+            auto const request { request_ };
+            auto const pending { ::std::exchange(pending_, {}) };
+            for (auto const& [level, column] : pending)
+            {
+                // Abandon this request as soon as a newer one arrives
+                if (stop.stop_requested() || request != request_)
+                {
+                    break;
+                }
+                if (lookup(key(level, column)))
+                {
+                    continue;
+                }
+
+                lock.unlock();
+                auto tile { render(level, column) };
+                lock.lock();
+                insert(key(level, column), ::std::move(tile));
+
+                if (callback_)
+                {
+                    lock.unlock();
+                    callback_();
+                    lock.lock();
+                }
+            }
+        }
+    }
+
+    ::model const& model_;
+    ::std::shared_ptr<model_view const> view_;
+    ::std::vector<diagram_series> series_;
+    diagram_axis axis_;
+    int width_;
+    int height_;
+    callback_type callback_;
+
+    mutable ::std::once_flag prepared_once_;
+    mutable prepared_data prepared_;
+
+    ::std::mutex lock_;
+    ::std::condition_variable_any request_available_;
+    size_t capacity_;
+    // Most recently used first
+    ::std::list<::std::pair<uint64_t, ::std::shared_ptr<diagram_tile const>>> tiles_;
+    ::std::unordered_map<uint64_t, decltype(tiles_)::iterator> index_;
+    ::std::vector<::std::pair<int, int64_t>> pending_;
+    uint64_t request_ { 0 };
+    ::std::shared_ptr<anomaly_cache> anomalies_;
+
+    // Declared last so that it stops before any of the members it uses are destroyed
+    ::std::jthread worker_;
+};
+
+
+//! \brief Encodes a tile as a PNG image (e.g. to inspect rendering headlessly).
+//!
+//! \param[in] tile The tile to encode.
+//!
+//! \return The PNG file contents. Pixel data is stored uncompressed.
+//!
+[[nodiscard]] inline ::std::vector<uint8_t> encode_png(diagram_tile const& tile)
+{
+    auto const put32 = [](::std::vector<uint8_t>& out, uint32_t const value) {
+        for (int shift { 24 }; shift >= 0; shift -= 8)
+        {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    };
+
+    ::std::vector<uint8_t> png { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    auto const chunk = [&](char const (&type)[5], ::std::vector<uint8_t> const& data) {
+        put32(png, static_cast<uint32_t>(data.size()));
+        auto const start { png.size() };
+        png.insert(end(png), type, type + 4);
+        png.insert(end(png), begin(data), end(data));
+        put32(png, ::crc32({ png.data() + start, png.size() - start }));
+    };
+
+    ::std::vector<uint8_t> header {};
+    put32(header, static_cast<uint32_t>(tile.width));
+    put32(header, static_cast<uint32_t>(tile.height));
+    // 8 bits per channel, RGB, default compression/filter, no interlacing
+    header.insert(end(header), { 8, 2, 0, 0, 0 });
+    chunk("IHDR", header);
+
+    // Scanlines without filtering (filter type 0), RGB
+    ::std::vector<uint8_t> raw {};
+    raw.reserve(static_cast<size_t>(tile.height) * (1 + 3 * static_cast<size_t>(tile.width)));
+    for (int y { 0 }; y < tile.height; ++y)
+    {
+        raw.push_back(0);
+        for (int x { 0 }; x < tile.width; ++x)
+        {
+            auto const pixel { tile.pixels[static_cast<size_t>(y) * tile.width + static_cast<size_t>(x)] };
+            raw.insert(end(raw), { static_cast<uint8_t>(pixel >> 16), static_cast<uint8_t>(pixel >> 8),
+                                   static_cast<uint8_t>(pixel) });
+        }
+    }
+
+    // zlib stream of stored (uncompressed) deflate blocks
+    constexpr size_t k_max_block { 0xFFFF };
+    ::std::vector<uint8_t> zlib { 0x78, 0x01 };
+    for (size_t pos { 0 }; pos < raw.size() || pos == 0; pos += k_max_block)
+    {
+        auto const length { ::std::min(k_max_block, raw.size() - pos) };
+        auto const final { pos + length >= raw.size() };
+        zlib.push_back(final ? 1 : 0);
+        zlib.insert(end(zlib), { static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+                                 static_cast<uint8_t>(~length), static_cast<uint8_t>(~length >> 8) });
+        zlib.insert(end(zlib), begin(raw) + pos, begin(raw) + pos + length);
+        if (final)
+        {
+            break;
+        }
+    }
+    put32(zlib, ::adler32(raw));
+    chunk("IDAT", zlib);
+    chunk("IEND", {});
+    return png;
+}
+
+
+// Time taken to render the tiles of the first screen at a zoom level
+struct diagram_level_timing
+{
+    int level;
+    int64_t tile_count;
+    double milliseconds;
+};
+
+
+//! \brief Renders the first screen of every zoom level headlessly, to measure
+//!        rendering performance or inspect tiles without a window.
+//!
+//! \param[in] tiles      The renderer. The data it plots is prepared before
+//!                       timing starts.
+//! \param[in] output_dir Directory receiving the rendered tiles as
+//!                       `<level>-<column>.png`. Pass an empty path to only
+//!                       measure rendering.
+//!
+//! \return The rendering time per zoom level, from level 0 to
+//!         `tiles.max_level()`.
+//!
+inline ::std::vector<diagram_level_timing> render_diagram_levels(diagram_tiles const& tiles,
+                                                                ::std::filesystem::path const& output_dir)
+{
+    trace_span const span { "render_diagram_levels" };
+
+    if (!output_dir.empty())
+    {
+        ::std::filesystem::create_directories(output_dir);
+    }
+    // Rendering the first tile prepares (and caches) the data of all series
+    static_cast<void>(tiles.render(0, 0));
+
+    ::std::vector<diagram_level_timing> timings {};
+    for (int level { 0 }; level <= tiles.max_level(); ++level)
+    {
+        auto const tile_count { ::std::min(tiles.column_count(level),
+                                           (int64_t { tiles.width() } + diagram_tiles::k_tile_width - 1)
+                                               / diagram_tiles::k_tile_width) };
+        ::std::vector<::std::shared_ptr<diagram_tile const>> rendered {};
+        auto const start { ::std::chrono::steady_clock::now() };
+        for (int64_t column { 0 }; column < tile_count; ++column)
+        {
+            rendered.push_back(tiles.render(level, column));
+        }
+        auto const elapsed { ::std::chrono::steady_clock::now() - start };
+        timings.push_back({ level, tile_count, ::std::chrono::duration<double, ::std::milli> { elapsed }.count() });
+
+        if (output_dir.empty())
+        {
+            continue;
+        }
+        for (auto const& tile : rendered)
+        {
+            auto const png { ::encode_png(*tile) };
+            ::std::ofstream out { output_dir / ::std::format(L"{}-{}.png", tile->level, tile->column),
+                                  ::std::ios::binary | ::std::ios::trunc };
+            out.write(reinterpret_cast<char const*>(png.data()), static_cast<::std::streamsize>(png.size()));
+            THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+        }
+    }
+    return timings;
+}
@@ -2,14 +2,18 @@
 
 #include "date_time_utils.h"
 #include "model.h"
+#include "tracing.h"
 
 #include <Windows.h>
 
+#include <array>
 #include <cassert>
 #include <format>
 #include <optional>
 #include <span>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 
 //! \brief Creates a human readable string representation for a timestamp value
@@ -83,50 +87,88 @@
     return result;
 }
 
+//! \brief Formats a payload element of a given type for display.
+//!
+//! \remark The caller is responsible for validating the element (see
+//!         `is_decodable`). Integers without a transform are formatted
+//!         exactly; everything else goes through the numeric decoder.
+//!
+template <payload_type Type>
+[[nodiscard]] ::std::wstring format_element(unsigned char const* const payload, ::payload_element const& element)
+{
+    if constexpr (Type == payload_type::unknown)
+    {
+        return {};
+    }
+    else if constexpr (Type == payload_type::file_time)
+    {
+        return ::to_iso8601(::load_unaligned<::FILETIME>(payload + element.offset));
+    }
+    else if constexpr (Type == payload_type::enumeration)
+    {
+        auto const value { ::decode_raw_unsigned(payload, element) };
+        if (auto const it { element.enum_values.find(value) }; it != end(element.enum_values))
+        {
+            return it->second;
+        }
+        return ::std::to_wstring(value);
+    }
+    else if constexpr (Type == payload_type::bitfield)
+    {
+        if (element.scale == 1.0 && element.bias == 0.0)
+        {
+            return ::std::to_wstring(::decode_raw_unsigned(payload, element));
+        }
+        return ::std::format(L"{}", ::decode_numeric<Type>(payload, element).value_or(0.0));
+    }
+    else
+    {
+        using traits = payload_traits<Type>;
+        if constexpr (::std::is_integral_v<typename traits::storage_type>)
+        {
+            if (element.scale == 1.0 && element.bias == 0.0)
+            {
+                return ::std::to_wstring(::load_unaligned<typename traits::storage_type, traits::big_endian>(
+                    payload + element.offset));
+            }
+        }
+        return ::std::format(L"{}", ::decode_numeric<Type>(payload, element).value_or(0.0));
+    }
+}
+
+using element_formatter = ::std::wstring (*)(unsigned char const* payload, ::payload_element const& element);
+
+template <size_t... Types>
+[[nodiscard]] consteval auto make_element_formatters(::std::index_sequence<Types...>) noexcept
+{
+    return ::std::array<element_formatter, sizeof...(Types)> { &::format_element<static_cast<payload_type>(
+        Types)>... };
+}
+
+// Formatter table, indexed by payload type
+inline constexpr auto k_element_formatters { ::make_element_formatters(
+    ::std::make_index_sequence<static_cast<size_t>(payload_type::last_value) + 1> {}) };
+
 // TODO: Refactor to not use the intended-to-be-internal data_proxy
 inline ::std::optional<::std::wstring> details_from_packet(::data_proxy const& packet,
                                                            ::payload_container const& package_descriptions)
 {
+    trace_span const span { "details_from_packet" };
+
     if (package_descriptions.contains(packet.type()))
     {
         auto const& description { package_descriptions.find(packet.type())->second };
         ::std::wstring ret { description.name.has_value() ? description.name.value() + L" " : L"<unknown>" };
+        auto const payload { packet.data() + packet.header_size() };
         for (auto const& el : description.elements)
         {
             ret += L" {" + ::std::to_wstring(el.offset) + L":" + ::std::to_wstring(el.size) + L"} ";
 
-            switch (el.type)
+            auto const index { static_cast<size_t>(el.type) };
+            if (index < k_element_formatters.size()
+                && k_element_decoders[index].is_decodable(packet.payload_size(), el))
             {
-            case payload_type::file_time: {
-                assert(el.size == sizeof(::FILETIME));
-                auto const& ft { *reinterpret_cast<::FILETIME const*>(packet.data() + packet.header_size()
-                                                                      + el.offset) };
-                ret += ::to_iso8601(ft);
-            }
-            break;
-
-            case payload_type::ui32: {
-                assert(el.size == sizeof(uint32_t));
-                ret += ::std::to_wstring(
-                    *reinterpret_cast<uint32_t const*>(packet.data() + packet.header_size() + el.offset));
-            }
-            break;
-
-            case payload_type::ui16: {
-                assert(el.size == sizeof(uint16_t));
-                assert(el.offset + el.size <= packet.payload_size());
-                ret += ::std::to_wstring(
-                    *reinterpret_cast<uint16_t const*>(packet.data() + packet.header_size() + el.offset));
-            }
-            break;
-
-            case payload_type::ui8: {
-                ret += ::std::to_wstring(*(packet.data() + packet.header_size() + el.offset));
-            }
-            break;
-
-            default:
-                break;
+                ret += k_element_formatters[index](payload, el);
             }
         }
 
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+
+//! \brief Maps a signed integer onto an unsigned integer such that values of
+//!        small magnitude (positive or negative) map to small values.
+//!
+//! \param[in] value The signed value to encode.
+//!
+//! \return The zigzag encoded value (0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3, ...).
+//!
+[[nodiscard]] constexpr inline uint64_t zigzag_encode(int64_t const value) noexcept
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+
+//! \brief Reverses `zigzag_encode`.
+//!
+[[nodiscard]] constexpr inline int64_t zigzag_decode(uint64_t const value) noexcept
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 0x1);
+}
+
+
+//! \brief Appends an unsigned integer as a variable length quantity (LEB128).
+//!
+//! \param[in,out] buffer The buffer to append to.
+//! \param[in]     value  The value to encode. Values below 128 take up a single
+//!                       byte, a 64-bit value takes up at most 10 bytes.
+//!
+inline void write_varint(::std::vector<uint8_t>& buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+
+//! \brief Decodes a variable length quantity written by `write_varint`.
+//!
+//! \param[in,out] pos Pointer to the first byte of the encoded value. On return
+//!                    this points one past the final byte of the encoded value.
+//!
+//! \return The decoded value.
+//!
+//! \remark The caller is responsible for ensuring that the encoded value lies
+//!         entirely inside the buffer.
+//!
+[[nodiscard]] inline uint64_t read_varint(uint8_t const*& pos) noexcept
+{
+    uint64_t result { 0 };
+    for (unsigned shift { 0 }; shift < 64; shift += 7)
+    {
+        auto const byte { *pos++ };
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,522 @@
+#pragma once
+
+#include "date_time_utils.h"
+#include "display_utils.h"
+#include "model.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+// Presumed meaning of a payload field, derived from its statistics
+enum struct field_kind
+{
+    unknown,
+    constant,
+    flag,
+    counter,
+    timestamp,
+    sensor,
+
+    last_value = sensor
+};
+
+
+[[nodiscard]] inline constexpr wchar_t const* to_string(field_kind const kind) noexcept
+{
+    switch (kind)
+    {
+    case field_kind::constant:
+        return L"constant";
+    case field_kind::flag:
+        return L"flag";
+    case field_kind::counter:
+        return L"counter";
+    case field_kind::timestamp:
+        return L"timestamp";
+    case field_kind::sensor:
+        return L"sensor";
+    case field_kind::unknown:
+    default:
+        return L"unknown";
+    }
+}
+
+
+// Statistics for a single payload window (a byte, or an aligned 16/32-bit little-endian value) of a packet type
+struct field_profile
+{
+    unsigned char type;
+    size_t offset;
+    // Window width in bytes (1, 2, 4, or 8 for timestamp candidates)
+    size_t width;
+
+    uint64_t samples;
+    uint64_t min;
+    uint64_t max;
+    // Shannon entropy of the observed values in bits
+    double entropy;
+    // Number of distinct values
+    size_t distinct;
+    // Share of successive packets of the same type where the value increased by exactly one
+    double increment_share;
+    // Share of successive packets of the same type where the value didn't decrease
+    double non_decreasing_share;
+    // Share of successive packets of the same type where the value changed (XOR is non-zero)
+    double change_rate;
+    // Average number of flipped bits between successive packets
+    double changed_bits;
+
+    field_kind kind;
+    // Confidence in `kind` in the range [0..1]; used to rank the report
+    double score;
+};
+
+
+// Accumulates statistics for a single window; instances are private to a thread and merged at the end
+struct window_accumulator
+{
+    uint64_t min { ::std::numeric_limits<uint64_t>::max() };
+    uint64_t max { 0 };
+    uint64_t samples { 0 };
+    uint64_t transitions { 0 };
+    uint64_t increments { 0 };
+    uint64_t non_decreasing { 0 };
+    uint64_t changes { 0 };
+    uint64_t changed_bits { 0 };
+
+    void add(uint64_t const value) noexcept
+    {
+        min = ::std::min(min, value);
+        max = ::std::max(max, value);
+        ++samples;
+    }
+
+    void add_transition(uint64_t const prev, uint64_t const cur) noexcept
+    {
+        ++transitions;
+        increments += (cur == prev + 1) ? 1 : 0;
+        non_decreasing += (cur >= prev) ? 1 : 0;
+        auto const diff { prev ^ cur };
+        changes += (diff != 0) ? 1 : 0;
+        changed_bits += static_cast<uint64_t>(::std::popcount(diff));
+    }
+
+    void merge(window_accumulator const& other) noexcept
+    {
+        min = ::std::min(min, other.min);
+        max = ::std::max(max, other.max);
+        samples += other.samples;
+        transitions += other.transitions;
+        increments += other.increments;
+        non_decreasing += other.non_decreasing;
+        changes += other.changes;
+        changed_bits += other.changed_bits;
+    }
+};
+
+
+// Per packet type accumulators
+struct type_accumulator
+{
+    // Exact value counts of a 16/32-bit window; sparse, as most windows only take a few distinct values
+    using value_counts = ::std::unordered_map<uint32_t, uint64_t>;
+
+    static constexpr ::std::array<size_t, 3> k_widths { 1, 2, 4 };
+
+    void resize(size_t const payload_size)
+    {
+        if (payload_size <= payload_size_)
+        {
+            return;
+        }
+        payload_size_ = payload_size;
+        byte_histograms.resize(payload_size);
+        for (size_t w { 1 }; w < k_widths.size(); ++w)
+        {
+            wide_counts[w - 1].resize(payload_size / k_widths[w]);
+        }
+        timestamp_hits.resize(payload_size);
+        for (auto& w : windows)
+        {
+            w.resize(payload_size);
+        }
+    }
+
+    void merge(type_accumulator const& other)
+    {
+        resize(other.payload_size_);
+        packets += other.packets;
+        for (size_t offset { 0 }; offset < other.payload_size_; ++offset)
+        {
+            for (size_t bin { 0 }; bin < 256; ++bin)
+            {
+                byte_histograms[offset][bin] += other.byte_histograms[offset][bin];
+            }
+            timestamp_hits[offset] += other.timestamp_hits[offset];
+            for (size_t w { 0 }; w < windows.size(); ++w)
+            {
+                windows[w][offset].merge(other.windows[w][offset]);
+            }
+        }
+        for (size_t w { 0 }; w < wide_counts.size(); ++w)
+        {
+            for (size_t window { 0 }; window < other.wide_counts[w].size(); ++window)
+            {
+                for (auto const& [value, count] : other.wide_counts[w][window])
+                {
+                    wide_counts[w][window][value] += count;
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] auto payload_size() const noexcept { return payload_size_; }
+
+    uint64_t packets { 0 };
+    // Indexed by payload offset
+    ::std::vector<::std::array<uint64_t, 256>> byte_histograms;
+    // Indexed by width index minus one (16/32-bit), then window (payload offset divided by the width)
+    ::std::array<::std::vector<value_counts>, k_widths.size() - 1> wide_counts;
+    // Number of packets where the 8 bytes at an offset form a plausible FILETIME
+    ::std::vector<uint64_t> timestamp_hits;
+    // Indexed by width index (see `k_widths`), then payload offset
+    ::std::array<::std::vector<window_accumulator>, k_widths.size()> windows;
+    // First and most recent packet of this type seen by a thread, required to stitch partitions together
+    data_proxy const* first { nullptr };
+    data_proxy const* last { nullptr };
+
+private:
+    size_t payload_size_ { 0 };
+};
+
+
+// Loads an unsigned little-endian value of `width` bytes from an arbitrarily aligned address
+[[nodiscard]] inline uint64_t load_window(unsigned char const* const data, size_t const width) noexcept
+{
+    uint64_t value { 0 };
+    ::std::memcpy(&value, data, width);
+    return value;
+}
+
+
+// Records the transition between two successive packets of the same type
+inline void accumulate_transition(type_accumulator& acc, data_proxy const& prev, data_proxy const& cur) noexcept
+{
+    auto const prev_payload { prev.data() + prev.header_size() };
+    auto const cur_payload { cur.data() + cur.header_size() };
+    auto const common_size { ::std::min(prev.payload_size(), cur.payload_size()) };
+    for (size_t w { 0 }; w < type_accumulator::k_widths.size(); ++w)
+    {
+        auto const width { type_accumulator::k_widths[w] };
+        for (size_t offset { 0 }; offset + width <= common_size; offset += width)
+        {
+            acc.windows[w][offset].add_transition(::load_window(prev_payload + offset, width),
+                                                  ::load_window(cur_payload + offset, width));
+        }
+    }
+}
+
+
+// Records a single packet
+inline void accumulate_packet(type_accumulator& acc, data_proxy const& packet) noexcept
+{
+    auto const payload { packet.data() + packet.header_size() };
+    auto const size { static_cast<size_t>(packet.payload_size()) };
+    acc.resize(size);
+    ++acc.packets;
+
+    for (size_t offset { 0 }; offset < size; ++offset)
+    {
+        ++acc.byte_histograms[offset][payload[offset]];
+        acc.windows[0][offset].add(payload[offset]);
+        if (offset + sizeof(uint64_t) <= size && ::is_plausible_timestamp(::load_window(payload + offset, 8)))
+        {
+            ++acc.timestamp_hits[offset];
+        }
+    }
+    for (size_t offset { 0 }; offset + 2 <= size; offset += 2)
+    {
+        auto const value { ::load_window(payload + offset, 2) };
+        acc.windows[1][offset].add(value);
+        ++acc.wide_counts[0][offset / 2][static_cast<uint32_t>(value)];
+    }
+    for (size_t offset { 0 }; offset + 4 <= size; offset += 4)
+    {
+        auto const value { ::load_window(payload + offset, 4) };
+        acc.windows[2][offset].add(value);
+        ++acc.wide_counts[1][offset / 4][static_cast<uint32_t>(value)];
+    }
+
+    if (acc.last != nullptr)
+    {
+        ::accumulate_transition(acc, *acc.last, packet);
+    }
+    if (acc.first == nullptr)
+    {
+        acc.first = &packet;
+    }
+    acc.last = &packet;
+}
+
+
+// Computes entropy (bits) and number of occupied bins of a histogram, given as a range of counts
+template <typename Range>
+[[nodiscard]] ::std::pair<double, size_t> histogram_entropy(Range&& bins) noexcept
+{
+    uint64_t total { 0 };
+    size_t distinct { 0 };
+    for (auto const count : bins)
+    {
+        total += count;
+        distinct += (count > 0) ? 1 : 0;
+    }
+
+    double entropy { 0.0 };
+    for (auto const count : bins)
+    {
+        if (count > 0)
+        {
+            auto const p { static_cast<double>(count) / static_cast<double>(total) };
+            entropy -= p * ::std::log2(p);
+        }
+    }
+    return { entropy, distinct };
+}
+
+
+// Derives a field kind and confidence score from a profile's statistics
+inline void classify(field_profile& profile) noexcept
+{
+    if (profile.width == sizeof(uint64_t))
+    {
+        // Timestamp candidates are pre-classified
+        return;
+    }
+
+    if (profile.min == profile.max)
+    {
+        profile.kind = field_kind::constant;
+        profile.score = 0.0;
+        return;
+    }
+
+    if (profile.width == 1 && profile.max <= 1)
+    {
+        profile.kind = field_kind::flag;
+        profile.score = 1.0 - profile.change_rate / 2;
+        return;
+    }
+
+    if (profile.non_decreasing_share > 0.95 && profile.change_rate > 0.05)
+    {
+        profile.kind = field_kind::counter;
+        profile.score = ::std::max(profile.increment_share, profile.non_decreasing_share * profile.change_rate);
+        return;
+    }
+
+    auto const max_entropy { 8.0 * static_cast<double>(profile.width) };
+    if (profile.change_rate > 0.2 && profile.entropy > 2.0)
+    {
+        profile.kind = field_kind::sensor;
+        profile.score = profile.change_rate * ::std::min(1.0, profile.entropy / ::std::min(max_entropy, 10.0));
+        return;
+    }
+
+    profile.kind = field_kind::unknown;
+    profile.score = 0.0;
+}
+
+
+//! \brief Computes per-field statistics for every packet type of a sensor log.
+//!
+//! \param[in] directory    All packets of a sensor log in natural order.
+//! \param[in] thread_count The number of worker threads. A value of 0 selects
+//!                         the number of hardware threads.
+//!
+//! \return A report containing a profile for every payload byte offset and
+//!         every aligned 16/32-bit window of every packet type, as well as
+//!         timestamp candidates (unaligned 8-byte windows that hold plausible
+//!         FILETIME values in at least 90% of the packets). The report is
+//!         ranked by field kind confidence, so that likely counters, flags,
+//!         timestamps, and sensor values come first.
+//!
+//! \remark The directory is partitioned into contiguous ranges, one per thread.
+//!         Every thread accumulates into private histograms, which are merged
+//!         once all threads are done. Transitions between successive packets
+//!         that end up in different partitions are stitched together during
+//!         the merge, so the result doesn't depend on the thread count.
+//!         Entropy and distinct values are exact for every window; 16/32-bit
+//!         windows keep sparse value counts, so their memory use grows with
+//!         the number of distinct values rather than the number of packets.
+//!
+[[nodiscard]] inline ::std::vector<field_profile> profile_fields(::std::span<data_proxy const> const directory,
+                                                                 size_t thread_count = 0)
+{
+    if (thread_count == 0)
+    {
+        thread_count = ::std::max(1u, ::std::thread::hardware_concurrency());
+    }
+    thread_count = ::std::max<size_t>(1, ::std::min(thread_count, directory.size() / 65'536 + 1));
+
+    using accumulator_set = ::std::array<::std::unique_ptr<type_accumulator>, 256>;
+    ::std::vector<accumulator_set> partitions(thread_count);
+    {
+        ::std::vector<::std::jthread> workers {};
+        for (size_t t { 0 }; t < thread_count; ++t)
+        {
+            workers.emplace_back([&, t] {
+                auto& accumulators { partitions[t] };
+                auto const first { directory.size() * t / thread_count };
+                auto const last { directory.size() * (t + 1) / thread_count };
+                for (auto index { first }; index < last; ++index)
+                {
+                    auto const& packet { directory[index] };
+                    auto& acc { accumulators[packet.type()] };
+                    if (!acc)
+                    {
+                        acc = ::std::make_unique<type_accumulator>();
+                    }
+                    ::accumulate_packet(*acc, packet);
+                }
+            });
+        }
+    }
+
+    // Merge partitions in order, stitching transitions across partition boundaries
+    accumulator_set merged {};
+    for (auto& partition : partitions)
+    {
+        for (size_t type { 0 }; type < 256; ++type)
+        {
+            auto& part { partition[type] };
+            if (!part)
+            {
+                continue;
+            }
+            auto& acc { merged[type] };
+            if (!acc)
+            {
+                acc = ::std::move(part);
+                continue;
+            }
+            ::accumulate_transition(*acc, *acc->last, *part->first);
+            acc->merge(*part);
+            acc->last = part->last;
+        }
+    }
+
+    // Produce report
+    ::std::vector<field_profile> report {};
+    for (size_t type { 0 }; type < 256; ++type)
+    {
+        auto const& acc { merged[type] };
+        if (!acc)
+        {
+            continue;
+        }
+
+        for (size_t w { 0 }; w < type_accumulator::k_widths.size(); ++w)
+        {
+            auto const width { type_accumulator::k_widths[w] };
+            for (size_t offset { 0 }; offset + width <= acc->payload_size(); offset += width)
+            {
+                auto const& win { acc->windows[w][offset] };
+                if (win.samples == 0)
+                {
+                    continue;
+                }
+
+                auto const [entropy, distinct] {
+                    width == 1 ? ::histogram_entropy(acc->byte_histograms[offset])
+                               : ::histogram_entropy(::std::views::values(acc->wide_counts[w - 1][offset / width]))
+                };
+                auto const transitions { static_cast<double>(::std::max<uint64_t>(win.transitions, 1)) };
+
+                field_profile profile { .type = static_cast<unsigned char>(type),
+                                        .offset = offset,
+                                        .width = width,
+                                        .samples = win.samples,
+                                        .min = win.min,
+                                        .max = win.max,
+                                        .entropy = entropy,
+                                        .distinct = distinct,
+                                        .increment_share = static_cast<double>(win.increments) / transitions,
+                                        .non_decreasing_share = static_cast<double>(win.non_decreasing) / transitions,
+                                        .change_rate = static_cast<double>(win.changes) / transitions,
+                                        .changed_bits = static_cast<double>(win.changed_bits) / transitions,
+                                        .kind = field_kind::unknown,
+                                        .score = 0.0 };
+                ::classify(profile);
+                report.push_back(profile);
+            }
+        }
+
+        // Timestamp candidates
+        for (size_t offset { 0 }; offset < acc->payload_size(); ++offset)
+        {
+            auto const share { static_cast<double>(acc->timestamp_hits[offset]) / static_cast<double>(acc->packets) };
+            if (share >= 0.9)
+            {
+                report.push_back({ .type = static_cast<unsigned char>(type),
+                                   .offset = offset,
+                                   .width = sizeof(uint64_t),
+                                   .samples = acc->timestamp_hits[offset],
+                                   .min = 0,
+                                   .max = 0,
+                                   .entropy = 0.0,
+                                   .distinct = 0,
+                                   .increment_share = 0.0,
+                                   .non_decreasing_share = 0.0,
+                                   .change_rate = 0.0,
+                                   .changed_bits = 0.0,
+                                   .kind = field_kind::timestamp,
+                                   .score = share });
+            }
+        }
+    }
+
+    // Rank: classified fields first (by confidence), then constant and unknown fields in natural order
+    ::std::stable_sort(begin(report), end(report), [](auto const& lhs, auto const& rhs) {
+        auto const rank = [](field_profile const& p) {
+            return (p.kind == field_kind::unknown || p.kind == field_kind::constant) ? 0.0 : 1.0 + p.score;
+        };
+        return rank(lhs) > rank(rhs);
+    });
+
+    return report;
+}
+
+
+//! \brief Formats a field profile report, one line per field.
+//!
+//! \param[in] report The report as returned by `profile_fields`.
+//!
+//! \return A human readable, tab-separated representation of the report.
+//!
+[[nodiscard]] inline ::std::wstring format_profile_report(::std::span<field_profile const> const report)
+{
+    ::std::wstring result { L"type\toffset\twidth\tkind\tscore\tsamples\tmin\tmax\tentropy\tdistinct\tinc\tnondec\t"
+                            L"change\tbits\n" };
+    for (auto const& p : report)
+    {
+        result += ::std::format(L"0x{}\t{}\t{}\t{}\t{:.3f}\t{}\t{}\t{}\t{:.2f}\t{}\t{:.3f}\t{:.3f}\t{:.3f}\t{:.2f}\n",
+                                ::to_hex_string(p.type), p.offset, p.width, ::to_string(p.kind), p.score, p.samples,
+                                p.min, p.max, p.entropy, p.distinct, p.increment_share, p.non_decreasing_share,
+                                p.change_rate, p.changed_bits);
+    }
+    return result;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "packet_descriptions.h"
+#include "tracing.h"
+
+#include <nlohmann/json.hpp>
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// A graph in the diagram area: a numeric payload element of a described packet type
+struct graph_definition
+{
+    unsigned char type;
+    // Index into `packet_description::elements`
+    size_t element;
+    // Line color (0x00BBGGRR, as a `COLORREF`)
+    uint32_t color;
+    // Graphs of the same (non-empty) group share a vertical scale; all others are scaled individually
+    ::std::string group;
+    // Whether to plot values detected as glitches (see `detect_anomalies()`); hidden by default
+    bool show_anomalies { false };
+
+    [[nodiscard]] friend bool operator==(graph_definition const&, graph_definition const&) = default;
+};
+
+using graph_definitions = ::std::vector<::graph_definition>;
+
+
+//! \brief Parses a color in HTML notation (`#RRGGBB`).
+//!
+//! \return The color as a `COLORREF` (0x00BBGGRR).
+//!
+[[nodiscard]] inline uint32_t parse_graph_color(::std::string const& text)
+{
+    THROW_HR_IF(E_INVALIDARG, text.size() != 7 || text[0] != '#');
+    auto const rgb { static_cast<uint32_t>(::std::stoul(text.substr(1), nullptr, 16)) };
+    return ((rgb & 0xFF) << 16) | (rgb & 0xFF00) | ((rgb >> 16) & 0xFF);
+}
+
+
+// Reads the graphs of the diagram area from a JSON file
+[[nodiscard]] inline ::graph_definitions load_graph_definitions(wchar_t const* path_name)
+{
+    trace_span const span { "load_graph_definitions" };
+
+    // The JSON file needs to have the following layout:
+
+    // { "graphs": [
+    //   { "type": "0x80",      /* type: string (needs to be a string due to numbers not supporting hex) */
+    //     "element": 0,        /* element: number (index into the elements of the packet description) */
+    //     "color": "#D20000",  /* color: string (#RRGGBB) */
+    //     "group": "[name]",   /* group: string (optional; graphs of a group share a vertical scale) */
+    //     "anomalies": "show"  /* anomalies: string (optional; "show" or "hide" (default) glitches) */
+    //   },
+    //   ...
+    // ]}
+
+    auto ifs { ::std::ifstream { path_name } };
+    THROW_WIN32_IF(ERROR_FILE_NOT_FOUND, !ifs);
+    ::nlohmann::json j {};
+    ifs >> j;
+
+    ::graph_definitions definitions {};
+    for (auto const& graph : j.at("graphs"))
+    {
+        auto const type { ::std::stoul(graph.at("type").get<::std::string>(), nullptr, 0) };
+        THROW_HR_IF(E_INVALIDARG, type > 0xFF);
+        auto const anomalies { graph.value("anomalies", ::std::string { "hide" }) };
+        THROW_HR_IF(E_INVALIDARG, anomalies != "show" && anomalies != "hide");
+        definitions.push_back({ static_cast<unsigned char>(type), graph.at("element").get<size_t>(),
+                                ::parse_graph_color(graph.at("color").get<::std::string>()),
+                                graph.value("group", ::std::string {}), anomalies == "show" });
+    }
+
+    return definitions;
+}
+
+
+//! \brief Returns the location of `graph_definitions.json`.
+//!
+//! \return The fully qualified pathname of `graph_definitions.json`, next to
+//!         `packet_descriptions.json`.
+//!
+[[nodiscard]] inline ::std::filesystem::path default_graph_definitions_path()
+{
+    return ::default_packet_descriptions_path().replace_filename(L"graph_definitions.json");
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+
+//! \brief Computes the 64-bit xxHash (XXH64) of a byte buffer.
+//!
+//! \param[in] data A view into the bytes to hash. This span may be empty.
+//! \param[in] seed An optional seed value.
+//!
+//! \return The hash value. This is a fast, non-cryptographic hash; it must not
+//!         be used where collisions can be provoked deliberately.
+//!
+[[nodiscard]] inline uint64_t xxhash64(::std::span<unsigned char const> const data, uint64_t const seed = 0) noexcept
+{
+    constexpr uint64_t prime1 { 0x9E3779B185EBCA87ull };
+    constexpr uint64_t prime2 { 0xC2B2AE3D27D4EB4Full };
+    constexpr uint64_t prime3 { 0x165667B19E3779F9ull };
+    constexpr uint64_t prime4 { 0x85EBCA77C2B2AE63ull };
+    constexpr uint64_t prime5 { 0x27D4EB2F165667C5ull };
+
+    auto const read64 = [](unsigned char const* p) noexcept {
+        uint64_t value {};
+        ::std::memcpy(&value, p, sizeof(value));
+        return value;
+    };
+    auto const read32 = [](unsigned char const* p) noexcept {
+        uint32_t value {};
+        ::std::memcpy(&value, p, sizeof(value));
+        return value;
+    };
+    auto const round = [](uint64_t acc, uint64_t const input) noexcept {
+        acc += input * prime2;
+        acc = ::std::rotl(acc, 31);
+        return acc * prime1;
+    };
+    auto const merge_round = [&](uint64_t acc, uint64_t const value) noexcept {
+        acc ^= round(0, value);
+        return acc * prime1 + prime4;
+    };
+
+    auto pos { data.data() };
+    auto const end { data.data() + data.size() };
+    uint64_t hash {};
+
+    if (data.size() >= 32)
+    {
+        uint64_t v1 { seed + prime1 + prime2 };
+        uint64_t v2 { seed + prime2 };
+        uint64_t v3 { seed };
+        uint64_t v4 { seed - prime1 };
+        for (; end - pos >= 32; pos += 32)
+        {
+            v1 = round(v1, read64(pos));
+            v2 = round(v2, read64(pos + 8));
+            v3 = round(v3, read64(pos + 16));
+            v4 = round(v4, read64(pos + 24));
+        }
+        hash = ::std::rotl(v1, 1) + ::std::rotl(v2, 7) + ::std::rotl(v3, 12) + ::std::rotl(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    }
+    else
+    {
+        hash = seed + prime5;
+    }
+
+    hash += static_cast<uint64_t>(data.size());
+
+    for (; end - pos >= 8; pos += 8)
+    {
+        hash ^= round(0, read64(pos));
+        hash = ::std::rotl(hash, 27) * prime1 + prime4;
+    }
+    if (end - pos >= 4)
+    {
+        hash ^= static_cast<uint64_t>(read32(pos)) * prime1;
+        hash = ::std::rotl(hash, 23) * prime2 + prime3;
+        pos += 4;
+    }
+    for (; pos < end; ++pos)
+    {
+        hash ^= *pos * prime5;
+        hash = ::std::rotl(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
+//! \brief Computes the CRC-32 (ISO 3309, as used by PNG and zip) of a byte buffer.
+//!
+//! \param[in] data A view into the bytes to checksum. This span may be empty.
+//! \param[in] crc  The checksum of preceding bytes, to checksum a buffer in
+//!                 pieces.
+//!
+[[nodiscard]] inline uint32_t crc32(::std::span<unsigned char const> const data, uint32_t const crc = 0) noexcept
+{
+    static constexpr auto k_table { [] {
+        ::std::array<uint32_t, 256> table {};
+        for (uint32_t n { 0 }; n < table.size(); ++n)
+        {
+            auto c { n };
+            for (int k { 0 }; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return table;
+    }() };
+
+    auto c { ~crc };
+    for (auto const byte : data)
+    {
+        c = k_table[(c ^ byte) & 0xFF] ^ (c >> 8);
+    }
+    return ~c;
+}
+
+
+//! \brief Computes the Adler-32 checksum (as used by zlib) of a byte buffer.
+//!
+[[nodiscard]] inline uint32_t adler32(::std::span<unsigned char const> const data) noexcept
+{
+    constexpr uint32_t k_modulus { 65521 };
+    // Largest number of bytes that can be summed before `b` may overflow
+    constexpr size_t k_block_size { 5552 };
+
+    uint32_t a { 1 };
+    uint32_t b { 0 };
+    for (size_t pos { 0 }; pos < data.size(); pos += k_block_size)
+    {
+        for (auto const byte : data.subspan(pos, ::std::min(k_block_size, data.size() - pos)))
+        {
+            a += byte;
+            b += a;
+        }
+        a %= k_modulus;
+        b %= k_modulus;
+    }
+    return (b << 16) | a;
+}
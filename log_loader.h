@@ -0,0 +1,179 @@
+#pragma once
+
+#include "model.h"
+#include "packet_descriptions.h"
+#include "sparse_log.h"
+
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+// Snapshot of an asynchronous load in progress
+struct load_progress
+{
+    // The packets parsed so far (a prefix of the final directory in natural order)
+    ::std::shared_ptr<::std::vector<data_proxy> const> packets;
+    // The log's memory `packets` point into; shared with the model under construction
+    ::std::shared_ptr<::log_memory const> memory;
+    size_t bytes_parsed;
+    size_t bytes_total;
+    // The packet descriptions the model is loaded with
+    ::std::shared_ptr<::payload_container const> descriptions;
+    // Time since the load started
+    ::std::chrono::steady_clock::duration elapsed;
+};
+
+
+// Loads a sensor log on a background thread, publishing growing prefixes of the packet directory while parsing.
+//
+// `on_progress` receives snapshots as parsing advances. A snapshot is published whenever the number of packets has
+// doubled, so the first rows are available almost immediately, while the total cost of copying prefixes stays linear.
+// `on_completed` receives the model once it has been fully constructed, or an exception if loading failed. Both
+// callbacks run on the loader thread; neither is called after the load was cancelled.
+//
+// Logs whose model would exceed `index_budget` (see `exceeds_index_budget()`) are opened as a `sparse_log` instead,
+// which `on_completed` receives in place of the model. No progress snapshots are published for those.
+//
+// Packets in a snapshot point into the log's memory, which the snapshot shares with the model under construction. They
+// remain valid for as long as the snapshot lives, even if the load fails or is cancelled.
+//
+// Destroying the loader cancels a load in progress and waits for the loader thread to finish.
+struct log_loader
+{
+    // A sensor log file, or an in-memory copy of one (e.g. decoded from an archive)
+    using source_type = ::std::variant<::std::filesystem::path, ::std::vector<unsigned char>>;
+    using progress_callback = ::std::function<void(load_progress)>;
+    using completed_callback
+        = ::std::function<void(::std::unique_ptr<::model>, ::std::unique_ptr<::sparse_log>, ::std::exception_ptr)>;
+
+    log_loader(source_type source, progress_callback on_progress, completed_callback on_completed,
+               size_t const index_budget = k_default_index_budget)
+        : on_progress_ { ::std::move(on_progress) }
+        , on_completed_ { ::std::move(on_completed) }
+        , index_budget_ { index_budget }
+    {
+        worker_ = ::std::jthread { [this, source { ::std::move(source) }](::std::stop_token const stop) mutable {
+            run(::std::move(source), stop);
+        } };
+    }
+
+    ~log_loader()
+    {
+        worker_.request_stop();
+        // `worker_` joins on destruction
+    }
+
+    log_loader(log_loader const&) = delete;
+    log_loader& operator=(log_loader const&) = delete;
+
+private:
+    void run(source_type source, ::std::stop_token const stop) noexcept
+    {
+        auto const start { ::std::chrono::steady_clock::now() };
+        ::std::unique_ptr<::model> loaded {};
+        ::std::unique_ptr<::sparse_log> loaded_sparse {};
+        ::std::exception_ptr error {};
+        try
+        {
+            auto descriptions { ::load_packet_descriptions_cached(::default_packet_descriptions_path()) };
+            auto const shared_descriptions { ::std::make_shared<::payload_container const>(descriptions) };
+
+            // Created before the model, so that progress snapshots can share it
+            ::std::shared_ptr<::log_memory const> memory {};
+            size_t next_snapshot { 0 };
+            directory_observer const observer { [&](::std::span<data_proxy const> const packets,
+                                                    size_t const bytes_parsed, size_t const bytes_total) {
+                if (stop.stop_requested())
+                {
+                    THROW_WIN32(ERROR_CANCELLED);
+                }
+                if (packets.size() < next_snapshot)
+                {
+                    return;
+                }
+                next_snapshot = packets.size() * 2;
+                if (on_progress_)
+                {
+                    ::trace_count(trace_counter::allocations);
+                    on_progress_({ ::std::make_shared<::std::vector<data_proxy> const>(begin(packets), end(packets)),
+                                   memory, bytes_parsed, bytes_total, shared_descriptions,
+                                   ::std::chrono::steady_clock::now() - start });
+                }
+            } };
+
+            auto const* const path { ::std::get_if<::std::filesystem::path>(&source) };
+            auto const sparse { [&] {
+                if (!path)
+                {
+                    auto const& buffer { ::std::get<::std::vector<unsigned char>>(source) };
+                    return ::exceeds_index_budget(buffer, buffer.size(), index_budget_);
+                }
+                // Only the first window is mapped to decide
+                ::windowed_mapping const probe { path->c_str() };
+                return probe.size() != 0
+                       && ::exceeds_index_budget(probe.pin(0)->bytes, probe.size(), index_budget_);
+            }() };
+            if (sparse)
+            {
+                index_observer const sparse_observer { [&](size_t, size_t, size_t) {
+                    if (stop.stop_requested())
+                    {
+                        THROW_WIN32(ERROR_CANCELLED);
+                    }
+                } };
+                if (path)
+                {
+                    loaded_sparse
+                        = ::std::make_unique<::sparse_log>(path->c_str(), ::std::move(descriptions), sparse_observer);
+                }
+                else
+                {
+                    loaded_sparse = ::std::make_unique<::sparse_log>(
+                        ::std::move(::std::get<::std::vector<unsigned char>>(source)), ::std::move(descriptions),
+                        sparse_observer);
+                }
+            }
+            else
+            {
+                memory = path ? ::std::make_shared<::log_memory const>(path->c_str())
+                              : ::std::make_shared<::log_memory const>(
+                                  ::std::move(::std::get<::std::vector<unsigned char>>(source)));
+                loaded = ::std::make_unique<::model>(memory, ::std::move(descriptions), observer);
+            }
+        }
+        catch (...)
+        {
+            error = ::std::current_exception();
+        }
+
+        if (stop.stop_requested())
+        {
+            // Cancelled; nobody is interested in the result anymore
+            return;
+        }
+        if (on_completed_)
+        {
+            on_completed_(::std::move(loaded), ::std::move(loaded_sparse), ::std::move(error));
+        }
+    }
+
+    progress_callback on_progress_;
+    completed_callback on_completed_;
+    size_t index_budget_;
+    // Declared last so that it stops before any of the members it uses are destroyed
+    ::std::jthread worker_;
+};
@@ -90,9 +90,7 @@
     }
 
     // Check whether the value falls into a sane range
-    auto const datetime_min { to_uint(to_filetime(1900, 1, 1, 0, 0, 0)) };
-    auto const datetime_max { to_uint(to_filetime(2200, 1, 1, 0, 0, 0)) };
-    if (value < datetime_min || value > datetime_max)
+    if (!is_plausible_timestamp(value))
     {
         return false;
     }
@@ -1,20 +1,30 @@
 #pragma once
 
-#include "char_encoding_utils.h"
 #include "date_time_utils.h"
+#include "packet_bitmap.h"
+#include "packet_descriptions.h"
+#include "payload_decoders.h"
+#include "time_column.h"
+#include "tracing.h"
 
-#include <nlohmann/json.hpp>
 #include <wil/resource.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
 #include <cassert>
-#include <fstream>
+#include <cstddef>
+#include <functional>
 #include <iterator>
-#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <optional>
+#include <span>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 
@@ -33,6 +43,14 @@ enum struct sort_predicate
 };
 
 
+// Well-known packet types (see doc/notes.md)
+constexpr unsigned char k_packet_type_timestamp { 0x00 };
+constexpr unsigned char k_packet_type_device_state { 0x0B };
+constexpr unsigned char k_packet_type_sequence_id { 0x0F };
+constexpr unsigned char k_packet_type_heart_rate { 0x80 };
+constexpr unsigned char k_packet_type_worn_period { 0x81 };
+
+
 // Raw data access
 struct data_proxy
 {
@@ -45,13 +63,16 @@ struct data_proxy
         return sizeof(unsigned char) + sizeof(unsigned char);
     }
     [[nodiscard]] auto payload_size() const noexcept { return ::std::distance(begin_, end_) - header_size(); }
+    // Full size of the packet including the header
+    [[nodiscard]] auto size() const noexcept { return static_cast<size_t>(::std::distance(begin_, end_)); }
     [[nodiscard]] auto data() const noexcept { return begin_; };
     // Return typed value at specific offset. The offset is relative to the payload.
     template <typename T>
     [[nodiscard]] std::add_const_t<T> value(size_t const offset) const noexcept
     {
         assert(offset + sizeof(T) <= payload_size());
-        return *reinterpret_cast<std::add_const_t<T>*>(begin_ + header_size() + offset);
+        // Packets aren't aligned
+        return ::load_unaligned<T>(begin_ + header_size() + offset);
     }
     [[nodiscard]] auto type() const noexcept { return *begin_; }
 
@@ -60,10 +81,19 @@ private:
     unsigned char const* end_;
 };
 
-struct raw_data
+// Receives progress while the directory of a sensor log is built: the packets parsed so far (a prefix of the final
+// directory), and the number of bytes they cover out of the total. Throwing from the observer aborts construction.
+using directory_observer
+    = ::std::function<void(::std::span<data_proxy const> packets, size_t bytes_parsed, size_t bytes_total)>;
+
+
+// Memory of a sensor log: a read-only mapping of the file, or an in-memory copy of it
+struct log_memory
 {
-    explicit raw_data(wchar_t const* path_name)
+    explicit log_memory(wchar_t const* path_name)
     {
+        trace_span const span { "log_memory::map" };
+
         // Open file
         wil::unique_hfile f { ::CreateFileW(path_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
                                             FILE_ATTRIBUTE_NORMAL, nullptr) };
@@ -81,232 +111,612 @@ struct raw_data
         THROW_LAST_ERROR_IF(file_mapping_ == nullptr);
 
         // Map view
-        memory_begin_
-            = static_cast<unsigned char const*>(::MapViewOfFile(file_mapping_.get(), FILE_MAP_READ, 0x0, 0x0, 0x0));
-        THROW_LAST_ERROR_IF_NULL(memory_begin_);
+        view_.reset(
+            static_cast<unsigned char const*>(::MapViewOfFile(file_mapping_.get(), FILE_MAP_READ, 0x0, 0x0, 0x0)));
+        THROW_LAST_ERROR_IF_NULL(view_.get());
+        memory_begin_ = view_.get();
         memory_end_ = memory_begin_ + file_size.QuadPart;
+    }
+
+    // Takes ownership of an in-memory copy of a sensor log (e.g. decoded from an archive)
+    explicit log_memory(::std::vector<unsigned char> buffer) : buffer_ { ::std::move(buffer) }
+    {
+        memory_begin_ = buffer_.data();
+        memory_end_ = memory_begin_ + buffer_.size();
+    }
+
+    log_memory(log_memory const&) = delete;
+    log_memory& operator=(log_memory const&) = delete;
+
+    // Returns the entire file contents
+    [[nodiscard]] ::std::span<unsigned char const> bytes() const noexcept
+    {
+        return { memory_begin_, static_cast<size_t>(memory_end_ - memory_begin_) };
+    }
 
-        // Build directory
-        auto current_pos { memory_begin_ };
-        while (current_pos < memory_end_)
+private:
+    ::wil::unique_handle file_mapping_;
+    // Unmapped on destruction, so that probing a log (see `exceeds_index_budget()`) doesn't leak address space
+    ::wil::unique_mapview_ptr<unsigned char const> view_;
+    // Backing store if not mapped from a file
+    ::std::vector<unsigned char> buffer_;
+    unsigned char const* memory_begin_ { nullptr };
+    unsigned char const* memory_end_ { nullptr };
+};
+
+
+struct raw_data
+{
+    explicit raw_data(wchar_t const* path_name, directory_observer const& observer = {})
+        : raw_data { ::std::make_shared<log_memory const>(path_name), observer }
+    {
+    }
+
+    // Takes ownership of an in-memory copy of a sensor log (e.g. decoded from an archive)
+    explicit raw_data(::std::vector<unsigned char> buffer, directory_observer const& observer = {})
+        : raw_data { ::std::make_shared<log_memory const>(::std::move(buffer)), observer }
+    {
+    }
+
+    // Shares the memory of a sensor log with other owners (e.g. progress snapshots pointing into it while loading)
+    explicit raw_data(::std::shared_ptr<log_memory const> memory, directory_observer const& observer = {})
+        : memory_ { ::std::move(memory) }
+    {
+        THROW_HR_IF_NULL(E_INVALIDARG, memory_);
+        build_directory(observer);
+    }
+
+    [[nodiscard]] auto const& directory() const noexcept { return directory_; }
+    // Returns the entire file contents, including any trailing bytes not covered by the directory
+    [[nodiscard]] ::std::span<unsigned char const> bytes() const noexcept { return memory_->bytes(); }
+
+private:
+    // Number of packets parsed between calls to a `directory_observer`
+    static constexpr size_t k_observer_interval { 4 * 1024 };
+
+    void build_directory(directory_observer const& observer)
+    {
+        trace_span const span { "raw_data::build_directory" };
+
+        auto const memory_begin { memory_->bytes().data() };
+        auto const memory_end { memory_begin + memory_->bytes().size() };
+        auto const total { memory_->bytes().size() };
+        auto current_pos { memory_begin };
+        while (memory_end - current_pos >= static_cast<ptrdiff_t>(data_proxy::header_size()))
         {
+            if (observer && directory_.size() % k_observer_interval == 0 && !directory_.empty())
+            {
+                observer(directory_, static_cast<size_t>(current_pos - memory_begin), total);
+            }
+
             // Full size of packet is the size stored at offset plus the header (type: byte, size: byte).
             auto const size { *(current_pos + 1) + 2 };
+            if (memory_end - current_pos < size)
+            {
+                // Truncated final packet
+                break;
+            }
             directory_.push_back({ current_pos, current_pos + size });
             current_pos += size;
         }
+        if (observer)
+        {
+            observer(directory_, static_cast<size_t>(current_pos - memory_begin), total);
+        }
+        ::trace_count(trace_counter::bytes_scanned, static_cast<uint64_t>(current_pos - memory_begin));
+        ::trace_count(trace_counter::packets_indexed, directory_.size());
     }
 
-    [[nodiscard]] auto const& directory() const noexcept { return directory_; }
-
-private:
-    // std::wstring path_name_;
-    ::wil::unique_handle file_mapping_;
-    unsigned char const* memory_begin_;
-    unsigned char const* memory_end_;
+    ::std::shared_ptr<log_memory const> memory_;
     ::std::vector<data_proxy> directory_;
 };
 
 
-// Packet information handling
-enum struct payload_type
+// Returns the numeric value of a payload element, or `nullopt` if the element isn't numeric or exceeds the payload
+[[nodiscard]] inline ::std::optional<double> element_value(::data_proxy const& packet,
+                                                           ::payload_element const& element) noexcept
 {
-    unknown,
-    ui8,
-    ui16,
-    ui32,
-    file_time,
+    return ::decode_element({ packet.data() + packet.header_size(), packet.payload_size() }, element);
+}
 
-    last_value = file_time
-};
 
-struct payload_element
+// Returns the payload offsets of the `file_time` elements per packet type, i.e. the potential time anchors
+[[nodiscard]] inline ::std::array<::std::vector<size_t>, 256> time_anchor_offsets(
+    ::payload_container const& descriptions)
 {
-    size_t offset;
-    size_t size;
-    payload_type type;
-    ::std::optional<::std::wstring> comment;
-};
+    ::std::array<::std::vector<size_t>, 256> anchor_offsets {};
+    for (auto const& [type, description] : descriptions)
+    {
+        for (auto const& el : description.elements)
+        {
+            if (el.type == payload_type::file_time && el.size == sizeof(uint64_t))
+            {
+                anchor_offsets[type].push_back(el.offset);
+            }
+        }
+    }
+    return anchor_offsets;
+}
+
+
+//! \brief Reconstructs a timestamp for every packet of a sensor log.
+//!
+//! \param[in] directory    All packets of a sensor log in natural order.
+//! \param[in] descriptions The packet descriptions. Every `file_time` element
+//!                         of a described packet type is a potential time
+//!                         anchor (e.g. [TIMESTAMP] packets, as well as types
+//!                         `0x0d`, `0xe0`, and `0xe1`).
+//!
+//! \return The time column, or `nullopt` if the log doesn't contain a single
+//!         valid time anchor.
+//!
+//! \remark Timestamps that aren't plausible (like the `0xFFFFFFFF'FFFFFFFF`
+//!         markers) are ignored. Packets between two anchors are interpolated
+//!         linearly by packet index. Packets before the first (after the last)
+//!         anchor receive the time of the first (last) anchor. If time runs
+//!         backwards between two anchors, the earlier anchor's time is held.
+//!
+[[nodiscard]] inline ::std::optional<time_column> build_time_column(::std::span<data_proxy const> const directory,
+                                                                    ::payload_container const& descriptions)
+{
+    auto const anchor_offsets { ::time_anchor_offsets(descriptions) };
 
-using payload_elements_container = ::std::vector<::payload_element>;
+    // Collect anchors
+    ::std::vector<::std::pair<size_t, uint64_t>> anchors {};
+    for (size_t index { 0 }; index < directory.size(); ++index)
+    {
+        auto const& packet { directory[index] };
+        for (auto const offset : anchor_offsets[packet.type()])
+        {
+            if (offset + sizeof(uint64_t) <= packet.payload_size())
+            {
+                auto const time { packet.value<uint64_t>(offset) };
+                if (::is_plausible_timestamp(time))
+                {
+                    anchors.emplace_back(index, time);
+                    break;
+                }
+            }
+        }
+    }
 
-struct packet_description
-{
-    ::std::optional<::std::wstring> name;
-    // TODO: Add field to allow users to provide a confidence level (unknown .. known beyond doubt)
-    ::payload_elements_container elements;
-};
+    if (anchors.empty())
+    {
+        return {};
+    }
+
+    // Interpolate
+    time_column column {};
+    size_t index { 0 };
+    for (; index < anchors.front().first; ++index)
+    {
+        column.push_back(anchors.front().second);
+    }
+    for (size_t a { 0 }; a + 1 < anchors.size(); ++a)
+    {
+        auto const [from_index, from_time] { anchors[a] };
+        auto const [to_index, to_time] { anchors[a + 1] };
+        auto const span { to_index - from_index };
+        auto const time_span { to_time > from_time ? to_time - from_time : 0 };
+        for (; index < to_index; ++index)
+        {
+            auto const step { index - from_index };
+            // Split the multiplication to avoid overflowing on large spans
+            column.push_back(from_time + time_span / span * step + time_span % span * step / span);
+        }
+    }
+    for (; index < directory.size(); ++index)
+    {
+        column.push_back(anchors.back().second);
+    }
+
+    column.shrink_to_fit();
+    return column;
+}
 
-using payload_container = ::std::map<unsigned char, ::packet_description>;
 
+// Sorts packet indices (natural order) by a predicate. Sorting is stable, so packets that compare equal remain in the
+// order given.
+inline void sort_packet_indices(::std::span<data_proxy const> const directory, ::std::vector<size_t>& indices,
+                                sort_predicate const pred, sort_direction const dir)
+{
+    // Special-case sorting by index
+    switch (pred)
+    {
+    case sort_predicate::index:
+        if (dir == sort_direction::desc)
+        {
+            ::std::reverse(begin(indices), end(indices));
+        }
+        // Nothing to do for index/asc
+        break;
+
+    case sort_predicate::type:
+        ::std::stable_sort(begin(indices), end(indices), [&](size_t const lhs, size_t const rhs) {
+            return (dir == sort_direction::asc) ? directory[lhs].type() < directory[rhs].type()
+                                                : directory[lhs].type() > directory[rhs].type();
+        });
+        break;
+
+    case sort_predicate::size:
+        ::std::stable_sort(begin(indices), end(indices), [&](size_t const lhs, size_t const rhs) {
+            return (dir == sort_direction::asc) ? directory[lhs].payload_size() < directory[rhs].payload_size()
+                                                : directory[lhs].payload_size() > directory[rhs].payload_size();
+        });
+        break;
+
+    default:
+        assert(!"Unexpected sort_predicate; update this function whenever sort_predicate changes.");
+        break;
+    }
+}
 
-NLOHMANN_JSON_SERIALIZE_ENUM(::payload_type, { { ::payload_type::unknown, nullptr },
-                                               { ::payload_type::ui8, "ui8" },
-                                               { ::payload_type::ui16, "ui16" },
-                                               { ::payload_type::ui32, "ui32" },
-                                               { ::payload_type::file_time, "file_time" } })
+
+// Immutable snapshot of a model's filter and sort order. Sorting and filtering publish a new snapshot rather than
+// modifying the current one, so readers that hold on to a snapshot see a consistent view without taking any locks.
+// Snapshots with the same filter (or the same order) share the underlying containers.
+//
+// The filter is the intersection of a packet type filter and an optional selection (e.g. the result of a
+// `packet_filter`), both kept as bitmaps. Only `sort_map` holds one index per packet; it's materialized last.
+struct model_view
+{
+    // Packet types passing the filter (`nullopt` for all packets)
+    ::std::optional<::std::bitset<256>> types;
+    // Packets passing the filter in addition to `types` (`nullptr` for all packets)
+    ::std::shared_ptr<packet_bitmap const> selection;
+    sort_predicate pred { sort_predicate::index };
+    sort_direction dir { sort_direction::asc };
+    // Incremented with every published snapshot
+    uint64_t version { 0 };
+    // Packets of `types`
+    ::std::shared_ptr<packet_bitmap const> type_filter;
+    // Packets passing the filter, i.e. `type_filter` intersected with `selection`
+    ::std::shared_ptr<packet_bitmap const> filter;
+    // `filter` in sort order
+    ::std::shared_ptr<::std::vector<size_t> const> sort_map;
+
+    [[nodiscard]] size_t packet_count() const noexcept { return sort_map->size(); }
+
+    // Returns the index in natural order of the packet at `row` (after filtering and sorting is applied)
+    [[nodiscard]] size_t packet_index(size_t const row) const noexcept
+    {
+        assert(row < sort_map->size());
+        return (*sort_map)[row];
+    }
+};
 
 
 // Declare actual model for use by clients
 struct model
 {
-    explicit model(wchar_t const* path_name) : data_ { path_name }
+    explicit model(wchar_t const* path_name)
+        : model { path_name, ::load_packet_descriptions_cached(::default_packet_descriptions_path()) }
     {
-        // Initialize filter
-        filter_.resize(data_.directory().size());
-        ::std::iota(begin(filter_), end(filter_), 0);
+    }
 
-        // TEMP --- VVV --- Filtering on a specific date/time range
-        // auto const tp_from { ::to_uint(::to_filetime(2019, 5, 30, 6, 0, 0)) };
-        // auto const tp_to { ::to_uint(::to_filetime(2019, 5, 30, 7, 0, 0)) };
+    // Constructs a model from an in-memory copy of a sensor log (e.g. decoded from a columnar archive)
+    explicit model(::std::vector<unsigned char> buffer)
+        : model { ::std::move(buffer), ::load_packet_descriptions_cached(::default_packet_descriptions_path()) }
+    {
+    }
 
-        // size_t index_from { 0 };
-        // size_t index_to { data_.directory().size() };
+    // Constructs a model with explicit packet descriptions, for clients that don't ship next to
+    // `packet_descriptions.json` (e.g. language bindings). `observer` receives progress while the directory is built
+    // (see `log_loader`).
+    model(wchar_t const* path_name, ::payload_container descriptions, directory_observer const& observer = {})
+        : data_ { path_name, observer }, packet_descriptions_ { ::std::move(descriptions) }
+    {
+        initialize();
+    }
 
-        // size_t index_current { 0 };
-        // for (auto const& packet : data_.directory())
-        //{
-        //    // Filter on [TIMESTAMP] packets only for now
-        //    if (packet.type() == 0x0)
-        //    {
-        //        auto const time_stamp { *reinterpret_cast<uint64_t const*>(packet.data() + packet.header_size()) };
+    model(::std::vector<unsigned char> buffer, ::payload_container descriptions,
+          directory_observer const& observer = {})
+        : data_ { ::std::move(buffer), observer }, packet_descriptions_ { ::std::move(descriptions) }
+    {
+        initialize();
+    }
 
-        //        if (time_stamp < tp_from)
-        //        {
-        //            index_from = index_current;
-        //        }
+    model(::std::shared_ptr<log_memory const> memory, ::payload_container descriptions,
+          directory_observer const& observer = {})
+        : data_ { ::std::move(memory), observer }, packet_descriptions_ { ::std::move(descriptions) }
+    {
+        initialize();
+    }
 
-        //        if (time_stamp >= tp_to)
-        //        {
-        //            index_to = index_current;
-        //            break;
-        //        }
-        //    }
+    // Returns the current filter and sort order. Clients that access several packets (e.g. to fill a list or render a
+    // graph) should hold on to a single snapshot rather than calling `packet()` repeatedly, as the view may be replaced
+    // concurrently.
+    [[nodiscard]] ::std::shared_ptr<model_view const> view() const noexcept
+    {
+        return view_.load(::std::memory_order_acquire);
+    }
 
-        //    ++index_current;
-        //}
+    // Returns packet at index applying the current sort map
+    [[nodiscard]] auto const& packet(size_t const index) const noexcept
+    {
+        auto const mapped_index { view()->packet_index(index) };
+        assert(mapped_index < data_.directory().size());
+        return data_.directory()[mapped_index];
+    }
 
-        // filter_.resize(index_to - index_from);
-        //::std::iota(begin(filter_), end(filter_), index_from);
-        // TEMP --- AAA
+    // Returns the mapped index (after filtering and sorting is applied)
+    [[nodiscard]] auto packet_index(size_t const index) const noexcept { return view()->packet_index(index); }
+
+    [[nodiscard]] auto packet_count() const noexcept { return view()->packet_count(); }
 
-        // Initialize sort mapping
-        sort_map_ = filter_;
-
-        // Read (known) packet descriptions from JSON file. The JSON file needs to have the following layout:
-
-        // { "descriptions": [
-        //   { "type": "0x00",      /* type: string (needs to be a string due to numbers not supporting hex) */
-        //     "name": "[name]",    /* name: string (optional) */
-        //     "elements": [
-        //       { "offset": 0,     /* offset: number */
-        //         "length": 8,     /* length: number */
-        //         "display_type": "file_time",     /* display_type: string (serialized ::payload_type enumeration) */
-        //         "comment": "<some comment>"      /* comment: string (optional) */
-        //       },
-        //       ...
-        //     ]
-        //   },
-        //   ...
-        // ]}
-
-        // TODO: Prepend with executable path
-        auto ifs { ::std::ifstream { L"packet_descriptions.json" } };
-        ::nlohmann::json j {};
-        ifs >> j;
-        for (auto const& descr : j.at("descriptions"))
+    // Returns the (reconstructed) timestamp of the packet at index applying the current sort map. Returns `nullopt` if
+    // the log doesn't contain any valid time information.
+    [[nodiscard]] ::std::optional<uint64_t> packet_time(size_t const index) const noexcept
+    {
+        if (!time_column_)
         {
-            // Read index; this is stored as a string because JSON doesn't support hexadecimal encoding.
-            size_t const index { static_cast<size_t const>(::std::stoll(descr.at("type").get<::std::string>(), 0, 0)) };
-            auto& packet_description { packet_descriptions_[static_cast<uint8_t>(index)] };
+            return {};
+        }
+        return (*time_column_)[packet_index(index)];
+    }
+
+    // Returns the per-packet timestamps in natural order (if available)
+    [[nodiscard]] auto const& time_column() const noexcept { return time_column_; }
 
-            // Set optional name
-            if (auto name_it { descr.find("name") }; name_it != end(descr))
+    // auto& data() noexcept { return data_; }
+    // auto const& data() const noexcept { return data_; }
+    // Returns all packets in natural order (ignoring filtering and sorting)
+    [[nodiscard]] auto const& directory() const noexcept { return data_.directory(); }
+    // Returns the raw sensor log, including any trailing bytes not covered by the directory
+    [[nodiscard]] auto bytes() const noexcept { return data_.bytes(); }
+    [[nodiscard]] auto const& packet_descriptions() const noexcept { return packet_descriptions_; }
+
+    // Replaces the packet descriptions (e.g. after `packet_descriptions.json` changed). Returns the packet types whose
+    // descriptions changed; data derived from any other packet type remains valid.
+    ::std::bitset<256> update_packet_descriptions(::payload_container descriptions)
+    {
+        auto const changed { ::changed_packet_types(packet_descriptions_, descriptions) };
+        if (changed.none())
+        {
+            return changed;
+        }
+
+        // Time anchors are `file_time` elements; the time column only needs rebuilding if those moved
+        auto const has_time_anchor = [&](::payload_container const& container) {
+            for (auto const& [type, description] : container)
             {
-                packet_description.name = ::to_utf16(name_it->get<::std::string>());
+                if (changed.test(type)
+                    && ::std::any_of(begin(description.elements), end(description.elements),
+                                     [](auto const& el) { return el.type == payload_type::file_time; }))
+                {
+                    return true;
+                }
             }
+            return false;
+        };
+        auto const rebuild_time_column { has_time_anchor(packet_descriptions_) || has_time_anchor(descriptions) };
 
-            // Append elements list
-            for (auto const& element : descr.at("elements"))
+        packet_descriptions_ = ::std::move(descriptions);
+        for (size_t type { 0 }; type < changed.size(); ++type)
+        {
+            if (changed.test(type))
             {
-                auto const offset { element.at("offset").get<size_t>() };
-                auto const length { element.at("length").get<size_t>() };
-                auto const display_type { element.at("display_type").get<::payload_type>() };
-                auto const comment { element.contains("comment") ? ::std::optional<::std::wstring> { ::to_utf16(
-                                         element.at("comment").get<::std::string>()) }
-                                                                 : ::std::nullopt };
-
-                packet_description.elements.emplace_back(::payload_element { offset, length, display_type, comment });
+                ++description_generations_[type];
             }
         }
+        if (rebuild_time_column)
+        {
+            time_column_ = ::build_time_column(data_.directory(), packet_descriptions_);
+        }
+        return changed;
     }
 
-    // Returns packet at index applying the current sort map
-    [[nodiscard]] auto const& packet(size_t const index) const noexcept
+    // Returns a counter that is incremented whenever the description of a packet type changes. Caches of data derived
+    // from a packet's description (e.g. rendered strings) compare this against the value they were built with.
+    [[nodiscard]] auto description_generation(unsigned char const type) const noexcept
     {
-        assert(index < sort_map_.size());
-        auto const mapped_index { sort_map_[index] };
-        assert(mapped_index < data_.directory().size());
-        return data_.directory()[mapped_index];
+        return description_generations_[type];
     }
 
-    // Returns the mapped index (after filtering and sorting is applied)
-    [[nodiscard]] auto packet_index(size_t const index) const noexcept
+    // Returns the packets of a type (natural order). The index is built for all types on first use.
+    [[nodiscard]] packet_bitmap const& type_bitmap(unsigned char const type) const
     {
-        assert(index < sort_map_.size());
-        return sort_map_[index];
+        ::std::call_once(type_bitmaps_built_, [this] {
+            trace_span const span { "model::type_bitmaps" };
+            auto const& directory { data_.directory() };
+            for (size_t index { 0 }; index < directory.size(); ++index)
+            {
+                type_bitmaps_[directory[index].type()].push_back(index);
+            }
+        });
+        return type_bitmaps_[type];
     }
 
-    [[nodiscard]] auto packet_count() const noexcept { return sort_map_.size(); }
+    // Returns the packets of a set of types (natural order)
+    [[nodiscard]] packet_bitmap type_bitmap(::std::bitset<256> const& types) const
+    {
+        // Unite the smaller set of types (filters that hide a few types are common)
+        auto const invert { types.count() > types.size() / 2 };
+        packet_bitmap result {};
+        for (size_t type { 0 }; type < types.size(); ++type)
+        {
+            if (types.test(type) != invert)
+            {
+                result = result | type_bitmap(static_cast<unsigned char>(type));
+            }
+        }
+        return invert ? result.complement(directory().size()) : result;
+    }
 
-    // auto& data() noexcept { return data_; }
-    // auto const& data() const noexcept { return data_; }
-    [[nodiscard]] auto const& packet_descriptions() const noexcept { return packet_descriptions_; }
+    // Computes a view with the given filter and sort order, reusing whatever `base` has in common with it. Changing
+    // either part of the filter costs a single set operation if the other part is unchanged. This doesn't modify the
+    // model and is safe to call from any thread; see `publish_view()`.
+    [[nodiscard]] ::std::shared_ptr<model_view const> make_view(model_view const& base,
+                                                                ::std::optional<::std::bitset<256>> const& types,
+                                                                ::std::shared_ptr<packet_bitmap const> selection,
+                                                                sort_predicate const pred,
+                                                                sort_direction const dir) const
+    {
+        trace_span const span { "model::make_view" };
+
+        auto next { ::std::make_shared<model_view>() };
+        next->types = types;
+        next->selection = ::std::move(selection);
+        next->pred = pred;
+        next->dir = dir;
+        next->version = base.version + 1;
+
+        if (types == base.types)
+        {
+            next->type_filter = base.type_filter;
+        }
+        else
+        {
+            next->type_filter = ::std::make_shared<packet_bitmap const>(
+                types ? type_bitmap(*types) : packet_bitmap::range(0, directory().size()));
+        }
+
+        if (next->type_filter == base.type_filter && next->selection == base.selection)
+        {
+            next->filter = base.filter;
+        }
+        else if (!next->selection)
+        {
+            next->filter = next->type_filter;
+        }
+        else
+        {
+            next->filter = ::std::make_shared<packet_bitmap const>(*next->type_filter & *next->selection);
+        }
+
+        if (next->filter == base.filter && pred == base.pred && dir == base.dir)
+        {
+            next->sort_map = base.sort_map;
+        }
+        else
+        {
+            auto sort_map { next->filter->to_vector() };
+            if (pred != sort_predicate::index || dir != sort_direction::asc)
+            {
+                ::sort_packet_indices(data_.directory(), sort_map, pred, dir);
+            }
+            next->sort_map = ::std::make_shared<::std::vector<size_t> const>(::std::move(sort_map));
+        }
+        return next;
+    }
+
+    // Computes a view with the given type filter and sort order, keeping the selection of `base`
+    [[nodiscard]] ::std::shared_ptr<model_view const> make_view(model_view const& base,
+                                                                ::std::optional<::std::bitset<256>> const& types,
+                                                                sort_predicate const pred,
+                                                                sort_direction const dir) const
+    {
+        return make_view(base, types, base.selection, pred, dir);
+    }
+
+    // Replaces the current view with `next`, unless a different view was published since `expected` was read. Returns
+    // whether `next` was published.
+    bool publish_view(::std::shared_ptr<model_view const> expected, ::std::shared_ptr<model_view const> next) noexcept
+    {
+        return view_.compare_exchange_strong(expected, ::std::move(next), ::std::memory_order_acq_rel);
+    }
 
     // Apply sorting
     // Defaults to natural sorting (sequential order as in the raw binary data)
     void sort(sort_predicate const pred = sort_predicate::index, sort_direction const dir = sort_direction::asc)
     {
-        assert(filter_.size() > 0 && filter_.size() <= data_.directory().size());
-        // Initialize sort map
-        sort_map_ = filter_;
-        // Special-case sorting by index
-        switch (pred)
+        trace_span const span { "model::sort" };
+        for (;;)
+        {
+            auto const base { view() };
+            if (publish_view(base, make_view(*base, base->types, pred, dir)))
+            {
+                return;
+            }
+        }
+    }
+
+    // Apply filtering, keeping the current sort order. Pass `nullopt` to show all packets.
+    void filter(::std::optional<::std::bitset<256>> const& types)
+    {
+        for (;;)
         {
-        case sort_predicate::index:
-            if (dir == sort_direction::desc)
+            auto const base { view() };
+            if (publish_view(base, make_view(*base, types, base->pred, base->dir)))
             {
-                ::std::reverse(begin(sort_map_), end(sort_map_));
+                return;
+            }
+        }
+    }
+
+    // Restrict the view to a selection of packets in addition to the type filter, keeping the current sort order.
+    // Pass `nullptr` to remove the selection.
+    void select(::std::shared_ptr<packet_bitmap const> const& selection)
+    {
+        for (;;)
+        {
+            auto const base { view() };
+            if (publish_view(base, make_view(*base, base->types, selection, base->pred, base->dir)))
+            {
+                return;
             }
-            // Nothing to do for index/asc
-            break;
-
-        case sort_predicate::type:
-            ::std::stable_sort(begin(sort_map_), end(sort_map_), [&](size_t const lhs, size_t const rhs) {
-                return (dir == sort_direction::asc) ? data_.directory()[lhs].type() < data_.directory()[rhs].type()
-                                                    : data_.directory()[lhs].type() > data_.directory()[rhs].type();
-            });
-            break;
-
-        case sort_predicate::size:
-            ::std::stable_sort(begin(sort_map_), end(sort_map_), [&](size_t const lhs, size_t const rhs) {
-                return (dir == sort_direction::asc)
-                           ? data_.directory()[lhs].payload_size() < data_.directory()[rhs].payload_size()
-                           : data_.directory()[lhs].payload_size() > data_.directory()[rhs].payload_size();
-            });
-            break;
-
-        default:
-            assert(!"Unexpected sort_predicate; update this method whenever sort_predicate changes.");
-            break;
         }
     }
 
 private:
+    void initialize()
+    {
+        // Initialize filter
+        auto filter { packet_bitmap::range(0, data_.directory().size()) };
+
+        // TEMP --- VVV --- Filtering on a specific date/time range
+        // auto const tp_from { ::to_uint(::to_filetime(2019, 5, 30, 6, 0, 0)) };
+        // auto const tp_to { ::to_uint(::to_filetime(2019, 5, 30, 7, 0, 0)) };
+
+        // size_t index_from { 0 };
+        // size_t index_to { data_.directory().size() };
+
+        // size_t index_current { 0 };
+        // for (auto const& packet : data_.directory())
+        //{
+        //    // Filter on [TIMESTAMP] packets only for now
+        //    if (packet.type() == 0x0)
+        //    {
+        //        auto const time_stamp { *reinterpret_cast<uint64_t const*>(packet.data() + packet.header_size()) };
+
+        //        if (time_stamp < tp_from)
+        //        {
+        //            index_from = index_current;
+        //        }
+
+        //        if (time_stamp >= tp_to)
+        //        {
+        //            index_to = index_current;
+        //            break;
+        //        }
+        //    }
+
+        //    ++index_current;
+        //}
+
+        // filter = packet_bitmap::range(index_from, index_to);
+        // TEMP --- AAA
+
+        // Initialize sort mapping (natural order)
+        auto initial { ::std::make_shared<model_view>() };
+        initial->type_filter = ::std::make_shared<packet_bitmap const>(::std::move(filter));
+        initial->filter = initial->type_filter;
+        initial->sort_map = ::std::make_shared<::std::vector<size_t> const>(initial->filter->to_vector());
+        view_.store(::std::move(initial), ::std::memory_order_release);
+
+        // Reconstruct per-packet timestamps
+        trace_span const span { "build_time_column" };
+        time_column_ = ::build_time_column(data_.directory(), packet_descriptions_);
+    }
+
     raw_data data_;
     payload_container packet_descriptions_;
-    // Sorted (and filtered) index container
-    ::std::vector<size_t> sort_map_;
-    // Filtered index container (this will be used for sorting again)
-    ::std::vector<size_t> filter_;
+    // Reconstructed timestamps in natural order
+    ::std::optional<::time_column> time_column_;
+    ::std::array<uint32_t, 256> description_generations_ {};
+    // Packets per type, see `type_bitmap()`
+    mutable ::std::once_flag type_bitmaps_built_;
+    mutable ::std::array<packet_bitmap, 256> type_bitmaps_ {};
+    // Current filter and sort order
+    ::std::atomic<::std::shared_ptr<model_view const>> view_;
 };
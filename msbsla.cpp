@@ -2,11 +2,23 @@
 
 #include "framework.h"
 
+#include "chunk_store.h"
 #include "control_utils.h"
+#include "description_watcher.h"
+#include "diagram_tiles.h"
 #include "display_utils.h"
+#include "graph_definitions.h"
+#include "log_loader.h"
 #include "log_utils.h"
 #include "model.h"
+#include "query_server.h"
+#include "row_cache.h"
+#include "session_segmentation.h"
+#include "sparse_log.h"
+#include "timeseries_store.h"
+#include "tracing.h"
 #include "utils.h"
+#include "view_worker.h"
 
 #include <wil/com.h>
 #include <wil/resource.h>
@@ -16,12 +28,21 @@
 #include <Windows.h>
 #include <windowsx.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <filesystem>
+#include <format>
+#include <fstream>
+#include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string_view>
 #include <utility>
+#include <vector>
 #include <wchar.h>
 
 
@@ -48,6 +69,16 @@ enum class packet_col
 
 // Constants
 constexpr auto k_diagram_height { 120 };
+// Posted by the description watcher after `packet_descriptions.json` was reloaded
+constexpr UINT WM_APP_DESCRIPTIONS_CHANGED { WM_APP + 1 };
+// Posted by the view worker after a new sort order was published
+constexpr UINT WM_APP_VIEW_CHANGED { WM_APP + 2 };
+// Posted by the log loader after parsing advanced
+constexpr UINT WM_APP_LOAD_PROGRESS { WM_APP + 3 };
+// Posted by the log loader once the model is available (or loading failed)
+constexpr UINT WM_APP_LOAD_COMPLETED { WM_APP + 4 };
+// Posted by the diagram renderer after a requested tile was rendered
+constexpr UINT WM_APP_TILES_READY { WM_APP + 5 };
 
 
 // Local data
@@ -61,6 +92,55 @@ static HWND g_lv_packets_handle { nullptr };
 static RECT g_rc_diagram {};
 
 ::std::unique_ptr<model> g_spModel { nullptr };
+// Loads the selected log in the background; `g_spModel` is set once it completes
+static ::std::unique_ptr<log_loader> g_spLoader { nullptr };
+// Packets parsed so far while `g_spLoader` is running, displayed until the model is available
+static ::std::optional<load_progress> g_load_progress {};
+// Progress and result of `g_spLoader`, waiting to be picked up by the UI thread
+static ::std::mutex g_pending_load_lock {};
+static ::std::optional<load_progress> g_pending_load_progress {};
+static ::std::unique_ptr<model> g_pending_model { nullptr };
+static ::std::unique_ptr<sparse_log> g_pending_sparse_log { nullptr };
+// Logs whose model would exceed this budget are opened as `g_spSparseLog` instead (`--index-budget=MB`)
+static size_t g_index_budget { k_default_index_budget };
+// Loaded log if it's too large for `g_spModel`; listed in natural order only (no sorting, diagram or query server)
+static ::std::unique_ptr<sparse_log> g_spSparseLog { nullptr };
+// Rendered rows of `g_spModel`; needs to be destroyed before the model
+static ::std::unique_ptr<row_cache> g_spRowCache { nullptr };
+// Sorts `g_spModel` in the background; needs to be destroyed before the model
+static ::std::unique_ptr<view_worker> g_spViewWorker { nullptr };
+// Filter and sort order of `g_spModel` as currently displayed. The UI thread only ever reads through this snapshot, so
+// the list view and the diagram stay consistent while the view worker publishes a new one.
+static ::std::shared_ptr<model_view const> g_spView { nullptr };
+// Serves `g_spModel` over HTTP when requested on the command line (`--serve=PORT`); needs to be destroyed before the
+// model
+static ::std::unique_ptr<query_server> g_spQueryServer { nullptr };
+static ::std::optional<uint16_t> g_query_server_port {};
+
+static ::std::unique_ptr<description_watcher> g_spDescriptionWatcher { nullptr };
+// Descriptions reloaded by the watcher thread, waiting to be picked up by the UI thread
+static ::std::mutex g_pending_descriptions_lock {};
+static ::std::optional<payload_container> g_pending_descriptions {};
+
+// Renders the diagram area of `g_spView`; needs to be destroyed before the model. Recreated whenever the view or the
+// size of the diagram area changes.
+static ::std::unique_ptr<diagram_tiles> g_spDiagram { nullptr };
+// Anomalies of the model's fields, shared by successive renderers so they aren't detected again whenever the renderer
+// is recreated; needs to be destroyed before the model
+static ::std::shared_ptr<anomaly_cache> g_spAnomalies { nullptr };
+static diagram_axis g_diagram_axis { diagram_axis::index };
+// Graphs displayed in the diagram area, read from `graph_definitions.json` on startup
+static graph_definitions g_graph_definitions {};
+// Zoom level and horizontal scroll position (in pixels at that level) of the diagram area
+static int g_diagram_level { 0 };
+static int64_t g_diagram_pan { 0 };
+// Cursor position and scroll position when the left mouse button went down over the diagram area, while dragging
+static ::std::optional<POINT> g_diagram_drag_origin {};
+static int64_t g_diagram_drag_pan { 0 };
+static bool g_diagram_dragged { false };
+
+// Trace written on exit when requested on the command line (`--trace=PATH`)
+static ::std::optional<fs::path> g_trace_path {};
 
 
 struct log_info
@@ -72,6 +152,73 @@ struct log_info
 
 // Local functions
 
+// Returns the value of a `--name=value` command line option, if `argument` is one
+[[nodiscard]] static ::std::optional<::std::wstring_view> option_value(::std::wstring_view const argument,
+                                                                      ::std::wstring_view const prefix) noexcept
+{
+    if (!argument.starts_with(prefix))
+    {
+        return {};
+    }
+    return argument.substr(prefix.size());
+}
+
+
+// Parses a decimal command line option value; fails on anything but digits, and on overflow
+[[nodiscard]] static ::std::optional<uint64_t> parse_option_number(::std::wstring_view const value) noexcept
+{
+    if (value.empty())
+    {
+        return {};
+    }
+    uint64_t result { 0 };
+    for (auto const c : value)
+    {
+        if (c < L'0' || c > L'9')
+        {
+            return {};
+        }
+        auto const digit { static_cast<uint64_t>(c - L'0') };
+        if (result > (::std::numeric_limits<uint64_t>::max() - digit) / 10)
+        {
+            return {};
+        }
+        result = result * 10 + digit;
+    }
+    return result;
+}
+
+
+// Cancels a load in progress and releases the loaded document along with everything referencing it
+static void close_document()
+{
+    // Reset virtual list view size first, so we can safely reset the
+    // loaded document (`g_spModel`)
+    ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, 0, 0);
+
+    // Joins the loader thread, so no more progress or results are reported
+    g_spLoader.reset(nullptr);
+    g_load_progress.reset();
+    {
+        ::std::scoped_lock lock { g_pending_load_lock };
+        g_pending_load_progress.reset();
+        g_pending_model.reset(nullptr);
+        g_pending_sparse_log.reset(nullptr);
+    }
+
+    // At this point no one is holding any references into the document
+    // anymore so we can delete it
+    g_spQueryServer.reset(nullptr);
+    g_spViewWorker.reset(nullptr);
+    g_spRowCache.reset(nullptr);
+    g_spDiagram.reset(nullptr);
+    g_spAnomalies.reset();
+    g_spView.reset();
+    g_spModel.reset(nullptr);
+    g_spSparseLog.reset(nullptr);
+}
+
+
 //! \brief Opens a folder picker dialog and returns the user's choice.
 //!
 //! \param[in,opt] owner The owner window for the modal folder picker dialog. If
@@ -308,10 +455,10 @@ static bool handle_sorting(HWND const header, size_t const col_index)
     // Update visual cues on the header control
     ::set_header_sorting(header, col_index, next_sorting_order);
 
-    // Sort the collection
+    // Sort the collection in the background; the list view is refreshed once the new order is published
     if (next_sorting_order == ::sort_order::none)
     {
-        g_spModel->sort();
+        g_spViewWorker->sort(::sort_predicate::index, ::sort_direction::asc);
     }
     else
     {
@@ -319,7 +466,7 @@ static bool handle_sorting(HWND const header, size_t const col_index)
         // point.
         auto const pred { static_cast<::sort_predicate>(col_index) };
         auto const order { next_sorting_order == sort_order::asc ? ::sort_direction::asc : ::sort_direction::desc };
-        g_spModel->sort(pred, order);
+        g_spViewWorker->sort(pred, order);
     }
 
     return true;
@@ -449,58 +596,97 @@ static void set_packets_list_column_widths(HWND const packets_list)
 }
 
 
-template <typename T>
-void render_graph(HDC const hdc, RECT const& rect, COLORREF const color, model const& m,
-                  unsigned char const packet_type, size_t const offset) noexcept
+// Returns the diagram area without its frame
+[[nodiscard]] static RECT diagram_inner_rect() noexcept
 {
-    ::std::vector<size_t> indexes {};
-    for (size_t i { 0 }; i < m.packet_count(); ++i)
-    {
-        if (m.packet(i).type() == packet_type)
-        {
-            indexes.push_back(i);
-        }
-    }
+    return { g_rc_diagram.left + 1, g_rc_diagram.top + 1, g_rc_diagram.right - 1, g_rc_diagram.bottom - 1 };
+}
 
-    if (indexes.size() > 0)
-    {
-        // Find min/max values
-        auto [min_it, max_it] { ::std::minmax_element(begin(indexes), end(indexes),
-                                                      [&m = m, offset](auto const lhs, auto const rhs) {
-                                                          auto const val_lhs { m.packet(lhs).value<T>(offset) };
-                                                          auto const val_rhs { m.packet(rhs).value<T>(offset) };
 
-                                                          return val_lhs < val_rhs;
-                                                      }) };
-        auto const min_val { m.packet(*min_it).value<T>(offset) };
-        auto const max_val { m.packet(*max_it).value<T>(offset) };
+// Keeps zoom level and scroll position within the range of the current renderer
+static void clamp_diagram_viewport() noexcept
+{
+    g_diagram_level = ::std::clamp(g_diagram_level, 0, g_spDiagram->max_level());
+    auto const max_pan { ::std::max(g_spDiagram->level_width(g_diagram_level) - g_spDiagram->width(), int64_t { 0 }) };
+    g_diagram_pan = ::std::clamp(g_diagram_pan, int64_t { 0 }, max_pan);
+}
 
-        // Render graph
-        auto const w { ::width(rect) - 2 };
-        auto const h { ::height(rect) - 2 };
-        auto const value_range { max_val - min_val };
 
-        if (value_range != 0)
-        {
-            auto x { rect.left + 1 + ::MulDiv(static_cast<int>(indexes[0]), w, static_cast<int>(m.packet_count())) };
-            auto val { m.packet(indexes[0]).value<T>(offset) };
-            auto y { rect.bottom - 1 - ::MulDiv(val - min_val, h, value_range) };
-            ::MoveToEx(hdc, x, y, nullptr);
+// (Re-)creates the diagram renderer if it doesn't match the current view or size of the diagram area. Returns `false`
+// if there's nothing to display.
+static bool ensure_diagram()
+{
+    if (!g_spModel || !g_spView)
+    {
+        return false;
+    }
+    auto const inner { diagram_inner_rect() };
+    if (!g_spDiagram || g_spDiagram->view() != g_spView || g_spDiagram->width() != ::width(inner)
+        || g_spDiagram->height() != ::height(inner))
+    {
+        // Join the previous renderer's thread before starting another one
+        g_spDiagram.reset(nullptr);
+        g_spDiagram = ::std::make_unique<diagram_tiles>(
+            *g_spModel, g_spView, ::resolve_diagram_series(g_graph_definitions, g_spModel->packet_descriptions()),
+            g_diagram_axis, ::width(inner), ::height(inner),
+            [] { ::PostMessageW(g_main_dlg_handle, WM_APP_TILES_READY, 0, 0); }, diagram_tiles::k_default_capacity,
+            g_spAnomalies);
+    }
+    clamp_diagram_viewport();
+    return true;
+}
 
-            auto const prev_pen { SelectPen(hdc, ::GetStockObject(DC_PEN)) };
-            ::SetDCPenColor(hdc, color);
 
-            for (size_t i { 1 }; i < indexes.size(); ++i)
+// Blits the visible tiles of the current zoom level. Tiles that haven't been rendered yet are approximated by
+// stretching tiles of coarser levels, and requested from the renderer.
+static void paint_diagram(HDC const hdc)
+{
+    trace_span const span { "paint_diagram" };
+
+    auto& tiles { *g_spDiagram };
+    auto const inner { diagram_inner_rect() };
+    auto const tile_width { diagram_tiles::k_tile_width };
+    auto const first { g_diagram_pan / tile_width };
+    auto const last { (g_diagram_pan + tiles.width() - 1) / tile_width };
+    // Prefetch the neighboring tiles, so panning doesn't reveal empty space
+    tiles.request(g_diagram_level, first - 1, last + 1);
+
+    BITMAPINFO bmi {};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = tile_width;
+    // Top-down
+    bmi.bmiHeader.biHeight = -tiles.height();
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    auto const saved_dc { ::SaveDC(hdc) };
+    ::IntersectClipRect(hdc, inner.left, inner.top, inner.right, inner.bottom);
+    ::SetStretchBltMode(hdc, COLORONCOLOR);
+    for (auto column { first }; column <= last; ++column)
+    {
+        auto const x { inner.left + static_cast<int>(column * tile_width - g_diagram_pan) };
+        if (auto const tile { tiles.cached(g_diagram_level, column) }; tile)
+        {
+            ::StretchDIBits(hdc, x, inner.top, tile_width, tiles.height(), 0, 0, tile_width, tiles.height(),
+                            tile->pixels.data(), &bmi, DIB_RGB_COLORS, SRCCOPY);
+            continue;
+        }
+        // Each coarser level covers this tile with half as many pixels
+        for (int coarser { g_diagram_level - 1 }; coarser >= 0 && g_diagram_level - coarser < 8; --coarser)
+        {
+            auto const shift { g_diagram_level - coarser };
+            auto const source_x { (column * tile_width) >> shift };
+            if (auto const tile { tiles.cached(coarser, source_x / tile_width) }; tile)
             {
-                x = rect.left + 1 + ::MulDiv(static_cast<int>(indexes[i]), w, static_cast<int>(m.packet_count()));
-                val = m.packet(indexes[i]).value<T>(offset);
-                y = rect.bottom - 1 - ::MulDiv(val - min_val, h, value_range);
-                ::LineTo(hdc, x, y);
+                ::StretchDIBits(hdc, x, inner.top, tile_width, tiles.height(), static_cast<int>(source_x % tile_width),
+                                0, tile_width >> shift, tiles.height(), tile->pixels.data(), &bmi, DIB_RGB_COLORS,
+                                SRCCOPY);
+                break;
             }
-
-            SelectPen(hdc, prev_pen);
         }
     }
+    ::RestoreDC(hdc, saved_dc);
 }
 
 
@@ -524,10 +710,58 @@ BOOL OnInitDialog(HWND hwnd, HWND /*hwndFocus*/, LPARAM /*lParam*/)
 
     // Populate sensor log list in case a directory is passed on the command
     // line (this is mainly intended to make debugging less cumbersome, as
-    // opposed to a well designed command line interface).
-    if (__argc >= 2)
+    // opposed to a well designed command line interface). `--serve=PORT`
+    // serves loaded logs to local clients over HTTP. `--index-budget=MB`
+    // sets the memory budget above which logs are opened in sparse mode.
+    // `--trace=PATH` records a Chrome trace that is written on exit.
+    // `--diagram-axis=time` plots the diagram over packet timestamps.
+    // `--render-tiles=DIR` renders the diagram, `--segment-sessions=DIR`
+    // segments a folder of logs, `--archive=STORE` adds a folder of logs to a
+    // chunk store, `--ingest-metrics=STORE` adds their elements to a time
+    // series store, and `--measure-load=DIR` times loading a log headlessly
+    // (see `wWinMain`).
+    // Invalid option values are ignored.
+    wchar_t const* log_dir { nullptr };
+    for (int arg { 1 }; arg < __argc; ++arg)
+    {
+        ::std::wstring_view const argument { __wargv[arg] };
+        if (auto const port_value { ::option_value(argument, L"--serve=") })
+        {
+            if (auto const port { ::parse_option_number(*port_value) }; port && *port <= 0xFFFF)
+            {
+                g_query_server_port = static_cast<uint16_t>(*port);
+            }
+        }
+        else if (auto const trace_value { ::option_value(argument, L"--trace=") })
+        {
+            g_trace_path = fs::path { *trace_value };
+            ::enable_tracing(true);
+        }
+        else if (argument == L"--diagram-axis=time")
+        {
+            g_diagram_axis = diagram_axis::time;
+        }
+        else if (auto const budget_value { ::option_value(argument, L"--index-budget=") })
+        {
+            constexpr uint64_t k_megabyte { 1024 * 1024 };
+            if (auto const megabytes { ::parse_option_number(*budget_value) };
+                megabytes && *megabytes > 0 && *megabytes <= ::std::numeric_limits<size_t>::max() / k_megabyte)
+            {
+                g_index_budget = static_cast<size_t>(*megabytes * k_megabyte);
+            }
+        }
+        else if (argument.starts_with(L"--"))
+        {
+            // Unknown options (e.g. misspelled ones) aren't taken for the log directory
+        }
+        else if (log_dir == nullptr)
+        {
+            log_dir = __wargv[arg];
+        }
+    }
+    if (log_dir != nullptr)
     {
-        populate_log_list(__wargv[1], g_lv_logs_handle);
+        populate_log_list(log_dir, g_lv_logs_handle);
     }
 
     // Set column(s) for logs list view
@@ -579,6 +813,27 @@ BOOL OnInitDialog(HWND hwnd, HWND /*hwndFocus*/, LPARAM /*lParam*/)
     //::SetWindowLongPtrW(lv_header, GWL_STYLE, header_style | HDS_FILTERBAR);
     // TEMP --- AAA
 
+    // Without graph definitions the diagram area stays empty
+    try
+    {
+        g_graph_definitions = ::load_graph_definitions(::default_graph_definitions_path().c_str());
+    }
+    CATCH_LOG();
+
+    // Watch packet descriptions for changes. Reloading is a convenience; failing to set up the watcher isn't fatal.
+    try
+    {
+        g_spDescriptionWatcher = ::std::make_unique<description_watcher>(
+            ::default_packet_descriptions_path(), [](payload_container descriptions) {
+                {
+                    ::std::scoped_lock lock { g_pending_descriptions_lock };
+                    g_pending_descriptions = ::std::move(descriptions);
+                }
+                ::PostMessageW(g_main_dlg_handle, WM_APP_DESCRIPTIONS_CHANGED, 0, 0);
+            });
+    }
+    CATCH_LOG();
+
     return TRUE;
 }
 
@@ -595,6 +850,8 @@ static void OnSize(HWND const hwnd, UINT const /*state*/, int const cx, int cons
 
 static void OnPaint(HWND hwnd)
 {
+    trace_span const span { "OnPaint" };
+
     PAINTSTRUCT ps {};
     auto const hdc { ::BeginPaint(hwnd, &ps) };
 
@@ -606,15 +863,9 @@ static void OnPaint(HWND hwnd)
     SelectBrush(hdc, prev_brush);
     SelectPen(hdc, prev_pen);
 
-    if (g_spModel)
+    if (ensure_diagram())
     {
-        // Unknown data
-        render_graph<uint16_t>(hdc, g_rc_diagram, RGB(0, 162, 232), *g_spModel, 0x42, 0);
-        // Heart rate
-        render_graph<uint8_t>(hdc, g_rc_diagram, RGB(210, 0, 0), *g_spModel, 0x80, 0);
-        render_graph<uint8_t>(hdc, g_rc_diagram, RGB(252, 209, 211), *g_spModel, 0x80, 1);
-        // Unknown data (apparently some cumulative sum)
-        render_graph<uint32_t>(hdc, g_rc_diagram, RGB(0, 220, 0), *g_spModel, 0x81, 0);
+        paint_diagram(hdc);
     }
 
     ::EndPaint(hwnd, &ps);
@@ -635,20 +886,41 @@ static void OnCommand(HWND /*hwnd*/, int id, HWND /*hwndCtl*/, UINT /*codeNotify
             ListView_GetItem(g_lv_logs_handle, &lvi);
             auto const& info { *reinterpret_cast<log_info const*>(lvi.lParam) };
 
-            g_spModel.reset(new model(info.file_path.path().c_str()));
-            auto const packet_count { g_spModel->packet_count() };
-
+            ::close_document();
             // Reset sorting indicators
             ::set_header_sorting(ListView_GetHeader(g_lv_packets_handle));
-            // Set virtual list view size
-            ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, static_cast<WPARAM>(packet_count), 0x0);
-            // Adjust packets list column widths. If we don't do this after
-            // setting the items count, a potentially appearing vertical
-            // scrollbar will not be accounted for.
-            set_packets_list_column_widths(g_lv_packets_handle);
-
-            // Redraw diagram
+            // Clear diagram area
             ::InvalidateRect(g_main_dlg_handle, &g_rc_diagram, FALSE);
+
+            // Packets show up as they are parsed (see `OnLoadProgress`); sorting is available once the model is
+            // complete (see `OnLoadCompleted`)
+            g_spLoader = ::std::make_unique<log_loader>(
+                info.file_path.path(),
+                [](load_progress progress) {
+                    {
+                        ::std::scoped_lock lock { g_pending_load_lock };
+                        g_pending_load_progress = ::std::move(progress);
+                    }
+                    ::PostMessageW(g_main_dlg_handle, WM_APP_LOAD_PROGRESS, 0, 0);
+                },
+                [](::std::unique_ptr<model> loaded, ::std::unique_ptr<sparse_log> loaded_sparse,
+                   ::std::exception_ptr const error) {
+                    if (error)
+                    {
+                        try
+                        {
+                            ::std::rethrow_exception(error);
+                        }
+                        CATCH_LOG();
+                    }
+                    {
+                        ::std::scoped_lock lock { g_pending_load_lock };
+                        g_pending_model = ::std::move(loaded);
+                        g_pending_sparse_log = ::std::move(loaded_sparse);
+                    }
+                    ::PostMessageW(g_main_dlg_handle, WM_APP_LOAD_COMPLETED, 0, 0);
+                },
+                g_index_budget);
         }
     }
     break;
@@ -659,16 +931,10 @@ static void OnCommand(HWND /*hwnd*/, int id, HWND /*hwndCtl*/, UINT /*codeNotify
         {
             auto&& folder_path { folder.value() };
 
-            // Reset virtual list view size first, so we can safely reset the
-            // loaded document (`g_spModel`)
-            ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, 0, 0);
+            ::close_document();
             // Reset sorting indicators for good measure, too
             ::set_header_sorting(ListView_GetHeader(g_lv_packets_handle));
 
-            // At this point no one is holding any references into the document
-            // anymore so we can delete it
-            g_spModel.reset(nullptr);
-
             // Clear the sensor log list (its items own resources)
             clear_log_list(g_lv_logs_handle);
 
@@ -687,21 +953,97 @@ static void OnCommand(HWND /*hwnd*/, int id, HWND /*hwndCtl*/, UINT /*codeNotify
 }
 
 
-static void OnLButtonDown(HWND /*hwnd*/, BOOL /*fDoubleClick*/, int x, int y, UINT /*keyFlags*/)
+static void OnLButtonDown(HWND hwnd, BOOL /*fDoubleClick*/, int x, int y, UINT /*keyFlags*/)
 {
     POINT const pt { x, y };
-    if (::PtInRect(&g_rc_diagram, pt) && g_spModel != nullptr)
+    if (::PtInRect(&g_rc_diagram, pt) && g_spDiagram != nullptr)
+    {
+        // Dragging pans the diagram; a click selects the row under the cursor (see `OnLButtonUp`)
+        g_diagram_drag_origin = pt;
+        g_diagram_drag_pan = g_diagram_pan;
+        g_diagram_dragged = false;
+        ::SetCapture(hwnd);
+    }
+}
+
+
+static void OnMouseMove(HWND hwnd, int x, int /*y*/, UINT /*keyFlags*/)
+{
+    if (!g_diagram_drag_origin || !g_spDiagram)
+    {
+        return;
+    }
+
+    auto const delta { x - g_diagram_drag_origin->x };
+    if (::abs(delta) > ::GetSystemMetrics(SM_CXDRAG))
+    {
+        g_diagram_dragged = true;
+    }
+    if (g_diagram_dragged)
     {
-        list_view_clear_selection(g_lv_packets_handle);
+        g_diagram_pan = g_diagram_drag_pan - delta;
+        clamp_diagram_viewport();
+        ::InvalidateRect(hwnd, &g_rc_diagram, FALSE);
+    }
+}
+
+
+static void OnLButtonUp(HWND /*hwnd*/, int x, int /*y*/, UINT /*keyFlags*/)
+{
+    if (!::std::exchange(g_diagram_drag_origin, ::std::nullopt))
+    {
+        return;
+    }
+    ::ReleaseCapture();
+    if (g_diagram_dragged || !g_spDiagram)
+    {
+        return;
+    }
+
+    auto const row { g_spDiagram->row_at(g_diagram_level, g_diagram_pan + x - diagram_inner_rect().left) };
+    if (!row)
+    {
+        return;
+    }
+    list_view_clear_selection(g_lv_packets_handle);
+
+    // Select item
+    auto const index { static_cast<int>(*row) };
+    ListView_SetItemState(g_lv_packets_handle, index, LVIS_SELECTED, LVIS_SELECTED);
+
+    // Make sure it's in view
+    ListView_EnsureVisible(g_lv_packets_handle, index, FALSE);
+}
 
-        // Select item
-        auto const x_offset { x - g_rc_diagram.left };
-        auto const index { ::MulDiv(x_offset, static_cast<int>(g_spModel->packet_count()), ::width(g_rc_diagram)) };
-        ListView_SetItemState(g_lv_packets_handle, index, LVIS_SELECTED, LVIS_SELECTED);
 
-        // Make sure it's in view
-        ListView_EnsureVisible(g_lv_packets_handle, index, FALSE);
+static void OnMouseWheel(HWND hwnd, int x_screen, int y_screen, int delta, UINT /*fwKeys*/)
+{
+    POINT pt { x_screen, y_screen };
+    ::ScreenToClient(hwnd, &pt);
+    if (!::PtInRect(&g_rc_diagram, pt) || !g_spDiagram || delta == 0)
+    {
+        return;
+    }
+
+    // Zoom in or out by one level, keeping the position under the cursor in place
+    auto const level { ::std::clamp(g_diagram_level + (delta > 0 ? 1 : -1), 0, g_spDiagram->max_level()) };
+    if (level == g_diagram_level)
+    {
+        return;
     }
+    auto const cursor { int64_t { pt.x - diagram_inner_rect().left } };
+    auto const position { g_diagram_pan + cursor };
+    g_diagram_pan = (level > g_diagram_level ? position * 2 : position / 2) - cursor;
+    g_diagram_level = level;
+    clamp_diagram_viewport();
+    ::InvalidateRect(hwnd, &g_rc_diagram, FALSE);
+}
+
+
+static void OnCaptureChanged(HWND /*hwnd*/)
+{
+    // Capture was taken away (e.g. by a message box); abandon dragging
+    g_diagram_drag_origin.reset();
 }
 
 
@@ -711,7 +1053,176 @@ static void OnGetMinMaxInfo(HWND /*hwnd*/, LPMINMAXINFO lpMinMaxInfo)
 }
 
 
-static void OnClose(HWND hwnd) { EndDialog(hwnd, 0); }
+static void OnDescriptionsChanged(HWND /*hwnd*/)
+{
+    ::std::optional<payload_container> descriptions {};
+    {
+        ::std::scoped_lock lock { g_pending_descriptions_lock };
+        descriptions.swap(g_pending_descriptions);
+    }
+    if (descriptions && !g_spModel && g_spLoader)
+    {
+        // The log being loaded uses the previous descriptions; apply these once it completes
+        ::std::scoped_lock lock { g_pending_descriptions_lock };
+        if (!g_pending_descriptions)
+        {
+            g_pending_descriptions = ::std::move(descriptions);
+        }
+        return;
+    }
+    if (!descriptions || !g_spModel)
+    {
+        // A model loaded later reads the descriptions on construction
+        return;
+    }
+
+    // The diagram renderer's thread reads the descriptions and the time column, both of which the update replaces.
+    // Join it first; it's recreated on the next paint.
+    g_spDiagram.reset(nullptr);
+    ::InvalidateRect(g_main_dlg_handle, &g_rc_diagram, FALSE);
+
+    // Only packet types with changed descriptions are re-decoded
+    if (auto const changed { g_spModel->update_packet_descriptions(::std::move(*descriptions)) }; changed.any())
+    {
+        g_spRowCache->invalidate(changed, g_spModel->packet_descriptions());
+        if (g_spQueryServer)
+        {
+            g_spQueryServer->set_descriptions(g_spModel->packet_descriptions());
+        }
+        ::InvalidateRect(g_lv_packets_handle, nullptr, FALSE);
+    }
+}
+
+
+static void OnViewChanged(HWND /*hwnd*/)
+{
+    if (!g_spModel)
+    {
+        return;
+    }
+    // The diagram renderer is recreated for the new view on the next paint; zoom level and scroll position are kept
+
+    // Pick up the most recently published view; intermediate ones may have been skipped
+    g_spView = g_spModel->view();
+    ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, static_cast<WPARAM>(g_spView->packet_count()),
+                   LVSICF_NOSCROLL);
+    ::InvalidateRect(g_lv_packets_handle, nullptr, FALSE);
+    ::InvalidateRect(g_main_dlg_handle, &g_rc_diagram, FALSE);
+}
+
+
+static void OnLoadProgress(HWND /*hwnd*/)
+{
+    ::std::optional<load_progress> progress {};
+    {
+        ::std::scoped_lock lock { g_pending_load_lock };
+        progress.swap(g_pending_load_progress);
+    }
+    if (!progress || !g_spLoader || g_spModel)
+    {
+        // Stale; the load was cancelled or has completed in the meantime
+        return;
+    }
+
+    // Only the most recent snapshot is displayed; intermediate ones may have been skipped
+    g_load_progress = ::std::move(progress);
+    ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, static_cast<WPARAM>(g_load_progress->packets->size()),
+                   LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+    ::InvalidateRect(g_main_dlg_handle, &g_rc_diagram, FALSE);
+}
+
+
+static void OnLoadCompleted(HWND /*hwnd*/)
+{
+    ::std::unique_ptr<model> loaded {};
+    ::std::unique_ptr<sparse_log> loaded_sparse {};
+    {
+        ::std::scoped_lock lock { g_pending_load_lock };
+        loaded.swap(g_pending_model);
+        loaded_sparse.swap(g_pending_sparse_log);
+    }
+    if (!g_spLoader)
+    {
+        // Stale; the load was cancelled in the meantime
+        return;
+    }
+    // The loader thread has finished reporting at this point
+    g_spLoader.reset(nullptr);
+
+    if (loaded_sparse)
+    {
+        // Too large for a model; rows are decoded on demand from the sparse index
+        g_spSparseLog = ::std::move(loaded_sparse);
+        g_load_progress.reset();
+        ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, static_cast<WPARAM>(g_spSparseLog->packet_count()),
+                       LVSICF_NOSCROLL);
+        set_packets_list_column_widths(g_lv_packets_handle);
+        return;
+    }
+    if (!loaded)
+    {
+        // Loading failed (the error has been logged); drop the partial list
+        g_load_progress.reset();
+        ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, 0, 0);
+        ::InvalidateRect(g_main_dlg_handle, &g_rc_diagram, FALSE);
+        return;
+    }
+
+    g_spModel = ::std::move(loaded);
+    g_spAnomalies = ::std::make_shared<anomaly_cache>(*g_spModel);
+    g_load_progress.reset();
+    g_diagram_level = 0;
+    g_diagram_pan = 0;
+    g_spView = g_spModel->view();
+    g_spRowCache = ::std::make_unique<row_cache>(g_spModel->directory(), g_spModel->packet_descriptions());
+    g_spViewWorker = ::std::make_unique<view_worker>(*g_spModel, [](auto&&) {
+        ::PostMessageW(g_main_dlg_handle, WM_APP_VIEW_CHANGED, 0, 0);
+    });
+    if (g_query_server_port)
+    {
+        try
+        {
+            g_spQueryServer = ::std::make_unique<query_server>(*g_spModel, *g_query_server_port);
+        }
+        CATCH_LOG();
+    }
+    auto const packet_count { g_spView->packet_count() };
+
+    // Set virtual list view size. Rows rendered from the partial list remain valid, since the model starts out in
+    // natural order.
+    ::SendMessageW(g_lv_packets_handle, LVM_SETITEMCOUNT, static_cast<WPARAM>(packet_count), LVSICF_NOSCROLL);
+    // Adjust packets list column widths. If we don't do this after
+    // setting the items count, a potentially appearing vertical
+    // scrollbar will not be accounted for.
+    set_packets_list_column_widths(g_lv_packets_handle);
+
+    // Redraw diagram
+    ::InvalidateRect(g_main_dlg_handle, &g_rc_diagram, FALSE);
+
+    // Apply descriptions that changed while loading
+    ::PostMessageW(g_main_dlg_handle, WM_APP_DESCRIPTIONS_CHANGED, 0, 0);
+}
+
+
+static void OnClose(HWND hwnd)
+{
+    // Stop background threads before the dialog goes away
+    g_spLoader.reset();
+    g_spDescriptionWatcher.reset();
+    g_spQueryServer.reset();
+    g_spViewWorker.reset();
+    g_spRowCache.reset();
+    g_spDiagram.reset();
+    if (g_trace_path)
+    {
+        try
+        {
+            ::write_chrome_trace(*g_trace_path);
+        }
+        CATCH_LOG();
+    }
+    EndDialog(hwnd, 0);
+}
 
 
 #pragma endregion
@@ -740,6 +1251,22 @@ INT_PTR CALLBACK MainDlgProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM l
         HANDLE_WM_LBUTTONDOWN(hwndDlg, wParam, lParam, &::OnLButtonDown);
         return TRUE;
 
+    case WM_LBUTTONUP:
+        HANDLE_WM_LBUTTONUP(hwndDlg, wParam, lParam, &::OnLButtonUp);
+        return TRUE;
+
+    case WM_MOUSEMOVE:
+        HANDLE_WM_MOUSEMOVE(hwndDlg, wParam, lParam, &::OnMouseMove);
+        return TRUE;
+
+    case WM_MOUSEWHEEL:
+        HANDLE_WM_MOUSEWHEEL(hwndDlg, wParam, lParam, &::OnMouseWheel);
+        return TRUE;
+
+    case WM_CAPTURECHANGED:
+        ::OnCaptureChanged(hwndDlg);
+        return TRUE;
+
     case WM_GETMINMAXINFO:
         HANDLE_WM_GETMINMAXINFO(hwndDlg, wParam, lParam, &::OnGetMinMaxInfo);
         return TRUE;
@@ -748,6 +1275,26 @@ INT_PTR CALLBACK MainDlgProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM l
         HANDLE_WM_CLOSE(hwndDlg, wParam, lParam, &::OnClose);
         return TRUE;
 
+    case WM_APP_DESCRIPTIONS_CHANGED:
+        ::OnDescriptionsChanged(hwndDlg);
+        return TRUE;
+
+    case WM_APP_VIEW_CHANGED:
+        ::OnViewChanged(hwndDlg);
+        return TRUE;
+
+    case WM_APP_LOAD_PROGRESS:
+        ::OnLoadProgress(hwndDlg);
+        return TRUE;
+
+    case WM_APP_LOAD_COMPLETED:
+        ::OnLoadCompleted(hwndDlg);
+        return TRUE;
+
+    case WM_APP_TILES_READY:
+        ::InvalidateRect(hwndDlg, &g_rc_diagram, FALSE);
+        return TRUE;
+
     case WM_NOTIFY: {
         auto const& nmhdr { *reinterpret_cast<NMHDR const*>(lParam) };
 #pragma warning(suppress : 26454) // Disable C26454 warning for LVN_GETDISPINFOW
@@ -756,36 +1303,55 @@ INT_PTR CALLBACK MainDlgProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM l
             auto& nmlvdi { *reinterpret_cast<NMLVDISPINFOW*>(lParam) };
             if (nmlvdi.item.mask & LVIF_TEXT)
             {
-                auto const item_index { nmlvdi.item.iItem };
+                auto const item_index { static_cast<size_t>(nmlvdi.item.iItem) };
+                ::std::shared_ptr<rendered_row const> row {};
+                if (g_spModel)
+                {
+                    row = g_spRowCache->row(g_spView->packet_index(item_index));
+                }
+                else if (g_spSparseLog && item_index < g_spSparseLog->packet_count())
+                {
+                    row = ::std::make_shared<rendered_row const>(::render_row(
+                        *g_spSparseLog->packet(item_index), item_index, g_spSparseLog->packet_descriptions()));
+                }
+                else if (g_load_progress && item_index < g_load_progress->packets->size())
+                {
+                    // Still loading; rendered on demand, as only the rows on screen are requested
+                    auto const& progress { *g_load_progress };
+                    row = ::std::make_shared<rendered_row const>(
+                        ::render_row((*progress.packets)[item_index], item_index, *progress.descriptions));
+                }
+                if (!row)
+                {
+                    return FALSE;
+                }
 
                 auto col_index { static_cast<packet_col>(nmlvdi.item.iSubItem) };
                 switch (col_index)
                 {
                 case packet_col::index: {
-                    auto const mapped_index { g_spModel->packet_index(item_index) };
-                    auto const index_str { ::std::to_wstring(mapped_index + 1) };
+                    auto const& index_str { row->index };
                     ::wcsncpy_s(nmlvdi.item.pszText, nmlvdi.item.cchTextMax, index_str.c_str(), index_str.size());
                     nmlvdi.item.mask |= LVIF_DI_SETITEM;
                 }
                 break;
 
                 case packet_col::type: {
-                    auto const type_str { ::to_hex_string(g_spModel->packet(item_index).type()) };
+                    auto const& type_str { row->type };
                     ::wcsncpy_s(nmlvdi.item.pszText, nmlvdi.item.cchTextMax, type_str.c_str(), type_str.size());
                     nmlvdi.item.mask |= LVIF_DI_SETITEM;
                 }
                 break;
 
                 case packet_col::size: {
-                    auto const size_str { ::std::to_wstring(g_spModel->packet(item_index).payload_size()) };
+                    auto const& size_str { row->size };
                     ::wcsncpy_s(nmlvdi.item.pszText, nmlvdi.item.cchTextMax, size_str.c_str(), size_str.size());
                     nmlvdi.item.mask |= LVIF_DI_SETITEM;
                 }
                 break;
 
                 case packet_col::payload: {
-                    auto payload_str { ::to_hex_string(
-                        { g_spModel->packet(item_index).data() + 2, g_spModel->packet(item_index).payload_size() }) };
+                    auto payload_str { row->payload };
                     // Truncate payload if it exceeds available space.
                     if (payload_str.size() >= nmlvdi.item.cchTextMax)
                     {
@@ -799,9 +1365,7 @@ INT_PTR CALLBACK MainDlgProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM l
                 break;
 
                 case packet_col::details: {
-                    auto const details { ::details_from_packet(g_spModel->packet(item_index),
-                                                               g_spModel->packet_descriptions()) };
-                    auto details_str { details.value_or(L"n/a") };
+                    auto details_str { row->details };
                     // Truncate payload if it exceeds available space.
                     if (details_str.size() >= nmlvdi.item.cchTextMax)
                     {
@@ -821,6 +1385,21 @@ INT_PTR CALLBACK MainDlgProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM l
             }
         }
 
+        // Render rows around the visible range in the background
+#pragma warning(suppress : 26454)
+        if (nmhdr.idFrom == IDC_LISTVIEW_PACKET_LIST && nmhdr.code == LVN_ODCACHEHINT && g_spModel)
+        {
+            auto const& hint { *reinterpret_cast<NMLVCACHEHINT const*>(lParam) };
+            if (hint.iFrom >= 0 && hint.iTo >= hint.iFrom)
+            {
+                // Prefetch one page ahead and behind
+                auto const page_size { static_cast<size_t>(hint.iTo - hint.iFrom) + 1 };
+                g_spRowCache->prefetch(::visible_range_indices(*g_spView, static_cast<size_t>(hint.iFrom),
+                                                               static_cast<size_t>(hint.iTo), page_size));
+            }
+            return TRUE;
+        }
+
         // Handle column click to toggle sorting
 #pragma warning(suppress : 26454)
         if (nmhdr.idFrom == IDC_LISTVIEW_PACKET_LIST && nmhdr.code == LVN_COLUMNCLICK)
@@ -828,11 +1407,9 @@ INT_PTR CALLBACK MainDlgProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM l
             auto const& msg_info { *reinterpret_cast<NMLISTVIEW const*>(lParam) };
             auto header_handle { ListView_GetHeader(nmhdr.hwndFrom) };
 
+            // The list view is refreshed once the view worker has published the new order (see `OnViewChanged`)
             if (handle_sorting(header_handle, msg_info.iSubItem))
             {
-                auto const lv_packets { nmhdr.hwndFrom };
-                // Refresh list view
-                ListView_RedrawItems(lv_packets, 0, static_cast<size_t>(ListView_GetItemCount(lv_packets)) - 1);
                 return TRUE;
             }
         }
@@ -888,9 +1465,340 @@ INT_PTR CALLBACK MainDlgProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM l
 }
 
 
+// Reports the failure of a headless command where the user sees it: on the standard error stream if it's redirected,
+// otherwise on the console the command was started from, or in a message box if there is none. `message` is encoded in
+// the active code page, like exception messages.
+static void report_headless_error(::std::string_view const message)
+{
+    auto const line { ::std::format("{}\r\n", message) };
+    DWORD written { 0 };
+    if (auto const error { ::GetStdHandle(STD_ERROR_HANDLE) };
+        error != nullptr && error != INVALID_HANDLE_VALUE
+        && ::WriteFile(error, line.data(), static_cast<DWORD>(line.size()), &written, nullptr))
+    {
+        return;
+    }
+    if (::AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+        ::wil::unique_hfile const console { ::CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr,
+                                                          OPEN_EXISTING, 0, nullptr) };
+        if (console && ::WriteConsoleA(console.get(), line.data(), static_cast<DWORD>(line.size()), &written, nullptr))
+        {
+            return;
+        }
+    }
+    ::MessageBoxA(nullptr, ::std::string { message }.c_str(), "msbsla", MB_OK | MB_ICONERROR);
+}
+
+
+// Renders the diagram of a log headlessly (`--render-tiles=DIR LOG`): writes the first screen of every zoom level to
+// `DIR` as PNG files, along with the rendering time per level (`DIR/timings.csv`). Returns the process exit code.
+[[nodiscard]] static int render_tiles_headless(fs::path const& output_dir, wchar_t const* log_path,
+                                               diagram_axis const axis)
+{
+    constexpr int k_width { 1024 };
+    constexpr int k_height { 256 };
+    ::model const m { log_path };
+    diagram_tiles const tiles {
+        m, m.view(),
+        ::resolve_diagram_series(::load_graph_definitions(::default_graph_definitions_path().c_str()),
+                                 m.packet_descriptions()),
+        axis, k_width, k_height
+    };
+    auto const timings { ::render_diagram_levels(tiles, output_dir) };
+
+    ::std::ofstream out { output_dir / L"timings.csv", ::std::ios::trunc };
+    out << "level,tiles,milliseconds\n";
+    for (auto const& timing : timings)
+    {
+        out << ::std::format("{},{},{:.3f}\n", timing.level, timing.tile_count, timing.milliseconds);
+    }
+    THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+    return 0;
+}
+
+
+// Returns the sensor logs of a folder in file name order
+[[nodiscard]] static ::std::vector<fs::path> sensor_logs_of(fs::path const& folder)
+{
+    ::std::vector<fs::path> logs {};
+    for (auto const& entry : fs::directory_iterator { folder })
+    {
+        if (entry.is_regular_file() && ::is_sensor_log(entry.path().wstring()))
+        {
+            logs.push_back(entry.path());
+        }
+    }
+    ::std::sort(begin(logs), end(logs));
+    return logs;
+}
+
+
+// Segments the sensor logs of a folder headlessly (`--segment-sessions=DIR FOLDER`), in file name order: writes the
+// sessions to `DIR/sessions.csv` and the time taken (including loading the logs) to `DIR/timings.csv`. Returns the
+// process exit code.
+[[nodiscard]] static int segment_sessions_headless(fs::path const& output_dir, wchar_t const* folder)
+{
+    auto const logs { ::sensor_logs_of(folder) };
+    uint64_t bytes { 0 };
+    for (auto const& log : logs)
+    {
+        bytes += fs::file_size(log);
+    }
+
+    auto const start { ::std::chrono::steady_clock::now() };
+    auto const segmenter { ::segment_log_files(
+        logs, ::load_packet_descriptions_cached(::default_packet_descriptions_path())) };
+    ::std::chrono::duration<double, ::std::milli> const elapsed { ::std::chrono::steady_clock::now() - start };
+
+    fs::create_directories(output_dir);
+    ::std::ofstream sessions { output_dir / L"sessions.csv", ::std::ios::trunc };
+    sessions << "begin,end,label,epochs,worn_seconds,heart_rate_samples,heart_rate_mean,heart_rate_deviation,"
+                "heart_rate_min,heart_rate_max,extra_timestamps,open\n";
+    for (auto const& session : segmenter.sessions())
+    {
+        sessions << ::std::format("{},{},{},{},{},{},{:.2f},{:.2f},{},{},{},{}\n", session.begin, session.end,
+                                  ::to_utf8(::to_string(session.label)), session.epochs, session.worn_seconds,
+                                  session.heart_rate_samples, session.heart_rate_mean, session.heart_rate_deviation,
+                                  session.heart_rate_min, session.heart_rate_max, session.extra_timestamps,
+                                  session.open ? 1 : 0);
+    }
+
+    ::std::ofstream timings { output_dir / L"timings.csv", ::std::ios::trunc };
+    timings << "logs,bytes,epochs,sessions,milliseconds\n";
+    timings << ::std::format("{},{},{},{},{:.3f}\n", logs.size(), bytes, segmenter.epoch_count(),
+                             segmenter.sessions().size(), elapsed.count());
+    THROW_WIN32_IF(ERROR_WRITE_FAULT, !sessions || !timings);
+    return 0;
+}
+
+
+// Adds the sensor logs of a folder to a chunk store headlessly (`--archive=STORE FOLDER`), and verifies that every log
+// can be reconstructed from the store: writes the chunks and bytes per log, and how many of them were new to the
+// store, to `STORE/ingests.csv`. Returns the process exit code, which is also non-zero if any log fails verification.
+[[nodiscard]] static int archive_logs_headless(fs::path const& store_dir, wchar_t const* folder)
+{
+    auto const logs { ::sensor_logs_of(folder) };
+    chunk_store store { store_dir };
+    auto const results { store.ingest(logs) };
+
+    ::std::ofstream out { store_dir / L"ingests.csv", ::std::ios::trunc };
+    out << "log,chunks,new_chunks,bytes,new_bytes,verified\n";
+    size_t failed { 0 };
+    for (auto const& result : results)
+    {
+        auto const ok { store.verify(result.source) };
+        failed += ok ? 0 : 1;
+        out << ::std::format("{},{},{},{},{},{}\n", ::to_utf8(result.source.filename().wstring()), result.chunk_count,
+                             result.new_chunk_count, result.bytes, result.new_bytes, ok ? 1 : 0);
+    }
+    THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+    if (failed != 0)
+    {
+        ::report_headless_error(::std::format("{} of {} logs failed verification (see ingests.csv in the store)",
+                                              failed, results.size()));
+        return 1;
+    }
+    return 0;
+}
+
+
+// Adds the numeric elements of the sensor logs of a folder to a time series store headlessly
+// (`--ingest-metrics=STORE FOLDER`). Every element of every described packet type becomes a metric named
+// `0x<type>.<element>`; logs already in the store are skipped. Writes the samples added and the time taken to
+// `STORE/timings.csv`, and the sample count and value range of every metric to `STORE/metrics.csv`. Returns the process
+// exit code.
+[[nodiscard]] static int ingest_metrics_headless(fs::path const& store_dir, wchar_t const* folder)
+{
+    auto const logs { ::sensor_logs_of(folder) };
+    auto const descriptions { ::load_packet_descriptions_cached(::default_packet_descriptions_path()) };
+    ::std::vector<metric_definition> metrics {};
+    for (auto const& [type, description] : descriptions)
+    {
+        for (size_t element { 0 }; element < description.elements.size(); ++element)
+        {
+            auto const element_type { description.elements[element].type };
+            if (element_type != payload_type::unknown && element_type != payload_type::file_time)
+            {
+                metrics.push_back({ ::std::format("0x{:02X}.{}", type, element), type, element });
+            }
+        }
+    }
+
+    timeseries_store store { store_dir };
+    auto const start { ::std::chrono::steady_clock::now() };
+    auto const added { store.ingest(logs, descriptions, metrics) };
+    ::std::chrono::duration<double, ::std::milli> const elapsed { ::std::chrono::steady_clock::now() - start };
+
+    ::std::ofstream timings { store_dir / L"timings.csv", ::std::ios::trunc };
+    timings << "logs,metrics,samples,milliseconds\n";
+    timings << ::std::format("{},{},{},{:.3f}\n", logs.size(), metrics.size(), added, elapsed.count());
+
+    ::std::ofstream summary { store_dir / L"metrics.csv", ::std::ios::trunc };
+    summary << "metric,samples,min,max,mean\n";
+    for (auto const& name : store.metric_names())
+    {
+        auto const all { store.aggregate(name, 0, ::std::numeric_limits<uint64_t>::max()) };
+        if (all.count == 0)
+        {
+            // Packet types that none of the logs contain
+            summary << ::std::format("{},0,,,\n", name);
+            continue;
+        }
+        summary << ::std::format("{},{},{},{},{}\n", name, all.count, all.min, all.max, all.mean());
+    }
+    THROW_WIN32_IF(ERROR_WRITE_FAULT, !timings || !summary);
+    return 0;
+}
+
+
+// Loads a log headlessly the way the UI does (`--measure-load=DIR LOG`): writes the number of packets, the time until
+// the first progress snapshot (when the packet list shows its first rows), and the total load time to
+// `DIR/timings.csv`. Returns the process exit code.
+[[nodiscard]] static int measure_load_headless(fs::path const& output_dir, wchar_t const* log_path)
+{
+    using milliseconds = ::std::chrono::duration<double, ::std::milli>;
+
+    // Written by the loader thread; read once `completed` is ready
+    size_t snapshots { 0 };
+    size_t first_rows { 0 };
+    milliseconds first_snapshot {};
+    milliseconds total {};
+    size_t packets { 0 };
+    bool sparse { false };
+    ::std::exception_ptr error {};
+    ::std::promise<void> completed {};
+
+    auto const start { ::std::chrono::steady_clock::now() };
+    {
+        log_loader const loader {
+            fs::path { log_path },
+            [&](load_progress progress) {
+                if (snapshots++ == 0)
+                {
+                    first_snapshot = ::std::chrono::steady_clock::now() - start;
+                    first_rows = progress.packets->size();
+                }
+            },
+            [&](::std::unique_ptr<model> loaded, ::std::unique_ptr<sparse_log> loaded_sparse,
+                ::std::exception_ptr failure) {
+                total = ::std::chrono::steady_clock::now() - start;
+                packets = loaded ? loaded->directory().size() : loaded_sparse ? loaded_sparse->packet_count() : 0;
+                sparse = loaded_sparse != nullptr;
+                error = ::std::move(failure);
+                completed.set_value();
+            }
+        };
+        // Destroying the loader any earlier would cancel the load
+        completed.get_future().wait();
+    }
+    if (error)
+    {
+        ::std::rethrow_exception(error);
+    }
+
+    fs::create_directories(output_dir);
+    ::std::ofstream timings { output_dir / L"timings.csv", ::std::ios::trunc };
+    timings << "packets,sparse,snapshots,first_rows,first_snapshot_milliseconds,total_milliseconds\n";
+    timings << ::std::format("{},{},{},{},{:.3f},{:.3f}\n", packets, sparse ? 1 : 0, snapshots, first_rows,
+                             first_snapshot.count(), total.count());
+    THROW_WIN32_IF(ERROR_WRITE_FAULT, !timings);
+    return 0;
+}
+
+
+// A command that runs without UI: `<prefix>OUTPUT INPUT`
+struct headless_command
+{
+    ::std::wstring_view prefix;
+    // Shown when the input is missing
+    char const* usage;
+    int (*run)(fs::path const& output, wchar_t const* input, diagram_axis axis);
+};
+
+static constexpr ::std::array k_headless_commands {
+    headless_command { L"--render-tiles=", "msbsla --render-tiles=DIR LOG",
+                       [](fs::path const& output, wchar_t const* input, diagram_axis const axis) {
+                           return ::render_tiles_headless(output, input, axis);
+                       } },
+    headless_command { L"--segment-sessions=", "msbsla --segment-sessions=DIR FOLDER",
+                       [](fs::path const& output, wchar_t const* input, diagram_axis) {
+                           return ::segment_sessions_headless(output, input);
+                       } },
+    headless_command { L"--archive=", "msbsla --archive=STORE FOLDER",
+                       [](fs::path const& output, wchar_t const* input, diagram_axis) {
+                           return ::archive_logs_headless(output, input);
+                       } },
+    headless_command { L"--ingest-metrics=", "msbsla --ingest-metrics=STORE FOLDER",
+                       [](fs::path const& output, wchar_t const* input, diagram_axis) {
+                           return ::ingest_metrics_headless(output, input);
+                       } },
+    headless_command { L"--measure-load=", "msbsla --measure-load=DIR LOG",
+                       [](fs::path const& output, wchar_t const* input, diagram_axis) {
+                           return ::measure_load_headless(output, input);
+                       } },
+};
+
+
+// Runs a headless command and reports its failure (see `report_headless_error()`). Returns the process exit code.
+[[nodiscard]] static int run_headless(headless_command const& command, fs::path const& output,
+                                      wchar_t const* input, diagram_axis const axis)
+{
+    if (input == nullptr)
+    {
+        ::report_headless_error(::std::format("Usage: {}", command.usage));
+        return 1;
+    }
+    try
+    {
+        return command.run(output, input, axis);
+    }
+    catch (::std::exception const& e)
+    {
+        LOG_CAUGHT_EXCEPTION();
+        ::report_headless_error(::std::format("{} failed: {}", command.usage, e.what()));
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION();
+        ::report_headless_error(::std::format("{} failed", command.usage));
+    }
+    return 1;
+}
+
+
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE /*hPrevInstance*/, _In_ LPWSTR /*lpCmdLine*/,
                       _In_ int /*nCmdShow*/)
 {
+    // Headless commands (see `k_headless_commands`) run without UI
+    headless_command const* command { nullptr };
+    fs::path output {};
+    wchar_t const* input { nullptr };
+    auto axis { diagram_axis::index };
+    for (int arg { 1 }; arg < __argc; ++arg)
+    {
+        ::std::wstring_view const argument { __wargv[arg] };
+        auto const match { ::std::find_if(begin(k_headless_commands), end(k_headless_commands),
+                                          [&](auto const& c) { return argument.starts_with(c.prefix); }) };
+        if (match != end(k_headless_commands))
+        {
+            command = &*match;
+            output = fs::path { argument.substr(match->prefix.size()) };
+        }
+        else if (argument == L"--diagram-axis=time")
+        {
+            axis = diagram_axis::time;
+        }
+        else if (!argument.starts_with(L"--") && input == nullptr)
+        {
+            input = __wargv[arg];
+        }
+    }
+    if (command != nullptr)
+    {
+        return ::run_headless(*command, output, input, axis);
+    }
+
     // Initialize COM; `cleanup` uninitializes a successful initialization when
     // it goes out of scope
     auto cleanup = wil::CoInitializeEx(COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+
+// Compressed set of packet indices (natural order), used to represent filters.
+//
+// Indices are partitioned into containers of 2^16 consecutive indices (Roaring bitmap layout). A container stores the
+// low 16 bits of its indices either as a sorted array (up to `k_array_limit` indices, 2 bytes each) or as a bitmap
+// (8 KB), whichever is smaller. Set operations work container by container and pick the algorithm by representation,
+// so sparse filters (e.g. a rare packet type) cost next to nothing and dense ones take up at most 1 bit per packet.
+//
+// Instances are immutable once built; the operators return new bitmaps.
+struct packet_bitmap
+{
+    static constexpr size_t k_container_bits { 16 };
+    static constexpr size_t k_container_size { size_t { 1 } << k_container_bits };
+    static constexpr size_t k_array_limit { 4096 };
+
+    packet_bitmap() = default;
+
+    // Returns the indices in [first, last)
+    [[nodiscard]] static packet_bitmap range(size_t const first, size_t const last)
+    {
+        packet_bitmap result {};
+        for (auto pos { first }; pos < last;)
+        {
+            auto const key { pos >> k_container_bits };
+            auto const low { pos & (k_container_size - 1) };
+            auto const high { ::std::min(last - (key << k_container_bits), k_container_size) };
+
+            container c { key };
+            if (high - low <= k_array_limit)
+            {
+                for (auto i { low }; i < high; ++i)
+                {
+                    c.array.push_back(static_cast<uint16_t>(i));
+                }
+            }
+            else
+            {
+                c.words.resize(k_words);
+                for (auto i { low }; i < high; ++i)
+                {
+                    c.words[i / 64] |= uint64_t { 1 } << (i % 64);
+                }
+            }
+            c.cardinality = static_cast<uint32_t>(high - low);
+            result.containers_.push_back(::std::move(c));
+            pos = (key << k_container_bits) + high;
+        }
+        return result;
+    }
+
+    // Adds an index; indices must be added in ascending order
+    void push_back(size_t const index)
+    {
+        auto const key { index >> k_container_bits };
+        auto const low { static_cast<uint16_t>(index & (k_container_size - 1)) };
+        if (containers_.empty() || containers_.back().key != key)
+        {
+            assert(containers_.empty() || containers_.back().key < key);
+            containers_.push_back({ key });
+        }
+
+        auto& c { containers_.back() };
+        if (c.words.empty())
+        {
+            assert(c.array.empty() || c.array.back() < low);
+            c.array.push_back(low);
+            ++c.cardinality;
+            if (c.cardinality > k_array_limit)
+            {
+                c = to_words(c);
+            }
+        }
+        else
+        {
+            assert((c.words[low / 64] & (uint64_t { 1 } << (low % 64))) == 0);
+            c.words[low / 64] |= uint64_t { 1 } << (low % 64);
+            ++c.cardinality;
+        }
+    }
+
+    [[nodiscard]] size_t size() const noexcept
+    {
+        size_t count { 0 };
+        for (auto const& c : containers_)
+        {
+            count += c.cardinality;
+        }
+        return count;
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return containers_.empty(); }
+
+    [[nodiscard]] bool contains(size_t const index) const noexcept
+    {
+        auto const key { index >> k_container_bits };
+        auto const it { ::std::lower_bound(begin(containers_), end(containers_), key,
+                                           [](container const& c, size_t const k) { return c.key < k; }) };
+        if (it == end(containers_) || it->key != key)
+        {
+            return false;
+        }
+        auto const low { static_cast<uint16_t>(index & (k_container_size - 1)) };
+        return it->words.empty() ? ::std::binary_search(begin(it->array), end(it->array), low)
+                                 : (it->words[low / 64] >> (low % 64)) & 1;
+    }
+
+    // Returns the (approximate) number of bytes used to store the set
+    [[nodiscard]] size_t memory_usage() const noexcept
+    {
+        auto bytes { containers_.capacity() * sizeof(container) };
+        for (auto const& c : containers_)
+        {
+            bytes += c.array.capacity() * sizeof(uint16_t) + c.words.capacity() * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+
+    // Invokes `f(index)` for every index in ascending order
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (auto const& c : containers_)
+        {
+            auto const base { c.key << k_container_bits };
+            if (c.words.empty())
+            {
+                for (auto const low : c.array)
+                {
+                    f(base + low);
+                }
+                continue;
+            }
+            for (size_t w { 0 }; w < k_words; ++w)
+            {
+                for (auto word { c.words[w] }; word != 0; word &= word - 1)
+                {
+                    f(base + w * 64 + static_cast<size_t>(::std::countr_zero(word)));
+                }
+            }
+        }
+    }
+
+    // Returns the indices in ascending order
+    [[nodiscard]] ::std::vector<size_t> to_vector() const
+    {
+        ::std::vector<size_t> indices {};
+        indices.reserve(size());
+        for_each([&](size_t const index) { indices.push_back(index); });
+        return indices;
+    }
+
+    [[nodiscard]] friend bool operator==(packet_bitmap const& lhs, packet_bitmap const& rhs) noexcept
+    {
+        return ::std::equal(begin(lhs.containers_), end(lhs.containers_), begin(rhs.containers_),
+                            end(rhs.containers_), [](container const& l, container const& r) {
+                                return l.key == r.key && l.cardinality == r.cardinality && l.array == r.array
+                                       && l.words == r.words;
+                            });
+    }
+
+    // Intersection
+    [[nodiscard]] friend packet_bitmap operator&(packet_bitmap const& lhs, packet_bitmap const& rhs)
+    {
+        packet_bitmap result {};
+        auto l { begin(lhs.containers_) };
+        auto r { begin(rhs.containers_) };
+        while (l != end(lhs.containers_) && r != end(rhs.containers_))
+        {
+            if (l->key < r->key)
+            {
+                ++l;
+            }
+            else if (r->key < l->key)
+            {
+                ++r;
+            }
+            else
+            {
+                result.append(intersect(*l++, *r++));
+            }
+        }
+        return result;
+    }
+
+    // Union
+    [[nodiscard]] friend packet_bitmap operator|(packet_bitmap const& lhs, packet_bitmap const& rhs)
+    {
+        packet_bitmap result {};
+        auto l { begin(lhs.containers_) };
+        auto r { begin(rhs.containers_) };
+        while (l != end(lhs.containers_) || r != end(rhs.containers_))
+        {
+            if (r == end(rhs.containers_) || (l != end(lhs.containers_) && l->key < r->key))
+            {
+                result.containers_.push_back(*l++);
+            }
+            else if (l == end(lhs.containers_) || r->key < l->key)
+            {
+                result.containers_.push_back(*r++);
+            }
+            else
+            {
+                result.append(unite(*l++, *r++));
+            }
+        }
+        return result;
+    }
+
+    // Difference (indices in `lhs` but not in `rhs`)
+    [[nodiscard]] friend packet_bitmap operator-(packet_bitmap const& lhs, packet_bitmap const& rhs)
+    {
+        packet_bitmap result {};
+        auto r { begin(rhs.containers_) };
+        for (auto const& c : lhs.containers_)
+        {
+            while (r != end(rhs.containers_) && r->key < c.key)
+            {
+                ++r;
+            }
+            result.append(r != end(rhs.containers_) && r->key == c.key ? subtract(c, *r) : c);
+        }
+        return result;
+    }
+
+    // Returns the indices in [0, universe) that aren't in the set
+    [[nodiscard]] packet_bitmap complement(size_t const universe) const { return range(0, universe) - *this; }
+
+private:
+    static constexpr size_t k_words { k_container_size / 64 };
+
+    // Indices [key << 16, (key + 1) << 16). Exactly one of `array` (sorted low bits) and `words` (bitmap of
+    // `k_words` words) is populated, depending on whether `cardinality` exceeds `k_array_limit`.
+    struct container
+    {
+        size_t key;
+        uint32_t cardinality { 0 };
+        ::std::vector<uint16_t> array {};
+        ::std::vector<uint64_t> words {};
+    };
+
+    [[nodiscard]] static container to_words(container const& c)
+    {
+        container result { c.key, c.cardinality, {}, ::std::vector<uint64_t>(k_words) };
+        for (auto const low : c.array)
+        {
+            result.words[low / 64] |= uint64_t { 1 } << (low % 64);
+        }
+        return result;
+    }
+
+    // Converts a bitmap container to the smaller representation after its cardinality dropped
+    [[nodiscard]] static container from_words(size_t const key, ::std::vector<uint64_t> words)
+    {
+        uint32_t cardinality { 0 };
+        for (auto const word : words)
+        {
+            cardinality += static_cast<uint32_t>(::std::popcount(word));
+        }
+        if (cardinality > k_array_limit)
+        {
+            return { key, cardinality, {}, ::std::move(words) };
+        }
+
+        container result { key, cardinality };
+        result.array.reserve(cardinality);
+        for (size_t w { 0 }; w < k_words; ++w)
+        {
+            for (auto word { words[w] }; word != 0; word &= word - 1)
+            {
+                result.array.push_back(static_cast<uint16_t>(w * 64 + static_cast<size_t>(::std::countr_zero(word))));
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] static bool test(container const& c, uint16_t const low) noexcept
+    {
+        return (c.words[low / 64] >> (low % 64)) & 1;
+    }
+
+    // Appends a container unless it's empty (empty containers aren't stored)
+    void append(container c)
+    {
+        if (c.cardinality > 0)
+        {
+            containers_.push_back(::std::move(c));
+        }
+    }
+
+    [[nodiscard]] static container intersect(container const& lhs, container const& rhs)
+    {
+        if (!lhs.words.empty() && !rhs.words.empty())
+        {
+            ::std::vector<uint64_t> words(k_words);
+            for (size_t w { 0 }; w < k_words; ++w)
+            {
+                words[w] = lhs.words[w] & rhs.words[w];
+            }
+            return from_words(lhs.key, ::std::move(words));
+        }
+
+        container result { lhs.key };
+        if (lhs.words.empty() && rhs.words.empty())
+        {
+            ::std::set_intersection(begin(lhs.array), end(lhs.array), begin(rhs.array), end(rhs.array),
+                                    ::std::back_inserter(result.array));
+        }
+        else
+        {
+            auto const& array { lhs.words.empty() ? lhs : rhs };
+            auto const& bitmap { lhs.words.empty() ? rhs : lhs };
+            ::std::copy_if(begin(array.array), end(array.array), ::std::back_inserter(result.array),
+                           [&](uint16_t const low) { return test(bitmap, low); });
+        }
+        result.cardinality = static_cast<uint32_t>(result.array.size());
+        return result;
+    }
+
+    [[nodiscard]] static container unite(container const& lhs, container const& rhs)
+    {
+        if (lhs.words.empty() && rhs.words.empty() && lhs.cardinality + rhs.cardinality <= k_array_limit)
+        {
+            container result { lhs.key };
+            ::std::set_union(begin(lhs.array), end(lhs.array), begin(rhs.array), end(rhs.array),
+                             ::std::back_inserter(result.array));
+            result.cardinality = static_cast<uint32_t>(result.array.size());
+            return result;
+        }
+
+        auto words { lhs.words.empty() ? to_words(lhs).words : lhs.words };
+        if (rhs.words.empty())
+        {
+            for (auto const low : rhs.array)
+            {
+                words[low / 64] |= uint64_t { 1 } << (low % 64);
+            }
+        }
+        else
+        {
+            for (size_t w { 0 }; w < k_words; ++w)
+            {
+                words[w] |= rhs.words[w];
+            }
+        }
+        return from_words(lhs.key, ::std::move(words));
+    }
+
+    [[nodiscard]] static container subtract(container const& lhs, container const& rhs)
+    {
+        if (lhs.words.empty())
+        {
+            container result { lhs.key };
+            if (rhs.words.empty())
+            {
+                ::std::set_difference(begin(lhs.array), end(lhs.array), begin(rhs.array), end(rhs.array),
+                                      ::std::back_inserter(result.array));
+            }
+            else
+            {
+                ::std::copy_if(begin(lhs.array), end(lhs.array), ::std::back_inserter(result.array),
+                               [&](uint16_t const low) { return !test(rhs, low); });
+            }
+            result.cardinality = static_cast<uint32_t>(result.array.size());
+            return result;
+        }
+
+        auto words { lhs.words };
+        if (rhs.words.empty())
+        {
+            for (auto const low : rhs.array)
+            {
+                words[low / 64] &= ~(uint64_t { 1 } << (low % 64));
+            }
+        }
+        else
+        {
+            for (size_t w { 0 }; w < k_words; ++w)
+            {
+                words[w] &= ~rhs.words[w];
+            }
+        }
+        return from_words(lhs.key, ::std::move(words));
+    }
+
+    // Sorted by `key`
+    ::std::vector<container> containers_;
+};
@@ -0,0 +1,425 @@
+#pragma once
+
+#include "char_encoding_utils.h"
+#include "encoding_utils.h"
+#include "tracing.h"
+
+#include <nlohmann/json.hpp>
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+
+// Packet information handling
+enum struct payload_type
+{
+    unknown,
+    ui8,
+    ui16,
+    ui32,
+    file_time,
+    ui64,
+    i8,
+    i16,
+    i32,
+    i64,
+    f32,
+    f64,
+    // Big endian variants
+    ui16_be,
+    ui32_be,
+    i16_be,
+    i32_be,
+    // Range of bits of a little endian unsigned integer of 1, 2, 4, or 8 bytes
+    bitfield,
+    // Little endian unsigned integer of 1, 2, 4, or 8 bytes mapped to names
+    enumeration,
+
+    last_value = enumeration
+};
+
+struct payload_element
+{
+    size_t offset;
+    size_t size;
+    payload_type type;
+    ::std::optional<::std::wstring> comment;
+    // Linear transform applied to numeric values (value * scale + bias); not applied to `file_time` and `enumeration`
+    double scale { 1.0 };
+    double bias { 0.0 };
+    // Bit range for `bitfield` elements
+    uint8_t bit_offset { 0 };
+    uint8_t bit_count { 0 };
+    // Names for `enumeration` elements
+    ::std::map<uint64_t, ::std::wstring> enum_values {};
+
+    [[nodiscard]] friend bool operator==(payload_element const&, payload_element const&) = default;
+};
+
+using payload_elements_container = ::std::vector<::payload_element>;
+
+struct packet_description
+{
+    ::std::optional<::std::wstring> name;
+    // TODO: Add field to allow users to provide a confidence level (unknown .. known beyond doubt)
+    ::payload_elements_container elements;
+
+    [[nodiscard]] friend bool operator==(packet_description const&, packet_description const&) = default;
+};
+
+using payload_container = ::std::map<unsigned char, ::packet_description>;
+
+
+NLOHMANN_JSON_SERIALIZE_ENUM(::payload_type, { { ::payload_type::unknown, nullptr },
+                                               { ::payload_type::ui8, "ui8" },
+                                               { ::payload_type::ui16, "ui16" },
+                                               { ::payload_type::ui32, "ui32" },
+                                               { ::payload_type::file_time, "file_time" },
+                                               { ::payload_type::ui64, "ui64" },
+                                               { ::payload_type::i8, "i8" },
+                                               { ::payload_type::i16, "i16" },
+                                               { ::payload_type::i32, "i32" },
+                                               { ::payload_type::i64, "i64" },
+                                               { ::payload_type::f32, "f32" },
+                                               { ::payload_type::f64, "f64" },
+                                               { ::payload_type::ui16_be, "ui16_be" },
+                                               { ::payload_type::ui32_be, "ui32_be" },
+                                               { ::payload_type::i16_be, "i16_be" },
+                                               { ::payload_type::i32_be, "i32_be" },
+                                               { ::payload_type::bitfield, "bitfield" },
+                                               { ::payload_type::enumeration, "enum" } })
+
+
+// Reads (known) packet descriptions from a JSON file
+[[nodiscard]] inline ::payload_container load_packet_descriptions(wchar_t const* path_name)
+{
+    trace_span const span { "load_packet_descriptions" };
+
+    // The JSON file needs to have the following layout:
+
+    // { "descriptions": [
+    //   { "type": "0x00",      /* type: string (needs to be a string due to numbers not supporting hex) */
+    //     "name": "[name]",    /* name: string (optional) */
+    //     "elements": [
+    //       { "offset": 0,     /* offset: number */
+    //         "length": 8,     /* length: number */
+    //         "display_type": "file_time",     /* display_type: string (serialized ::payload_type enumeration) */
+    //         "comment": "<some comment>",     /* comment: string (optional) */
+    //         "scale": 0.5,    /* scale: number (optional, default 1) */
+    //         "bias": -40,     /* bias: number (optional, default 0) */
+    //         "bits": [ 4, 2 ],                /* bits: [first, count] (required for "bitfield") */
+    //         "values": { "0": "off", "1": "on" }  /* values: object (optional, names for "enum") */
+    //       },
+    //       ...
+    //     ]
+    //   },
+    //   ...
+    // ]}
+
+    auto ifs { ::std::ifstream { path_name } };
+    ::payload_container descriptions {};
+    ::nlohmann::json j {};
+    ifs >> j;
+    for (auto const& descr : j.at("descriptions"))
+    {
+        // Read index; this is stored as a string because JSON doesn't support hexadecimal encoding.
+        size_t const index { static_cast<size_t const>(::std::stoll(descr.at("type").get<::std::string>(), 0, 0)) };
+        auto& packet_description { descriptions[static_cast<uint8_t>(index)] };
+
+        // Set optional name
+        if (auto name_it { descr.find("name") }; name_it != end(descr))
+        {
+            packet_description.name = ::to_utf16(name_it->get<::std::string>());
+        }
+
+        // Append elements list
+        for (auto const& element : descr.at("elements"))
+        {
+            auto const offset { element.at("offset").get<size_t>() };
+            auto const length { element.at("length").get<size_t>() };
+            auto const display_type { element.at("display_type").get<::payload_type>() };
+            auto const comment { element.contains("comment") ? ::std::optional<::std::wstring> { ::to_utf16(
+                                     element.at("comment").get<::std::string>()) }
+                                                             : ::std::nullopt };
+
+            ::payload_element el { offset, length, display_type, comment };
+            el.scale = element.value("scale", 1.0);
+            el.bias = element.value("bias", 0.0);
+            if (auto const bits_it { element.find("bits") }; bits_it != end(element))
+            {
+                auto const bits { bits_it->get<::std::array<unsigned, 2>>() };
+                el.bit_offset = static_cast<uint8_t>(bits[0]);
+                el.bit_count = static_cast<uint8_t>(bits[1]);
+            }
+            if (auto const values_it { element.find("values") }; values_it != end(element))
+            {
+                for (auto const& [key, name] : values_it->items())
+                {
+                    el.enum_values.emplace(::std::stoull(key, nullptr, 0), ::to_utf16(name.get<::std::string>()));
+                }
+            }
+
+            packet_description.elements.push_back(::std::move(el));
+        }
+    }
+
+    return descriptions;
+}
+
+
+//! \brief Returns the location of `packet_descriptions.json`.
+//!
+//! \return The fully qualified pathname of `packet_descriptions.json` in the
+//!         directory of the executable. The build copies the file there.
+//!
+[[nodiscard]] inline ::std::filesystem::path default_packet_descriptions_path()
+{
+    ::std::wstring module_path(MAX_PATH, L'\0');
+    for (;;)
+    {
+        auto const length { ::GetModuleFileNameW(nullptr, module_path.data(), static_cast<DWORD>(module_path.size())) };
+        THROW_LAST_ERROR_IF(length == 0);
+        if (length < module_path.size())
+        {
+            module_path.resize(length);
+            break;
+        }
+        // Truncated
+        module_path.resize(module_path.size() * 2);
+    }
+    return ::std::filesystem::path { module_path }.replace_filename(L"packet_descriptions.json");
+}
+
+
+//! \brief Determines the packet types whose descriptions differ.
+//!
+//! \param[in] lhs A set of packet descriptions.
+//! \param[in] rhs Another set of packet descriptions.
+//!
+//! \return A bit set with a bit set for every packet type that is described in
+//!         only one of the inputs, or described differently in both.
+//!
+[[nodiscard]] inline ::std::bitset<256> changed_packet_types(::payload_container const& lhs,
+                                                             ::payload_container const& rhs)
+{
+    ::std::bitset<256> changed {};
+    for (auto const& [type, description] : lhs)
+    {
+        auto const it { rhs.find(type) };
+        if (it == end(rhs) || it->second != description)
+        {
+            changed.set(type);
+        }
+    }
+    for (auto const& [type, description] : rhs)
+    {
+        if (!lhs.contains(type))
+        {
+            changed.set(type);
+        }
+    }
+    return changed;
+}
+
+
+// Binary cache of parsed packet descriptions. The cache is stored next to the JSON file and is valid as long as the
+// JSON file's size and last write time match those recorded in the cache.
+struct packet_description_cache
+{
+    static constexpr ::std::array<uint8_t, 4> k_magic { 'M', 'S', 'B', 'D' };
+    static constexpr uint8_t k_version { 2 };
+
+    [[nodiscard]] static ::std::filesystem::path path_for(::std::filesystem::path const& json_path)
+    {
+        auto path { json_path };
+        path += L".cache";
+        return path;
+    }
+
+    [[nodiscard]] static ::std::vector<uint8_t> serialize(::payload_container const& descriptions,
+                                                          uint64_t const source_size, int64_t const source_time)
+    {
+        ::std::vector<uint8_t> buffer { begin(k_magic), end(k_magic) };
+        buffer.push_back(k_version);
+        ::write_varint(buffer, source_size);
+        ::write_varint(buffer, ::zigzag_encode(source_time));
+
+        auto const write_string = [&](::std::optional<::std::wstring> const& s) {
+            buffer.push_back(s.has_value() ? 1 : 0);
+            if (s)
+            {
+                ::write_varint(buffer, s->size());
+                for (auto const ch : *s)
+                {
+                    ::write_varint(buffer, static_cast<uint64_t>(ch));
+                }
+            }
+        };
+
+        ::write_varint(buffer, descriptions.size());
+        for (auto const& [type, description] : descriptions)
+        {
+            buffer.push_back(type);
+            write_string(description.name);
+            ::write_varint(buffer, description.elements.size());
+            for (auto const& el : description.elements)
+            {
+                ::write_varint(buffer, el.offset);
+                ::write_varint(buffer, el.size);
+                buffer.push_back(static_cast<uint8_t>(el.type));
+                write_string(el.comment);
+                ::write_varint(buffer, ::std::bit_cast<uint64_t>(el.scale));
+                ::write_varint(buffer, ::std::bit_cast<uint64_t>(el.bias));
+                buffer.push_back(el.bit_offset);
+                buffer.push_back(el.bit_count);
+                ::write_varint(buffer, el.enum_values.size());
+                for (auto const& [value, name] : el.enum_values)
+                {
+                    ::write_varint(buffer, value);
+                    write_string(name);
+                }
+            }
+        }
+        return buffer;
+    }
+
+    // Returns `nullopt` if the cache is malformed or stale
+    [[nodiscard]] static ::std::optional<::payload_container> deserialize(::std::vector<uint8_t> buffer,
+                                                                         uint64_t const source_size,
+                                                                         int64_t const source_time)
+    {
+        auto const size { buffer.size() };
+        // Padding guarantees that a truncated varint doesn't read past the buffer
+        buffer.resize(size + 16);
+        uint8_t const* pos { buffer.data() };
+        auto const end { buffer.data() + size };
+
+        if (size < k_magic.size() + 1 || !::std::equal(begin(k_magic), ::std::end(k_magic), pos)
+            || pos[k_magic.size()] != k_version)
+        {
+            return {};
+        }
+        pos += k_magic.size() + 1;
+        if (::read_varint(pos) != source_size || ::zigzag_decode(::read_varint(pos)) != source_time)
+        {
+            return {};
+        }
+
+        bool valid { true };
+        auto const read_byte = [&]() -> uint8_t {
+            valid = valid && pos < end;
+            return valid ? *pos++ : 0;
+        };
+        auto const read_count = [&]() -> size_t {
+            auto const value { ::read_varint(pos) };
+            // Every serialized item takes up at least one byte
+            valid = valid && pos <= end && value <= static_cast<uint64_t>(end - pos);
+            return valid ? static_cast<size_t>(value) : 0;
+        };
+        auto const read_string = [&]() -> ::std::optional<::std::wstring> {
+            if (read_byte() == 0)
+            {
+                return {};
+            }
+            ::std::wstring s(read_count(), L'\0');
+            for (auto& ch : s)
+            {
+                ch = static_cast<wchar_t>(::read_varint(pos));
+            }
+            return s;
+        };
+
+        ::payload_container descriptions {};
+        for (auto count { read_count() }; valid && count > 0; --count)
+        {
+            auto& description { descriptions[read_byte()] };
+            description.name = read_string();
+            for (auto element_count { read_count() }; valid && element_count > 0; --element_count)
+            {
+                auto const offset { static_cast<size_t>(::read_varint(pos)) };
+                auto const el_size { static_cast<size_t>(::read_varint(pos)) };
+                auto const type { read_byte() };
+                valid = valid && type <= static_cast<uint8_t>(payload_type::last_value);
+                ::payload_element el { offset, el_size, static_cast<payload_type>(type), read_string() };
+                el.scale = ::std::bit_cast<double>(::read_varint(pos));
+                el.bias = ::std::bit_cast<double>(::read_varint(pos));
+                el.bit_offset = read_byte();
+                el.bit_count = read_byte();
+                for (auto value_count { read_count() }; valid && value_count > 0; --value_count)
+                {
+                    auto const value { ::read_varint(pos) };
+                    el.enum_values.emplace(value, read_string().value_or(L""));
+                }
+                description.elements.push_back(::std::move(el));
+            }
+        }
+
+        if (!valid || pos != end)
+        {
+            return {};
+        }
+        return descriptions;
+    }
+};
+
+
+//! \brief Reads packet descriptions, preferring an up-to-date binary cache.
+//!
+//! \param[in] json_path The pathname of `packet_descriptions.json`.
+//!
+//! \return The packet descriptions.
+//!
+//! \remark If the cache is missing or stale, the JSON file is parsed, and the
+//!         cache is rewritten. Failing to write the cache (e.g. in a read-only
+//!         installation directory) isn't an error.
+//!
+[[nodiscard]] inline ::payload_container load_packet_descriptions_cached(::std::filesystem::path const& json_path)
+{
+    trace_span const span { "load_packet_descriptions_cached" };
+    auto const source_size { ::std::filesystem::file_size(json_path) };
+    auto const source_time { static_cast<int64_t>(
+        ::std::filesystem::last_write_time(json_path).time_since_epoch().count()) };
+    auto const cache_path { packet_description_cache::path_for(json_path) };
+
+    // Try cache
+    if (::std::ifstream in { cache_path, ::std::ios::binary }; in)
+    {
+        ::std::vector<uint8_t> buffer { ::std::istreambuf_iterator<char> { in }, ::std::istreambuf_iterator<char> {} };
+        if (auto descriptions { packet_description_cache::deserialize(::std::move(buffer), source_size, source_time) };
+            descriptions)
+        {
+            return ::std::move(*descriptions);
+        }
+    }
+
+    // Parse JSON and update cache
+    auto descriptions { ::load_packet_descriptions(json_path.c_str()) };
+    try
+    {
+        auto const buffer { packet_description_cache::serialize(descriptions, source_size, source_time) };
+        auto tmp_path { cache_path };
+        tmp_path += ::std::to_wstring(::GetCurrentThreadId());
+        {
+            ::std::ofstream out { tmp_path, ::std::ios::binary | ::std::ios::trunc };
+            out.write(reinterpret_cast<char const*>(buffer.data()), static_cast<::std::streamsize>(buffer.size()));
+            THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+        }
+        ::std::filesystem::rename(tmp_path, cache_path);
+    }
+    CATCH_LOG();
+
+    return descriptions;
+}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include "model.h"
+#include "packet_bitmap.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Condition on the packets of a model, composed from base conditions (packet types, time ranges, element values) with
+// `&`, `|`, and `~`. Conditions are cheap to copy and share their operands, so saved filters can be combined freely.
+// Evaluate them with a `filter_cache`.
+struct packet_filter
+{
+    // Packets of any of the given types
+    [[nodiscard]] static packet_filter types(::std::bitset<256> const& type_set)
+    {
+        auto n { ::std::make_shared<node>() };
+        n->op = operation::types;
+        n->type_set = type_set;
+        n->key = ::std::format("t{}", type_set.to_string());
+        return packet_filter { ::std::move(n) };
+    }
+
+    // Packets with a timestamp in [from, to); matches nothing if the log doesn't contain time information
+    [[nodiscard]] static packet_filter time_range(uint64_t const from, uint64_t const to)
+    {
+        auto n { ::std::make_shared<node>() };
+        n->op = operation::time_range;
+        n->from = from;
+        n->to = to;
+        n->key = ::std::format("r{}-{}", from, to);
+        return packet_filter { ::std::move(n) };
+    }
+
+    // Packets of `type` whose (decoded) payload element `element` is in [min, max]
+    [[nodiscard]] static packet_filter value_range(unsigned char const type, size_t const element, double const min,
+                                                   double const max)
+    {
+        auto n { ::std::make_shared<node>() };
+        n->op = operation::value_range;
+        n->type = type;
+        n->element = element;
+        n->min = min;
+        n->max = max;
+        n->key = ::std::format("v{}.{}[{},{}]", type, element, min, max);
+        return packet_filter { ::std::move(n) };
+    }
+
+    [[nodiscard]] friend packet_filter operator&(packet_filter const& lhs, packet_filter const& rhs)
+    {
+        return combine(operation::intersection, lhs, rhs);
+    }
+
+    [[nodiscard]] friend packet_filter operator|(packet_filter const& lhs, packet_filter const& rhs)
+    {
+        return combine(operation::union_, lhs, rhs);
+    }
+
+    [[nodiscard]] friend packet_filter operator~(packet_filter const& operand)
+    {
+        return combine(operation::complement, operand, operand);
+    }
+
+    // Returns a textual representation that identifies the condition
+    [[nodiscard]] ::std::string const& key() const noexcept { return node_->key; }
+
+private:
+    friend struct filter_cache;
+
+    enum struct operation
+    {
+        types,
+        time_range,
+        value_range,
+        intersection,
+        union_,
+        complement
+    };
+
+    struct node
+    {
+        operation op;
+        ::std::string key;
+        // Base conditions
+        ::std::bitset<256> type_set;
+        uint64_t from { 0 };
+        uint64_t to { 0 };
+        unsigned char type { 0 };
+        size_t element { 0 };
+        double min { 0.0 };
+        double max { 0.0 };
+        // Combined conditions (`complement` only uses `lhs`)
+        ::std::shared_ptr<node const> lhs;
+        ::std::shared_ptr<node const> rhs;
+    };
+
+    explicit packet_filter(::std::shared_ptr<node const> n) : node_ { ::std::move(n) } {}
+
+    [[nodiscard]] static packet_filter combine(operation const op, packet_filter const& lhs, packet_filter const& rhs)
+    {
+        auto n { ::std::make_shared<node>() };
+        n->op = op;
+        n->lhs = lhs.node_;
+        n->rhs = rhs.node_;
+        n->key = op == operation::complement ? ::std::format("~{}", lhs.key())
+                                             : ::std::format("({}{}{})", lhs.key(),
+                                                             op == operation::intersection ? '&' : '|', rhs.key());
+        return packet_filter { ::std::move(n) };
+    }
+
+    ::std::shared_ptr<node const> node_;
+};
+
+
+// Evaluates `packet_filter`s against a model, caching the bitmap of every condition and sub-condition. Toggling or
+// changing a single condition of a combined filter re-evaluates that condition, and then one set operation per
+// enclosing combination; all other operands are served from the cache.
+//
+// Element values and timestamps are evaluated against the cache's own snapshot of the packet descriptions and the time
+// column derived from them, rather than the model's, which may change at any time. `set_descriptions()` replaces the
+// snapshot. Results depending on it are keyed by generation counters of the snapshot, so a description update only
+// invalidates the results of the packet types it changed, and a result is always cached under the generation it was
+// computed from. The cache is safe to use from multiple threads. The model must outlive the cache.
+struct filter_cache
+{
+    static constexpr size_t k_default_capacity { 64 };
+
+    explicit filter_cache(::model const& m, size_t const capacity = k_default_capacity)
+        : model_ { m }
+        , capacity_ { capacity }
+        , state_ { ::std::make_shared<state const>(
+              m.packet_descriptions(), ::std::make_shared<::std::optional<::time_column> const>(m.time_column())) }
+    {
+    }
+
+    filter_cache(filter_cache const&) = delete;
+    filter_cache& operator=(filter_cache const&) = delete;
+
+    // Returns the packets matching `filter` (natural order), e.g. to pass to `model::select()`
+    [[nodiscard]] ::std::shared_ptr<packet_bitmap const> evaluate(packet_filter const& filter)
+    {
+        trace_span const span { "filter_cache::evaluate" };
+        return evaluate(*filter.node_, *snapshot()).second;
+    }
+
+    // Replaces the packet descriptions that element values and timestamps are evaluated against, e.g. following
+    // `model::update_packet_descriptions()`. The time column is rebuilt if the descriptions change the packet types or
+    // offsets carrying time anchors.
+    void set_descriptions(::payload_container const& descriptions)
+    {
+        auto const current { snapshot() };
+        auto const changed { ::changed_packet_types(current->descriptions, descriptions) };
+        if (changed.none())
+        {
+            return;
+        }
+
+        auto next { ::std::make_shared<state>(descriptions, current->times) };
+        next->generations = current->generations;
+        next->time_generation = current->time_generation;
+        for (size_t type { 0 }; type < changed.size(); ++type)
+        {
+            if (changed.test(type))
+            {
+                ++next->generations[type];
+            }
+        }
+        if (::time_anchor_offsets(descriptions) != ::time_anchor_offsets(current->descriptions))
+        {
+            next->times = ::std::make_shared<::std::optional<::time_column> const>(
+                ::build_time_column(model_.directory(), descriptions));
+            ++next->time_generation;
+        }
+
+        ::std::scoped_lock lock { lock_ };
+        state_ = ::std::move(next);
+    }
+
+    void clear()
+    {
+        ::std::scoped_lock lock { lock_ };
+        entries_.clear();
+    }
+
+private:
+    using node = packet_filter::node;
+    using operation = packet_filter::operation;
+
+    struct entry
+    {
+        ::std::string key;
+        ::std::shared_ptr<packet_bitmap const> bitmap;
+        uint64_t last_used;
+    };
+
+    // Snapshot of the packet descriptions and the time column derived from them
+    struct state
+    {
+        state(::payload_container d, ::std::shared_ptr<::std::optional<::time_column> const> t)
+            : descriptions { ::std::move(d) }, times { ::std::move(t) }
+        {
+        }
+
+        ::payload_container descriptions;
+        ::std::shared_ptr<::std::optional<::time_column> const> times;
+        // Incremented per packet type whenever its description changes
+        ::std::array<uint64_t, 256> generations {};
+        // Incremented whenever the time column is rebuilt
+        uint64_t time_generation { 0 };
+    };
+
+    [[nodiscard]] ::std::shared_ptr<state const> snapshot() const
+    {
+        ::std::scoped_lock lock { lock_ };
+        return state_;
+    }
+
+    // Returns the cache key and result of a condition. The whole filter is evaluated against a single snapshot.
+    ::std::pair<::std::string, ::std::shared_ptr<packet_bitmap const>> evaluate(node const& n, state const& current)
+    {
+        // Operands are resolved first, so that the key reflects their current (generation-qualified) keys
+        ::std::shared_ptr<packet_bitmap const> lhs {};
+        ::std::shared_ptr<packet_bitmap const> rhs {};
+        ::std::string key {};
+        switch (n.op)
+        {
+        case operation::types:
+            key = n.key;
+            break;
+
+        case operation::time_range:
+            key = ::std::format("{}@{}", n.key, current.time_generation);
+            break;
+
+        case operation::value_range:
+            key = ::std::format("{}@{}", n.key, current.generations[n.type]);
+            break;
+
+        case operation::complement:
+        {
+            auto [operand_key, operand] { evaluate(*n.lhs, current) };
+            key = ::std::format("~{}", operand_key);
+            lhs = ::std::move(operand);
+            break;
+        }
+
+        default:
+        {
+            auto [lhs_key, lhs_bitmap] { evaluate(*n.lhs, current) };
+            auto [rhs_key, rhs_bitmap] { evaluate(*n.rhs, current) };
+            key = ::std::format("({}{}{})", lhs_key, n.op == operation::intersection ? '&' : '|', rhs_key);
+            lhs = ::std::move(lhs_bitmap);
+            rhs = ::std::move(rhs_bitmap);
+            break;
+        }
+        }
+
+        if (auto cached { find(key) }; cached)
+        {
+            return { ::std::move(key), ::std::move(cached) };
+        }
+
+        // Build outside the lock; concurrent requests for the same condition may build it twice
+        packet_bitmap result {};
+        switch (n.op)
+        {
+        case operation::types:
+            result = model_.type_bitmap(n.type_set);
+            break;
+
+        case operation::time_range:
+            result = time_range(*current.times, n.from, n.to);
+            break;
+
+        case operation::value_range:
+            result = value_range(current.descriptions, n.type, n.element, n.min, n.max);
+            break;
+
+        case operation::intersection:
+            result = *lhs & *rhs;
+            break;
+
+        case operation::union_:
+            result = *lhs | *rhs;
+            break;
+
+        case operation::complement:
+            result = lhs->complement(model_.directory().size());
+            break;
+        }
+
+        auto shared { ::std::make_shared<packet_bitmap const>(::std::move(result)) };
+        insert(key, shared);
+        return { ::std::move(key), ::std::move(shared) };
+    }
+
+    [[nodiscard]] ::std::shared_ptr<packet_bitmap const> find(::std::string const& key)
+    {
+        ::std::scoped_lock lock { lock_ };
+        auto const it { ::std::find_if(begin(entries_), end(entries_), [&](auto const& e) { return e.key == key; }) };
+        if (it == end(entries_))
+        {
+            return {};
+        }
+        it->last_used = ++clock_;
+        return it->bitmap;
+    }
+
+    void insert(::std::string const& key, ::std::shared_ptr<packet_bitmap const> const& bitmap)
+    {
+        ::std::scoped_lock lock { lock_ };
+        if (entries_.size() >= capacity_)
+        {
+            entries_.erase(::std::min_element(begin(entries_), end(entries_), [](auto const& lhs, auto const& rhs) {
+                return lhs.last_used < rhs.last_used;
+            }));
+        }
+        entries_.push_back({ key, bitmap, ++clock_ });
+    }
+
+    [[nodiscard]] static packet_bitmap time_range(::std::optional<::time_column> const& times, uint64_t const from,
+                                                  uint64_t const to)
+    {
+        packet_bitmap result {};
+        if (!times)
+        {
+            return result;
+        }
+
+        // Decode sequentially in blocks rather than seeking per packet
+        ::std::vector<uint64_t> block(4096);
+        for (size_t first { 0 }; first < times->size(); first += block.size())
+        {
+            auto const count { ::std::min(block.size(), times->size() - first) };
+            times->decode(first, { block.data(), count });
+            for (size_t i { 0 }; i < count; ++i)
+            {
+                if (block[i] >= from && block[i] < to)
+                {
+                    result.push_back(first + i);
+                }
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] packet_bitmap value_range(::payload_container const& descriptions, unsigned char const type,
+                                            size_t const element, double const min, double const max) const
+    {
+        packet_bitmap result {};
+        auto const description { descriptions.find(type) };
+        if (description == end(descriptions) || element >= description->second.elements.size())
+        {
+            return result;
+        }
+
+        auto const& el { description->second.elements[element] };
+        auto const& directory { model_.directory() };
+        model_.type_bitmap(type).for_each([&](size_t const index) {
+            if (auto const value { ::element_value(directory[index], el) };
+                value && !::std::isnan(*value) && *value >= min && *value <= max)
+            {
+                result.push_back(index);
+            }
+        });
+        return result;
+    }
+
+    ::model const& model_;
+    size_t const capacity_;
+
+    mutable ::std::mutex lock_;
+    ::std::shared_ptr<state const> state_;
+    ::std::vector<entry> entries_;
+    uint64_t clock_ { 0 };
+};
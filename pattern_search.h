@@ -0,0 +1,593 @@
+#pragma once
+
+#include "log_utils.h"
+#include "model.h"
+#include "tracing.h"
+#include "windowed_mapping.h"
+
+#include <wil/result.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// A byte sequence to search for. Wildcards match any value in the masked-out bits.
+struct byte_pattern
+{
+    // A pattern needs to fit into a single payload
+    static constexpr size_t k_max_size { 0xFF };
+
+    ::std::vector<unsigned char> bytes;
+    // Bits of `bytes` that need to match: 0xFF for a literal byte, 0x00 for `??`, 0xF0 or 0x0F for a single wildcard
+    // nibble
+    ::std::vector<unsigned char> mask;
+
+    [[nodiscard]] size_t size() const noexcept { return bytes.size(); }
+
+    // Compares the pattern against `size()` bytes at `data`
+    [[nodiscard]] bool matches(unsigned char const* const data) const noexcept
+    {
+        for (size_t i { 0 }; i < bytes.size(); ++i)
+        {
+            if ((data[i] & mask[i]) != bytes[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+//! \brief Parses a byte pattern in hexadecimal notation.
+//!
+//! \param[in] text Pairs of hex digits, optionally separated by whitespace. A
+//!                 `?` in place of a digit matches any nibble, e.g.
+//!                 `0d ?? 4? ff`.
+//!
+//! \return The pattern, or `nullopt` if `text` is malformed, empty, or longer
+//!         than `byte_pattern::k_max_size` bytes.
+//!
+[[nodiscard]] inline ::std::optional<byte_pattern> parse_byte_pattern(::std::string_view const text)
+{
+    auto const nibble { [](char const c) -> ::std::optional<unsigned char> {
+        if (c >= '0' && c <= '9')
+        {
+            return static_cast<unsigned char>(c - '0');
+        }
+        if (c >= 'a' && c <= 'f')
+        {
+            return static_cast<unsigned char>(c - 'a' + 10);
+        }
+        if (c >= 'A' && c <= 'F')
+        {
+            return static_cast<unsigned char>(c - 'A' + 10);
+        }
+        return {};
+    } };
+
+    byte_pattern pattern {};
+    ::std::optional<char> high {};
+    for (auto const c : text)
+    {
+        if (c == ' ' || c == '\t')
+        {
+            if (high)
+            {
+                return {};
+            }
+            continue;
+        }
+        if (c != '?' && !nibble(c))
+        {
+            return {};
+        }
+        if (!high)
+        {
+            high = c;
+            continue;
+        }
+
+        unsigned char value { 0 };
+        unsigned char mask { 0 };
+        if (*high != '?')
+        {
+            value |= static_cast<unsigned char>(*nibble(*high) << 4);
+            mask |= 0xF0;
+        }
+        if (c != '?')
+        {
+            value |= *nibble(c);
+            mask |= 0x0F;
+        }
+        pattern.bytes.push_back(value);
+        pattern.mask.push_back(mask);
+        high.reset();
+    }
+    if (high || pattern.bytes.empty() || pattern.size() > byte_pattern::k_max_size)
+    {
+        return {};
+    }
+    return pattern;
+}
+
+
+//! \brief Finds all occurrences of a pattern in a range of bytes.
+//!
+//! \param[in] haystack The bytes to search.
+//! \param[in] pattern  The pattern to search for.
+//! \param[in] limit    Only occurrences that start before this offset are
+//!                     reported. The bytes past it are only used to verify
+//!                     occurrences straddling it.
+//! \param[in] f        Invoked with the offset of every occurrence, in
+//!                     ascending order. Returning `false` stops the search.
+//!
+//! \remark Candidates are filtered 16 positions at a time with SSE2, comparing
+//!         the first and last literal bytes of the pattern. Only candidates
+//!         that match both are verified in full.
+//!
+template <typename F>
+void find_pattern(::std::span<unsigned char const> const haystack, byte_pattern const& pattern, size_t const limit,
+                  F&& f)
+{
+    auto const size { pattern.size() };
+    if (size == 0 || haystack.size() < size)
+    {
+        return;
+    }
+    auto const end { ::std::min(limit, haystack.size() - size + 1) };
+    auto const data { haystack.data() };
+
+    // Anchor on the first and last literal bytes; a pattern without any needs to be verified everywhere
+    auto const first { static_cast<size_t>(::std::find(begin(pattern.mask), ::std::end(pattern.mask), 0xFF)
+                                           - begin(pattern.mask)) };
+    size_t start { 0 };
+    if (first != size)
+    {
+        auto const last { size - 1
+                          - static_cast<size_t>(::std::find(rbegin(pattern.mask), rend(pattern.mask), 0xFF)
+                                                - rbegin(pattern.mask)) };
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+        auto const first_byte { _mm_set1_epi8(static_cast<char>(pattern.bytes[first])) };
+        auto const last_byte { _mm_set1_epi8(static_cast<char>(pattern.bytes[last])) };
+        // Both loads of a block need to stay inside the haystack
+        for (; start + last + 16 <= haystack.size() && start + 16 <= end; start += 16)
+        {
+            auto const a { _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + start + first)) };
+            auto const b { _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + start + last)) };
+            auto candidates { static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first_byte), _mm_cmpeq_epi8(b, last_byte)))) };
+            while (candidates != 0)
+            {
+                auto const pos { start + static_cast<size_t>(::std::countr_zero(candidates)) };
+                if (pattern.matches(data + pos) && !f(pos))
+                {
+                    return;
+                }
+                candidates &= candidates - 1;
+            }
+        }
+#endif
+        // Remainder (or everything without SSE2)
+        for (; start < end; ++start)
+        {
+            if (data[start + first] == pattern.bytes[first] && data[start + last] == pattern.bytes[last]
+                && pattern.matches(data + start) && !f(start))
+            {
+                return;
+            }
+        }
+        return;
+    }
+
+    for (; start < end; ++start)
+    {
+        if (pattern.matches(data + start) && !f(start))
+        {
+            return;
+        }
+    }
+}
+
+
+struct search_options
+{
+    // Only report occurrences in packets of this type
+    ::std::optional<unsigned char> type {};
+    // Only report occurrences starting at this offset into the payload
+    ::std::optional<size_t> offset {};
+    // Maximum number of occurrences reported per log
+    size_t max_hits { 100'000 };
+    // Number of worker threads; 0 selects the number of hardware threads
+    size_t thread_count { 0 };
+};
+
+
+// An occurrence of a pattern inside of a payload
+struct search_hit
+{
+    // Index of the packet in natural order
+    size_t packet_index;
+    unsigned char type;
+    // Offset of the occurrence relative to the payload
+    size_t payload_offset;
+    // Offset of the occurrence relative to the log
+    uint64_t log_offset;
+};
+
+
+// Occurrences of a pattern in one of the logs of a folder
+struct file_search_result
+{
+    ::std::filesystem::path path;
+    ::std::vector<search_hit> hits;
+    // Set if the log couldn't be searched
+    bool failed { false };
+};
+
+
+// Search internals (see `search_model()` and `search_folder()`)
+struct pattern_search
+{
+    // Maps occurrences (in ascending order) to the packets containing them. Packet headers are only read up to the
+    // most recent occurrence, so logs without any occurrences are never parsed. `header(offset)` returns the type and
+    // full size of the packet at `offset`, or `nullopt` if it is truncated.
+    template <typename Header>
+    struct resolver
+    {
+        Header header;
+        // Offset and index of the packet that the next occurrence is mapped against
+        uint64_t pos { 0 };
+        size_t index { 0 };
+        ::std::optional<::std::pair<unsigned char, size_t>> current {};
+
+        [[nodiscard]] ::std::optional<search_hit> resolve(uint64_t const offset, size_t const length,
+                                                          search_options const& options)
+        {
+            for (;;)
+            {
+                if (!current)
+                {
+                    current = header(pos);
+                    if (!current)
+                    {
+                        return {};
+                    }
+                }
+                if (pos + current->second > offset)
+                {
+                    break;
+                }
+                pos += current->second;
+                ++index;
+                current.reset();
+            }
+
+            return accept(index, pos, current->first, current->second, offset, length, options);
+        }
+    };
+
+    // Returns the hit for an occurrence in the packet at `pos`, unless it is rejected by `options`
+    [[nodiscard]] static ::std::optional<search_hit> accept(size_t const index, uint64_t const pos,
+                                                            unsigned char const type, size_t const size,
+                                                            uint64_t const offset, size_t const length,
+                                                            search_options const& options) noexcept
+    {
+        auto const payload_begin { pos + data_proxy::header_size() };
+        if (offset < payload_begin || offset + length > pos + size)
+        {
+            // Overlaps a packet header or straddles two packets
+            return {};
+        }
+        auto const payload_offset { static_cast<size_t>(offset - payload_begin) };
+        if ((options.type && *options.type != type) || (options.offset && *options.offset != payload_offset))
+        {
+            return {};
+        }
+        return search_hit { index, type, payload_offset, offset };
+    }
+
+    template <typename Header>
+    [[nodiscard]] static resolver<Header> make_resolver(Header header, uint64_t const pos = 0, size_t const index = 0)
+    {
+        return { ::std::move(header), pos, index };
+    }
+
+    [[nodiscard]] static size_t thread_count(search_options const& options) noexcept
+    {
+        return options.thread_count != 0 ? options.thread_count
+                                         : ::std::max(size_t { 1 }, size_t { ::std::thread::hardware_concurrency() });
+    }
+
+    // Returns a resolver that reads packet headers from `mapping`, pinning one window at a time
+    [[nodiscard]] static auto make_mapping_resolver(windowed_mapping const& mapping)
+    {
+        return make_resolver(
+            [&mapping, view = ::std::shared_ptr<mapped_window const> {}](
+                uint64_t const pos) mutable -> ::std::optional<::std::pair<unsigned char, size_t>> {
+                if (mapping.size() - pos < data_proxy::header_size())
+                {
+                    return {};
+                }
+                if (!view || pos < view->offset || pos >= view->offset + mapping.window_size())
+                {
+                    view = mapping.pin(pos);
+                }
+                auto const header { view->bytes.data() + (pos - view->offset) };
+                auto const size { static_cast<size_t>(header[1]) + data_proxy::header_size() };
+                if (mapping.size() - pos < size)
+                {
+                    return {};
+                }
+                return ::std::pair { header[0], size };
+            });
+    }
+
+    // Searches a log in `mapping`, scanning its windows on up to `thread_count` threads. Windows are resolved in order
+    // as soon as they are scanned, so `max_hits` limits the reported hits (not the raw occurrences, some of which may
+    // be rejected), and scanning stops once enough hits are found.
+    [[nodiscard]] static ::std::vector<search_hit> search_mapping(windowed_mapping const& mapping,
+                                                                  byte_pattern const& pattern,
+                                                                  search_options const& options)
+    {
+        auto const window_size { static_cast<uint64_t>(mapping.window_size()) };
+        auto const window_count { static_cast<size_t>((mapping.size() + window_size - 1) / window_size) };
+        auto r { make_mapping_resolver(mapping) };
+        ::std::vector<search_hit> hits {};
+        // Resolves the occurrences of a window; returns `false` once `max_hits` is reached
+        auto const resolve_window { [&](::std::vector<uint64_t> const& offsets) {
+            for (auto const offset : offsets)
+            {
+                if (auto const hit { r.resolve(offset, pattern.size(), options) }; hit)
+                {
+                    hits.push_back(*hit);
+                    if (hits.size() >= options.max_hits)
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        } };
+
+        auto const threads { ::std::min(thread_count(options), window_count) };
+        if (threads <= 1)
+        {
+            for (size_t w { 0 }; w < window_count; ++w)
+            {
+                if (!resolve_window(scan_window(mapping, w, pattern)))
+                {
+                    break;
+                }
+            }
+            return hits;
+        }
+
+        ::std::vector<::std::optional<::std::vector<uint64_t>>> offsets(window_count);
+        ::std::mutex lock {};
+        ::std::condition_variable scanned {};
+        ::std::atomic<size_t> next { 0 };
+        ::std::atomic<bool> stop { false };
+        ::std::vector<::std::jthread> workers {};
+        for (size_t t { 0 }; t < threads; ++t)
+        {
+            workers.emplace_back([&] {
+                for (auto w { next++ }; w < window_count && !stop; w = next++)
+                {
+                    auto window { scan_window(mapping, w, pattern) };
+                    {
+                        ::std::scoped_lock guard { lock };
+                        offsets[w] = ::std::move(window);
+                    }
+                    scanned.notify_one();
+                }
+            });
+        }
+
+        for (size_t w { 0 }; w < window_count; ++w)
+        {
+            ::std::vector<uint64_t> window {};
+            {
+                ::std::unique_lock guard { lock };
+                scanned.wait(guard, [&] { return offsets[w].has_value(); });
+                window = ::std::move(*offsets[w]);
+            }
+            if (!resolve_window(window))
+            {
+                break;
+            }
+        }
+        // Workers finish the windows they are scanning and exit
+        stop = true;
+        workers.clear();
+        return hits;
+    }
+
+    [[nodiscard]] static ::std::vector<uint64_t> scan_window(windowed_mapping const& mapping, size_t const w,
+                                                             byte_pattern const& pattern)
+    {
+        trace_span const span { "pattern_search::scan_window" };
+
+        auto const view { mapping.pin(w * static_cast<uint64_t>(mapping.window_size())) };
+        // Views extend past the window; occurrences starting there belong to the next window
+        auto const limit { ::std::min(mapping.window_size(), view->bytes.size()) };
+        ::std::vector<uint64_t> offsets {};
+        ::find_pattern(view->bytes, pattern, limit, [&](size_t const pos) {
+            offsets.push_back(view->offset + pos);
+            return true;
+        });
+        ::trace_count(trace_counter::bytes_scanned, limit);
+        return offsets;
+    }
+};
+
+
+//! \brief Searches the payloads of a model for a byte pattern.
+//!
+//! \return The occurrences in natural packet order, up to `options.max_hits`.
+//!         Occurrences that overlap a packet header or straddle two packets
+//!         aren't reported.
+//!
+//! \remark The log is split into `options.thread_count` ranges at packet
+//!         boundaries, which are searched concurrently. Occurrences are mapped
+//!         to packets through the directory.
+//!
+[[nodiscard]] inline ::std::vector<search_hit> search_model(model const& m, byte_pattern const& pattern,
+                                                            search_options const& options = {})
+{
+    trace_span const span { "search_model" };
+
+    auto const& directory { m.directory() };
+    if (directory.empty())
+    {
+        return {};
+    }
+    auto const log { m.bytes() };
+    auto const base { log.data() };
+    auto const ranges { ::std::min(::pattern_search::thread_count(options), directory.size()) };
+
+    ::std::vector<::std::vector<search_hit>> results(ranges);
+    auto const search_range { [&](size_t const range) {
+        auto const first { directory.size() * range / ranges };
+        auto const last { directory.size() * (range + 1) / ranges };
+        auto const begin { static_cast<size_t>(directory[first].data() - base) };
+        auto const end { static_cast<size_t>(directory[last - 1].data() - base) + directory[last - 1].size() };
+
+        // Occurrences are ascending, so each binary search over the directory starts at the previous packet
+        auto packet { directory.begin() + static_cast<ptrdiff_t>(first) };
+        auto const packets_end { directory.begin() + static_cast<ptrdiff_t>(last) };
+        auto& hits { results[range] };
+        ::find_pattern(log.subspan(begin, end - begin), pattern, end - begin, [&](size_t const pos) {
+            auto const p { base + begin + pos };
+            packet = ::std::prev(::std::upper_bound(packet, packets_end, p, [](auto const q, data_proxy const& rhs) {
+                return q < rhs.data();
+            }));
+            if (auto const hit { ::pattern_search::accept(
+                    static_cast<size_t>(packet - directory.begin()), static_cast<uint64_t>(packet->data() - base),
+                    packet->type(), packet->size(), begin + pos, pattern.size(), options) };
+                hit)
+            {
+                hits.push_back(*hit);
+            }
+            return hits.size() < options.max_hits;
+        });
+        ::trace_count(trace_counter::bytes_scanned, end - begin);
+    } };
+
+    if (ranges > 1)
+    {
+        ::std::vector<::std::jthread> workers {};
+        for (size_t range { 0 }; range < ranges; ++range)
+        {
+            workers.emplace_back(search_range, range);
+        }
+    }
+    else
+    {
+        search_range(0);
+    }
+
+    ::std::vector<search_hit> hits {};
+    for (auto const& range : results)
+    {
+        auto const count { ::std::min(range.size(), options.max_hits - hits.size()) };
+        hits.insert(hits.end(), range.begin(), range.begin() + static_cast<ptrdiff_t>(count));
+    }
+    return hits;
+}
+
+
+//! \brief Searches the payloads of a sensor log file for a byte pattern.
+//!
+//! \return The occurrences in natural packet order, up to `options.max_hits`.
+//!
+//! \remark The file is mapped in windows (see `windowed_mapping`), which are
+//!         scanned concurrently. Packet headers are only parsed up to the last
+//!         occurrence, to map occurrences to packet indices.
+//!
+[[nodiscard]] inline ::std::vector<search_hit> search_file(wchar_t const* const path_name, byte_pattern const& pattern,
+                                                           search_options const& options = {})
+{
+    trace_span const span { "search_file" };
+
+    windowed_mapping const mapping { path_name };
+    if (mapping.size() == 0)
+    {
+        return {};
+    }
+    return ::pattern_search::search_mapping(mapping, pattern, options);
+}
+
+
+//! \brief Searches all sensor logs in a folder for a byte pattern.
+//!
+//! \return One result per sensor log (see `is_sensor_log()`), in directory
+//!         order. Logs that fail to open are reported as `failed`.
+//!
+//! \remark Logs are searched concurrently, each with a share of
+//!         `options.thread_count`.
+//!
+[[nodiscard]] inline ::std::vector<file_search_result> search_folder(::std::filesystem::path const& folder,
+                                                                     byte_pattern const& pattern,
+                                                                     search_options const& options = {})
+{
+    trace_span const span { "search_folder" };
+
+    ::std::vector<file_search_result> results {};
+    for (auto const& entry : ::std::filesystem::directory_iterator { folder })
+    {
+        if (entry.is_regular_file() && ::is_sensor_log(entry.path().wstring()))
+        {
+            results.push_back({ entry.path(), {} });
+        }
+    }
+    if (results.empty())
+    {
+        return results;
+    }
+
+    auto const thread_count { ::pattern_search::thread_count(options) };
+    auto const file_threads { ::std::min(thread_count, results.size()) };
+    auto per_file { options };
+    per_file.thread_count = ::std::max(size_t { 1 }, thread_count / file_threads);
+
+    ::std::atomic<size_t> next { 0 };
+    {
+        ::std::vector<::std::jthread> workers {};
+        for (size_t t { 0 }; t < file_threads; ++t)
+        {
+            workers.emplace_back([&] {
+                for (auto index { next++ }; index < results.size(); index = next++)
+                {
+                    auto& result { results[index] };
+                    try
+                    {
+                        result.hits = ::search_file(result.path.c_str(), pattern, per_file);
+                    }
+                    catch (...)
+                    {
+                        LOG_CAUGHT_EXCEPTION();
+                        result.failed = true;
+                    }
+                }
+            });
+        }
+    }
+    return results;
+}
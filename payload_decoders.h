@@ -0,0 +1,237 @@
+#pragma once
+
+#include "packet_descriptions.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+
+//! \brief Reads a value from a possibly unaligned address.
+//!
+//! \tparam T          A trivially copyable type.
+//! \tparam big_endian Whether the value is stored in big endian byte order.
+//!
+//! \param[in] data Pointer to the first byte of the value.
+//!
+//! \return The value.
+//!
+template <typename T, bool big_endian = false>
+[[nodiscard]] inline T load_unaligned(unsigned char const* const data) noexcept
+{
+    static_assert(::std::is_trivially_copyable_v<T>);
+
+    ::std::array<unsigned char, sizeof(T)> bytes {};
+    ::std::memcpy(bytes.data(), data, sizeof(T));
+    if constexpr (big_endian)
+    {
+        ::std::reverse(begin(bytes), end(bytes));
+    }
+    return ::std::bit_cast<T>(bytes);
+}
+
+
+//! \brief Reads a little endian unsigned integer of 1 to 8 bytes.
+//!
+[[nodiscard]] inline uint64_t load_unsigned(unsigned char const* const data, size_t const size) noexcept
+{
+    assert(size >= 1 && size <= sizeof(uint64_t));
+
+    uint64_t value { 0 };
+    for (size_t b { 0 }; b < size; ++b)
+    {
+        value |= static_cast<uint64_t>(data[b]) << (b * 8);
+    }
+    return value;
+}
+
+
+// Storage properties per payload type. `size` is 0 for types of variable size.
+template <payload_type Type>
+struct payload_traits
+{
+    static constexpr size_t size { 0 };
+};
+
+template <typename T, bool BigEndian = false>
+struct fixed_payload_traits
+{
+    using storage_type = T;
+    static constexpr size_t size { sizeof(T) };
+    static constexpr bool big_endian { BigEndian };
+};
+
+// clang-format off
+template <> struct payload_traits<payload_type::ui8> : fixed_payload_traits<uint8_t> {};
+template <> struct payload_traits<payload_type::ui16> : fixed_payload_traits<uint16_t> {};
+template <> struct payload_traits<payload_type::ui32> : fixed_payload_traits<uint32_t> {};
+template <> struct payload_traits<payload_type::ui64> : fixed_payload_traits<uint64_t> {};
+template <> struct payload_traits<payload_type::file_time> : fixed_payload_traits<uint64_t> {};
+template <> struct payload_traits<payload_type::i8> : fixed_payload_traits<int8_t> {};
+template <> struct payload_traits<payload_type::i16> : fixed_payload_traits<int16_t> {};
+template <> struct payload_traits<payload_type::i32> : fixed_payload_traits<int32_t> {};
+template <> struct payload_traits<payload_type::i64> : fixed_payload_traits<int64_t> {};
+template <> struct payload_traits<payload_type::f32> : fixed_payload_traits<float> {};
+template <> struct payload_traits<payload_type::f64> : fixed_payload_traits<double> {};
+template <> struct payload_traits<payload_type::ui16_be> : fixed_payload_traits<uint16_t, true> {};
+template <> struct payload_traits<payload_type::ui32_be> : fixed_payload_traits<uint32_t, true> {};
+template <> struct payload_traits<payload_type::i16_be> : fixed_payload_traits<int16_t, true> {};
+template <> struct payload_traits<payload_type::i32_be> : fixed_payload_traits<int32_t, true> {};
+// clang-format on
+
+
+//! \brief Determines whether an element can be decoded from a payload.
+//!
+//! \return `true` if the element lies inside the payload and its size is valid
+//!         for its type (1, 2, 4, or 8 bytes for types of variable size).
+//!
+template <payload_type Type>
+[[nodiscard]] constexpr bool is_decodable(size_t const payload_size, ::payload_element const& element) noexcept
+{
+    if (element.offset + element.size > payload_size)
+    {
+        return false;
+    }
+    if constexpr (Type == payload_type::unknown)
+    {
+        return false;
+    }
+    else if constexpr (payload_traits<Type>::size == 0)
+    {
+        return ::std::has_single_bit(element.size) && element.size <= sizeof(uint64_t)
+               && (Type != payload_type::bitfield
+                   || (element.bit_count > 0 && element.bit_offset + element.bit_count <= element.size * 8));
+    }
+    else
+    {
+        return element.size == payload_traits<Type>::size;
+    }
+}
+
+
+//! \brief Decodes the raw (untransformed) integer of a `bitfield` or
+//!        `enumeration` element.
+//!
+[[nodiscard]] inline uint64_t decode_raw_unsigned(unsigned char const* const payload,
+                                                  ::payload_element const& element) noexcept
+{
+    auto const value { ::load_unsigned(payload + element.offset, element.size) };
+    if (element.type != payload_type::bitfield)
+    {
+        return value;
+    }
+    auto const shifted { value >> element.bit_offset };
+    return element.bit_count >= 64 ? shifted : shifted & ((uint64_t { 1 } << element.bit_count) - 1);
+}
+
+
+//! \brief Decodes the numeric value of a payload element of a given type.
+//!
+//! \remark The caller is responsible for validating the element (see
+//!         `is_decodable`). `file_time` elements don't have a numeric value.
+//!
+template <payload_type Type>
+[[nodiscard]] ::std::optional<double> decode_numeric(unsigned char const* const payload,
+                                                     ::payload_element const& element) noexcept
+{
+    if constexpr (Type == payload_type::unknown || Type == payload_type::file_time)
+    {
+        return {};
+    }
+    else if constexpr (Type == payload_type::enumeration)
+    {
+        return static_cast<double>(::decode_raw_unsigned(payload, element));
+    }
+    else if constexpr (Type == payload_type::bitfield)
+    {
+        return static_cast<double>(::decode_raw_unsigned(payload, element)) * element.scale + element.bias;
+    }
+    else
+    {
+        using traits = payload_traits<Type>;
+        auto const value { ::load_unaligned<typename traits::storage_type, traits::big_endian>(payload
+                                                                                              + element.offset) };
+        return static_cast<double>(value) * element.scale + element.bias;
+    }
+}
+
+
+//! \brief Decodes the numeric value of a payload element of a given type from
+//!        a number of payloads.
+//!
+//! \param[in]  payloads The packet payloads.
+//! \param[in]  element  The element description.
+//! \param[out] values   Receives one value per payload; NaN where the element
+//!                      cannot be decoded.
+//!
+//! \remark The type is resolved once for all payloads, so decoding a column
+//!         costs little more than loading the values.
+//!
+template <payload_type Type>
+void decode_numeric_column(::std::span<::std::span<unsigned char const> const> const payloads,
+                           ::payload_element const& element, double* const values) noexcept
+{
+    constexpr auto k_nan { ::std::numeric_limits<double>::quiet_NaN() };
+    for (size_t i { 0 }; i < payloads.size(); ++i)
+    {
+        auto const payload { payloads[i] };
+        values[i] = ::is_decodable<Type>(payload.size(), element)
+                        ? ::decode_numeric<Type>(payload.data(), element).value_or(k_nan)
+                        : k_nan;
+    }
+}
+
+
+// Decoder table, indexed by payload type. Adding a payload type only adds an entry; the decode path itself never
+// switches on the type.
+struct element_decoder
+{
+    bool (*is_decodable)(size_t payload_size, ::payload_element const& element) noexcept;
+    ::std::optional<double> (*decode_numeric)(unsigned char const* payload, ::payload_element const& element) noexcept;
+    void (*decode_numeric_column)(::std::span<::std::span<unsigned char const> const> payloads,
+                                  ::payload_element const& element, double* values) noexcept;
+};
+
+template <size_t... Types>
+[[nodiscard]] consteval auto make_element_decoders(::std::index_sequence<Types...>) noexcept
+{
+    return ::std::array<element_decoder, sizeof...(Types)> { element_decoder {
+        &::is_decodable<static_cast<payload_type>(Types)>, &::decode_numeric<static_cast<payload_type>(Types)>,
+        &::decode_numeric_column<static_cast<payload_type>(Types)> }... };
+}
+
+inline constexpr auto k_element_decoders { ::make_element_decoders(
+    ::std::make_index_sequence<static_cast<size_t>(payload_type::last_value) + 1> {}) };
+
+
+//! \brief Decodes the numeric value of a payload element.
+//!
+//! \param[in] payload The packet payload.
+//! \param[in] element The element description.
+//!
+//! \return The numeric value with scale and bias applied, or `nullopt` if the
+//!         element doesn't have a numeric value, or doesn't fit the payload.
+//!
+[[nodiscard]] inline ::std::optional<double> decode_element(::std::span<unsigned char const> const payload,
+                                                            ::payload_element const& element) noexcept
+{
+    auto const index { static_cast<size_t>(element.type) };
+    if (index >= k_element_decoders.size())
+    {
+        return {};
+    }
+    auto const& decoder { k_element_decoders[index] };
+    if (!decoder.is_decodable(payload.size(), element))
+    {
+        return {};
+    }
+    return decoder.decode_numeric(payload.data(), element);
+}
@@ -0,0 +1,808 @@
+// Python bindings for the sensor log model.
+//
+// Columns (raw log bytes, packet directory, per-type indices, decoded element values, timestamps) are exported through
+// the buffer protocol, so `numpy.asarray()` and `memoryview()` use them without copying. Columns are computed on first
+// use and shared by all subsequent requests. Loading and column computation run without holding the GIL.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "model.h"
+#include "packet_descriptions.h"
+#include "payload_decoders.h"
+
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+
+// Releases the GIL for the lifetime of the object. Must not touch any Python objects in the meantime.
+struct gil_release
+{
+    gil_release() noexcept : state_ { ::PyEval_SaveThread() } {}
+    ~gil_release() { ::PyEval_RestoreThread(state_); }
+
+    gil_release(gil_release const&) = delete;
+    gil_release& operator=(gil_release const&) = delete;
+
+private:
+    PyThreadState* state_;
+};
+
+
+// Runs a function implementing a Python method, translating C++ exceptions into Python exceptions
+template <typename F>
+[[nodiscard]] PyObject* translate_exceptions(F&& f) noexcept
+{
+    try
+    {
+        return f();
+    }
+    catch (::std::bad_alloc const&)
+    {
+        return ::PyErr_NoMemory();
+    }
+    catch (::std::filesystem::filesystem_error const& e)
+    {
+        ::PyErr_SetString(PyExc_OSError, e.what());
+    }
+    catch (::std::exception const& e)
+    {
+        ::PyErr_SetString(PyExc_RuntimeError, e.what());
+    }
+    return nullptr;
+}
+
+
+// Element format codes (see the `struct` module)
+template <typename T>
+constexpr char const* k_format { nullptr };
+template <>
+constexpr char const* k_format<uint8_t> { "B" };
+template <>
+constexpr char const* k_format<uint64_t> { "Q" };
+template <>
+constexpr char const* k_format<double> { "d" };
+
+
+// Memory exported through the buffer protocol
+struct column_storage
+{
+    void const* data;
+    Py_ssize_t length;
+    Py_ssize_t item_size;
+    char const* format;
+    // Owns `data`, unless it points into the model
+    ::std::shared_ptr<void const> keep_alive;
+};
+
+template <typename T>
+[[nodiscard]] column_storage make_column_storage(::std::shared_ptr<::std::vector<T> const> values) noexcept
+{
+    return { values->data(), static_cast<Py_ssize_t>(values->size()), sizeof(T), k_format<T>, ::std::move(values) };
+}
+
+
+// Native state of a `Model`
+struct model_state
+{
+    template <typename Source>
+    model_state(Source&& source, ::payload_container descriptions)
+        : m { ::std::forward<Source>(source), ::std::move(descriptions) }
+    {
+    }
+
+    ::model m;
+
+    // Guards the cached columns. Acquired without holding the GIL.
+    ::std::mutex lock;
+    ::std::shared_ptr<::std::vector<uint64_t> const> offsets;
+    ::std::shared_ptr<::std::vector<uint8_t> const> types;
+    ::std::shared_ptr<::std::vector<uint8_t> const> sizes;
+    ::std::shared_ptr<::std::vector<uint64_t> const> times;
+    bool type_indices_built { false };
+    ::std::array<::std::shared_ptr<::std::vector<uint64_t> const>, 256> type_indices {};
+    // Decoded element values, keyed by packet type and element index
+    ::std::map<::std::pair<unsigned char, size_t>, ::std::shared_ptr<::std::vector<double> const>> element_columns;
+};
+
+
+struct model_object
+{
+    PyObject_HEAD
+    model_state* state;
+};
+
+struct column_object
+{
+    PyObject_HEAD
+    // The `Model` this column was taken from; keeps the log mapped
+    PyObject* owner;
+    column_storage storage;
+};
+
+PyTypeObject g_model_type {};
+PyTypeObject g_column_type {};
+
+
+[[nodiscard]] PyObject* make_column(PyObject* const owner, column_storage storage) noexcept
+{
+    auto* const column { PyObject_New(column_object, &g_column_type) };
+    if (column == nullptr)
+    {
+        return nullptr;
+    }
+    ::Py_INCREF(owner);
+    column->owner = owner;
+    new (&column->storage) column_storage { ::std::move(storage) };
+    return reinterpret_cast<PyObject*>(column);
+}
+
+
+void column_dealloc(PyObject* const self) noexcept
+{
+    auto* const column { reinterpret_cast<column_object*>(self) };
+    column->storage.~column_storage();
+    ::Py_XDECREF(column->owner);
+    PyObject_Free(self);
+}
+
+
+int column_getbuffer(PyObject* const self, Py_buffer* const view, int const flags) noexcept
+{
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+    {
+        ::PyErr_SetString(PyExc_BufferError, "Columns are read-only");
+        view->obj = nullptr;
+        return -1;
+    }
+
+    auto* const column { reinterpret_cast<column_object*>(self) };
+    auto& storage { column->storage };
+    view->buf = const_cast<void*>(storage.data);
+    view->obj = ::Py_NewRef(self);
+    view->len = storage.length * storage.item_size;
+    view->readonly = 1;
+    view->itemsize = storage.item_size;
+    view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? const_cast<char*>(storage.format) : nullptr;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &storage.length : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &storage.item_size : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+
+Py_ssize_t column_length(PyObject* const self) noexcept
+{
+    return reinterpret_cast<column_object*>(self)->storage.length;
+}
+
+
+// Converts a `str` or path-like object into a path
+[[nodiscard]] ::std::optional<::std::filesystem::path> to_path(PyObject* const object)
+{
+    PyObject* decoded { nullptr };
+    if (!::PyUnicode_FSDecoder(object, &decoded))
+    {
+        return {};
+    }
+    Py_ssize_t length {};
+    auto* const wide { ::PyUnicode_AsWideCharString(decoded, &length) };
+    ::Py_DECREF(decoded);
+    if (wide == nullptr)
+    {
+        return {};
+    }
+    ::std::filesystem::path path { ::std::wstring_view { wide, static_cast<size_t>(length) } };
+    ::PyMem_Free(wide);
+    return path;
+}
+
+
+[[nodiscard]] PyObject* from_wide(::std::wstring_view const text) noexcept
+{
+    return ::PyUnicode_FromWideChar(text.data(), static_cast<Py_ssize_t>(text.size()));
+}
+
+
+[[nodiscard]] ::std::optional<::payload_container> load_descriptions(PyObject* const path_object)
+{
+    if (path_object == nullptr || path_object == Py_None)
+    {
+        return ::payload_container {};
+    }
+    auto const path { to_path(path_object) };
+    if (!path)
+    {
+        return {};
+    }
+    gil_release const unlocked {};
+    return ::load_packet_descriptions_cached(*path);
+}
+
+
+[[nodiscard]] model_state& state(PyObject* const self) noexcept
+{
+    return *reinterpret_cast<model_object*>(self)->state;
+}
+
+
+// Model(path, descriptions=None)
+PyObject* model_new(PyTypeObject* const type, PyObject* const args, PyObject* const kwargs) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        static char const* keywords[] { "path", "descriptions", nullptr };
+        PyObject* path_object { nullptr };
+        PyObject* descriptions_object { nullptr };
+        if (!::PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char**>(keywords), &path_object,
+                                           &descriptions_object))
+        {
+            return nullptr;
+        }
+        auto const path { to_path(path_object) };
+        auto descriptions { load_descriptions(descriptions_object) };
+        if (!path || !descriptions)
+        {
+            return nullptr;
+        }
+
+        ::std::unique_ptr<model_state> loaded {};
+        {
+            gil_release const unlocked {};
+            loaded = ::std::make_unique<model_state>(path->c_str(), ::std::move(*descriptions));
+        }
+        auto* const self { reinterpret_cast<model_object*>(type->tp_alloc(type, 0)) };
+        if (self != nullptr)
+        {
+            self->state = loaded.release();
+        }
+        return reinterpret_cast<PyObject*>(self);
+    });
+}
+
+
+// Model.from_bytes(data, descriptions=None)
+PyObject* model_from_bytes(PyObject* const cls, PyObject* const args, PyObject* const kwargs) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        static char const* keywords[] { "data", "descriptions", nullptr };
+        Py_buffer data {};
+        PyObject* descriptions_object { nullptr };
+        if (!::PyArg_ParseTupleAndKeywords(args, kwargs, "y*|O", const_cast<char**>(keywords), &data,
+                                           &descriptions_object))
+        {
+            return nullptr;
+        }
+        // `PyBuffer_Release` must run with the GIL held, after the copy
+        ::std::unique_ptr<Py_buffer, decltype(&::PyBuffer_Release)> const release { &data, &::PyBuffer_Release };
+        auto descriptions { load_descriptions(descriptions_object) };
+        if (!descriptions)
+        {
+            return nullptr;
+        }
+
+        ::std::unique_ptr<model_state> loaded {};
+        {
+            gil_release const unlocked {};
+            auto const* const bytes { static_cast<unsigned char const*>(data.buf) };
+            loaded = ::std::make_unique<model_state>(::std::vector<unsigned char>(bytes, bytes + data.len),
+                                                     ::std::move(*descriptions));
+        }
+        auto* const type { reinterpret_cast<PyTypeObject*>(cls) };
+        auto* const self { reinterpret_cast<model_object*>(type->tp_alloc(type, 0)) };
+        if (self != nullptr)
+        {
+            self->state = loaded.release();
+        }
+        return reinterpret_cast<PyObject*>(self);
+    });
+}
+
+
+void model_dealloc(PyObject* const self) noexcept
+{
+    delete reinterpret_cast<model_object*>(self)->state;
+    Py_TYPE(self)->tp_free(self);
+}
+
+
+Py_ssize_t model_length(PyObject* const self) noexcept
+{
+    return static_cast<Py_ssize_t>(state(self).m.directory().size());
+}
+
+
+// Model.data: the raw sensor log
+PyObject* model_data(PyObject* const self, void*) noexcept
+{
+    auto const bytes { state(self).m.bytes() };
+    return make_column(self, { bytes.data(), static_cast<Py_ssize_t>(bytes.size()), 1, k_format<uint8_t>, {} });
+}
+
+
+// Builds the packet directory columns. Requires `s.lock` to be held.
+void build_directory_columns(model_state& s)
+{
+    if (s.offsets)
+    {
+        return;
+    }
+    auto const& directory { s.m.directory() };
+    auto const* const base { s.m.bytes().data() };
+    ::std::vector<uint64_t> offsets(directory.size());
+    ::std::vector<uint8_t> types(directory.size());
+    ::std::vector<uint8_t> sizes(directory.size());
+    for (size_t index { 0 }; index < directory.size(); ++index)
+    {
+        offsets[index] = static_cast<uint64_t>(directory[index].data() - base);
+        types[index] = directory[index].type();
+        sizes[index] = static_cast<uint8_t>(directory[index].payload_size());
+    }
+    s.offsets = ::std::make_shared<::std::vector<uint64_t> const>(::std::move(offsets));
+    s.types = ::std::make_shared<::std::vector<uint8_t> const>(::std::move(types));
+    s.sizes = ::std::make_shared<::std::vector<uint8_t> const>(::std::move(sizes));
+}
+
+
+// Model.offsets, Model.types, Model.sizes: the packet directory in natural order
+template <auto Member>
+PyObject* model_directory_column(PyObject* const self, void*) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        auto& s { state(self) };
+        column_storage storage {};
+        {
+            gil_release const unlocked {};
+            ::std::scoped_lock lock { s.lock };
+            build_directory_columns(s);
+            storage = make_column_storage(s.*Member);
+        }
+        return make_column(self, ::std::move(storage));
+    });
+}
+
+
+// Model.times: reconstructed timestamps (FILETIME) in natural order, or None
+PyObject* model_times(PyObject* const self, void*) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        auto& s { state(self) };
+        if (!s.m.time_column())
+        {
+            Py_RETURN_NONE;
+        }
+        column_storage storage {};
+        {
+            gil_release const unlocked {};
+            ::std::scoped_lock lock { s.lock };
+            if (!s.times)
+            {
+                auto const& column { *s.m.time_column() };
+                ::std::vector<uint64_t> times(column.size());
+                column.decode(0, times);
+                s.times = ::std::make_shared<::std::vector<uint64_t> const>(::std::move(times));
+            }
+            storage = make_column_storage(s.times);
+        }
+        return make_column(self, ::std::move(storage));
+    });
+}
+
+
+// Builds the per-type index columns. Requires `s.lock` to be held.
+void build_type_indices(model_state& s)
+{
+    if (s.type_indices_built)
+    {
+        return;
+    }
+    auto const& directory { s.m.directory() };
+    ::std::array<size_t, 256> counts {};
+    for (auto const& packet : directory)
+    {
+        ++counts[packet.type()];
+    }
+    ::std::array<::std::vector<uint64_t>, 256> indices {};
+    for (size_t type { 0 }; type < indices.size(); ++type)
+    {
+        indices[type].reserve(counts[type]);
+    }
+    for (size_t index { 0 }; index < directory.size(); ++index)
+    {
+        indices[directory[index].type()].push_back(index);
+    }
+    for (size_t type { 0 }; type < indices.size(); ++type)
+    {
+        s.type_indices[type] = ::std::make_shared<::std::vector<uint64_t> const>(::std::move(indices[type]));
+    }
+    s.type_indices_built = true;
+}
+
+
+[[nodiscard]] bool parse_packet_type(PyObject* const object, unsigned char& type) noexcept
+{
+    auto const value { ::PyLong_AsLong(object) };
+    if (value == -1 && ::PyErr_Occurred())
+    {
+        return false;
+    }
+    if (value < 0 || value > 0xFF)
+    {
+        ::PyErr_SetString(PyExc_ValueError, "Packet type must be in the range 0..255");
+        return false;
+    }
+    type = static_cast<unsigned char>(value);
+    return true;
+}
+
+
+// Model.type_indices(type): indices (natural order) of all packets of a type
+PyObject* model_type_indices(PyObject* const self, PyObject* const arg) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        unsigned char type {};
+        if (!parse_packet_type(arg, type))
+        {
+            return nullptr;
+        }
+        auto& s { state(self) };
+        column_storage storage {};
+        {
+            gil_release const unlocked {};
+            ::std::scoped_lock lock { s.lock };
+            build_type_indices(s);
+            storage = make_column_storage(s.type_indices[type]);
+        }
+        return make_column(self, ::std::move(storage));
+    });
+}
+
+
+// Model.column(type, element): decoded values of an element for all packets of a type (aligned with
+// `type_indices(type)`); NaN where a packet is too short
+PyObject* model_column(PyObject* const self, PyObject* const args) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        PyObject* type_object { nullptr };
+        Py_ssize_t element_index {};
+        if (!::PyArg_ParseTuple(args, "On", &type_object, &element_index))
+        {
+            return nullptr;
+        }
+        unsigned char type {};
+        if (!parse_packet_type(type_object, type))
+        {
+            return nullptr;
+        }
+        auto& s { state(self) };
+        auto const& descriptions { s.m.packet_descriptions() };
+        auto const description { descriptions.find(type) };
+        if (description == end(descriptions) || element_index < 0
+            || static_cast<size_t>(element_index) >= description->second.elements.size())
+        {
+            ::PyErr_SetString(PyExc_KeyError, "Unknown packet type or element");
+            return nullptr;
+        }
+        auto const& element { description->second.elements[static_cast<size_t>(element_index)] };
+
+        column_storage storage {};
+        {
+            gil_release const unlocked {};
+            ::std::scoped_lock lock { s.lock };
+            auto& cached { s.element_columns[{ type, static_cast<size_t>(element_index) }] };
+            if (!cached)
+            {
+                build_type_indices(s);
+                auto const& indices { *s.type_indices[type] };
+                auto const& directory { s.m.directory() };
+                ::std::vector<double> values(indices.size());
+                for (size_t i { 0 }; i < indices.size(); ++i)
+                {
+                    auto const& packet { directory[static_cast<size_t>(indices[i])] };
+                    values[i] = ::decode_element({ packet.data() + packet.header_size(), packet.payload_size() },
+                                                 element)
+                                    .value_or(::std::numeric_limits<double>::quiet_NaN());
+                }
+                cached = ::std::make_shared<::std::vector<double> const>(::std::move(values));
+            }
+            storage = make_column_storage(cached);
+        }
+        return make_column(self, ::std::move(storage));
+    });
+}
+
+
+// Model.indices(types=None, sort="index", order="asc"): packet indices (natural order) after filtering and sorting
+PyObject* model_indices(PyObject* const self, PyObject* const args, PyObject* const kwargs) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        static char const* keywords[] { "types", "sort", "order", nullptr };
+        PyObject* types_object { nullptr };
+        char const* sort_name { "index" };
+        char const* order_name { "asc" };
+        if (!::PyArg_ParseTupleAndKeywords(args, kwargs, "|Oss", const_cast<char**>(keywords), &types_object,
+                                           &sort_name, &order_name))
+        {
+            return nullptr;
+        }
+
+        ::std::optional<::std::bitset<256>> types {};
+        if (types_object != nullptr && types_object != Py_None)
+        {
+            PyObject* const iterator { ::PyObject_GetIter(types_object) };
+            if (iterator == nullptr)
+            {
+                return nullptr;
+            }
+            types.emplace();
+            while (PyObject* const item { ::PyIter_Next(iterator) })
+            {
+                unsigned char type {};
+                auto const valid { parse_packet_type(item, type) };
+                ::Py_DECREF(item);
+                if (!valid)
+                {
+                    break;
+                }
+                types->set(type);
+            }
+            ::Py_DECREF(iterator);
+            if (::PyErr_Occurred())
+            {
+                return nullptr;
+            }
+        }
+
+        ::std::string_view const sort { sort_name };
+        ::std::string_view const order { order_name };
+        auto const pred { sort == "type" ? sort_predicate::type
+                          : sort == "size" ? sort_predicate::size
+                                           : sort_predicate::index };
+        if (pred == sort_predicate::index && sort != "index")
+        {
+            ::PyErr_SetString(PyExc_ValueError, "sort must be one of 'index', 'type', 'size'");
+            return nullptr;
+        }
+        if (order != "asc" && order != "desc")
+        {
+            ::PyErr_SetString(PyExc_ValueError, "order must be one of 'asc', 'desc'");
+            return nullptr;
+        }
+        auto const dir { order == "asc" ? sort_direction::asc : sort_direction::desc };
+
+        auto& s { state(self) };
+        column_storage storage {};
+        {
+            gil_release const unlocked {};
+            auto const& directory { s.m.directory() };
+            ::std::vector<size_t> indices {};
+            if (types)
+            {
+                for (size_t index { 0 }; index < directory.size(); ++index)
+                {
+                    if (types->test(directory[index].type()))
+                    {
+                        indices.push_back(index);
+                    }
+                }
+            }
+            else
+            {
+                indices.resize(directory.size());
+                ::std::iota(begin(indices), end(indices), size_t { 0 });
+            }
+            ::sort_packet_indices(directory, indices, pred, dir);
+            storage = make_column_storage(
+                ::std::make_shared<::std::vector<uint64_t> const>(begin(indices), end(indices)));
+        }
+        return make_column(self, ::std::move(storage));
+    });
+}
+
+
+// Model.payload(index): the payload of a packet (natural order)
+PyObject* model_payload(PyObject* const self, PyObject* const arg) noexcept
+{
+    auto const index { ::PyLong_AsSsize_t(arg) };
+    if (index == -1 && ::PyErr_Occurred())
+    {
+        return nullptr;
+    }
+    auto const& directory { state(self).m.directory() };
+    if (index < 0 || static_cast<size_t>(index) >= directory.size())
+    {
+        ::PyErr_SetString(PyExc_IndexError, "Packet index out of range");
+        return nullptr;
+    }
+    auto const& packet { directory[static_cast<size_t>(index)] };
+    return make_column(self, { packet.data() + packet.header_size(), static_cast<Py_ssize_t>(packet.payload_size()), 1,
+                               k_format<uint8_t>, {} });
+}
+
+
+// Model.packet_descriptions: {type: {"name": str | None, "elements": [{...}]}}
+PyObject* model_packet_descriptions(PyObject* const self, void*) noexcept
+{
+    return translate_exceptions([&]() -> PyObject* {
+        // Steals a reference to `value`
+        auto const set_item = [](PyObject* const dict, char const* const key, PyObject* const value) {
+            if (value == nullptr)
+            {
+                return false;
+            }
+            auto const result { ::PyDict_SetItemString(dict, key, value) };
+            ::Py_DECREF(value);
+            return result == 0;
+        };
+        auto const optional_string = [](::std::optional<::std::wstring> const& text) {
+            return text ? from_wide(*text) : ::Py_NewRef(Py_None);
+        };
+
+        ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> result { ::PyDict_New(), &::Py_DecRef };
+        if (!result)
+        {
+            return nullptr;
+        }
+        for (auto const& [type, description] : state(self).m.packet_descriptions())
+        {
+            ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> entry { ::PyDict_New(), &::Py_DecRef };
+            ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> elements { ::PyList_New(0), &::Py_DecRef };
+            if (!entry || !elements || !set_item(entry.get(), "name", optional_string(description.name)))
+            {
+                return nullptr;
+            }
+            for (auto const& el : description.elements)
+            {
+                ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> element { ::PyDict_New(), &::Py_DecRef };
+                ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> values { ::PyDict_New(), &::Py_DecRef };
+                if (!element || !values)
+                {
+                    return nullptr;
+                }
+                for (auto const& [value, name] : el.enum_values)
+                {
+                    ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> key { ::PyLong_FromUnsignedLongLong(value),
+                                                                              &::Py_DecRef };
+                    ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> text { from_wide(name), &::Py_DecRef };
+                    if (!key || !text || ::PyDict_SetItem(values.get(), key.get(), text.get()) != 0)
+                    {
+                        return nullptr;
+                    }
+                }
+                ::nlohmann::json const type_name = el.type;
+                if (!set_item(element.get(), "offset", ::PyLong_FromSize_t(el.offset))
+                    || !set_item(element.get(), "size", ::PyLong_FromSize_t(el.size))
+                    || !set_item(element.get(), "type",
+                                 type_name.is_null() ? ::Py_NewRef(Py_None)
+                                                     : ::PyUnicode_FromString(type_name.get<::std::string>().c_str()))
+                    || !set_item(element.get(), "comment", optional_string(el.comment))
+                    || !set_item(element.get(), "scale", ::PyFloat_FromDouble(el.scale))
+                    || !set_item(element.get(), "bias", ::PyFloat_FromDouble(el.bias))
+                    || !set_item(element.get(), "bit_offset", ::PyLong_FromLong(el.bit_offset))
+                    || !set_item(element.get(), "bit_count", ::PyLong_FromLong(el.bit_count))
+                    || !set_item(element.get(), "values", values.release())
+                    || ::PyList_Append(elements.get(), element.get()) != 0)
+                {
+                    return nullptr;
+                }
+            }
+            ::std::unique_ptr<PyObject, decltype(&::Py_DecRef)> key { ::PyLong_FromLong(type), &::Py_DecRef };
+            if (!key || !set_item(entry.get(), "elements", elements.release())
+                || ::PyDict_SetItem(result.get(), key.get(), entry.get()) != 0)
+            {
+                return nullptr;
+            }
+        }
+        return result.release();
+    });
+}
+
+
+PyMethodDef g_model_methods[] {
+    { "from_bytes", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(&model_from_bytes)),
+      METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+      "from_bytes(data, descriptions=None)\n--\n\nLoads a sensor log from a bytes-like object (copied)." },
+    { "type_indices", &model_type_indices, METH_O,
+      "type_indices(type)\n--\n\nIndices (natural order) of all packets of a type." },
+    { "column", &model_column, METH_VARARGS,
+      "column(type, element)\n--\n\nDecoded values (float64) of a payload element for all packets of a type, aligned "
+      "with type_indices(type). NaN where the element doesn't fit the payload." },
+    { "indices", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(&model_indices)),
+      METH_VARARGS | METH_KEYWORDS,
+      "indices(types=None, sort='index', order='asc')\n--\n\nPacket indices (natural order) filtered by packet type "
+      "and stably sorted by 'index', 'type', or 'size'." },
+    { "payload", &model_payload, METH_O, "payload(index)\n--\n\nThe payload bytes of a packet (natural order)." },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+PyGetSetDef g_model_getset[] {
+    { "data", &model_data, nullptr, "The raw sensor log (uint8).", nullptr },
+    { "offsets", &model_directory_column<&model_state::offsets>, nullptr,
+      "Byte offset of each packet (uint64, natural order).", nullptr },
+    { "types", &model_directory_column<&model_state::types>, nullptr, "Type of each packet (uint8, natural order).",
+      nullptr },
+    { "sizes", &model_directory_column<&model_state::sizes>, nullptr,
+      "Payload size of each packet (uint8, natural order).", nullptr },
+    { "times", &model_times, nullptr,
+      "Reconstructed timestamp (FILETIME, uint64) of each packet in natural order, or None.", nullptr },
+    { "packet_descriptions", &model_packet_descriptions, nullptr, "The packet descriptions used for decoding.",
+      nullptr },
+    { nullptr, nullptr, nullptr, nullptr, nullptr }
+};
+
+PySequenceMethods g_model_sequence {};
+PySequenceMethods g_column_sequence {};
+PyBufferProcs g_column_buffer {};
+
+PyModuleDef g_module {
+    PyModuleDef_HEAD_INIT,
+    "msbsla",
+    "Zero-copy access to Microsoft Band sensor logs.",
+    -1,
+    nullptr,
+};
+
+} // namespace
+
+
+PyMODINIT_FUNC PyInit_msbsla()
+{
+    g_column_sequence.sq_length = &column_length;
+    g_column_buffer.bf_getbuffer = &column_getbuffer;
+    g_column_type.tp_name = "msbsla.Column";
+    g_column_type.tp_doc = "Read-only column exported through the buffer protocol (e.g. numpy.asarray(column)).";
+    g_column_type.tp_basicsize = sizeof(column_object);
+    g_column_type.tp_flags = Py_TPFLAGS_DEFAULT;
+    g_column_type.tp_dealloc = &column_dealloc;
+    g_column_type.tp_as_sequence = &g_column_sequence;
+    g_column_type.tp_as_buffer = &g_column_buffer;
+
+    g_model_sequence.sq_length = &model_length;
+    g_model_type.tp_name = "msbsla.Model";
+    g_model_type.tp_doc = "Model(path, descriptions=None)\n--\n\nA memory-mapped sensor log. `descriptions` is the "
+                          "path of a packet_descriptions.json file.";
+    g_model_type.tp_basicsize = sizeof(model_object);
+    g_model_type.tp_flags = Py_TPFLAGS_DEFAULT;
+    g_model_type.tp_new = &model_new;
+    g_model_type.tp_dealloc = &model_dealloc;
+    g_model_type.tp_as_sequence = &g_model_sequence;
+    g_model_type.tp_methods = g_model_methods;
+    g_model_type.tp_getset = g_model_getset;
+
+    if (::PyType_Ready(&g_column_type) < 0 || ::PyType_Ready(&g_model_type) < 0)
+    {
+        return nullptr;
+    }
+    auto* const module { ::PyModule_Create(&g_module) };
+    if (module == nullptr)
+    {
+        return nullptr;
+    }
+    if (::PyModule_AddObjectRef(module, "Model", reinterpret_cast<PyObject*>(&g_model_type)) < 0
+        || ::PyModule_AddObjectRef(module, "Column", reinterpret_cast<PyObject*>(&g_column_type)) < 0)
+    {
+        ::Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
@@ -0,0 +1,33 @@
+# Builds the `msbsla` Python extension module:
+#
+#   python -m pip install ./python
+#
+# Restore the NuGet packages of msbsla.sln first; the extension uses the same WIL and nlohmann.json headers as the
+# application.
+
+import pathlib
+
+from setuptools import Extension, setup
+
+root = pathlib.Path(__file__).resolve().parent.parent
+packages = root / "packages"
+
+setup(
+    name="msbsla",
+    version="0.1.0",
+    description="Zero-copy access to Microsoft Band sensor logs",
+    python_requires=">=3.10",
+    ext_modules=[
+        Extension(
+            "msbsla",
+            sources=[str(pathlib.Path(__file__).resolve().parent / "msbsla_module.cpp")],
+            include_dirs=[
+                str(root),
+                str(packages / "Microsoft.Windows.ImplementationLibrary.1.0.220201.1" / "include"),
+                str(packages / "nlohmann.json.3.10.5" / "build" / "native" / "include"),
+            ],
+            define_macros=[("WIN32_LEAN_AND_MEAN", None), ("NOMINMAX", None), ("UNICODE", None), ("_UNICODE", None)],
+            extra_compile_args=["/std:c++latest", "/EHsc", "/permissive-"],
+        )
+    ],
+)
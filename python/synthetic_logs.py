@@ -0,0 +1,67 @@
+# Writes a year of synthetic sensor logs (one per day, about 66 MB in total) for timing session segmentation:
+#
+#   python python/synthetic_logs.py OUTPUT_DIR [DAYS]
+#   msbsla --segment-sessions=RESULT_DIR OUTPUT_DIR
+#
+# Every day is split into 10-minute chunks of heart rate readings every 2 seconds and a worn-state packet every minute.
+# Nights (23:00-07:00) are asleep (low heart rate, sleep confidence), 18:00-19:00 is a bike ride (high heart rate,
+# extra [TIMESTAMP] packets every 30 seconds), and the device is off the wrist from 12:00-13:00. Output is
+# deterministic.
+
+import pathlib
+import random
+import struct
+import sys
+
+TICKS_PER_SECOND = 10_000_000
+TICKS_PER_DAY = 86_400 * TICKS_PER_SECOND
+# 2022-06-17 00:00 UTC
+FIRST_DAY = 133_000_000_000_000_000 // TICKS_PER_DAY * TICKS_PER_DAY
+
+TIMESTAMP = 0x00
+SEQUENCE_ID = 0x0F
+HEART_RATE = 0x80
+WORN = 0x81
+
+
+def packet(packet_type, payload):
+    return bytes((packet_type, len(payload))) + payload
+
+
+def write_logs(output_dir, days):
+    output_dir.mkdir(parents=True, exist_ok=True)
+    rng = random.Random(3)
+    sequence_id = 0
+    worn_seconds = 0
+    for day in range(days):
+        log = bytearray()
+        for chunk in range(144):
+            start = FIRST_DAY + day * TICKS_PER_DAY + chunk * 600 * TICKS_PER_SECOND
+            log += packet(TIMESTAMP, struct.pack("<Q", start))
+            for second in range(0, 600, 2):
+                hour = (chunk * 600 + second) // 3_600
+                asleep = hour < 7 or hour >= 23
+                riding = hour == 18
+                if riding and second % 30 == 0 and second > 0:
+                    log += packet(TIMESTAMP, struct.pack("<Q", start + second * TICKS_PER_SECOND))
+                if hour == 12:
+                    continue
+                if asleep:
+                    bpm, confidence = 52 + rng.randrange(6), 10
+                elif riding:
+                    bpm, confidence = 130 + rng.randrange(20), rng.randrange(10)
+                else:
+                    bpm, confidence = 70 + rng.randrange(15), rng.randrange(10)
+                log += packet(HEART_RATE, bytes((bpm, confidence)))
+                if second % 60 == 0:
+                    worn_seconds += 60
+                    log += packet(WORN, struct.pack("<IH", worn_seconds & 0xFFFF_FFFF, 60))
+            log += packet(SEQUENCE_ID, struct.pack("<I", sequence_id))
+            sequence_id += 1
+        (output_dir / f"{day:03}.bin").write_bytes(log)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        sys.exit(f"usage: {sys.argv[0]} OUTPUT_DIR [DAYS]")
+    write_logs(pathlib.Path(sys.argv[1]), int(sys.argv[2]) if len(sys.argv) == 3 else 365)
@@ -0,0 +1,1480 @@
+#pragma once
+
+#include "char_encoding_utils.h"
+#include "cross_correlation.h"
+#include "field_profiler.h"
+#include "model.h"
+#include "packet_filters.h"
+#include "pattern_search.h"
+#include "payload_decoders.h"
+#include "sampling_cadence.h"
+#include "sequence_statistics.h"
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+// Included after the Winsock headers for `wil::unique_socket`
+#include <wil/resource.h>
+#include <wil/result.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#pragma comment(lib, "ws2_32.lib")
+
+
+struct http_response
+{
+    int status;
+    // JSON document
+    ::std::string body;
+};
+
+
+//! \brief Parses an unsigned integer in decimal or hexadecimal (`0x` prefix)
+//!        notation.
+//!
+//! \return The value, or `nullopt` if `text` isn't a valid number in its
+//!         entirety.
+//!
+[[nodiscard]] inline ::std::optional<uint64_t> parse_unsigned(::std::string_view text) noexcept
+{
+    auto base { 10 };
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+    {
+        text.remove_prefix(2);
+        base = 16;
+    }
+    uint64_t value {};
+    auto const [end, ec] { ::std::from_chars(text.data(), text.data() + text.size(), value, base) };
+    if (text.empty() || ec != ::std::errc {} || end != text.data() + text.size())
+    {
+        return {};
+    }
+    return value;
+}
+
+
+//! \brief Splits a URL query string into percent-decoded key/value pairs.
+//!
+//! \param[in] query The query string without the leading `?`.
+//!
+//! \return The key/value pairs. Keys without a value map to an empty string.
+//!         If a key appears more than once, the final value wins.
+//!
+[[nodiscard]] inline ::std::map<::std::string, ::std::string, ::std::less<>> parse_query_string(
+    ::std::string_view query)
+{
+    auto const decode = [](::std::string_view const encoded) {
+        ::std::string decoded {};
+        decoded.reserve(encoded.size());
+        for (size_t i { 0 }; i < encoded.size(); ++i)
+        {
+            if (encoded[i] == '+')
+            {
+                decoded.push_back(' ');
+            }
+            else if (encoded[i] == '%' && i + 2 < encoded.size())
+            {
+                unsigned value {};
+                auto const [end, ec] { ::std::from_chars(encoded.data() + i + 1, encoded.data() + i + 3, value, 16) };
+                if (ec == ::std::errc {} && end == encoded.data() + i + 3)
+                {
+                    decoded.push_back(static_cast<char>(value));
+                    i += 2;
+                }
+                else
+                {
+                    decoded.push_back('%');
+                }
+            }
+            else
+            {
+                decoded.push_back(encoded[i]);
+            }
+        }
+        return decoded;
+    };
+
+    ::std::map<::std::string, ::std::string, ::std::less<>> result {};
+    while (!query.empty())
+    {
+        auto const amp { query.find('&') };
+        auto const pair { query.substr(0, amp) };
+        query = amp == ::std::string_view::npos ? ::std::string_view {} : query.substr(amp + 1);
+        if (pair.empty())
+        {
+            continue;
+        }
+        auto const eq { pair.find('=') };
+        result[decode(pair.substr(0, eq))] = eq == ::std::string_view::npos ? ::std::string {}
+                                                                              : decode(pair.substr(eq + 1));
+    }
+    return result;
+}
+
+
+//! \brief Appends a string to a JSON document as a quoted and escaped string
+//!        literal.
+//!
+//! \param[in,out] out  The JSON document.
+//! \param[in]     utf8 The UTF-8 encoded string.
+//!
+inline void append_json_string(::std::string& out, ::std::string_view const utf8)
+{
+    out.push_back('"');
+    for (auto const ch : utf8)
+    {
+        switch (ch)
+        {
+        case '"':
+            out.append("\\\"");
+            break;
+        case '\\':
+            out.append("\\\\");
+            break;
+        case '\n':
+            out.append("\\n");
+            break;
+        case '\r':
+            out.append("\\r");
+            break;
+        case '\t':
+            out.append("\\t");
+            break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20)
+            {
+                ::std::format_to(::std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(ch));
+            }
+            else
+            {
+                out.push_back(ch);
+            }
+            break;
+        }
+    }
+    out.push_back('"');
+}
+
+
+//! \brief Appends a number to a JSON document. Non-finite values are written as
+//!        `null`, since JSON has no representation for them.
+//!
+inline void append_json_number(::std::string& out, double const value)
+{
+    if (::std::isfinite(value))
+    {
+        ::std::format_to(::std::back_inserter(out), "{}", value);
+    }
+    else
+    {
+        out.append("null");
+    }
+}
+
+
+// Embedded HTTP server answering read-only queries against a model over JSON. The server only listens on the loopback
+// interface.
+//
+// Endpoints (all `GET`):
+//
+//   /packets?offset=0&count=100&types=0x80,0x81&sort=index|type|size&order=asc|desc
+//            &from=<FILETIME>&to=<FILETIME>&value=0x80:0:60:100
+//     A page of packets in the requested filter and sort order, including their reconstructed time and decoded element
+//     values. `from` and `to` restrict packets to a time range [from, to), `value` to packets of a type whose element
+//     (`type:element:min:max`) is in [min, max].
+//   /series?type=0x80&element=0&from=<FILETIME>&to=<FILETIME>&points=1000
+//     An element's values over the time range [from, to), downsampled into at most `points` buckets of equal duration
+//     (count, min, max, and mean per bucket). `from` and `to` default to the type's time range. Packet times aren't
+//     necessarily ascending in natural order, so packets are selected by time rather than by position.
+//   /stats
+//     Per-type packet counts, sizes, and index ranges.
+//   /search?pattern=A5??5A&type=0x80&offset=0&limit=100
+//     Occurrences of a byte pattern (hex digits, `?` matches any nibble) in the payloads, in natural order. `type` and
+//     `offset` restrict occurrences to a packet type and a payload offset, respectively. Each search runs on the
+//     worker serving the request.
+//   /sequences?length=8&top=32&chunks=1
+//     Packet type counts, the type transition matrix (non-zero cells only), and the `top` most frequent type n-grams
+//     of length 2 through `length`. `chunks=1` doesn't count transitions across chunk boundaries.
+//   /cadence?min_gap=<ticks>&events=100
+//     Sampling cadence per packet type (interval distribution and dominant interval), along with the first `events`
+//     gaps and bursts. Gaps need to last at least `min_gap` FILETIME ticks.
+//   /correlation?lhs=0x80:0&rhs=0x81:1&resolution=<ticks>&lag=60
+//     Lagged Pearson and Spearman correlation between two elements (`type:element`), resampled onto a common time base
+//     of `resolution` FILETIME ticks per bin, for lags in [-lag, lag] bins.
+//   /profile?type=0x80&offset=0&limit=100
+//     Statistics and presumed kind (counter, flag, timestamp, ...) of the payload fields, most confident first. The
+//     profile covers all packet types; `type` restricts the response to one of them.
+//
+// Responses are written straight from the mapped log data into the response buffer. Per-type index and time columns,
+// as well as filtered/sorted views, are built on first use and shared between requests. Responses that take a full
+// pass over the log (`/sequences`, `/cadence`, `/correlation`) are computed once per set of parameters and packet
+// descriptions, and served from a cache afterwards.
+//
+// The server only reads the model's packets, which never change. It works on its own snapshots of the packet
+// descriptions (see `set_descriptions()`) and the time column derived from them, so the UI is free to sort the model
+// or update its descriptions while the server is running.
+struct query_server
+{
+    static constexpr size_t k_default_page_size { 100 };
+    static constexpr size_t k_max_page_size { 10'000 };
+    static constexpr size_t k_default_series_points { 1'000 };
+    static constexpr size_t k_max_series_points { 100'000 };
+
+    //! \brief Starts the server.
+    //!
+    //! \param[in] m            The model to serve. It needs to outlive the server.
+    //! \param[in] port         The TCP port to listen on. Pass 0 to pick any
+    //!                         available port (see `port()`).
+    //! \param[in] thread_count The number of connections served concurrently.
+    //!                         Pass 0 to pick a default based on the number of
+    //!                         hardware threads.
+    //!
+    explicit query_server(::model const& m, uint16_t const port = 0, size_t thread_count = 0)
+        : model_ { m }
+        , descriptions_ { ::std::make_shared<::payload_container const>(m.packet_descriptions()) }
+        , times_ { ::std::make_shared<time_snapshot const>(m.time_column()) }
+        , filters_ { m }
+    {
+        listen_socket_.reset(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+        THROW_WIN32_IF(::WSAGetLastError(), !listen_socket_);
+
+        auto address { loopback_address(port) };
+        THROW_WIN32_IF(::WSAGetLastError(), ::bind(listen_socket_.get(), reinterpret_cast<sockaddr const*>(&address),
+                                                   sizeof(address)) != 0);
+        THROW_WIN32_IF(::WSAGetLastError(), ::listen(listen_socket_.get(), SOMAXCONN) != 0);
+
+        socklen_t address_length { sizeof(address) };
+        THROW_WIN32_IF(::WSAGetLastError(), ::getsockname(listen_socket_.get(), reinterpret_cast<sockaddr*>(&address),
+                                                          &address_length) != 0);
+        port_ = ntohs(address.sin_port);
+
+        if (thread_count == 0)
+        {
+            // Connections are mostly idle between requests; serve more of them than there are cores
+            thread_count = ::std::max(8u, 2 * ::std::thread::hardware_concurrency());
+        }
+        for (size_t t { 0 }; t < thread_count; ++t)
+        {
+            workers_.emplace_back([this] { accept_connections(); });
+        }
+    }
+
+    ~query_server()
+    {
+        stopping_ = true;
+        // Shutting down connections fails pending `recv` calls
+        {
+            ::std::scoped_lock lock { connections_lock_ };
+            for (auto const s : connections_)
+            {
+                ::shutdown(s, SD_BOTH);
+            }
+        }
+        // Connecting completes pending `accept` calls; each worker sees `stopping_` and exits
+        auto const address { loopback_address(port_) };
+        for (size_t w { 0 }; w < workers_.size(); ++w)
+        {
+            ::wil::unique_socket const wake { ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) };
+            if (wake)
+            {
+                ::connect(wake.get(), reinterpret_cast<sockaddr const*>(&address), sizeof(address));
+            }
+        }
+        workers_.clear();
+    }
+
+    query_server(query_server const&) = delete;
+    query_server& operator=(query_server const&) = delete;
+
+    [[nodiscard]] uint16_t port() const noexcept { return port_; }
+
+    // Replaces the packet descriptions used to decode element values. The time column is rebuilt if the descriptions
+    // change the packet types or offsets carrying time anchors.
+    void set_descriptions(::payload_container const& descriptions)
+    {
+        auto snapshot { ::std::make_shared<::payload_container const>(descriptions) };
+        ::std::shared_ptr<time_snapshot const> times {};
+        if (::time_anchor_offsets(descriptions) != ::time_anchor_offsets(*this->descriptions()))
+        {
+            times = ::std::make_shared<time_snapshot const>(::build_time_column(model_.directory(), descriptions));
+        }
+
+        filters_.set_descriptions(descriptions);
+
+        ::std::scoped_lock lock { state_lock_ };
+        descriptions_ = ::std::move(snapshot);
+        if (times)
+        {
+            times_ = ::std::move(times);
+        }
+    }
+
+    //! \brief Answers a request.
+    //!
+    //! \param[in] target The request target (path and query string), e.g.
+    //!                   `/packets?offset=0&count=10`.
+    //!
+    //! \return The response. This function is safe to call concurrently, and
+    //!         doesn't require a network connection (e.g. for testing).
+    //!
+    [[nodiscard]] http_response handle(::std::string_view const target) const
+    {
+        auto const question_mark { target.find('?') };
+        auto const path { target.substr(0, question_mark) };
+        auto const query { parse_query_string(
+            question_mark == ::std::string_view::npos ? ::std::string_view {} : target.substr(question_mark + 1)) };
+
+        try
+        {
+            if (path == "/packets")
+            {
+                return handle_packets(query);
+            }
+            if (path == "/series")
+            {
+                return handle_series(query);
+            }
+            if (path == "/stats")
+            {
+                return handle_stats();
+            }
+            if (path == "/search")
+            {
+                return handle_search(query);
+            }
+            if (path == "/sequences")
+            {
+                return handle_sequences(query);
+            }
+            if (path == "/cadence")
+            {
+                return handle_cadence(query);
+            }
+            if (path == "/correlation")
+            {
+                return handle_correlation(query);
+            }
+            if (path == "/profile")
+            {
+                return handle_profile(query);
+            }
+            return error(404, "Unknown endpoint");
+        }
+        catch (::std::exception const&)
+        {
+            return error(500, "Internal error");
+        }
+    }
+
+private:
+    using query_parameters = ::std::map<::std::string, ::std::string, ::std::less<>>;
+
+    static constexpr size_t k_max_header_size { 16 * 1024 };
+    // Idle keep-alive connections are closed after this time so they don't pin a worker
+    static constexpr DWORD k_idle_timeout_ms { 2'000 };
+    static constexpr size_t k_view_cache_capacity { 16 };
+    static constexpr size_t k_report_cache_capacity { 16 };
+
+    // Packets of a single type in natural order
+    struct type_column
+    {
+        ::std::vector<size_t> indices;
+        uint64_t bytes { 0 };
+        size_t min_size { ::std::numeric_limits<size_t>::max() };
+        size_t max_size { 0 };
+    };
+
+    // Timestamps of the packets of a single type, parallel to `type_column::indices`
+    struct type_times
+    {
+        // Empty if the log doesn't contain time information
+        ::std::vector<uint64_t> times;
+        uint64_t min { ::std::numeric_limits<uint64_t>::max() };
+        uint64_t max { 0 };
+    };
+
+    // Time column for a set of packet descriptions, and the per-type timestamps derived from it on first use
+    struct time_snapshot
+    {
+        explicit time_snapshot(::std::optional<::time_column> c) : column { ::std::move(c) } {}
+
+        ::std::optional<::time_column> const column;
+        mutable ::std::once_flag types_built;
+        mutable ::std::array<type_times, 256> types;
+    };
+
+    // A filtered and sorted list of packet indices
+    struct view
+    {
+        ::std::string key;
+        ::std::shared_ptr<::std::vector<size_t> const> indices;
+        uint64_t last_used;
+    };
+
+    // A response computed from a full pass over the log, shared by all requests with the same parameters
+    struct report
+    {
+        ::std::string key;
+        // The descriptions the response was computed from, or `nullptr` if it only depends on the packets
+        ::std::shared_ptr<::payload_container const> descriptions;
+        ::std::once_flag built;
+        http_response response;
+        uint64_t last_used { 0 };
+    };
+
+    // Initializes Winsock for the lifetime of the server
+    struct winsock_session
+    {
+        winsock_session()
+        {
+            WSADATA wsa_data {};
+            THROW_IF_WIN32_ERROR(::WSAStartup(MAKEWORD(2, 2), &wsa_data));
+        }
+        ~winsock_session() { ::WSACleanup(); }
+        winsock_session(winsock_session const&) = delete;
+        winsock_session& operator=(winsock_session const&) = delete;
+    };
+
+    [[nodiscard]] static sockaddr_in loopback_address(uint16_t const port) noexcept
+    {
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+        address.sin_port = ::htons(port);
+        return address;
+    }
+
+    [[nodiscard]] static http_response error(int const status, ::std::string_view const message)
+    {
+        ::std::string body { "{\"error\":" };
+        append_json_string(body, message);
+        body.push_back('}');
+        return { status, ::std::move(body) };
+    }
+
+    [[nodiscard]] static ::std::optional<uint64_t> parameter(query_parameters const& query,
+                                                             ::std::string_view const key)
+    {
+        auto const it { query.find(key) };
+        return it == end(query) ? ::std::nullopt : parse_unsigned(it->second);
+    }
+
+    // Parses the time range and element value conditions of `/packets`. Returns `monostate` without any conditions, and
+    // an error message if a condition is invalid.
+    [[nodiscard]] static ::std::variant<::std::monostate, packet_filter, char const*> filter_parameters(
+        query_parameters const& query)
+    {
+        ::std::optional<packet_filter> filter {};
+        if (query.contains("from") || query.contains("to"))
+        {
+            auto const from { query.contains("from") ? parameter(query, "from") : uint64_t { 0 } };
+            auto const to { query.contains("to") ? parameter(query, "to") : ::std::numeric_limits<uint64_t>::max() };
+            if (!from || !to || *to <= *from)
+            {
+                return "Invalid time range";
+            }
+            filter = packet_filter::time_range(*from, *to);
+        }
+        if (auto const it { query.find("value") }; it != end(query))
+        {
+            // type:element:min:max
+            ::std::array<::std::string_view, 4> parts {};
+            ::std::string_view rest { it->second };
+            for (size_t i { 0 }; i < parts.size(); ++i)
+            {
+                auto const colon { rest.find(':') };
+                if ((colon == ::std::string_view::npos) != (i + 1 == parts.size()))
+                {
+                    return "Invalid value condition";
+                }
+                parts[i] = rest.substr(0, colon);
+                rest = colon == ::std::string_view::npos ? ::std::string_view {} : rest.substr(colon + 1);
+            }
+            auto const type { parse_unsigned(parts[0]) };
+            auto const element { parse_unsigned(parts[1]) };
+            double min {};
+            double max {};
+            auto const parse_double = [](::std::string_view const text, double& value) {
+                auto const [end, ec] { ::std::from_chars(text.data(), text.data() + text.size(), value) };
+                return ec == ::std::errc {} && end == text.data() + text.size();
+            };
+            if (!type || *type > 0xFF || !element || !parse_double(parts[2], min) || !parse_double(parts[3], max))
+            {
+                return "Invalid value condition";
+            }
+            auto const condition { packet_filter::value_range(static_cast<unsigned char>(*type),
+                                                              static_cast<size_t>(*element), min, max) };
+            filter = filter ? *filter & condition : condition;
+        }
+        if (!filter)
+        {
+            return {};
+        }
+        return *filter;
+    }
+
+    // Parses a field parameter in `type:element` notation
+    [[nodiscard]] static ::std::optional<field_ref> field_parameter(query_parameters const& query,
+                                                                   ::std::string_view const key)
+    {
+        auto const it { query.find(key) };
+        if (it == end(query))
+        {
+            return {};
+        }
+        ::std::string_view const text { it->second };
+        auto const colon { text.find(':') };
+        auto const type { parse_unsigned(text.substr(0, colon)) };
+        auto const element { colon == ::std::string_view::npos ? ::std::optional<uint64_t> { 0 }
+                                                               : parse_unsigned(text.substr(colon + 1)) };
+        if (!type || *type > 0xFF || !element)
+        {
+            return {};
+        }
+        return field_ref { static_cast<unsigned char>(*type), static_cast<size_t>(*element) };
+    }
+
+    [[nodiscard]] ::std::shared_ptr<::payload_container const> descriptions() const
+    {
+        ::std::scoped_lock lock { state_lock_ };
+        return descriptions_;
+    }
+
+    [[nodiscard]] ::std::shared_ptr<time_snapshot const> times() const
+    {
+        ::std::scoped_lock lock { state_lock_ };
+        return times_;
+    }
+
+    [[nodiscard]] ::std::array<type_column, 256> const& type_columns() const
+    {
+        ::std::call_once(type_columns_built_, [this] {
+            auto const& directory { model_.directory() };
+            for (size_t index { 0 }; index < directory.size(); ++index)
+            {
+                auto& column { type_columns_[directory[index].type()] };
+                column.indices.push_back(index);
+                column.bytes += directory[index].size();
+                column.min_size = ::std::min(column.min_size, static_cast<size_t>(directory[index].payload_size()));
+                column.max_size = ::std::max(column.max_size, static_cast<size_t>(directory[index].payload_size()));
+            }
+        });
+        return type_columns_;
+    }
+
+    // Only depends on the packets, so it's built once
+    [[nodiscard]] ::std::vector<field_profile> const& field_profiles() const
+    {
+        ::std::call_once(field_profiles_built_, [this] {
+            // On the worker serving the request, like searches
+            field_profiles_ = ::profile_fields(model_.directory(), 1);
+        });
+        return field_profiles_;
+    }
+
+    // Returns the per-type timestamps of a time snapshot
+    [[nodiscard]] ::std::array<type_times, 256> const& type_times_of(time_snapshot const& snapshot) const
+    {
+        ::std::call_once(snapshot.types_built, [&] {
+            auto const& times { snapshot.column };
+            if (!times)
+            {
+                return;
+            }
+            auto const& columns { type_columns() };
+            for (size_t type { 0 }; type < columns.size(); ++type)
+            {
+                snapshot.types[type].times.reserve(columns[type].indices.size());
+            }
+            // Decode sequentially in blocks rather than seeking per packet
+            auto const& directory { model_.directory() };
+            ::std::vector<uint64_t> block(4096);
+            for (size_t first { 0 }; first < times->size(); first += block.size())
+            {
+                auto const count { ::std::min(block.size(), times->size() - first) };
+                times->decode(first, { block.data(), count });
+                for (size_t i { 0 }; i < count; ++i)
+                {
+                    auto& t { snapshot.types[directory[first + i].type()] };
+                    t.times.push_back(block[i]);
+                    t.min = ::std::min(t.min, block[i]);
+                    t.max = ::std::max(t.max, block[i]);
+                }
+            }
+        });
+        return snapshot.types;
+    }
+
+    // Returns the filtered and sorted packet indices, or `nullptr` for all packets in natural order
+    [[nodiscard]] ::std::shared_ptr<::std::vector<size_t> const> filtered_view(
+        ::std::optional<::std::bitset<256>> const& types, sort_predicate const pred, sort_direction const dir) const
+    {
+        if (!types && pred == sort_predicate::index && dir == sort_direction::asc)
+        {
+            return {};
+        }
+
+        auto const key { ::std::format("{}|{}|{}", types ? types->to_string() : ::std::string {},
+                                       static_cast<int>(pred), static_cast<int>(dir)) };
+        {
+            ::std::scoped_lock lock { state_lock_ };
+            auto const it { ::std::find_if(begin(views_), end(views_), [&](auto const& v) { return v.key == key; }) };
+            if (it != end(views_))
+            {
+                it->last_used = ++view_clock_;
+                return it->indices;
+            }
+        }
+
+        // Build outside the lock; concurrent requests for the same view may build it twice
+        ::std::vector<size_t> indices {};
+        if (types)
+        {
+            auto const& columns { type_columns() };
+            for (size_t type { 0 }; type < columns.size(); ++type)
+            {
+                if (types->test(type))
+                {
+                    indices.insert(end(indices), begin(columns[type].indices), end(columns[type].indices));
+                }
+            }
+            ::std::sort(begin(indices), end(indices));
+        }
+        else
+        {
+            indices.resize(model_.directory().size());
+            ::std::iota(begin(indices), end(indices), size_t { 0 });
+        }
+        ::sort_packet_indices(model_.directory(), indices, pred, dir);
+        auto shared { ::std::make_shared<::std::vector<size_t> const>(::std::move(indices)) };
+
+        ::std::scoped_lock lock { state_lock_ };
+        if (views_.size() >= k_view_cache_capacity)
+        {
+            views_.erase(::std::min_element(begin(views_), end(views_), [](auto const& lhs, auto const& rhs) {
+                return lhs.last_used < rhs.last_used;
+            }));
+        }
+        views_.push_back({ key, shared, ++view_clock_ });
+        return shared;
+    }
+
+    // Returns the response cached for `key` and `descriptions`, computing it with `build` on first use. Concurrent
+    // requests for the same response wait for the first one rather than repeating the pass. Responses computed from
+    // descriptions that have since been replaced are dropped.
+    template <typename Build>
+    [[nodiscard]] http_response cached_report(::std::string key,
+                                              ::std::shared_ptr<::payload_container const> descriptions,
+                                              Build&& build) const
+    {
+        ::std::shared_ptr<report> entry {};
+        {
+            ::std::scoped_lock lock { state_lock_ };
+            ::std::erase_if(reports_,
+                            [this](auto const& r) { return r->descriptions && r->descriptions != descriptions_; });
+            auto const it { ::std::find_if(begin(reports_), end(reports_), [&](auto const& r) {
+                return r->key == key && r->descriptions == descriptions;
+            }) };
+            if (it != end(reports_))
+            {
+                entry = *it;
+            }
+            else
+            {
+                if (reports_.size() >= k_report_cache_capacity)
+                {
+                    reports_.erase(::std::min_element(begin(reports_), end(reports_),
+                                                      [](auto const& lhs, auto const& rhs) {
+                                                          return lhs->last_used < rhs->last_used;
+                                                      }));
+                }
+                entry = reports_.emplace_back(::std::make_shared<report>());
+                entry->key = ::std::move(key);
+                entry->descriptions = ::std::move(descriptions);
+            }
+            entry->last_used = ++report_clock_;
+        }
+
+        // Outside the lock, so that other requests aren't held up by the pass
+        ::std::call_once(entry->built, [&] { entry->response = build(); });
+        return entry->response;
+    }
+
+    [[nodiscard]] http_response handle_packets(query_parameters const& query) const
+    {
+        auto const offset { parameter(query, "offset").value_or(0) };
+        auto const count { ::std::min<uint64_t>(parameter(query, "count").value_or(k_default_page_size),
+                                                k_max_page_size) };
+
+        ::std::optional<::std::bitset<256>> types {};
+        if (auto const it { query.find("types") }; it != end(query))
+        {
+            types.emplace();
+            ::std::string_view list { it->second };
+            while (!list.empty())
+            {
+                auto const comma { list.find(',') };
+                auto const type { parse_unsigned(list.substr(0, comma)) };
+                if (!type || *type > 0xFF)
+                {
+                    return error(400, "Invalid packet type");
+                }
+                types->set(static_cast<size_t>(*type));
+                list = comma == ::std::string_view::npos ? ::std::string_view {} : list.substr(comma + 1);
+            }
+        }
+
+        auto pred { sort_predicate::index };
+        if (auto const it { query.find("sort") }; it != end(query))
+        {
+            if (it->second == "type")
+            {
+                pred = sort_predicate::type;
+            }
+            else if (it->second == "size")
+            {
+                pred = sort_predicate::size;
+            }
+            else if (it->second != "index")
+            {
+                return error(400, "Invalid sort predicate");
+            }
+        }
+        auto dir { sort_direction::asc };
+        if (auto const it { query.find("order") }; it != end(query))
+        {
+            if (it->second == "desc")
+            {
+                dir = sort_direction::desc;
+            }
+            else if (it->second != "asc")
+            {
+                return error(400, "Invalid sort order");
+            }
+        }
+
+        auto const conditions { filter_parameters(query) };
+        if (auto const message { ::std::get_if<char const*>(&conditions) }; message)
+        {
+            return error(400, *message);
+        }
+
+        auto view { filtered_view(types, pred, dir) };
+        if (auto const filter { ::std::get_if<packet_filter>(&conditions) }; filter)
+        {
+            // The bitmaps of the conditions are cached; only the intersection with the sorted view is built per request
+            auto const selection { filters_.evaluate(*filter) };
+            ::std::vector<size_t> indices {};
+            if (view)
+            {
+                ::std::copy_if(begin(*view), end(*view), ::std::back_inserter(indices),
+                               [&](size_t const index) { return selection->contains(index); });
+            }
+            else
+            {
+                indices = selection->to_vector();
+            }
+            view = ::std::make_shared<::std::vector<size_t> const>(::std::move(indices));
+        }
+        auto const& directory { model_.directory() };
+        auto const total { view ? view->size() : directory.size() };
+        auto const first { ::std::min<uint64_t>(offset, total) };
+        auto const last { ::std::min<uint64_t>(first + count, total) };
+        auto const snapshot { descriptions() };
+        auto const time_state { times() };
+        auto const& times { time_state->column };
+
+        ::std::string body {};
+        body.reserve(static_cast<size_t>(last - first) * 96 + 64);
+        auto out { ::std::back_inserter(body) };
+        ::std::format_to(out, "{{\"total\":{},\"offset\":{},\"packets\":[", total, first);
+        for (auto row { first }; row < last; ++row)
+        {
+            auto const index { view ? (*view)[static_cast<size_t>(row)] : static_cast<size_t>(row) };
+            auto const& packet { directory[index] };
+            ::std::format_to(out, "{}{{\"index\":{},\"type\":{},\"size\":{},\"time\":", row == first ? "" : ",", index,
+                             packet.type(), packet.payload_size());
+            if (times)
+            {
+                ::std::format_to(out, "{}", (*times)[index]);
+            }
+            else
+            {
+                body.append("null");
+            }
+
+            body.append(",\"payload\":\"");
+            constexpr auto& digits { "0123456789abcdef" };
+            ::std::span<unsigned char const> const payload { packet.data() + packet.header_size(),
+                                                             packet.payload_size() };
+            for (auto const byte : payload)
+            {
+                body.push_back(digits[byte >> 4]);
+                body.push_back(digits[byte & 0xF]);
+            }
+            body.append("\",\"values\":[");
+            if (auto const it { snapshot->find(packet.type()) }; it != end(*snapshot))
+            {
+                for (size_t e { 0 }; e < it->second.elements.size(); ++e)
+                {
+                    if (e > 0)
+                    {
+                        body.push_back(',');
+                    }
+                    auto const value { ::decode_element(payload, it->second.elements[e]) };
+                    append_json_number(body, value.value_or(::std::numeric_limits<double>::quiet_NaN()));
+                }
+            }
+            body.append("]}");
+        }
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    [[nodiscard]] http_response handle_series(query_parameters const& query) const
+    {
+        auto const type { parameter(query, "type") };
+        if (!type || *type > 0xFF)
+        {
+            return error(400, "Missing or invalid packet type");
+        }
+        auto const snapshot { descriptions() };
+        auto const description { snapshot->find(static_cast<unsigned char>(*type)) };
+        auto const element_index { parameter(query, "element").value_or(0) };
+        if (description == end(*snapshot) || element_index >= description->second.elements.size())
+        {
+            return error(404, "Unknown element");
+        }
+        auto const& element { description->second.elements[static_cast<size_t>(element_index)] };
+
+        auto const& column { type_columns()[static_cast<size_t>(*type)] };
+        auto const time_state { times() };
+        auto const& type_times { type_times_of(*time_state)[static_cast<size_t>(*type)] };
+        if (!column.indices.empty() && type_times.times.empty())
+        {
+            return error(409, "Log doesn't contain time information");
+        }
+
+        ::std::string body { "{\"buckets\":[" };
+        if (type_times.times.empty())
+        {
+            body.append("]}");
+            return { 200, ::std::move(body) };
+        }
+
+        auto const from { parameter(query, "from").value_or(type_times.min) };
+        auto const to { parameter(query, "to").value_or(type_times.max + 1) };
+        auto const points { ::std::clamp<uint64_t>(parameter(query, "points").value_or(k_default_series_points), 1,
+                                                   k_max_series_points) };
+        if (to <= from)
+        {
+            return error(400, "Invalid time range");
+        }
+        auto const width { (to - from - 1) / points + 1 };
+
+        struct bucket
+        {
+            size_t count { 0 };
+            double min { 0.0 };
+            double max { 0.0 };
+            double sum { 0.0 };
+        };
+        ::std::vector<bucket> buckets(static_cast<size_t>(points));
+
+        auto const& directory { model_.directory() };
+        for (size_t i { 0 }; i < type_times.times.size(); ++i)
+        {
+            auto const time { type_times.times[i] };
+            if (time < from || time >= to)
+            {
+                continue;
+            }
+            auto const& packet { directory[column.indices[i]] };
+            auto const value { ::decode_element({ packet.data() + packet.header_size(), packet.payload_size() },
+                                                element) };
+            if (!value)
+            {
+                continue;
+            }
+            auto& b { buckets[static_cast<size_t>(::std::min((time - from) / width, points - 1))] };
+            if (b.count == 0)
+            {
+                b.min = *value;
+                b.max = *value;
+            }
+            ++b.count;
+            b.min = ::std::min(b.min, *value);
+            b.max = ::std::max(b.max, *value);
+            b.sum += *value;
+        }
+
+        bool first_bucket { true };
+        for (size_t index { 0 }; index < buckets.size(); ++index)
+        {
+            auto const& b { buckets[index] };
+            if (b.count == 0)
+            {
+                continue;
+            }
+            ::std::format_to(::std::back_inserter(body), "{}{{\"time\":{},\"count\":{},\"min\":",
+                             first_bucket ? "" : ",", from + index * width, b.count);
+            append_json_number(body, b.min);
+            body.append(",\"max\":");
+            append_json_number(body, b.max);
+            body.append(",\"mean\":");
+            append_json_number(body, b.sum / static_cast<double>(b.count));
+            body.push_back('}');
+            first_bucket = false;
+        }
+
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    [[nodiscard]] http_response handle_stats() const
+    {
+        auto const& columns { type_columns() };
+        auto const& directory { model_.directory() };
+        auto const snapshot { descriptions() };
+
+        ::std::string body {};
+        auto out { ::std::back_inserter(body) };
+        ::std::format_to(out, "{{\"packets\":{},\"bytes\":{},\"types\":[", directory.size(), model_.bytes().size());
+        bool first { true };
+        for (size_t type { 0 }; type < columns.size(); ++type)
+        {
+            auto const& column { columns[type] };
+            if (column.indices.empty())
+            {
+                continue;
+            }
+            ::std::format_to(out,
+                             "{}{{\"type\":{},\"count\":{},\"bytes\":{},\"min_size\":{},\"max_size\":{},"
+                             "\"first_index\":{},\"last_index\":{},\"name\":",
+                             first ? "" : ",", type, column.indices.size(), column.bytes, column.min_size,
+                             column.max_size, column.indices.front(), column.indices.back());
+            auto const description { snapshot->find(static_cast<unsigned char>(type)) };
+            if (description != end(*snapshot) && description->second.name && !description->second.name->empty())
+            {
+                append_json_string(body, ::to_utf8(*description->second.name));
+            }
+            else
+            {
+                body.append("null");
+            }
+            body.push_back('}');
+            first = false;
+        }
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    [[nodiscard]] http_response handle_search(query_parameters const& query) const
+    {
+        auto const text { query.find("pattern") };
+        auto const pattern { text == end(query) ? ::std::nullopt : parse_byte_pattern(text->second) };
+        if (!pattern)
+        {
+            return error(400, "Missing or invalid pattern");
+        }
+        search_options options {};
+        if (query.contains("type"))
+        {
+            auto const type { parameter(query, "type") };
+            if (!type || *type > 0xFF)
+            {
+                return error(400, "Invalid packet type");
+            }
+            options.type = static_cast<unsigned char>(*type);
+        }
+        if (query.contains("offset"))
+        {
+            auto const offset { parameter(query, "offset") };
+            if (!offset || *offset > ::std::numeric_limits<uint16_t>::max())
+            {
+                return error(400, "Invalid payload offset");
+            }
+            options.offset = static_cast<size_t>(*offset);
+        }
+        options.max_hits = static_cast<size_t>(
+            ::std::min<uint64_t>(parameter(query, "limit").value_or(k_default_page_size), k_max_page_size));
+        // Search on the worker serving the request. Concurrent searches are bounded by the worker pool instead of
+        // starting another set of threads per request.
+        options.thread_count = 1;
+
+        auto const hits { search_model(model_, *pattern, options) };
+
+        ::std::string body {};
+        auto out { ::std::back_inserter(body) };
+        ::std::format_to(out, "{{\"count\":{},\"hits\":[", hits.size());
+        for (size_t i { 0 }; i < hits.size(); ++i)
+        {
+            auto const& hit { hits[i] };
+            ::std::format_to(out, "{}{{\"index\":{},\"type\":{},\"offset\":{},\"log_offset\":{}}}",
+                             i == 0 ? "" : ",", hit.packet_index, static_cast<unsigned>(hit.type), hit.payload_offset,
+                             hit.log_offset);
+        }
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    [[nodiscard]] http_response handle_sequences(query_parameters const& query) const
+    {
+        sequence_options options {};
+        if (query.contains("length"))
+        {
+            auto const length { parameter(query, "length") };
+            if (!length || *length < 2 || *length > type_ngram::k_max_length)
+            {
+                return error(400, "Invalid n-gram length");
+            }
+            options.max_length = static_cast<size_t>(*length);
+        }
+        options.top_k = static_cast<size_t>(
+            ::std::min<uint64_t>(parameter(query, "top").value_or(options.top_k), k_max_page_size));
+        options.within_chunks = parameter(query, "chunks").value_or(0) != 0;
+        // Same as `handle_search()`: count on the worker serving the request
+        options.thread_count = 1;
+
+        // Only depends on the packets
+        auto key { ::std::format("/sequences|{}|{}|{}", options.max_length, options.top_k, options.within_chunks) };
+        return cached_report(::std::move(key), nullptr, [&] { return sequences_response(options); });
+    }
+
+    [[nodiscard]] http_response sequences_response(sequence_options const& options) const
+    {
+        auto const statistics { collect_sequence_statistics(model_, options) };
+
+        ::std::string body {};
+        auto out { ::std::back_inserter(body) };
+        ::std::format_to(out, "{{\"packets\":{},\"max_error\":{},\"types\":[", statistics.packet_count,
+                         statistics.max_error);
+        bool first { true };
+        for (size_t type { 0 }; type < statistics.type_counts.size(); ++type)
+        {
+            if (statistics.type_counts[type] != 0)
+            {
+                ::std::format_to(out, "{}{{\"type\":{},\"count\":{}}}", first ? "" : ",", type,
+                                 statistics.type_counts[type]);
+                first = false;
+            }
+        }
+        body.append("],\"transitions\":[");
+        // Row sums, rather than `successor_probability()` per cell
+        ::std::array<uint64_t, 256> successors {};
+        for (size_t cell { 0 }; cell < statistics.transitions.size(); ++cell)
+        {
+            successors[cell >> 8] += statistics.transitions[cell];
+        }
+        first = true;
+        for (size_t cell { 0 }; cell < statistics.transitions.size(); ++cell)
+        {
+            if (statistics.transitions[cell] == 0)
+            {
+                continue;
+            }
+            ::std::format_to(out, "{}{{\"from\":{},\"to\":{},\"count\":{},\"probability\":", first ? "" : ",",
+                             cell >> 8, cell & 0xFF, statistics.transitions[cell]);
+            append_json_number(body, static_cast<double>(statistics.transitions[cell]) /
+                                         static_cast<double>(successors[cell >> 8]));
+            body.push_back('}');
+            first = false;
+        }
+        body.append("],\"ngrams\":[");
+        first = true;
+        for (auto const& ngrams : statistics.ngrams)
+        {
+            for (auto const& ngram : ngrams)
+            {
+                ::std::format_to(out, "{}{{\"types\":[", first ? "" : ",");
+                for (size_t t { 0 }; t < ngram.length; ++t)
+                {
+                    ::std::format_to(out, "{}{}", t == 0 ? "" : ",", static_cast<unsigned>(ngram.types[t]));
+                }
+                ::std::format_to(out, "],\"count\":{},\"frequency\":", ngram.count);
+                append_json_number(body, ngram.frequency);
+                body.append(",\"probability\":");
+                append_json_number(body, ngram.probability);
+                body.push_back('}');
+                first = false;
+            }
+        }
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    [[nodiscard]] http_response handle_cadence(query_parameters const& query) const
+    {
+        cadence_options options {};
+        if (query.contains("min_gap"))
+        {
+            auto const min_gap { parameter(query, "min_gap") };
+            if (!min_gap)
+            {
+                return error(400, "Invalid minimum gap");
+            }
+            options.min_gap = *min_gap;
+        }
+        options.max_events = static_cast<size_t>(
+            ::std::min<uint64_t>(parameter(query, "events").value_or(k_default_page_size), k_max_page_size));
+
+        // Packet times depend on the descriptions
+        auto snapshot { descriptions() };
+        auto key { ::std::format("/cadence|{}|{}", options.min_gap, options.max_events) };
+        return cached_report(::std::move(key), snapshot, [&] { return cadence_response(*snapshot, options); });
+    }
+
+    [[nodiscard]] http_response cadence_response(::payload_container const& descriptions,
+                                                 cadence_options const& options) const
+    {
+        auto const report { analyze_cadence(model_, descriptions, options) };
+
+        ::std::string body {};
+        auto out { ::std::back_inserter(body) };
+        ::std::format_to(out, "{{\"untimed_packets\":{},\"dropped_events\":{},\"types\":[", report.untimed_packets,
+                         report.dropped_events);
+        for (size_t i { 0 }; i < report.types.size(); ++i)
+        {
+            auto const& t { report.types[i] };
+            ::std::format_to(out,
+                             "{}{{\"type\":{},\"count\":{},\"first_time\":{},\"last_time\":{},"
+                             "\"min_interval\":{},\"max_interval\":{},\"gaps\":{},\"bursts\":{}",
+                             i == 0 ? "" : ",", static_cast<unsigned>(t.type), t.count, t.first_time, t.last_time,
+                             t.min_interval, t.max_interval, t.gap_count, t.burst_count);
+            for (auto const& [name, value] : { ::std::pair { "mean_interval", t.mean_interval },
+                                               ::std::pair { "dominant_interval", t.dominant_interval },
+                                               ::std::pair { "p10_interval", t.p10_interval },
+                                               ::std::pair { "median_interval", t.median_interval },
+                                               ::std::pair { "p90_interval", t.p90_interval } })
+            {
+                ::std::format_to(out, ",\"{}\":", name);
+                append_json_number(body, value);
+            }
+            body.push_back('}');
+        }
+        body.append("],\"gaps\":[");
+        for (size_t i { 0 }; i < report.gaps.size(); ++i)
+        {
+            auto const& gap { report.gaps[i] };
+            ::std::format_to(out, "{}{{\"type\":", i == 0 ? "" : ",");
+            if (gap.type)
+            {
+                ::std::format_to(out, "{}", static_cast<unsigned>(*gap.type));
+            }
+            else
+            {
+                body.append("null");
+            }
+            ::std::format_to(out, ",\"start\":{},\"end\":{}}}", gap.start, gap.end);
+        }
+        body.append("],\"bursts\":[");
+        for (size_t i { 0 }; i < report.bursts.size(); ++i)
+        {
+            auto const& burst { report.bursts[i] };
+            ::std::format_to(out, "{}{{\"type\":{},\"start\":{},\"end\":{},\"count\":{}}}", i == 0 ? "" : ",",
+                             static_cast<unsigned>(burst.type), burst.start, burst.end, burst.count);
+        }
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    [[nodiscard]] http_response handle_correlation(query_parameters const& query) const
+    {
+        auto const lhs { field_parameter(query, "lhs") };
+        auto const rhs { field_parameter(query, "rhs") };
+        if (!lhs || !rhs)
+        {
+            return error(400, "Missing or invalid field");
+        }
+        correlation_options options {};
+        options.resolution = ::std::max<uint64_t>(parameter(query, "resolution").value_or(options.resolution), 1);
+        options.max_lag = static_cast<size_t>(
+            ::std::min<uint64_t>(parameter(query, "lag").value_or(options.max_lag), k_max_page_size));
+
+        auto snapshot { descriptions() };
+        auto key { ::std::format("/correlation|{}:{}|{}:{}|{}|{}", static_cast<unsigned>(lhs->type), lhs->element,
+                                 static_cast<unsigned>(rhs->type), rhs->element, options.resolution, options.max_lag) };
+        return cached_report(::std::move(key), snapshot,
+                             [&] { return correlation_response(*snapshot, *lhs, *rhs, options); });
+    }
+
+    [[nodiscard]] http_response correlation_response(::payload_container const& descriptions, field_ref const lhs,
+                                                     field_ref const rhs, correlation_options const& options) const
+    {
+        auto const time_state { times() };
+        if (!time_state->column)
+        {
+            return error(409, "Log doesn't contain time information");
+        }
+        auto const result { ::correlate(model_, *time_state->column, descriptions, lhs, rhs, options) };
+        if (!result)
+        {
+            return error(404, "Unknown element, or no samples");
+        }
+
+        ::std::string body {};
+        auto const append_lag { [&](lag_correlation const& lag) {
+            ::std::format_to(::std::back_inserter(body), "{{\"lag\":{},\"overlap\":{},\"pearson\":", lag.lag,
+                             lag.overlap);
+            append_json_number(body, lag.pearson);
+            body.append(",\"spearman\":");
+            append_json_number(body, lag.spearman);
+            body.push_back('}');
+        } };
+        ::std::format_to(::std::back_inserter(body), "{{\"resolution\":{},\"best\":", options.resolution);
+        append_lag(result->best);
+        body.append(",\"lags\":[");
+        for (size_t i { 0 }; i < result->lags.size(); ++i)
+        {
+            if (i != 0)
+            {
+                body.push_back(',');
+            }
+            append_lag(result->lags[i]);
+        }
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    [[nodiscard]] http_response handle_profile(query_parameters const& query) const
+    {
+        auto const offset { parameter(query, "offset").value_or(0) };
+        auto const limit { ::std::min<uint64_t>(parameter(query, "limit").value_or(k_default_page_size),
+                                                k_max_page_size) };
+        ::std::optional<unsigned char> type {};
+        if (query.contains("type"))
+        {
+            auto const value { parameter(query, "type") };
+            if (!value || *value > 0xFF)
+            {
+                return error(400, "Invalid packet type");
+            }
+            type = static_cast<unsigned char>(*value);
+        }
+
+        auto const& profiles { field_profiles() };
+        auto const total { static_cast<uint64_t>(::std::count_if(
+            begin(profiles), end(profiles), [&](auto const& p) { return !type || p.type == *type; })) };
+
+        ::std::string body {};
+        auto out { ::std::back_inserter(body) };
+        ::std::format_to(out, "{{\"total\":{},\"offset\":{},\"fields\":[", total, offset);
+        uint64_t matches { 0 };
+        for (auto const& p : profiles)
+        {
+            if (type && p.type != *type)
+            {
+                continue;
+            }
+            if (matches >= offset && matches - offset < limit)
+            {
+                ::std::format_to(out,
+                                 "{}{{\"type\":{},\"offset\":{},\"width\":{},\"kind\":\"{}\",\"samples\":{},"
+                                 "\"min\":{},\"max\":{},\"distinct\":{}",
+                                 matches == offset ? "" : ",", static_cast<unsigned>(p.type), p.offset, p.width,
+                                 ::to_utf8(::to_string(p.kind)), p.samples, p.min, p.max, p.distinct);
+                for (auto const& [name, value] : { ::std::pair { "score", p.score },
+                                                   ::std::pair { "entropy", p.entropy },
+                                                   ::std::pair { "increment_share", p.increment_share },
+                                                   ::std::pair { "non_decreasing_share", p.non_decreasing_share },
+                                                   ::std::pair { "change_rate", p.change_rate },
+                                                   ::std::pair { "changed_bits", p.changed_bits } })
+                {
+                    ::std::format_to(out, ",\"{}\":", name);
+                    append_json_number(body, value);
+                }
+                body.push_back('}');
+            }
+            ++matches;
+        }
+        body.append("]}");
+        return { 200, ::std::move(body) };
+    }
+
+    void accept_connections()
+    {
+        while (!stopping_)
+        {
+            auto const client { ::accept(listen_socket_.get(), nullptr, nullptr) };
+            if (client == INVALID_SOCKET)
+            {
+                continue;
+            }
+
+            {
+                ::std::scoped_lock lock { connections_lock_ };
+                if (stopping_)
+                {
+                    ::closesocket(client);
+                    return;
+                }
+                connections_.insert(client);
+            }
+            serve_connection(client);
+            {
+                ::std::scoped_lock lock { connections_lock_ };
+                connections_.erase(client);
+            }
+            ::closesocket(client);
+        }
+    }
+
+    void serve_connection(SOCKET const client) const
+    {
+        DWORD const timeout { k_idle_timeout_ms };
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<char const*>(&timeout), sizeof(timeout));
+        // Headers and body are sent separately; don't let Nagle's algorithm delay the body
+        BOOL const no_delay { TRUE };
+        ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&no_delay), sizeof(no_delay));
+
+        ::std::string buffer {};
+        ::std::array<char, 4096> chunk {};
+        while (!stopping_)
+        {
+            // Read request line and headers
+            auto header_end { buffer.find("\r\n\r\n") };
+            while (header_end == ::std::string::npos)
+            {
+                if (buffer.size() > k_max_header_size)
+                {
+                    send_response(client, error(431, "Request header too large"), false);
+                    return;
+                }
+                auto const received { ::recv(client, chunk.data(), static_cast<int>(chunk.size()), 0) };
+                if (received <= 0)
+                {
+                    return;
+                }
+                buffer.append(chunk.data(), static_cast<size_t>(received));
+                header_end = buffer.find("\r\n\r\n");
+            }
+
+            ::std::string_view const head { buffer.data(), header_end };
+            auto const line_end { head.find("\r\n") };
+            auto const request_line { head.substr(0, line_end) };
+            auto const first_space { request_line.find(' ') };
+            auto const second_space { request_line.find(' ', first_space + 1) };
+            if (first_space == ::std::string_view::npos || second_space == ::std::string_view::npos)
+            {
+                send_response(client, error(400, "Malformed request"), false);
+                return;
+            }
+            auto const method { request_line.substr(0, first_space) };
+            auto const target { request_line.substr(first_space + 1, second_space - first_space - 1) };
+            auto const version { request_line.substr(second_space + 1) };
+
+            // HTTP/1.1 keeps connections alive unless asked otherwise
+            ::std::string headers { head.substr(line_end == ::std::string_view::npos ? head.size() : line_end) };
+            ::std::transform(begin(headers), end(headers), begin(headers), [](char const ch) {
+                return static_cast<char>(::tolower(static_cast<unsigned char>(ch)));
+            });
+            auto const keep_alive { version == "HTTP/1.1" && headers.find("connection: close") == ::std::string::npos };
+
+            auto const response { method == "GET" ? handle(target) : error(405, "Only GET is supported") };
+            buffer.erase(0, header_end + 4);
+            if (!send_response(client, response, keep_alive) || !keep_alive)
+            {
+                return;
+            }
+        }
+    }
+
+    [[nodiscard]] static bool send_all(SOCKET const client, ::std::string_view data) noexcept
+    {
+        while (!data.empty())
+        {
+            auto const length { static_cast<int>(::std::min<size_t>(data.size(), INT_MAX)) };
+            auto const sent { ::send(client, data.data(), length, 0) };
+            if (sent <= 0)
+            {
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(sent));
+        }
+        return true;
+    }
+
+    static bool send_response(SOCKET const client, http_response const& response, bool const keep_alive)
+    {
+        auto const reason = [](int const status) -> ::std::string_view {
+            switch (status)
+            {
+            case 200:
+                return "OK";
+            case 400:
+                return "Bad Request";
+            case 404:
+                return "Not Found";
+            case 405:
+                return "Method Not Allowed";
+            case 409:
+                return "Conflict";
+            case 431:
+                return "Request Header Fields Too Large";
+            default:
+                return "Internal Server Error";
+            }
+        };
+        auto const header { ::std::format("HTTP/1.1 {} {}\r\nContent-Type: application/json\r\nContent-Length: {}\r\n"
+                                          "Connection: {}\r\n\r\n",
+                                          response.status, reason(response.status), response.body.size(),
+                                          keep_alive ? "keep-alive" : "close") };
+        return send_all(client, header) && send_all(client, response.body);
+    }
+
+    // Declared first so that Winsock is cleaned up after all sockets are closed
+    winsock_session winsock_;
+    ::model const& model_;
+    ::wil::unique_socket listen_socket_;
+    uint16_t port_ { 0 };
+    ::std::atomic<bool> stopping_ { false };
+
+    mutable ::std::mutex state_lock_;
+    ::std::shared_ptr<::payload_container const> descriptions_;
+    ::std::shared_ptr<time_snapshot const> times_;
+    mutable ::std::vector<view> views_;
+    mutable uint64_t view_clock_ { 0 };
+    mutable ::std::vector<::std::shared_ptr<report>> reports_;
+    mutable uint64_t report_clock_ { 0 };
+    // Bitmaps of the time range and element value conditions of `/packets`
+    mutable ::filter_cache filters_;
+
+    mutable ::std::once_flag type_columns_built_;
+    mutable ::std::array<type_column, 256> type_columns_;
+
+    mutable ::std::once_flag field_profiles_built_;
+    mutable ::std::vector<field_profile> field_profiles_;
+
+    ::std::mutex connections_lock_;
+    ::std::set<SOCKET> connections_;
+
+    // Declared last so that workers stop before any of the members they use are destroyed
+    ::std::vector<::std::jthread> workers_;
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "display_utils.h"
+#include "model.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// Text representation of a single packet, as displayed in a packet list
+struct rendered_row
+{
+    // One-based index in natural order
+    ::std::wstring index;
+    ::std::wstring type;
+    ::std::wstring size;
+    ::std::wstring payload;
+    // "n/a" for packet types without a description
+    ::std::wstring details;
+};
+
+
+//! \brief Renders the text representation of a packet.
+//!
+//! \param[in] packet       The packet to render.
+//! \param[in] index        The packet's index in natural order.
+//! \param[in] descriptions The packet descriptions used to render details.
+//!
+//! \return The rendered row. Strings aren't truncated.
+//!
+[[nodiscard]] inline rendered_row render_row(::data_proxy const& packet, size_t const index,
+                                             ::payload_container const& descriptions)
+{
+    return { ::std::to_wstring(index + 1), ::to_hex_string(packet.type()), ::std::to_wstring(packet.payload_size()),
+             ::to_hex_string({ packet.data() + packet.header_size(), packet.payload_size() }),
+             ::details_from_packet(packet, descriptions).value_or(L"n/a") };
+}
+
+
+// Bounded cache of rendered rows, keyed by packet index in natural order (so entries survive sorting and filtering).
+//
+// `row()` renders synchronously on a cache miss. `prefetch()` hands a list of packets to a background thread that
+// renders them ahead of time; a new request supersedes any pending one. This mirrors the `LVN_ODCACHEHINT` pattern of
+// virtual list views, but doesn't depend on any particular front end.
+//
+// The cache keeps its own snapshot of the packet descriptions. `invalidate()` replaces the snapshot and drops rows of
+// changed packet types only. The directory must outlive the cache.
+struct row_cache
+{
+    static constexpr size_t k_default_capacity { 16 * 1024 };
+
+    row_cache(::std::span<data_proxy const> const directory, ::payload_container const& descriptions,
+              size_t const capacity = k_default_capacity)
+        : directory_ { directory }
+        , descriptions_ { ::std::make_shared<::payload_container const>(descriptions) }
+        , capacity_ { ::std::max(capacity, size_t { 1 }) }
+    {
+        worker_ = ::std::jthread { [this](::std::stop_token const stop) { run(stop); } };
+    }
+
+    ~row_cache()
+    {
+        worker_.request_stop();
+        // `worker_` joins on destruction
+    }
+
+    row_cache(row_cache const&) = delete;
+    row_cache& operator=(row_cache const&) = delete;
+
+    // Returns the rendered row for the packet at `index` (natural order)
+    [[nodiscard]] ::std::shared_ptr<rendered_row const> row(size_t const index)
+    {
+        assert(index < directory_.size());
+
+        ::std::shared_ptr<::payload_container const> descriptions {};
+        uint32_t generation {};
+        {
+            ::std::scoped_lock lock { lock_ };
+            if (auto cached { lookup(index) }; cached)
+            {
+                ++hits_;
+                ::trace_count(trace_counter::cache_hits);
+                return cached;
+            }
+            ++misses_;
+            ::trace_count(trace_counter::cache_misses);
+            descriptions = descriptions_;
+            generation = generations_[directory_[index].type()];
+        }
+
+        auto rendered { ::std::make_shared<rendered_row const>(::render_row(directory_[index], index, *descriptions)) };
+        ::trace_count(trace_counter::allocations);
+        ::std::scoped_lock lock { lock_ };
+        insert(index, generation, rendered);
+        return rendered;
+    }
+
+    // Renders the given packets (natural order) in the background. Replaces any pending request.
+    void prefetch(::std::vector<size_t> indices)
+    {
+        {
+            ::std::scoped_lock lock { lock_ };
+            pending_ = ::std::move(indices);
+            ++request_;
+        }
+        request_available_.notify_one();
+    }
+
+    // Replaces the packet descriptions; rows of the packet types in `changed` are rendered again on next access
+    void invalidate(::std::bitset<256> const& changed, ::payload_container const& descriptions)
+    {
+        auto snapshot { ::std::make_shared<::payload_container const>(descriptions) };
+        ::std::scoped_lock lock { lock_ };
+        descriptions_ = ::std::move(snapshot);
+        for (size_t type { 0 }; type < changed.size(); ++type)
+        {
+            if (changed.test(type))
+            {
+                ++generations_[type];
+            }
+        }
+    }
+
+    struct statistics
+    {
+        uint64_t hits;
+        uint64_t misses;
+        size_t size;
+    };
+
+    [[nodiscard]] statistics stats() const
+    {
+        ::std::scoped_lock lock { lock_ };
+        return { hits_, misses_, entries_.size() };
+    }
+
+private:
+    struct entry
+    {
+        size_t index;
+        // Generation of the packet type's description when rendering started
+        uint32_t generation;
+        ::std::shared_ptr<rendered_row const> row;
+    };
+
+    // Requires `lock_` to be held
+    [[nodiscard]] ::std::shared_ptr<rendered_row const> lookup(size_t const index)
+    {
+        auto const it { index_.find(index) };
+        if (it == end(index_) || it->second->generation != generations_[directory_[index].type()])
+        {
+            return {};
+        }
+        // Move to front (most recently used)
+        entries_.splice(begin(entries_), entries_, it->second);
+        return it->second->row;
+    }
+
+    // Requires `lock_` to be held
+    void insert(size_t const index, uint32_t const generation, ::std::shared_ptr<rendered_row const> row)
+    {
+        if (generation != generations_[directory_[index].type()])
+        {
+            // Rendered with outdated descriptions
+            return;
+        }
+        if (auto const it { index_.find(index) }; it != end(index_))
+        {
+            it->second->generation = generation;
+            it->second->row = ::std::move(row);
+            entries_.splice(begin(entries_), entries_, it->second);
+            return;
+        }
+        entries_.push_front({ index, generation, ::std::move(row) });
+        index_.emplace(index, begin(entries_));
+        while (entries_.size() > capacity_)
+        {
+            index_.erase(entries_.back().index);
+            entries_.pop_back();
+        }
+    }
+
+    void run(::std::stop_token const stop)
+    {
+        ::std::unique_lock lock { lock_ };
+        while (!stop.stop_requested())
+        {
+            request_available_.wait(lock, stop, [&] { return !pending_.empty(); });
+            if (stop.stop_requested())
+            {
+                return;
+            }
+
+            auto const request { request_ };
+            auto const indices { ::std::exchange(pending_, {}) };
+            for (auto const index : indices)
+            {
+                // Abandon this request as soon as a newer one arrives
+                if (stop.stop_requested() || request != request_)
+                {
+                    break;
+                }
+                if (index >= directory_.size() || lookup(index))
+                {
+                    continue;
+                }
+
+                auto const descriptions { descriptions_ };
+                auto const generation { generations_[directory_[index].type()] };
+                lock.unlock();
+                auto rendered { ::std::make_shared<rendered_row const>(
+                    ::render_row(directory_[index], index, *descriptions)) };
+                lock.lock();
+                insert(index, generation, ::std::move(rendered));
+            }
+        }
+    }
+
+    ::std::span<data_proxy const> directory_;
+
+    mutable ::std::mutex lock_;
+    ::std::condition_variable_any request_available_;
+    ::std::shared_ptr<::payload_container const> descriptions_;
+    ::std::array<uint32_t, 256> generations_ {};
+    size_t capacity_;
+    // Most recently used first
+    ::std::list<entry> entries_;
+    ::std::unordered_map<size_t, ::std::list<entry>::iterator> index_;
+    ::std::vector<size_t> pending_;
+    uint64_t request_ { 0 };
+    uint64_t hits_ { 0 };
+    uint64_t misses_ { 0 };
+
+    // Declared last so that it stops before any of the members it uses are destroyed
+    ::std::jthread worker_;
+};
+
+
+//! \brief Collects the packets around a visible range of a packet list.
+//!
+//! \param[in] view   The filter and sort order of the packet list.
+//! \param[in] first  The first visible row (after filtering and sorting).
+//! \param[in] last   The last visible row (inclusive).
+//! \param[in] margin The number of rows to include ahead of and behind the
+//!                   visible range.
+//!
+//! \return The packet indices (natural order) suitable for
+//!         `row_cache::prefetch()`. Visible rows come first, followed by rows
+//!         alternating ahead and behind with increasing distance.
+//!
+[[nodiscard]] inline ::std::vector<size_t> visible_range_indices(::model_view const& view, size_t const first,
+                                                                 size_t const last, size_t const margin)
+{
+    ::std::vector<size_t> indices {};
+    auto const count { view.packet_count() };
+    if (first > last || first >= count)
+    {
+        return indices;
+    }
+
+    auto const clamped_last { ::std::min(last, count - 1) };
+    for (auto row { first }; row <= clamped_last; ++row)
+    {
+        indices.push_back(view.packet_index(row));
+    }
+    for (size_t distance { 1 }; distance <= margin; ++distance)
+    {
+        if (clamped_last + distance < count)
+        {
+            indices.push_back(view.packet_index(clamped_last + distance));
+        }
+        if (distance <= first)
+        {
+            indices.push_back(view.packet_index(first - distance));
+        }
+    }
+    return indices;
+}
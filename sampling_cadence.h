@@ -0,0 +1,470 @@
+#pragma once
+
+#include "date_time_utils.h"
+#include "model.h"
+#include "tracing.h"
+#include "windowed_mapping.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+struct cadence_options
+{
+    // An interval counts as a gap if it exceeds the typical interval by this factor...
+    double gap_factor { 10.0 };
+    // ...and lasts at least this long (FILETIME ticks)
+    uint64_t min_gap { 10 * 10'000'000ull };
+    // An interval is part of a burst if it falls short of the typical interval by this factor...
+    double burst_factor { 4.0 };
+    // ...for at least this many consecutive packets
+    size_t min_burst { 3 };
+    // Maximum number of gaps and bursts reported each
+    size_t max_events { 10'000 };
+};
+
+
+// Sampling cadence of a packet type. Intervals and times are in FILETIME ticks.
+struct type_cadence
+{
+    unsigned char type;
+    uint64_t count;
+    uint64_t first_time;
+    uint64_t last_time;
+    // Intervals between consecutive packets of this type, excluding log-wide gaps
+    uint64_t min_interval;
+    uint64_t max_interval;
+    double mean_interval;
+    // Most common interval (mean of the most populated histogram bucket)
+    double dominant_interval;
+    // Approximate percentiles (within about 9%)
+    double p10_interval;
+    double median_interval;
+    double p90_interval;
+    size_t gap_count;
+    size_t burst_count;
+};
+
+
+// A time range without packets; `type` is `nullopt` if the whole log is affected
+struct cadence_gap
+{
+    ::std::optional<unsigned char> type;
+    uint64_t start;
+    uint64_t end;
+};
+
+
+// A run of packets of a type arriving considerably faster than usual
+struct cadence_burst
+{
+    unsigned char type;
+    uint64_t start;
+    uint64_t end;
+    size_t count;
+};
+
+
+struct cadence_report
+{
+    // Packet types in ascending order
+    ::std::vector<type_cadence> types;
+    // In order of detection
+    ::std::vector<cadence_gap> gaps;
+    ::std::vector<cadence_burst> bursts;
+    // Packets preceding the first time anchor
+    uint64_t untimed_packets { 0 };
+    // Gaps and bursts beyond `cadence_options::max_events`
+    size_t dropped_events { 0 };
+};
+
+
+// Estimates the sampling cadence of every packet type from a stream of packets in natural order, and flags gaps and
+// bursts.
+//
+// Packet times are reconstructed like `build_time_column()` does, by interpolating between time anchors. To that end,
+// the types of the packets following the most recent anchor are held back until the next anchor arrives (at most
+// `k_max_pending`; beyond that, packets are timed at the typical packet rate). All other state is a fixed-size
+// histogram per packet type, so memory usage doesn't depend on the size of the log.
+//
+// Interpolation spreads packets evenly over the time between two anchors, which would hide the periods where the
+// device was switched off. A segment between anchors that takes considerably longer than usual for its number of
+// packets is reported as a log-wide gap instead, and its packets are timed at the typical packet rate. Log-wide gaps
+// are excluded from the intervals of individual types.
+struct cadence_analyzer
+{
+    static constexpr size_t k_max_pending { 1 << 16 };
+    // Number of samples required before typical intervals (and thus gaps and bursts) are assessed
+    static constexpr uint64_t k_warmup_samples { 16 };
+
+    explicit cadence_analyzer(::payload_container const& descriptions, cadence_options const& options = {})
+        : options_ { options }, anchor_offsets_ { ::time_anchor_offsets(descriptions) }
+    {
+    }
+
+    // Adds the next packet in natural order
+    void add(unsigned char const type, ::std::span<unsigned char const> const payload)
+    {
+        if (auto const time { anchor_time(type, payload) }; time)
+        {
+            close_segment(*time);
+            record(type, clock_);
+            return;
+        }
+
+        if (!anchor_)
+        {
+            ++report_.untimed_packets;
+            return;
+        }
+        pending_.push_back(type);
+        if (pending_.size() == k_max_pending)
+        {
+            flush_pending();
+        }
+    }
+
+    // Completes the analysis. Packets following the final anchor are timed at the typical packet rate.
+    [[nodiscard]] cadence_report finish()
+    {
+        flush_pending();
+        for (size_t type { 0 }; type < states_.size(); ++type)
+        {
+            auto const& state { states_[type] };
+            if (!state)
+            {
+                continue;
+            }
+            end_burst(static_cast<unsigned char>(type), *state);
+            auto const& h { state->intervals };
+            report_.types.push_back({ static_cast<unsigned char>(type), state->count, state->first_time,
+                                      state->last_time, h.count == 0 ? 0 : h.min, h.max,
+                                      h.count == 0 ? 0.0 : h.sum / static_cast<double>(h.count), h.typical(),
+                                      h.quantile(0.1), h.quantile(0.5), h.quantile(0.9), state->gap_count,
+                                      state->burst_count });
+        }
+        return ::std::move(report_);
+    }
+
+private:
+    // Log-scale histogram of intervals with 8 buckets per octave. Keeps the sum of the values per bucket, so bucket
+    // means serve as (more accurate) representatives.
+    struct interval_histogram
+    {
+        static constexpr size_t k_sub_buckets { 8 };
+        static constexpr size_t k_bucket_count { 1 + 64 * k_sub_buckets };
+
+        ::std::array<uint64_t, k_bucket_count> counts {};
+        ::std::array<double, k_bucket_count> sums {};
+        uint64_t count { 0 };
+        double sum { 0.0 };
+        uint64_t min { UINT64_MAX };
+        uint64_t max { 0 };
+        size_t mode { 0 };
+
+        [[nodiscard]] static size_t bucket(uint64_t const value) noexcept
+        {
+            if (value == 0)
+            {
+                return 0;
+            }
+            auto const octave { static_cast<size_t>(::std::bit_width(value)) - 1 };
+            auto const sub { octave >= 3 ? (value >> (octave - 3)) & 7 : (value << (3 - octave)) & 7 };
+            return 1 + octave * k_sub_buckets + static_cast<size_t>(sub);
+        }
+
+        void add(uint64_t const value, uint64_t const weight = 1) noexcept
+        {
+            auto const b { bucket(value) };
+            counts[b] += weight;
+            sums[b] += static_cast<double>(value) * static_cast<double>(weight);
+            count += weight;
+            sum += static_cast<double>(value) * static_cast<double>(weight);
+            min = ::std::min(min, value);
+            max = ::std::max(max, value);
+            if (counts[b] > counts[mode])
+            {
+                mode = b;
+            }
+        }
+
+        [[nodiscard]] double typical() const noexcept
+        {
+            return counts[mode] == 0 ? 0.0 : sums[mode] / static_cast<double>(counts[mode]);
+        }
+
+        [[nodiscard]] double quantile(double const q) const noexcept
+        {
+            if (count == 0)
+            {
+                return 0.0;
+            }
+            auto const rank { static_cast<uint64_t>(q * static_cast<double>(count - 1)) };
+            uint64_t seen { 0 };
+            for (size_t b { 0 }; b < counts.size(); ++b)
+            {
+                seen += counts[b];
+                if (seen > rank)
+                {
+                    return sums[b] / static_cast<double>(counts[b]);
+                }
+            }
+            return static_cast<double>(max);
+        }
+    };
+
+    struct type_state
+    {
+        interval_histogram intervals;
+        uint64_t count { 0 };
+        uint64_t first_time { 0 };
+        uint64_t last_time { 0 };
+        // Value of `gap_time_` at `last_time`
+        uint64_t gap_time { 0 };
+        size_t gap_count { 0 };
+        size_t burst_count { 0 };
+        // Ongoing run of short intervals
+        uint64_t burst_start { 0 };
+        size_t burst_length { 0 };
+    };
+
+    [[nodiscard]] ::std::optional<uint64_t> anchor_time(unsigned char const type,
+                                                        ::std::span<unsigned char const> const payload) const noexcept
+    {
+        for (auto const offset : anchor_offsets_[type])
+        {
+            if (offset + sizeof(uint64_t) <= payload.size())
+            {
+                auto const time { ::load_unaligned<uint64_t>(payload.data() + offset) };
+                if (::is_plausible_timestamp(time))
+                {
+                    return time;
+                }
+            }
+        }
+        return {};
+    }
+
+    // Times the pending packets between the previous anchor and an anchor at `time`
+    void close_segment(uint64_t const time)
+    {
+        if (!anchor_)
+        {
+            anchor_ = time;
+            clock_ = time;
+            return;
+        }
+
+        auto const steps { pending_.size() + 1 };
+        // Time is held if it runs backwards
+        auto const span_time { time > *anchor_ ? time - *anchor_ : 0 };
+        auto const rate { static_cast<double>(span_time) / static_cast<double>(steps) };
+        auto const typical_rate { rates_.count >= k_warmup_samples ? rates_.typical() : 0.0 };
+        if (typical_rate > 0.0 && rate > options_.gap_factor * typical_rate && span_time >= options_.min_gap)
+        {
+            // The device was off (or didn't record) for most of the segment
+            auto const active { static_cast<uint64_t>(typical_rate * static_cast<double>(pending_.size())) };
+            time_pending(*anchor_, typical_rate);
+            add_event(report_.gaps, cadence_gap { {}, *anchor_ + active, time });
+            gap_time_ += span_time - active;
+        }
+        else
+        {
+            rates_.add(span_time / steps, steps);
+            for (size_t step { 1 }; step < steps; ++step)
+            {
+                // Split the multiplication to avoid overflowing on large spans (like `build_time_column()`)
+                record(pending_[step - 1],
+                       *anchor_ + span_time / steps * step + span_time % steps * step / steps);
+            }
+        }
+        pending_.clear();
+        anchor_ = time;
+        clock_ = ::std::max(clock_, time);
+    }
+
+    // Times the pending packets at the typical packet rate, continuing from the previous anchor
+    void flush_pending()
+    {
+        if (!anchor_ || pending_.empty())
+        {
+            return;
+        }
+        auto const typical_rate { rates_.count > 0 ? rates_.typical() : 0.0 };
+        time_pending(*anchor_, typical_rate);
+        anchor_ = *anchor_ + static_cast<uint64_t>(typical_rate * static_cast<double>(pending_.size()));
+        pending_.clear();
+    }
+
+    void time_pending(uint64_t const start, double const rate)
+    {
+        for (size_t step { 1 }; step <= pending_.size(); ++step)
+        {
+            record(pending_[step - 1], start + static_cast<uint64_t>(rate * static_cast<double>(step)));
+        }
+    }
+
+    // Adds a packet of `type` at `time`
+    void record(unsigned char const type, uint64_t time)
+    {
+        time = ::std::max(time, clock_);
+        clock_ = time;
+
+        auto& state { states_[type] };
+        if (!state)
+        {
+            state = ::std::make_unique<type_state>();
+            state->first_time = time;
+            state->last_time = time;
+            state->gap_time = gap_time_;
+            state->count = 1;
+            return;
+        }
+
+        auto const elapsed { time - state->last_time };
+        auto const excluded { ::std::min(gap_time_ - state->gap_time, elapsed) };
+        auto const interval { elapsed - excluded };
+        auto const typical { state->intervals.count >= k_warmup_samples ? state->intervals.typical() : 0.0 };
+
+        if (typical > 0.0 && static_cast<double>(interval) > options_.gap_factor * typical
+            && interval >= options_.min_gap)
+        {
+            ++state->gap_count;
+            add_event(report_.gaps, cadence_gap { type, state->last_time, time });
+        }
+
+        if (typical > 0.0 && static_cast<double>(interval) * options_.burst_factor < typical)
+        {
+            if (state->burst_length == 0)
+            {
+                state->burst_start = state->last_time;
+            }
+            ++state->burst_length;
+        }
+        else
+        {
+            end_burst(type, *state);
+        }
+
+        state->intervals.add(interval);
+        ++state->count;
+        state->last_time = time;
+        state->gap_time = gap_time_;
+    }
+
+    void end_burst(unsigned char const type, type_state& state)
+    {
+        // A run of n short intervals spans n + 1 packets
+        if (state.burst_length + 1 >= options_.min_burst && state.burst_length > 0)
+        {
+            ++state.burst_count;
+            add_event(report_.bursts, cadence_burst { type, state.burst_start, state.last_time,
+                                                      state.burst_length + 1 });
+        }
+        state.burst_length = 0;
+    }
+
+    template <typename Event>
+    void add_event(::std::vector<Event>& events, Event const& event)
+    {
+        if (events.size() < options_.max_events)
+        {
+            events.push_back(event);
+        }
+        else
+        {
+            ++report_.dropped_events;
+        }
+    }
+
+    cadence_options options_;
+    ::std::array<::std::vector<size_t>, 256> anchor_offsets_;
+
+    // Time of the most recent anchor; `nullopt` until the first anchor
+    ::std::optional<uint64_t> anchor_;
+    // Types of the packets following the most recent anchor
+    ::std::vector<unsigned char> pending_ {};
+    // Time of the most recently recorded packet
+    uint64_t clock_ { 0 };
+    // Total duration of log-wide gaps so far
+    uint64_t gap_time_ { 0 };
+    // Time per packet between anchors, weighted by packet count
+    interval_histogram rates_ {};
+    ::std::array<::std::unique_ptr<type_state>, 256> states_ {};
+
+    cadence_report report_ {};
+};
+
+
+//! \brief Estimates the sampling cadence of every packet type of a model.
+//!
+//! \param[in] descriptions The packet descriptions locating the time anchors,
+//!                         e.g. a snapshot taken independently of the model's.
+//!
+//! \return The cadence per packet type along with all gaps and bursts (see
+//!         `cadence_analyzer`).
+//!
+[[nodiscard]] inline cadence_report analyze_cadence(model const& m, ::payload_container const& descriptions,
+                                                    cadence_options const& options = {})
+{
+    trace_span const span { "analyze_cadence" };
+
+    cadence_analyzer analyzer { descriptions, options };
+    for (auto const& packet : m.directory())
+    {
+        analyzer.add(packet.type(), { packet.data() + packet.header_size(), packet.size() - packet.header_size() });
+    }
+    return analyzer.finish();
+}
+
+
+//! \brief Estimates the sampling cadence of every packet type of a model,
+//!        using the model's packet descriptions.
+//!
+[[nodiscard]] inline cadence_report analyze_cadence(model const& m, cadence_options const& options = {})
+{
+    return analyze_cadence(m, m.packet_descriptions(), options);
+}
+
+
+//! \brief Estimates the sampling cadence of every packet type of a sensor log
+//!        file.
+//!
+//! \remark The file is streamed through a `windowed_mapping`, so neither the
+//!         file nor a packet directory needs to fit into memory. A truncated
+//!         final packet is ignored.
+//!
+[[nodiscard]] inline cadence_report analyze_file_cadence(wchar_t const* const path_name,
+                                                         ::payload_container const& descriptions,
+                                                         cadence_options const& options = {})
+{
+    trace_span const span { "analyze_file_cadence" };
+
+    cadence_analyzer analyzer { descriptions, options };
+    windowed_mapping const mapping { path_name };
+    ::std::shared_ptr<mapped_window const> view {};
+    uint64_t pos { 0 };
+    while (mapping.size() - pos >= data_proxy::header_size())
+    {
+        if (!view || pos >= view->offset + mapping.window_size())
+        {
+            view = mapping.pin(pos);
+        }
+        auto const header { view->bytes.data() + (pos - view->offset) };
+        auto const payload_size { static_cast<size_t>(header[1]) };
+        if (mapping.size() - pos < data_proxy::header_size() + payload_size)
+        {
+            break;
+        }
+        analyzer.add(header[0], { header + data_proxy::header_size(), payload_size });
+        pos += data_proxy::header_size() + payload_size;
+    }
+    ::trace_count(trace_counter::bytes_scanned, pos);
+    return analyzer.finish();
+}
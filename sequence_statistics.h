@@ -0,0 +1,544 @@
+#pragma once
+
+#include "log_utils.h"
+#include "model.h"
+#include "tracing.h"
+#include "windowed_mapping.h"
+
+#include <wil/result.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+struct sequence_options
+{
+    // Maximum n-gram length (2 through `type_ngram::k_max_length`)
+    size_t max_length { 8 };
+    // Number of n-grams reported per length
+    size_t top_k { 32 };
+    // Don't count transitions and n-grams across chunk boundaries (see `split_into_chunks()`)
+    bool within_chunks { false };
+    // Maximum number of distinct n-grams tracked per length and thread; less frequent n-grams are evicted beyond that
+    size_t max_tracked { 1 << 16 };
+    // Number of worker threads; 0 selects the number of hardware threads
+    size_t thread_count { 0 };
+};
+
+
+// A sequence of packet types along with its frequency
+struct type_ngram
+{
+    static constexpr size_t k_max_length { 8 };
+
+    // Packet types in order of appearance; only the first `length` are valid
+    ::std::array<unsigned char, k_max_length> types;
+    size_t length;
+    uint64_t count;
+    // Share of all n-grams of this length
+    double frequency;
+    // Probability of the final type following the preceding ones
+    double probability;
+};
+
+
+// Packet type statistics of one or more sensor logs
+struct sequence_statistics
+{
+    uint64_t packet_count { 0 };
+    ::std::array<uint64_t, 256> type_counts {};
+    // Number of times a packet of type `to` immediately follows one of type `from`, at `[from * 256 + to]`
+    ::std::vector<uint64_t> transitions = ::std::vector<uint64_t>(256 * 256);
+    // Most frequent n-grams in descending order, per length starting at 2 (`ngrams[0]` holds pairs)
+    ::std::vector<::std::vector<type_ngram>> ngrams;
+    // Upper bound of the amount by which counts of n-grams longer than 2 can be too low, due to eviction
+    uint64_t max_error { 0 };
+    // Number of logs that couldn't be read (folders only)
+    size_t failed_logs { 0 };
+
+    [[nodiscard]] uint64_t transition_count(unsigned char const from, unsigned char const to) const noexcept
+    {
+        return transitions[from * size_t { 256 } + to];
+    }
+
+    // Returns the probability of a packet of type `to` following a packet of type `from`
+    [[nodiscard]] double successor_probability(unsigned char const from, unsigned char const to) const noexcept
+    {
+        uint64_t total { 0 };
+        for (size_t next { 0 }; next < 256; ++next)
+        {
+            total += transitions[from * size_t { 256 } + next];
+        }
+        return total == 0 ? 0.0 : static_cast<double>(transition_count(from, to)) / static_cast<double>(total);
+    }
+
+    // Returns the probability of a packet of type `to` being preceded by a packet of type `from`
+    [[nodiscard]] double predecessor_probability(unsigned char const from, unsigned char const to) const noexcept
+    {
+        uint64_t total { 0 };
+        for (size_t previous { 0 }; previous < 256; ++previous)
+        {
+            total += transitions[previous * size_t { 256 } + to];
+        }
+        return total == 0 ? 0.0 : static_cast<double>(transition_count(from, to)) / static_cast<double>(total);
+    }
+};
+
+
+// Collection internals (see `collect_sequence_statistics()`)
+//
+// Per packet, only the longest n-gram ending at it is counted; shorter n-grams are its suffixes and are aggregated in
+// `summarize()`. N-grams evicted from a full table are rolled up into the table of the next shorter length, so counts
+// of shorter n-grams stay exact.
+struct sequence_counter
+{
+    // Counts n-grams of a single length. N-grams are keyed by their types, packed with the final type in the least
+    // significant byte.
+    struct ngram_table
+    {
+        // Slots with a count of 0 are empty
+        ::std::vector<uint64_t> keys = ::std::vector<uint64_t>(1024);
+        ::std::vector<uint64_t> counts = ::std::vector<uint64_t>(1024);
+        size_t size { 0 };
+        // Sum of the eviction thresholds; bounds the undercount of any n-gram of this length
+        uint64_t max_error { 0 };
+
+        [[nodiscard]] size_t slot(uint64_t const key) const noexcept
+        {
+            // Fibonacci hashing; the table size is a power of 2
+            return static_cast<size_t>((key * 0x9E37'79B9'7F4A'7C15ull) >> (64 - ::std::countr_zero(keys.size())));
+        }
+    };
+
+    explicit sequence_counter(sequence_options const& options)
+        : max_length_ { ::std::clamp(options.max_length, size_t { 2 }, type_ngram::k_max_length) }
+        , max_tracked_ { ::std::max(options.max_tracked, size_t { 16 }) }
+        , within_chunks_ { options.within_chunks }
+        , tables_(max_length_ - 2)
+    {
+    }
+
+    // Counts a packet
+    void add(unsigned char const type, size_t const payload_size)
+    {
+        ++packet_count_;
+        ++type_counts_[type];
+        if (length_ > 0)
+        {
+            ++transitions_[((history_ & 0xFF) << 8) | type];
+        }
+        push(type);
+        ++ends_[length_];
+        if (length_ >= 3)
+        {
+            insert(length_, history_ & mask(length_), 1);
+        }
+        reset_at_chunk_end(type, payload_size);
+    }
+
+    // Records a packet as the context of the following ones, without counting it
+    void skip(unsigned char const type, size_t const payload_size) noexcept
+    {
+        push(type);
+        reset_at_chunk_end(type, payload_size);
+    }
+
+    void merge(sequence_counter const& other)
+    {
+        packet_count_ += other.packet_count_;
+        for (size_t type { 0 }; type < type_counts_.size(); ++type)
+        {
+            type_counts_[type] += other.type_counts_[type];
+        }
+        for (size_t t { 0 }; t < transitions_.size(); ++t)
+        {
+            transitions_[t] += other.transitions_[t];
+        }
+        for (size_t length { 0 }; length < ends_.size(); ++length)
+        {
+            ends_[length] += other.ends_[length];
+        }
+        for (size_t length { 3 }; length <= max_length_; ++length)
+        {
+            auto const& table { other.tables_[length - 3] };
+            tables_[length - 3].max_error += table.max_error;
+            for (size_t s { 0 }; s < table.keys.size(); ++s)
+            {
+                if (table.counts[s] != 0)
+                {
+                    insert(length, table.keys[s], table.counts[s]);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] sequence_statistics summarize(size_t const top_k) const
+    {
+        sequence_statistics result {};
+        result.packet_count = packet_count_;
+        result.type_counts = type_counts_;
+        result.transitions = transitions_;
+        result.ngrams.resize(max_length_ - 1);
+
+        // Number of n-grams per length, i.e. packets preceded by at least `length - 1` packets
+        ::std::array<uint64_t, type_ngram::k_max_length + 1> totals {};
+        for (auto length { max_length_ }; length >= 2; --length)
+        {
+            totals[length] = ends_[length] + (length < max_length_ ? totals[length + 1] : 0);
+        }
+
+        // Longer n-grams contribute to the counts of their suffixes
+        ::std::unordered_map<uint64_t, uint64_t> counts {};
+        for (auto length { max_length_ }; length >= 3; --length)
+        {
+            ::std::unordered_map<uint64_t, uint64_t> suffixes {};
+            for (auto const& [key, count] : counts)
+            {
+                suffixes[key & mask(length)] += count;
+            }
+            auto const& table { tables_[length - 3] };
+            for (size_t s { 0 }; s < table.keys.size(); ++s)
+            {
+                if (table.counts[s] != 0)
+                {
+                    suffixes[table.keys[s]] += table.counts[s];
+                }
+            }
+            counts = ::std::move(suffixes);
+
+            ::std::unordered_map<uint64_t, uint64_t> prefix_totals {};
+            for (auto const& [key, count] : counts)
+            {
+                prefix_totals[key >> 8] += count;
+            }
+            result.ngrams[length - 2] = top_ngrams({ begin(counts), end(counts) }, length, top_k, totals[length],
+                                                   [&](uint64_t const prefix) { return prefix_totals[prefix]; });
+            result.max_error = ::std::max(result.max_error, table.max_error);
+        }
+
+        // Pairs
+        ::std::array<uint64_t, 256> row_totals {};
+        ::std::vector<::std::pair<uint64_t, uint64_t>> pairs {};
+        for (size_t t { 0 }; t < transitions_.size(); ++t)
+        {
+            if (transitions_[t] != 0)
+            {
+                pairs.emplace_back(t, transitions_[t]);
+                row_totals[t >> 8] += transitions_[t];
+            }
+        }
+        result.ngrams[0] = top_ngrams(::std::move(pairs), 2, top_k, totals[2],
+                                      [&](uint64_t const prefix) { return row_totals[prefix]; });
+        return result;
+    }
+
+private:
+    [[nodiscard]] static constexpr uint64_t mask(size_t const length) noexcept
+    {
+        return length >= 8 ? ~uint64_t { 0 } : (uint64_t { 1 } << (8 * length)) - 1;
+    }
+
+    void push(unsigned char const type) noexcept
+    {
+        history_ = (history_ << 8) | type;
+        length_ = ::std::min(length_ + 1, max_length_);
+    }
+
+    void reset_at_chunk_end(unsigned char const type, size_t const payload_size) noexcept
+    {
+        // Same criterion as `split_into_chunks()`
+        if (within_chunks_ && type == k_packet_type_sequence_id && payload_size >= sizeof(uint32_t))
+        {
+            length_ = 0;
+        }
+    }
+
+    void insert(size_t const length, uint64_t const key, uint64_t const count)
+    {
+        auto& table { tables_[length - 3] };
+        auto const slot_mask { table.keys.size() - 1 };
+        for (auto s { table.slot(key) };; s = (s + 1) & slot_mask)
+        {
+            if (table.counts[s] == 0)
+            {
+                if (table.size >= max_tracked_ || (table.size + 1) * 4 > table.keys.size() * 3)
+                {
+                    make_room(length);
+                    insert(length, key, count);
+                    return;
+                }
+                table.keys[s] = key;
+                table.counts[s] = count;
+                ++table.size;
+                return;
+            }
+            if (table.keys[s] == key)
+            {
+                table.counts[s] += count;
+                return;
+            }
+        }
+    }
+
+    // Grows a table, or evicts the less frequent half of its n-grams once `max_tracked_` is reached
+    void make_room(size_t const length)
+    {
+        auto& table { tables_[length - 3] };
+        uint64_t threshold { 0 };
+        if (table.size >= max_tracked_)
+        {
+            ::std::vector<uint64_t> occupied {};
+            occupied.reserve(table.size);
+            ::std::copy_if(begin(table.counts), end(table.counts), ::std::back_inserter(occupied),
+                           [](auto const c) { return c != 0; });
+            auto const median { begin(occupied) + static_cast<ptrdiff_t>(occupied.size() / 2) };
+            ::std::nth_element(begin(occupied), median, end(occupied));
+            threshold = *median;
+            table.max_error += threshold;
+        }
+
+        auto const keys { ::std::exchange(table.keys, {}) };
+        auto const counts { ::std::exchange(table.counts, {}) };
+        auto const capacity { threshold == 0 ? keys.size() * 2 : keys.size() };
+        table.keys.resize(capacity);
+        table.counts.resize(capacity);
+        table.size = 0;
+        for (size_t s { 0 }; s < keys.size(); ++s)
+        {
+            if (counts[s] > threshold)
+            {
+                insert(length, keys[s], counts[s]);
+            }
+        }
+        // Pairs are counted separately
+        if (threshold != 0 && length > 3)
+        {
+            for (size_t s { 0 }; s < keys.size(); ++s)
+            {
+                if (counts[s] != 0 && counts[s] <= threshold)
+                {
+                    insert(length - 1, keys[s] & mask(length - 1), counts[s]);
+                }
+            }
+        }
+    }
+
+    // Returns the `top_k` most frequent of `entries` (packed n-grams and their counts)
+    template <typename PrefixTotal>
+    [[nodiscard]] static ::std::vector<type_ngram> top_ngrams(::std::vector<::std::pair<uint64_t, uint64_t>> entries,
+                                                              size_t const length, size_t const top_k,
+                                                              uint64_t const total, PrefixTotal prefix_total)
+    {
+        auto const count { ::std::min(top_k, entries.size()) };
+        ::std::partial_sort(begin(entries), begin(entries) + static_cast<ptrdiff_t>(count), end(entries),
+                            [](auto const& lhs, auto const& rhs) {
+                                return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+                            });
+
+        ::std::vector<type_ngram> ngrams {};
+        ngrams.reserve(count);
+        for (size_t i { 0 }; i < count; ++i)
+        {
+            auto const [key, occurrences] { entries[i] };
+            type_ngram ngram { {}, length, occurrences, static_cast<double>(occurrences) / static_cast<double>(total),
+                               static_cast<double>(occurrences) / static_cast<double>(prefix_total(key >> 8)) };
+            for (size_t t { 0 }; t < length; ++t)
+            {
+                ngram.types[t] = static_cast<unsigned char>(key >> (8 * (length - 1 - t)));
+            }
+            ngrams.push_back(ngram);
+        }
+        return ngrams;
+    }
+
+    size_t max_length_;
+    size_t max_tracked_;
+    bool within_chunks_;
+
+    uint64_t packet_count_ { 0 };
+    ::std::array<uint64_t, 256> type_counts_ {};
+    ::std::vector<uint64_t> transitions_ = ::std::vector<uint64_t>(256 * 256);
+    // Number of packets by the length of the longest n-gram ending at them
+    ::std::array<uint64_t, type_ngram::k_max_length + 1> ends_ {};
+    // N-grams of length 3 and up, by length
+    ::std::vector<ngram_table> tables_;
+
+    // Most recent types, the latest in the least significant byte
+    uint64_t history_ { 0 };
+    // Number of valid types in `history_`
+    size_t length_ { 0 };
+};
+
+
+//! \brief Counts packet type transitions and n-grams of a model.
+//!
+//! \return The transition matrix and the `options.top_k` most frequent n-grams
+//!         per length, with their frequencies and conditional probabilities.
+//!
+//! \remark The packets are split into `options.thread_count` ranges, which are
+//!         counted concurrently and merged afterwards. Each range is preceded
+//!         by the packets needed to count the n-grams spanning into it, so the
+//!         result doesn't depend on the number of threads.
+//!
+[[nodiscard]] inline sequence_statistics collect_sequence_statistics(model const& m,
+                                                                     sequence_options const& options = {})
+{
+    trace_span const span { "collect_sequence_statistics" };
+
+    auto const& directory { m.directory() };
+    auto const threads { ::std::max(size_t { 1 },
+                                    ::std::min(options.thread_count != 0
+                                                   ? options.thread_count
+                                                   : size_t { ::std::thread::hardware_concurrency() },
+                                               directory.size())) };
+
+    ::std::vector<sequence_counter> counters(threads, sequence_counter { options });
+    auto const count_range { [&](size_t const range) {
+        auto const first { directory.size() * range / threads };
+        auto const last { directory.size() * (range + 1) / threads };
+        auto& counter { counters[range] };
+        for (auto index { first - ::std::min(first, type_ngram::k_max_length - 1) }; index < first; ++index)
+        {
+            counter.skip(directory[index].type(), static_cast<size_t>(directory[index].payload_size()));
+        }
+        for (auto index { first }; index < last; ++index)
+        {
+            counter.add(directory[index].type(), static_cast<size_t>(directory[index].payload_size()));
+        }
+    } };
+
+    if (threads > 1)
+    {
+        ::std::vector<::std::jthread> workers {};
+        for (size_t range { 0 }; range < threads; ++range)
+        {
+            workers.emplace_back(count_range, range);
+        }
+    }
+    else
+    {
+        count_range(0);
+    }
+
+    for (size_t range { 1 }; range < threads; ++range)
+    {
+        counters.front().merge(counters[range]);
+    }
+    return counters.front().summarize(options.top_k);
+}
+
+
+//! \brief Counts the packet types of a sensor log file into `counter`.
+//!
+//! \remark The file is walked sequentially through a `windowed_mapping`, so
+//!         neither the file nor a packet directory needs to fit into memory.
+//!         A truncated final packet is ignored.
+//!
+inline void count_file_sequences(wchar_t const* const path_name, sequence_counter& counter)
+{
+    trace_span const span { "count_file_sequences" };
+
+    windowed_mapping const mapping { path_name };
+    ::std::shared_ptr<mapped_window const> view {};
+    uint64_t pos { 0 };
+    while (mapping.size() - pos >= data_proxy::header_size())
+    {
+        if (!view || pos >= view->offset + mapping.window_size())
+        {
+            view = mapping.pin(pos);
+        }
+        auto const header { view->bytes.data() + (pos - view->offset) };
+        auto const payload_size { static_cast<size_t>(header[1]) };
+        if (mapping.size() - pos < data_proxy::header_size() + payload_size)
+        {
+            break;
+        }
+        counter.add(header[0], payload_size);
+        pos += data_proxy::header_size() + payload_size;
+    }
+    ::trace_count(trace_counter::bytes_scanned, pos);
+}
+
+
+//! \brief Counts packet type transitions and n-grams of all sensor logs in a
+//!        folder.
+//!
+//! \return The combined statistics of all sensor logs (see `is_sensor_log()`).
+//!         N-grams don't span logs. Logs that fail to open are skipped and
+//!         reported in `failed_logs`.
+//!
+//! \remark Logs are counted concurrently on up to `options.thread_count`
+//!         threads, one log per thread at a time.
+//!
+[[nodiscard]] inline sequence_statistics collect_folder_sequence_statistics(::std::filesystem::path const& folder,
+                                                                            sequence_options const& options = {})
+{
+    trace_span const span { "collect_folder_sequence_statistics" };
+
+    ::std::vector<::std::filesystem::path> logs {};
+    for (auto const& entry : ::std::filesystem::directory_iterator { folder })
+    {
+        if (entry.is_regular_file() && ::is_sensor_log(entry.path().wstring()))
+        {
+            logs.push_back(entry.path());
+        }
+    }
+
+    auto const threads { ::std::max(size_t { 1 },
+                                    ::std::min(options.thread_count != 0
+                                                   ? options.thread_count
+                                                   : size_t { ::std::thread::hardware_concurrency() },
+                                               logs.size())) };
+    ::std::vector<sequence_counter> counters(threads, sequence_counter { options });
+    ::std::atomic<size_t> next { 0 };
+    ::std::atomic<size_t> failed { 0 };
+    auto const worker { [&](size_t const thread) {
+        for (auto index { next++ }; index < logs.size(); index = next++)
+        {
+            // Counts are merged only for logs that were read in full
+            sequence_counter counter { options };
+            try
+            {
+                ::count_file_sequences(logs[index].c_str(), counter);
+                counters[thread].merge(counter);
+            }
+            catch (...)
+            {
+                LOG_CAUGHT_EXCEPTION();
+                ++failed;
+            }
+        }
+    } };
+
+    if (threads > 1)
+    {
+        ::std::vector<::std::jthread> workers {};
+        for (size_t thread { 0 }; thread < threads; ++thread)
+        {
+            workers.emplace_back(worker, thread);
+        }
+    }
+    else
+    {
+        worker(0);
+    }
+
+    for (size_t thread { 1 }; thread < threads; ++thread)
+    {
+        counters.front().merge(counters[thread]);
+    }
+    auto result { counters.front().summarize(options.top_k) };
+    result.failed_logs = failed;
+    return result;
+}
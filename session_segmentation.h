@@ -0,0 +1,565 @@
+#pragma once
+
+#include "chunk_utils.h"
+#include "date_time_utils.h"
+#include "model.h"
+#include "tracing.h"
+#include "worn_timeline.h"
+
+#include <wil/result.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <set>
+#include <span>
+#include <vector>
+
+
+// Label of a session
+enum struct session_label : uint8_t
+{
+    idle,
+    sleep,
+    activity,
+
+    last_value = activity
+};
+
+
+[[nodiscard]] inline constexpr wchar_t const* to_string(session_label const label) noexcept
+{
+    switch (label)
+    {
+    case session_label::sleep:
+        return L"sleep";
+    case session_label::activity:
+        return L"activity";
+    case session_label::idle:
+    default:
+        return L"idle";
+    }
+}
+
+
+struct segmentation_options
+{
+    // Duration of the epochs packets are aggregated into before they are labelled
+    uint64_t epoch { 60 * k_filetime_ticks_per_second };
+    // Epochs are asleep if at least this share of their heart rate samples has a second byte of 10 (see doc/notes.md)
+    double sleep_confidence_share { 0.8 };
+    // Epochs are active if they contain at least this many [TIMESTAMP] packets in addition to the one starting a chunk
+    // (observed during bike rides)...
+    size_t activity_timestamps { 1 };
+    // ...or if their mean heart rate exceeds the resting heart rate by this many beats per minute
+    double activity_heart_rate_margin { 25.0 };
+    // The resting heart rate is this percentile of the mean heart rate of all worn epochs
+    double resting_percentile { 0.1 };
+    // Resting heart rate assumed until enough epochs have been seen
+    double default_resting_heart_rate { 60.0 };
+    // Closed sessions are relabelled once the resting heart rate moves further than this (in beats per minute) from
+    // the rate they were labelled with
+    double resting_heart_rate_tolerance { 2.0 };
+    // Epochs worn for less than this share of their duration are idle
+    double min_worn_share { 0.5 };
+    // A different label needs to persist for this many epochs to end a session (shorter runs are absorbed)
+    size_t min_session_epochs { 5 };
+    // Sessions end at gaps in the data longer than this
+    uint64_t max_gap { 15 * 60 * k_filetime_ticks_per_second };
+};
+
+
+// A labelled time span with summary statistics. Times are raw FILETIME values.
+struct activity_session
+{
+    uint64_t begin;
+    uint64_t end;
+    session_label label;
+    size_t epochs { 0 };
+    uint64_t worn_seconds { 0 };
+    uint64_t heart_rate_samples { 0 };
+    double heart_rate_mean { 0.0 };
+    // Standard deviation of all heart rate samples of the session
+    double heart_rate_deviation { 0.0 };
+    uint8_t heart_rate_min { 0 };
+    uint8_t heart_rate_max { 0 };
+    // [TIMESTAMP] packets in addition to the ones starting a chunk
+    uint64_t extra_timestamps { 0 };
+    // The most recent session may still be extended by new data
+    bool open { false };
+
+    [[nodiscard]] auto duration() const noexcept { return end - begin; }
+};
+
+
+// Splits sensor logs into sleep, activity, and idle sessions.
+//
+// Packets are aggregated into fixed epochs (heart rate level, variability, and confidence; extra [TIMESTAMP] packets).
+// Every epoch is labelled by combining these with the worn state (see `worn_timeline`). Sessions are runs of equally
+// labelled epochs; a different label only starts a new session once it persists for `min_session_epochs`, and gaps in
+// the data longer than `max_gap` end a session.
+//
+// Segmentation is incremental: Chunks are identified by their sequence ID and processed at most once. Only the sessions
+// from the earliest epoch touched by new chunks onwards are recomputed, which (for logs added in order) is the open
+// session at the end. Closed sessions before that keep the resting heart rate they were labelled with, unless it moves
+// by more than `resting_heart_rate_tolerance`, in which case all sessions are relabelled. Sessions therefore depend on
+// the order logs are added in only within that tolerance.
+struct session_segmenter
+{
+    explicit session_segmenter(segmentation_options const& options = {})
+        : options_ { options }
+        , resting_heart_rate_ { options.default_resting_heart_rate }
+        , labelled_resting_heart_rate_ { options.default_resting_heart_rate }
+    {
+        options_.epoch = ::std::max(options_.epoch, uint64_t { 1 });
+        options_.min_session_epochs = ::std::max(options_.min_session_epochs, size_t { 1 });
+    }
+
+    // Processes all new chunks of a loaded log, using its reconstructed packet timestamps where available
+    size_t add(::model const& m)
+    {
+        if (auto const& times { m.time_column() }; times)
+        {
+            return add(m.directory(), [reader = time_column_reader { *times }](size_t const index) mutable
+                                          -> ::std::optional<uint64_t> { return reader(index); });
+        }
+        return add(m.directory(), ::timestamp_packet_times(m.directory()));
+    }
+
+    // Processes all new chunks in `directory`. `time_of` maps a packet index (natural order) to an optional timestamp.
+    // Returns the number of chunks processed.
+    template <typename TimeSource>
+    size_t add(::std::span<data_proxy const> const directory, TimeSource&& time_of)
+    {
+        trace_span const span { "session_segmenter::add" };
+
+        worn_.add(directory, time_of);
+
+        size_t processed { 0 };
+        auto earliest { ::std::numeric_limits<uint64_t>::max() };
+        for (auto const& chunk : ::split_into_chunks(directory))
+        {
+            if (!chunk.is_complete() || !chunks_.insert(*chunk.sequence_id).second)
+            {
+                continue;
+            }
+            earliest = ::std::min(earliest, process_chunk(directory, chunk, time_of));
+            ++processed;
+        }
+
+        if (earliest != ::std::numeric_limits<uint64_t>::max())
+        {
+            segment(earliest);
+        }
+        return processed;
+    }
+
+    [[nodiscard]] auto const& sessions() const noexcept { return sessions_; }
+    [[nodiscard]] auto const& wear() const noexcept { return worn_; }
+    [[nodiscard]] auto epoch_count() const noexcept { return epochs_.size(); }
+    [[nodiscard]] auto chunk_count() const noexcept { return chunks_.size(); }
+
+    // Returns the resting heart rate the most recent sessions were labelled with (see
+    // `segmentation_options::resting_percentile`)
+    [[nodiscard]] auto resting_heart_rate() const noexcept { return resting_heart_rate_; }
+
+private:
+    using heart_rate_histogram = ::std::array<uint64_t, 256>;
+
+    [[nodiscard]] double resting_heart_rate(heart_rate_histogram const& histogram) const noexcept
+    {
+        constexpr uint64_t k_min_epochs { 30 };
+        uint64_t total { 0 };
+        for (auto const count : histogram)
+        {
+            total += count;
+        }
+        if (total < k_min_epochs)
+        {
+            return options_.default_resting_heart_rate;
+        }
+        auto const target { static_cast<uint64_t>(options_.resting_percentile * static_cast<double>(total)) };
+        uint64_t seen { 0 };
+        for (size_t bpm { 0 }; bpm < histogram.size(); ++bpm)
+        {
+            seen += histogram[bpm];
+            if (seen > target)
+            {
+                return static_cast<double>(bpm);
+            }
+        }
+        return options_.default_resting_heart_rate;
+    }
+
+    // Aggregates of the packets within an epoch; independent of the order packets are added in
+    struct epoch_stats
+    {
+        uint64_t begin;
+        uint64_t heart_rate_samples { 0 };
+        uint64_t heart_rate_sum { 0 };
+        uint64_t heart_rate_sum_of_squares { 0 };
+        uint8_t heart_rate_min { 0xFF };
+        uint8_t heart_rate_max { 0 };
+        uint64_t confident_samples { 0 };
+        uint64_t extra_timestamps { 0 };
+
+        [[nodiscard]] double heart_rate_mean() const noexcept
+        {
+            return static_cast<double>(heart_rate_sum) / static_cast<double>(heart_rate_samples);
+        }
+    };
+
+    // Adds a chunk's packets to their epochs; returns the earliest epoch touched
+    template <typename TimeSource>
+    uint64_t process_chunk(::std::span<data_proxy const> const directory, chunk_info const& chunk,
+                           TimeSource& time_of)
+    {
+        constexpr uint8_t k_sleep_confidence { 10 };
+
+        auto earliest { ::std::numeric_limits<uint64_t>::max() };
+        // Packets arrive in time order (mostly), so the epoch of the previous packet is the first candidate
+        size_t cursor { 0 };
+        bool first_timestamp { true };
+        for (auto index { chunk.begin }; index < chunk.end; ++index)
+        {
+            auto const& packet { directory[index] };
+            auto const is_heart_rate { packet.type() == k_packet_type_heart_rate && packet.payload_size() >= 2 };
+            auto const is_timestamp { packet.type() == k_packet_type_timestamp };
+            if (!is_heart_rate && !is_timestamp)
+            {
+                continue;
+            }
+            if (is_timestamp && ::std::exchange(first_timestamp, false))
+            {
+                continue;
+            }
+            auto const time { time_of(index) };
+            if (!time)
+            {
+                continue;
+            }
+
+            auto const epoch_begin { *time - *time % options_.epoch };
+            earliest = ::std::min(earliest, epoch_begin);
+            if (cursor >= epochs_.size() || epochs_[cursor].begin != epoch_begin)
+            {
+                cursor = find_epoch(epoch_begin);
+            }
+            auto& e { epochs_[cursor] };
+            if (is_timestamp)
+            {
+                ++e.extra_timestamps;
+                continue;
+            }
+
+            auto const bpm { packet.value<uint8_t>(0) };
+            if (bpm == 0)
+            {
+                // No reading
+                continue;
+            }
+            ++e.heart_rate_samples;
+            e.heart_rate_sum += bpm;
+            e.heart_rate_sum_of_squares += uint64_t { bpm } * bpm;
+            e.heart_rate_min = ::std::min(e.heart_rate_min, bpm);
+            e.heart_rate_max = ::std::max(e.heart_rate_max, bpm);
+            e.confident_samples += packet.value<uint8_t>(1) == k_sleep_confidence ? 1 : 0;
+        }
+        return earliest;
+    }
+
+    // Returns the index of the epoch starting at `begin`, inserting it if needed
+    [[nodiscard]] size_t find_epoch(uint64_t const epoch_begin)
+    {
+        if (epochs_.empty() || epochs_.back().begin < epoch_begin)
+        {
+            epochs_.push_back({ epoch_begin });
+            return epochs_.size() - 1;
+        }
+        auto const it { lower_bound_epoch(epoch_begin) };
+        auto const pos { static_cast<size_t>(it - begin(epochs_)) };
+        if (it == end(epochs_) || it->begin != epoch_begin)
+        {
+            epochs_.insert(it, { epoch_begin });
+        }
+        return pos;
+    }
+
+    [[nodiscard]] ::std::vector<epoch_stats>::iterator lower_bound_epoch(uint64_t const epoch_begin)
+    {
+        return ::std::lower_bound(begin(epochs_), end(epochs_), epoch_begin,
+                                  [](epoch_stats const& e, uint64_t const b) { return e.begin < b; });
+    }
+
+    // Returns the worn time of an epoch in seconds, or `nullopt` if the epoch isn't covered by wear data
+    [[nodiscard]] ::std::optional<uint64_t> worn_seconds(epoch_stats const& e) const noexcept
+    {
+        auto const epoch_end { e.begin + options_.epoch };
+        auto const intervals { worn_.wear().overlapping(e.begin, epoch_end) };
+        if (intervals.empty())
+        {
+            return {};
+        }
+        uint64_t ticks { 0 };
+        for (auto const& iv : intervals)
+        {
+            if (iv.value == wear_state::worn)
+            {
+                ticks += ::std::min(iv.end, epoch_end) - ::std::max(iv.begin, e.begin);
+            }
+        }
+        return ticks / k_filetime_ticks_per_second;
+    }
+
+    [[nodiscard]] session_label classify(epoch_stats const& e, ::std::optional<uint64_t> const worn,
+                                         double const resting) const noexcept
+    {
+        // Without wear data, heart rate readings imply the device is worn
+        auto const is_worn { worn ? static_cast<double>(*worn * k_filetime_ticks_per_second)
+                                        >= options_.min_worn_share * static_cast<double>(options_.epoch)
+                                  : e.heart_rate_samples > 0 };
+        if (!is_worn)
+        {
+            return session_label::idle;
+        }
+
+        auto const elevated { e.heart_rate_samples > 0
+                              && e.heart_rate_mean() >= resting + options_.activity_heart_rate_margin };
+        if (e.heart_rate_samples > 0 && !elevated
+            && static_cast<double>(e.confident_samples)
+                   >= options_.sleep_confidence_share * static_cast<double>(e.heart_rate_samples))
+        {
+            return session_label::sleep;
+        }
+        if (elevated || e.extra_timestamps >= options_.activity_timestamps)
+        {
+            return session_label::activity;
+        }
+        return session_label::idle;
+    }
+
+    // Session under construction, accumulating epoch aggregates
+    struct session_builder
+    {
+        activity_session session;
+        uint64_t heart_rate_sum { 0 };
+        uint64_t heart_rate_sum_of_squares { 0 };
+
+        void add(epoch_stats const& e, uint64_t const epoch, ::std::optional<uint64_t> const worn)
+        {
+            auto& s { session };
+            s.end = e.begin + epoch;
+            ++s.epochs;
+            s.worn_seconds += worn.value_or(0);
+            s.extra_timestamps += e.extra_timestamps;
+            if (e.heart_rate_samples > 0)
+            {
+                s.heart_rate_min = s.heart_rate_samples == 0 ? e.heart_rate_min
+                                                             : ::std::min(s.heart_rate_min, e.heart_rate_min);
+                s.heart_rate_max = ::std::max(s.heart_rate_max, e.heart_rate_max);
+                s.heart_rate_samples += e.heart_rate_samples;
+                heart_rate_sum += e.heart_rate_sum;
+                heart_rate_sum_of_squares += e.heart_rate_sum_of_squares;
+            }
+        }
+
+        [[nodiscard]] activity_session finish(bool const open)
+        {
+            auto& s { session };
+            if (s.heart_rate_samples > 0)
+            {
+                auto const n { static_cast<double>(s.heart_rate_samples) };
+                s.heart_rate_mean = static_cast<double>(heart_rate_sum) / n;
+                s.heart_rate_deviation = ::std::sqrt(::std::max(
+                    static_cast<double>(heart_rate_sum_of_squares) / n - s.heart_rate_mean * s.heart_rate_mean, 0.0));
+            }
+            s.open = open;
+            return s;
+        }
+    };
+
+    // Recomputes the sessions affected by epochs starting at `from` or later
+    void segment(uint64_t const from)
+    {
+        // Keep the sessions that end (including the gap that could extend them) before `from`; an epoch starting
+        // exactly `max_gap` after a session's end still extends it
+        auto const keep { static_cast<size_t>(
+            ::std::partition_point(begin(sessions_), end(sessions_),
+                                   [&](activity_session const& s) { return s.end + options_.max_gap < from; })
+            - begin(sessions_)) };
+        auto const restart { keep < sessions_.size() ? ::std::min(sessions_[keep].begin, from) : from };
+        sessions_.resize(keep);
+        for (auto& s : sessions_)
+        {
+            s.open = false;
+        }
+
+        auto first { static_cast<size_t>(lower_bound_epoch(restart) - begin(epochs_)) };
+
+        // The resting heart rate covers all worn epochs. Epochs before `first` are final and counted once; the others
+        // are counted for this pass only. Epochs inserted before the counted ones (logs added out of order) require a
+        // recount.
+        if (first < counted_epochs_)
+        {
+            resting_histogram_.fill(0);
+            counted_epochs_ = 0;
+        }
+        auto const count = [](heart_rate_histogram& histogram, epoch_stats const& e,
+                              ::std::optional<uint64_t> const worn) {
+            if (e.heart_rate_samples > 0 && worn.value_or(1) > 0)
+            {
+                ++histogram[static_cast<size_t>(::std::lround(e.heart_rate_mean()))];
+            }
+        };
+        for (; counted_epochs_ < first; ++counted_epochs_)
+        {
+            count(resting_histogram_, epochs_[counted_epochs_], worn_seconds(epochs_[counted_epochs_]));
+        }
+        auto histogram { resting_histogram_ };
+        ::std::vector<::std::optional<uint64_t>> worn(epochs_.size() - first);
+        for (auto i { first }; i < epochs_.size(); ++i)
+        {
+            worn[i - first] = worn_seconds(epochs_[i]);
+            count(histogram, epochs_[i], worn[i - first]);
+        }
+        auto const resting { resting_heart_rate(histogram) };
+        resting_heart_rate_ = resting;
+        if (first > 0 && ::std::abs(resting - labelled_resting_heart_rate_) > options_.resting_heart_rate_tolerance)
+        {
+            // The kept sessions were labelled with a resting heart rate too far off; relabel all of them. The
+            // histogram already covers all epochs.
+            sessions_.clear();
+            worn.insert(begin(worn), first, ::std::nullopt);
+            for (size_t i { 0 }; i < first; ++i)
+            {
+                worn[i] = worn_seconds(epochs_[i]);
+            }
+            first = 0;
+        }
+        if (first == 0)
+        {
+            labelled_resting_heart_rate_ = resting;
+        }
+
+        ::std::optional<session_builder> current {};
+        // Run of epochs with a different label than `current`, not (yet) long enough for a session of their own
+        session_label pending_label { session_label::idle };
+        size_t pending_first { 0 };
+        size_t pending_count { 0 };
+        auto const absorb_pending = [&] {
+            for (auto i { pending_first }; i < pending_first + pending_count; ++i)
+            {
+                current->add(epochs_[i], options_.epoch, worn[i - first]);
+            }
+            pending_count = 0;
+        };
+        auto const start = [&](size_t const i, session_label const label) {
+            current.emplace();
+            current->session.begin = epochs_[i].begin;
+            current->session.label = label;
+        };
+
+        for (auto i { first }; i < epochs_.size(); ++i)
+        {
+            auto const label { classify(epochs_[i], worn[i - first], resting) };
+            auto const last_end { pending_count > 0 ? epochs_[pending_first + pending_count - 1].begin + options_.epoch
+                                                    : current ? current->session.end : 0 };
+            if (current && epochs_[i].begin > last_end + options_.max_gap)
+            {
+                absorb_pending();
+                sessions_.push_back(current->finish(false));
+                current.reset();
+            }
+            if (!current)
+            {
+                start(i, label);
+                current->add(epochs_[i], options_.epoch, worn[i - first]);
+                continue;
+            }
+            if (label == current->session.label)
+            {
+                absorb_pending();
+                current->add(epochs_[i], options_.epoch, worn[i - first]);
+                continue;
+            }
+
+            if (pending_count > 0 && label != pending_label)
+            {
+                absorb_pending();
+            }
+            if (pending_count == 0)
+            {
+                pending_label = label;
+                pending_first = i;
+            }
+            ++pending_count;
+            if (pending_count >= options_.min_session_epochs)
+            {
+                // A session that is too short itself (e.g. an outlier right after a gap) takes on the new label
+                if (current->session.epochs < options_.min_session_epochs)
+                {
+                    current->session.label = pending_label;
+                }
+                else
+                {
+                    sessions_.push_back(current->finish(false));
+                    start(pending_first, pending_label);
+                }
+                absorb_pending();
+            }
+        }
+        if (current)
+        {
+            absorb_pending();
+            sessions_.push_back(current->finish(true));
+        }
+    }
+
+    segmentation_options options_;
+    worn_timeline worn_;
+    ::std::set<uint32_t> chunks_;
+    // Sorted by `begin`
+    ::std::vector<epoch_stats> epochs_;
+    // Number of worn epochs per (rounded) mean heart rate, for the first `counted_epochs_` epochs
+    heart_rate_histogram resting_histogram_ {};
+    size_t counted_epochs_ { 0 };
+    double resting_heart_rate_ { 0.0 };
+    // Resting heart rate all sessions were last relabelled with; later passes stay within the tolerance of it
+    double labelled_resting_heart_rate_ { 0.0 };
+    ::std::vector<activity_session> sessions_;
+};
+
+
+//! \brief Segments a set of sensor logs into sessions.
+//!
+//! \param[in] log_paths    The logs, processed in the given order. Logs that
+//!                         fail to load are skipped.
+//! \param[in] descriptions The packet descriptions, used to reconstruct packet
+//!                         timestamps.
+//! \param[in] options      Segmentation parameters.
+//!
+//! \return The segmenter holding all sessions, which further logs can be
+//!         added to.
+//!
+[[nodiscard]] inline session_segmenter segment_log_files(::std::span<::std::filesystem::path const> const log_paths,
+                                                         ::payload_container const& descriptions,
+                                                         segmentation_options const& options = {})
+{
+    trace_span const span { "segment_log_files" };
+
+    session_segmenter segmenter { options };
+    for (auto const& path : log_paths)
+    {
+        try
+        {
+            ::model const m { path.c_str(), descriptions };
+            segmenter.add(m);
+        }
+        CATCH_LOG();
+    }
+    return segmenter;
+}
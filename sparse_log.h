@@ -0,0 +1,339 @@
+#pragma once
+
+#include "model.h"
+#include "packet_descriptions.h"
+#include "tracing.h"
+#include "windowed_mapping.h"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+// Default memory budget for the index structures of a fully loaded model (see `exceeds_index_budget()`)
+constexpr size_t k_default_index_budget { size_t { 1 } << 30 };
+
+// Approximate memory a model needs per packet: the directory entry, the sort map, the filter and per-type bitmaps
+// (at most 2 bytes), and a compressed timestamp
+constexpr size_t k_model_bytes_per_packet { sizeof(data_proxy) + sizeof(size_t) + 2 + 2 };
+
+
+// Largest log that is mapped as a whole for a model; larger logs don't fit into a 32-bit address space reliably
+constexpr uint64_t k_max_model_log_size { sizeof(void*) < 8 ? uint64_t { 512 } * 1024 * 1024 : UINT64_MAX };
+
+
+//! \brief Estimates the memory the index structures of a model would take up for a sensor log.
+//!
+//! \param[in] bytes The start of the raw sensor log.
+//! \param[in] total The size of the entire log.
+//!
+//! \return The estimated number of bytes. The packet count is extrapolated from the average packet size at the start
+//!         of the log, so the log doesn't need to be parsed (or even mapped) in full.
+//!
+[[nodiscard]] inline size_t estimate_index_bytes(::std::span<unsigned char const> const bytes,
+                                                 uint64_t const total) noexcept
+{
+    constexpr size_t k_sample_size { 1024 * 1024 };
+
+    size_t packets { 0 };
+    size_t pos { 0 };
+    while (pos < k_sample_size && bytes.size() - pos >= data_proxy::header_size())
+    {
+        auto const size { static_cast<size_t>(bytes[pos + 1]) + data_proxy::header_size() };
+        if (bytes.size() - pos < size)
+        {
+            break;
+        }
+        pos += size;
+        ++packets;
+    }
+    if (pos == 0)
+    {
+        return 0;
+    }
+    auto const estimated_packets { static_cast<double>(total) / static_cast<double>(pos) * packets };
+    return static_cast<size_t>(estimated_packets) * k_model_bytes_per_packet;
+}
+
+
+//! \brief Determines whether a sensor log should be opened as a `sparse_log` rather than a `model`.
+//!
+//! \param[in] bytes  The start of the raw sensor log.
+//! \param[in] total  The size of the entire log.
+//! \param[in] budget The memory budget for the model's index structures.
+//!
+[[nodiscard]] inline bool exceeds_index_budget(::std::span<unsigned char const> const bytes, uint64_t const total,
+                                               size_t const budget) noexcept
+{
+    return total > k_max_model_log_size || ::estimate_index_bytes(bytes, total) > budget;
+}
+
+
+// Receives progress while a sparse index is built: the number of packets indexed so far, and the number of bytes they
+// cover out of the total. Throwing from the observer aborts construction.
+using index_observer = ::std::function<void(size_t packets, size_t bytes_parsed, size_t bytes_total)>;
+
+
+// Sensor log with a sparse checkpoint index, for logs whose packet directory would exceed the memory budget.
+//
+// Only the offset of every `interval()`-th packet (a checkpoint) is stored, along with the number of packets of each
+// type in the window that starts there. Packets are decoded on demand one window at a time; the most recently used
+// windows are cached. Index memory thus grows with the number of windows rather than the number of packets.
+//
+// The log is mapped through a `windowed_mapping`, so address space usage is bounded as well. Decoded windows pin the
+// mapped windows their packets point into.
+//
+// Packets always appear in natural order. All members are safe to call concurrently.
+struct sparse_log
+{
+    static constexpr size_t k_default_interval { 4 * 1024 };
+    static constexpr size_t k_default_window_capacity { 8 };
+
+    sparse_log(wchar_t const* path_name, ::payload_container descriptions, index_observer const& observer = {},
+               size_t const interval = k_default_interval)
+        : memory_ { path_name }, packet_descriptions_ { ::std::move(descriptions) }, interval_ { clamp(interval) }
+    {
+        build_index(observer);
+    }
+
+    // Takes ownership of an in-memory copy of a sensor log (e.g. decoded from an archive)
+    sparse_log(::std::vector<unsigned char> buffer, ::payload_container descriptions,
+               index_observer const& observer = {}, size_t const interval = k_default_interval)
+        : memory_ { ::std::move(buffer) }
+        , packet_descriptions_ { ::std::move(descriptions) }
+        , interval_ { clamp(interval) }
+    {
+        build_index(observer);
+    }
+
+    sparse_log(sparse_log const&) = delete;
+    sparse_log& operator=(sparse_log const&) = delete;
+
+    [[nodiscard]] size_t packet_count() const noexcept { return packet_count_; }
+    // Number of packets between consecutive checkpoints
+    [[nodiscard]] size_t interval() const noexcept { return interval_; }
+    [[nodiscard]] size_t window_count() const noexcept { return checkpoints_.size(); }
+    [[nodiscard]] auto const& packet_descriptions() const noexcept { return packet_descriptions_; }
+    // Returns the size of the raw sensor log, including any trailing bytes not covered by the index
+    [[nodiscard]] uint64_t size() const noexcept { return memory_.size(); }
+
+    // Returns the packet at `index` (natural order). The packet keeps the memory it points into mapped.
+    [[nodiscard]] ::std::shared_ptr<data_proxy const> packet(size_t const index) const
+    {
+        assert(index < packet_count_);
+        auto const packets { window(index / interval_) };
+        return { packets, &(*packets)[index % interval_] };
+    }
+
+    // Returns the packets of the window starting at checkpoint `w`. The packets keep the memory they point into mapped.
+    [[nodiscard]] ::std::shared_ptr<::std::vector<data_proxy> const> window(size_t const w) const
+    {
+        auto const decoded { decoded_window_at(w) };
+        return { decoded, &decoded->packets };
+    }
+
+    // Returns the number of packets of the given types
+    [[nodiscard]] size_t count(::std::bitset<256> const& types) const noexcept
+    {
+        size_t result { 0 };
+        for (size_t type { 0 }; type < types.size(); ++type)
+        {
+            if (types.test(type))
+            {
+                result += type_totals_[type];
+            }
+        }
+        return result;
+    }
+
+    // Invokes `f(index, packet)` for every packet of the given types in natural order. Windows without any packets of
+    // these types aren't decoded at all. Decoded windows bypass the cache, so a scan doesn't evict the windows on
+    // screen.
+    template <typename F>
+    void for_each(::std::bitset<256> const& types, F&& f) const
+    {
+        for (size_t w { 0 }; w < checkpoints_.size(); ++w)
+        {
+            auto const& counts { checkpoints_[w].type_counts };
+            auto const any { [&] {
+                for (size_t type { 0 }; type < types.size(); ++type)
+                {
+                    if (types.test(type) && counts[type] != 0)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }() };
+            if (!any)
+            {
+                continue;
+            }
+
+            auto const decoded { decode_window(w) };
+            auto const& packets { decoded.packets };
+            for (size_t i { 0 }; i < packets.size(); ++i)
+            {
+                if (types.test(packets[i].type()))
+                {
+                    f(w * interval_ + i, packets[i]);
+                }
+            }
+        }
+    }
+
+    // Returns the memory taken up by the index (excluding cached windows)
+    [[nodiscard]] size_t index_bytes() const noexcept { return checkpoints_.capacity() * sizeof(checkpoint); }
+
+private:
+    struct checkpoint
+    {
+        // Offset of the window's first packet
+        uint64_t offset;
+        // Number of packets of each type in the window
+        ::std::array<uint16_t, 256> type_counts;
+    };
+
+    struct decoded_window
+    {
+        // The mapped windows `packets` point into
+        ::std::vector<::std::shared_ptr<mapped_window const>> views;
+        ::std::vector<data_proxy> packets;
+    };
+
+    // Type counts are stored in 16 bits
+    [[nodiscard]] static size_t clamp(size_t const interval) noexcept
+    {
+        return ::std::clamp(interval, size_t { 1 }, size_t { UINT16_MAX });
+    }
+
+    [[nodiscard]] ::std::shared_ptr<decoded_window const> decoded_window_at(size_t const w) const
+    {
+        assert(w < checkpoints_.size());
+        {
+            ::std::scoped_lock lock { lock_ };
+            if (auto cached { lookup(w) }; cached)
+            {
+                return cached;
+            }
+        }
+
+        auto decoded { ::std::make_shared<decoded_window const>(decode_window(w)) };
+        ::trace_count(trace_counter::allocations);
+        ::std::scoped_lock lock { lock_ };
+        if (auto cached { lookup(w) }; cached)
+        {
+            // Decoded concurrently
+            return cached;
+        }
+        windows_.emplace_front(w, decoded);
+        while (windows_.size() > k_default_window_capacity)
+        {
+            windows_.pop_back();
+        }
+        return decoded;
+    }
+
+    // Requires `lock_` to be held
+    [[nodiscard]] ::std::shared_ptr<decoded_window const> lookup(size_t const w) const
+    {
+        auto const it { ::std::find_if(begin(windows_), end(windows_),
+                                       [&](auto const& cached) { return cached.first == w; }) };
+        if (it == end(windows_))
+        {
+            return {};
+        }
+        // Move to front (most recently used)
+        windows_.splice(begin(windows_), windows_, it);
+        return it->second;
+    }
+
+    void build_index(index_observer const& observer)
+    {
+        trace_span const span { "sparse_log::build_index" };
+
+        auto const total { memory_.size() };
+        ::std::shared_ptr<mapped_window const> view {};
+        uint64_t pos { 0 };
+        while (total - pos >= data_proxy::header_size())
+        {
+            if (!view || pos >= view->offset + memory_.window_size())
+            {
+                // Previous views are released as soon as they have been scanned
+                view = memory_.pin(pos);
+            }
+            auto const current { view->bytes.data() + (pos - view->offset) };
+
+            // Full size of packet is the size stored at offset plus the header (type: byte, size: byte).
+            auto const size { static_cast<size_t>(current[1]) + data_proxy::header_size() };
+            if (total - pos < size)
+            {
+                // Truncated final packet
+                break;
+            }
+            if (packet_count_ % interval_ == 0)
+            {
+                if (observer && packet_count_ != 0)
+                {
+                    observer(packet_count_, static_cast<size_t>(pos), static_cast<size_t>(total));
+                }
+                checkpoints_.push_back({ pos, {} });
+            }
+            ++checkpoints_.back().type_counts[current[0]];
+            ++type_totals_[current[0]];
+            ++packet_count_;
+            pos += size;
+        }
+        checkpoints_.shrink_to_fit();
+        ::trace_count(trace_counter::bytes_scanned, pos);
+        ::trace_count(trace_counter::packets_indexed, packet_count_);
+        if (observer)
+        {
+            observer(packet_count_, static_cast<size_t>(pos), static_cast<size_t>(total));
+        }
+    }
+
+    [[nodiscard]] decoded_window decode_window(size_t const w) const
+    {
+        trace_span const span { "sparse_log::decode_window" };
+
+        auto const count { ::std::min(interval_, packet_count_ - w * interval_) };
+        decoded_window decoded {};
+        decoded.packets.reserve(count);
+        auto pos { checkpoints_[w].offset };
+        for (size_t i { 0 }; i < count; ++i)
+        {
+            if (decoded.views.empty() || pos >= decoded.views.back()->offset + memory_.window_size())
+            {
+                decoded.views.push_back(memory_.pin(pos));
+            }
+            auto const& view { *decoded.views.back() };
+            auto const current { view.bytes.data() + (pos - view.offset) };
+            // Sizes were validated while building the index. Views overlap, so the packet is contained in full.
+            auto const size { static_cast<size_t>(current[1]) + data_proxy::header_size() };
+            decoded.packets.push_back({ current, current + size });
+            pos += size;
+        }
+        return decoded;
+    }
+
+    windowed_mapping memory_;
+    payload_container packet_descriptions_;
+    size_t interval_;
+    size_t packet_count_ { 0 };
+    ::std::vector<checkpoint> checkpoints_;
+    ::std::array<size_t, 256> type_totals_ {};
+
+    mutable ::std::mutex lock_;
+    // Decoded windows, most recently used first
+    mutable ::std::list<::std::pair<size_t, ::std::shared_ptr<decoded_window const>>> windows_;
+};
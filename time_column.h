@@ -0,0 +1,147 @@
+#pragma once
+
+#include "encoding_utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+// Column of per-packet timestamps (raw FILETIME values), stored in compressed form.
+//
+// Every `k_checkpoint_interval`-th value is stored as an absolute checkpoint. All other values are stored as zigzag
+// and varint encoded delta-of-deltas. Interpolated timestamps advance by a near-constant delta, so most values take up
+// a single byte. Random access decodes at most `k_checkpoint_interval - 1` values starting at the nearest checkpoint.
+struct time_column
+{
+    static constexpr size_t k_checkpoint_interval { 64 };
+
+    void push_back(uint64_t const time)
+    {
+        auto const delta { static_cast<int64_t>(time - last_time_) };
+        if (size_ % k_checkpoint_interval == 0)
+        {
+            checkpoints_.push_back({ time, size_ == 0 ? 0 : delta, bytes_.size() });
+        }
+        else
+        {
+            ::write_varint(bytes_, ::zigzag_encode(delta - last_delta_));
+        }
+
+        last_time_ = time;
+        last_delta_ = size_ == 0 ? 0 : delta;
+        ++size_;
+    }
+
+    // Returns the timestamp of the packet at `index` (natural order)
+    [[nodiscard]] uint64_t operator[](size_t const index) const noexcept
+    {
+        assert(index < size_);
+        auto const& cp { checkpoints_[index / k_checkpoint_interval] };
+        auto time { cp.time };
+        auto delta { cp.delta };
+        auto pos { bytes_.data() + cp.offset };
+        for (auto remaining { index % k_checkpoint_interval }; remaining > 0; --remaining)
+        {
+            delta += ::zigzag_decode(::read_varint(pos));
+            time += static_cast<uint64_t>(delta);
+        }
+        return time;
+    }
+
+    // Decodes `out.size()` consecutive timestamps starting at `first` (natural order)
+    void decode(size_t const first, ::std::span<uint64_t> const out) const noexcept
+    {
+        assert(first + out.size() <= size_);
+        if (out.empty())
+        {
+            return;
+        }
+
+        auto const cp_index { first / k_checkpoint_interval };
+        auto const& cp { checkpoints_[cp_index] };
+        auto time { cp.time };
+        auto delta { cp.delta };
+        auto pos { bytes_.data() + cp.offset };
+        auto index { cp_index * k_checkpoint_interval };
+        for (size_t written { 0 }; written < out.size(); ++index)
+        {
+            if (index % k_checkpoint_interval == 0)
+            {
+                // Re-synchronize at checkpoints (the encoded stream skips them)
+                auto const& next_cp { checkpoints_[index / k_checkpoint_interval] };
+                time = next_cp.time;
+                delta = next_cp.delta;
+                pos = bytes_.data() + next_cp.offset;
+            }
+            else
+            {
+                delta += ::zigzag_decode(::read_varint(pos));
+                time += static_cast<uint64_t>(delta);
+            }
+
+            if (index >= first)
+            {
+                out[written++] = time;
+            }
+        }
+    }
+
+    [[nodiscard]] auto size() const noexcept { return size_; }
+    [[nodiscard]] auto empty() const noexcept { return size_ == 0; }
+    // Returns the (approximate) number of bytes used to store the column
+    [[nodiscard]] auto memory_usage() const noexcept
+    {
+        return bytes_.capacity() + checkpoints_.capacity() * sizeof(checkpoint);
+    }
+
+    void shrink_to_fit()
+    {
+        bytes_.shrink_to_fit();
+        checkpoints_.shrink_to_fit();
+    }
+
+private:
+    struct checkpoint
+    {
+        uint64_t time;
+        // Delta to the preceding value, required to continue decoding delta-of-deltas
+        int64_t delta;
+        size_t offset;
+    };
+
+    ::std::vector<checkpoint> checkpoints_;
+    ::std::vector<uint8_t> bytes_;
+    size_t size_ { 0 };
+    uint64_t last_time_ { 0 };
+    int64_t last_delta_ { 0 };
+};
+
+
+// Reads timestamps of a column by index, decoding them in blocks. Mostly sequential access (e.g. walking the packets of
+// a chunk) costs about one decoded value per read, rather than up to `k_checkpoint_interval` for random access.
+struct time_column_reader
+{
+    static constexpr size_t k_block_size { 4096 };
+
+    explicit time_column_reader(time_column const& column) : column_ { &column } {}
+
+    [[nodiscard]] uint64_t operator()(size_t const index)
+    {
+        assert(index < column_->size());
+        if (index < first_ || index >= first_ + block_.size())
+        {
+            first_ = index - index % k_block_size;
+            block_.resize(::std::min(k_block_size, column_->size() - first_));
+            column_->decode(first_, block_);
+        }
+        return block_[index - first_];
+    }
+
+private:
+    time_column const* column_;
+    ::std::vector<uint64_t> block_ {};
+    size_t first_ { 0 };
+};
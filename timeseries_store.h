@@ -0,0 +1,775 @@
+#pragma once
+
+#include "columnar_archive.h"
+#include "date_time_utils.h"
+#include "hash_utils.h"
+#include "model.h"
+#include "tracing.h"
+
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// A numeric payload element stored as a metric
+struct metric_definition
+{
+    // Directory name of the metric inside the store (letters, digits, `-`, `_`, and `.`)
+    ::std::string name;
+    unsigned char type;
+    // Index into `packet_description::elements`
+    size_t element;
+};
+
+
+struct timeseries_sample
+{
+    // Raw FILETIME value
+    uint64_t time;
+    double value;
+};
+
+
+enum struct rollup_level
+{
+    minute,
+    hour,
+    day,
+    last_value = day
+};
+
+
+// Aggregate of the samples inside a time range
+struct rollup_bucket
+{
+    // Start of the range (raw FILETIME value)
+    uint64_t start;
+    uint64_t count { 0 };
+    double min { ::std::numeric_limits<double>::infinity() };
+    double max { -::std::numeric_limits<double>::infinity() };
+    double sum { 0.0 };
+
+    [[nodiscard]] double mean() const noexcept
+    {
+        return count == 0 ? ::std::numeric_limits<double>::quiet_NaN() : sum / static_cast<double>(count);
+    }
+
+    void add(double const value) noexcept
+    {
+        ++count;
+        min = ::std::min(min, value);
+        max = ::std::max(max, value);
+        sum += value;
+    }
+
+    void merge(rollup_bucket const& other) noexcept
+    {
+        count += other.count;
+        min = ::std::min(min, other.min);
+        max = ::std::max(max, other.max);
+        sum += other.sum;
+    }
+};
+
+
+// Persistent, append-only store of metric samples over time, built from the logs' decoded payload elements.
+//
+// Every metric lives in `<root>/<name>`:
+//
+//   raw/<day>.blk              Samples of a day (columns: time | value)
+//   <level>/<partition>.roll   Rollup records of `k_buckets_per_partition` consecutive buckets of a level (minute,
+//                              hour, day; columns: start | count | min | max | sum). Records of the same bucket from
+//                              different ingests are merged on read.
+//   sources.txt                Committed ingests, one per line: the XXH64 hash of the log and a random ingest ID
+//                              (both hexadecimal)
+//
+// Both kinds of data files are sequences of blocks, one appended per ingest:
+//
+//   size:u32 | ingest:u64 | count:varint | kind:u8 | scale:f64 | bias:f64 | column...
+//
+// Columns are encoded with `encode_column()`. Sample values are stored unscaled, with the element's scale and bias
+// applied on read, so integer elements stay integers (as do their rollups' min/max/sum). Values are stored as integers
+// (`kind` 0) if all of a block's are, and as IEEE 754 bit patterns (`kind` 1) otherwise.
+//
+// Range queries are decomposed into the coarsest buckets that fit the range, with finer levels covering the
+// remainder at both ends (see `aggregate()`), so long-range queries only read a few small rollup files.
+//
+// An ingest appends its blocks first and commits them by adding its line to `sources.txt` last. Blocks are only read
+// if their ingest ID is committed, so blocks left behind by an interrupted ingest (including a truncated trailing
+// block) are ignored, and ingesting the same log again after a crash doesn't count its samples twice. Queries see the
+// ingests committed when they start.
+struct timeseries_store
+{
+    static constexpr ::std::array<uint64_t, static_cast<size_t>(rollup_level::last_value) + 1> k_level_widths {
+        60 * k_filetime_ticks_per_second, 3'600 * k_filetime_ticks_per_second, k_filetime_ticks_per_day
+    };
+    static constexpr uint64_t k_buckets_per_partition { 1'024 };
+
+    explicit timeseries_store(::std::filesystem::path root) : root_ { ::std::move(root) }
+    {
+        ::std::filesystem::create_directories(root_);
+    }
+
+    timeseries_store(timeseries_store const&) = delete;
+    timeseries_store& operator=(timeseries_store const&) = delete;
+
+    //! \brief Appends the samples of `metrics` found in a model.
+    //!
+    //! \return The number of samples added. Metrics that already hold this log
+    //!         (by content hash) are skipped.
+    //!
+    //! \remark The model needs a time column; models without one don't add any
+    //!         samples. Packets whose element can't be decoded are skipped.
+    //!
+    size_t ingest(model const& m, ::std::span<metric_definition const> const metrics)
+    {
+        trace_span const span { "timeseries_store::ingest" };
+
+        for (auto const& metric : metrics)
+        {
+            validate_name(metric.name);
+        }
+        auto const& times { m.time_column() };
+        if (!times || metrics.empty())
+        {
+            return 0;
+        }
+
+        // Extract the samples of all metrics in a single pass. Values are stored unscaled, so that integer elements
+        // remain integers; scale and bias are recorded per block instead.
+        ::std::array<::std::vector<size_t>, 256> metrics_by_type {};
+        ::std::vector<payload_element> elements(metrics.size());
+        ::std::vector<::std::pair<double, double>> transforms(metrics.size(), { 1.0, 0.0 });
+        for (size_t i { 0 }; i < metrics.size(); ++i)
+        {
+            auto const description { m.packet_descriptions().find(metrics[i].type) };
+            if (description != end(m.packet_descriptions())
+                && metrics[i].element < description->second.elements.size())
+            {
+                elements[i] = description->second.elements[metrics[i].element];
+                if (elements[i].type != payload_type::enumeration)
+                {
+                    transforms[i] = { elements[i].scale, elements[i].bias };
+                }
+                elements[i].scale = 1.0;
+                elements[i].bias = 0.0;
+                metrics_by_type[metrics[i].type].push_back(i);
+            }
+        }
+        ::std::vector<::std::vector<timeseries_sample>> extracted(metrics.size());
+        auto const& directory { m.directory() };
+        for (size_t index { 0 }; index < directory.size(); ++index)
+        {
+            auto const& packet { directory[index] };
+            for (auto const i : metrics_by_type[packet.type()])
+            {
+                if (auto const value { ::element_value(packet, elements[i]) }; value && ::std::isfinite(*value))
+                {
+                    extracted[i].push_back({ (*times)[index], *value });
+                }
+            }
+        }
+
+        auto const hash { ::xxhash64(m.bytes()) };
+        size_t added { 0 };
+        ::std::scoped_lock lock { write_lock_ };
+        for (size_t i { 0 }; i < metrics.size(); ++i)
+        {
+            auto const directory_path { root_ / metrics[i].name };
+            ::std::filesystem::create_directories(directory_path);
+            if (read_sources(directory_path).contains(hash))
+            {
+                continue;
+            }
+            // A fresh ID per attempt, so that the blocks of an interrupted attempt are never committed
+            auto const ingest { (uint64_t { random_() } << 32) | random_() };
+            auto const [scale, bias] { transforms[i] };
+            append_samples(directory_path, extracted[i], ingest, scale, bias);
+            append_rollups(directory_path, extracted[i], ingest, scale, bias);
+            commit_source(directory_path, hash, ingest);
+            added += extracted[i].size();
+        }
+        return added;
+    }
+
+    // Ingests multiple sensor logs in parallel. A `thread_count` of 0 selects the number of hardware threads.
+    size_t ingest(::std::span<::std::filesystem::path const> const log_paths,
+                  ::payload_container const& descriptions, ::std::span<metric_definition const> const metrics,
+                  size_t thread_count = 0)
+    {
+        if (thread_count == 0)
+        {
+            thread_count = ::std::max(1u, ::std::thread::hardware_concurrency());
+        }
+
+        ::std::atomic<size_t> added { 0 };
+        ::std::vector<::std::exception_ptr> errors(log_paths.size());
+        ::std::atomic<size_t> next { 0 };
+        {
+            ::std::vector<::std::jthread> workers {};
+            for (size_t t { 0 }; t < ::std::min(thread_count, log_paths.size()); ++t)
+            {
+                workers.emplace_back([&] {
+                    for (auto index { next++ }; index < log_paths.size(); index = next++)
+                    {
+                        try
+                        {
+                            ::model const m { log_paths[index].c_str(), descriptions };
+                            added += ingest(m, metrics);
+                        }
+                        catch (...)
+                        {
+                            errors[index] = ::std::current_exception();
+                        }
+                    }
+                });
+            }
+        }
+
+        for (auto const& error : errors)
+        {
+            if (error)
+            {
+                ::std::rethrow_exception(error);
+            }
+        }
+        return added;
+    }
+
+    // Returns the names of all metrics
+    [[nodiscard]] ::std::vector<::std::string> metric_names() const
+    {
+        ::std::vector<::std::string> names {};
+        for (auto const& entry : ::std::filesystem::directory_iterator { root_ })
+        {
+            if (entry.is_directory())
+            {
+                names.push_back(entry.path().filename().string());
+            }
+        }
+        ::std::sort(begin(names), end(names));
+        return names;
+    }
+
+    // Returns the raw samples in [from, to) in chronological order
+    [[nodiscard]] ::std::vector<timeseries_sample> samples(::std::string const& metric, uint64_t const from,
+                                                           uint64_t const to) const
+    {
+        query_context context { root_, metric };
+        ::std::vector<timeseries_sample> result {};
+        context.for_each_sample(from, to, [&](timeseries_sample const& sample) { result.push_back(sample); });
+        return result;
+    }
+
+    // Returns the non-empty buckets of a level starting in [from, to), in chronological order
+    [[nodiscard]] ::std::vector<rollup_bucket> rollups(::std::string const& metric, rollup_level const level,
+                                                       uint64_t const from, uint64_t const to) const
+    {
+        query_context context { root_, metric };
+        ::std::vector<rollup_bucket> result {};
+        context.for_each_bucket(level, from, to, [&](rollup_bucket const& bucket) { result.push_back(bucket); });
+        return result;
+    }
+
+    //! \brief Aggregates the samples in [from, to).
+    //!
+    //! \remark The range is covered by day buckets as far as possible, the
+    //!         remainder at either end by hour buckets, then minute buckets,
+    //!         and finally raw samples.
+    //!
+    [[nodiscard]] rollup_bucket aggregate(::std::string const& metric, uint64_t const from, uint64_t const to) const
+    {
+        query_context context { root_, metric };
+        rollup_bucket result { from };
+        context.aggregate(result, from, to, k_level_widths.size());
+        return result;
+    }
+
+    //! \brief Aggregates the samples in [from, to) into buckets of equal width.
+    //!
+    //! \return The buckets `[from + k * width, from + (k + 1) * width)`, the
+    //!         final one clipped to `to`. Empty buckets are omitted.
+    //!
+    //! \remark Every bucket is aggregated as in `aggregate()`; rollup files are
+    //!         read once per query.
+    //!
+    [[nodiscard]] ::std::vector<rollup_bucket> query(::std::string const& metric, uint64_t const from,
+                                                     uint64_t const to, uint64_t const width) const
+    {
+        trace_span const span { "timeseries_store::query" };
+        THROW_HR_IF(E_INVALIDARG, width == 0);
+
+        query_context context { root_, metric };
+        ::std::vector<rollup_bucket> result {};
+        for (auto start { from }; start < to; start = to - start > width ? start + width : to)
+        {
+            rollup_bucket bucket { start };
+            context.aggregate(bucket, start, to - start > width ? start + width : to, k_level_widths.size());
+            if (bucket.count != 0)
+            {
+                result.push_back(bucket);
+            }
+        }
+        return result;
+    }
+
+private:
+    // Columns of a block (see `append_block()`)
+    struct block_columns
+    {
+        ::std::vector<::std::vector<uint64_t>> integers;
+        ::std::vector<::std::vector<double>> values;
+    };
+
+    // Caches the partitions read while answering a query
+    struct query_context
+    {
+        ::std::filesystem::path directory;
+        // IDs of the ingests committed when the query started
+        ::std::set<uint64_t> committed {};
+        ::std::map<::std::pair<size_t, uint64_t>, ::std::vector<rollup_bucket>> partitions {};
+        ::std::map<uint64_t, ::std::vector<timeseries_sample>> days {};
+
+        query_context(::std::filesystem::path const& root, ::std::string const& metric) : directory { root / metric }
+        {
+            validate_name(metric);
+            for (auto const& [source, ingest] : read_sources(directory))
+            {
+                committed.insert(ingest);
+            }
+        }
+
+        // Adds the samples in [from, to) to `result`, using buckets of `levels` (coarsest first) and finer
+        void aggregate(rollup_bucket& result, uint64_t const from, uint64_t const to, size_t const levels)
+        {
+            if (from >= to)
+            {
+                return;
+            }
+            if (levels == 0)
+            {
+                for_each_sample(from, to, [&](timeseries_sample const& sample) { result.add(sample.value); });
+                return;
+            }
+
+            auto const level { levels - 1 };
+            auto const width { k_level_widths[level] };
+            auto const first { from / width + (from % width != 0 ? 1 : 0) };
+            auto const last { to / width };
+            if (first >= last)
+            {
+                aggregate(result, from, to, level);
+                return;
+            }
+            for_each_bucket(static_cast<rollup_level>(level), first * width, last * width,
+                            [&](rollup_bucket const& bucket) { result.merge(bucket); });
+            aggregate(result, from, first * width, level);
+            aggregate(result, last * width, to, level);
+        }
+
+        template <typename F>
+        void for_each_bucket(rollup_level const level, uint64_t const from, uint64_t const to, F&& f)
+        {
+            if (from >= to)
+            {
+                return;
+            }
+            auto const index { static_cast<size_t>(level) };
+            auto const partition_width { k_level_widths[index] * k_buckets_per_partition };
+            for (auto p { from / partition_width }; p <= (to - 1) / partition_width; ++p)
+            {
+                auto it { partitions.find({ index, p }) };
+                if (it == end(partitions))
+                {
+                    it = partitions.emplace(::std::pair { index, p }, read_partition(level, p)).first;
+                }
+                auto const& buckets { it->second };
+                for (auto b { ::std::lower_bound(begin(buckets), end(buckets), from,
+                                                 [](auto const& lhs, uint64_t const t) { return lhs.start < t; }) };
+                     b != end(buckets) && b->start < to; ++b)
+                {
+                    f(*b);
+                }
+            }
+        }
+
+        template <typename F>
+        void for_each_sample(uint64_t const from, uint64_t const to, F&& f)
+        {
+            if (from >= to)
+            {
+                return;
+            }
+            for (auto day { from / k_filetime_ticks_per_day }; day <= (to - 1) / k_filetime_ticks_per_day; ++day)
+            {
+                auto it { days.find(day) };
+                if (it == end(days))
+                {
+                    it = days.emplace(day, read_day(day)).first;
+                }
+                auto const& samples { it->second };
+                for (auto s { ::std::lower_bound(begin(samples), end(samples), from,
+                                                 [](auto const& lhs, uint64_t const t) { return lhs.time < t; }) };
+                     s != end(samples) && s->time < to; ++s)
+                {
+                    f(*s);
+                }
+            }
+        }
+
+        [[nodiscard]] ::std::vector<rollup_bucket> read_partition(rollup_level const level, uint64_t const p) const
+        {
+            ::std::map<uint64_t, rollup_bucket> merged {};
+            read_blocks(partition_path(directory, level, p), committed, 2, 3,
+                        [&](block_columns const& columns, double const scale, double const bias) {
+                            for (size_t i { 0 }; i < columns.integers[0].size(); ++i)
+                            {
+                                auto const count { columns.integers[1][i] };
+                                auto min { columns.values[0][i] * scale + bias };
+                                auto max { columns.values[1][i] * scale + bias };
+                                if (scale < 0.0)
+                                {
+                                    ::std::swap(min, max);
+                                }
+                                rollup_bucket const record { columns.integers[0][i], count, min, max,
+                                                             columns.values[2][i] * scale
+                                                                 + static_cast<double>(count) * bias };
+                                auto const [it, inserted] { merged.try_emplace(record.start, record) };
+                                if (!inserted)
+                                {
+                                    it->second.merge(record);
+                                }
+                            }
+                        });
+
+            ::std::vector<rollup_bucket> buckets {};
+            buckets.reserve(merged.size());
+            for (auto const& [start, bucket] : merged)
+            {
+                buckets.push_back(bucket);
+            }
+            return buckets;
+        }
+
+        [[nodiscard]] ::std::vector<timeseries_sample> read_day(uint64_t const day) const
+        {
+            ::std::vector<timeseries_sample> samples {};
+            read_blocks(directory / L"raw" / ::std::format(L"{}.blk", day), committed, 1, 1,
+                        [&](block_columns const& columns, double const scale, double const bias) {
+                            for (size_t i { 0 }; i < columns.integers[0].size(); ++i)
+                            {
+                                samples.push_back({ columns.integers[0][i], columns.values[0][i] * scale + bias });
+                            }
+                        });
+            // Blocks of different ingests may overlap in time
+            ::std::stable_sort(begin(samples), end(samples),
+                               [](auto const& lhs, auto const& rhs) { return lhs.time < rhs.time; });
+            return samples;
+        }
+    };
+
+    static void validate_name(::std::string const& name)
+    {
+        THROW_HR_IF(E_INVALIDARG, name.empty() || name == "." || name == ".."
+                                      || !::std::all_of(begin(name), end(name), [](char const c) {
+                                             return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                                                    || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.';
+                                         }));
+    }
+
+    [[nodiscard]] static ::std::filesystem::path partition_path(::std::filesystem::path const& directory,
+                                                                rollup_level const level, uint64_t const p)
+    {
+        static constexpr ::std::array<wchar_t const*, k_level_widths.size()> k_level_names { L"minute", L"hour",
+                                                                                             L"day" };
+        return directory / k_level_names[static_cast<size_t>(level)] / ::std::format(L"{}.roll", p);
+    }
+
+    // Returns the content of a file, or nothing if it doesn't exist
+    [[nodiscard]] static ::std::vector<uint8_t> read_file(::std::filesystem::path const& path)
+    {
+        ::std::ifstream in { path, ::std::ios::binary | ::std::ios::ate };
+        if (!in)
+        {
+            return {};
+        }
+        ::std::vector<uint8_t> content(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(content.data()), static_cast<::std::streamsize>(content.size()));
+        THROW_WIN32_IF(ERROR_READ_FAULT, static_cast<size_t>(in.gcount()) != content.size());
+        ::trace_count(trace_counter::bytes_scanned, content.size());
+        return content;
+    }
+
+    static void append_file(::std::filesystem::path const& path, ::std::span<uint8_t const> const content)
+    {
+        ::std::filesystem::create_directories(path.parent_path());
+        ::std::ofstream out { path, ::std::ios::binary | ::std::ios::app };
+        out.write(reinterpret_cast<char const*>(content.data()), static_cast<::std::streamsize>(content.size()));
+        THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+    }
+
+    static void append_file(::std::filesystem::path const& path, ::std::string const& content)
+    {
+        append_file(path, { reinterpret_cast<uint8_t const*>(content.data()), content.size() });
+    }
+
+    // Returns the committed ingests of a metric, mapping log hashes to ingest IDs. Lines that don't parse (e.g. one
+    // truncated by a crash) are ignored.
+    [[nodiscard]] static ::std::map<uint64_t, uint64_t> read_sources(::std::filesystem::path const& directory)
+    {
+        ::std::map<uint64_t, uint64_t> sources {};
+        ::std::ifstream in { directory / L"sources.txt" };
+        for (::std::string line {}; ::std::getline(in, line);)
+        {
+            uint64_t source {};
+            uint64_t ingest {};
+            auto const data { line.data() };
+            if (line.size() == 33 && line[16] == ' '
+                && ::std::from_chars(data, data + 16, source, 16) == ::std::from_chars_result { data + 16, {} }
+                && ::std::from_chars(data + 17, data + 33, ingest, 16) == ::std::from_chars_result { data + 33, {} })
+            {
+                sources.emplace(source, ingest);
+            }
+        }
+        return sources;
+    }
+
+    // Commits an ingest by appending its line to `sources.txt`
+    static void commit_source(::std::filesystem::path const& directory, uint64_t const source, uint64_t const ingest)
+    {
+        auto const path { directory / L"sources.txt" };
+        auto line { ::std::format("{:016x} {:016x}\n", source, ingest) };
+        // Complete a line truncated by a crash, so that it doesn't swallow this one
+        if (auto const content { read_file(path) }; !content.empty() && content.back() != '\n')
+        {
+            line.insert(line.begin(), '\n');
+        }
+        append_file(path, line);
+    }
+
+    //! \brief Appends a block of equally sized columns to a file.
+    //!
+    //! \param[in] path    The file to append to.
+    //! \param[in] ingest  ID of the ingest the block belongs to.
+    //! \param[in] columns The columns.
+    //! \param[in] scale   Scale applied to the values on read.
+    //! \param[in] bias    Bias applied to the values on read.
+    //!
+    //! \remark Values are stored as integers if all values of the block are,
+    //!         and as IEEE 754 bit patterns otherwise.
+    //!
+    static void append_block(::std::filesystem::path const& path, uint64_t const ingest, block_columns const& columns,
+                             double const scale, double const bias)
+    {
+        auto const count { columns.integers.front().size() };
+        auto const integral { ::std::all_of(begin(columns.values), end(columns.values), [](auto const& column) {
+            return ::std::all_of(begin(column), end(column), [](double const value) {
+                return value == ::std::trunc(value) && ::std::abs(value) < 0x1p53;
+            });
+        }) };
+
+        ::std::vector<uint8_t> block(sizeof(uint32_t) + sizeof(ingest));
+        ::std::memcpy(block.data() + sizeof(uint32_t), &ingest, sizeof(ingest));
+        ::write_varint(block, count);
+        block.push_back(integral ? 0 : 1);
+        for (auto const parameter : { scale, bias })
+        {
+            auto const bits { ::std::bit_cast<uint64_t>(parameter) };
+            for (size_t b { 0 }; b < sizeof(bits); ++b)
+            {
+                block.push_back(static_cast<uint8_t>(bits >> (b * 8)));
+            }
+        }
+        for (auto const& column : columns.integers)
+        {
+            ::encode_column(block, column, sizeof(uint64_t));
+        }
+        ::std::vector<uint64_t> encoded(count);
+        for (auto const& column : columns.values)
+        {
+            ::std::transform(begin(column), end(column), begin(encoded), [&](double const value) {
+                return integral ? ::zigzag_encode(static_cast<int64_t>(value)) : ::std::bit_cast<uint64_t>(value);
+            });
+            ::encode_column(block, encoded, sizeof(uint64_t));
+        }
+        auto const size { static_cast<uint32_t>(block.size() - sizeof(uint32_t)) };
+        ::std::memcpy(block.data(), &size, sizeof(size));
+        truncate_torn_block(path);
+        append_file(path, block);
+    }
+
+    // Drops a trailing block truncated by a crash, which would otherwise swallow the blocks appended after it
+    static void truncate_torn_block(::std::filesystem::path const& path)
+    {
+        uint64_t offset { 0 };
+        uint64_t file_size { 0 };
+        {
+            ::std::ifstream in { path, ::std::ios::binary | ::std::ios::ate };
+            if (!in)
+            {
+                return;
+            }
+            file_size = static_cast<uint64_t>(in.tellg());
+            uint32_t size {};
+            while (file_size - offset >= sizeof(size))
+            {
+                in.seekg(static_cast<::std::streamoff>(offset));
+                in.read(reinterpret_cast<char*>(&size), sizeof(size));
+                THROW_WIN32_IF(ERROR_READ_FAULT, !in);
+                if (file_size - offset - sizeof(size) < size)
+                {
+                    break;
+                }
+                offset += sizeof(size) + size;
+            }
+        }
+        if (offset != file_size)
+        {
+            ::std::filesystem::resize_file(path, offset);
+        }
+    }
+
+    // Invokes `f(columns, scale, bias)` for every block of a file (see `append_block()`) that belongs to a committed
+    // ingest, if the file exists
+    template <typename F>
+    static void read_blocks(::std::filesystem::path const& path, ::std::set<uint64_t> const& committed,
+                            size_t const integer_count, size_t const value_count, F&& f)
+    {
+        auto content { read_file(path) };
+        auto const content_size { content.size() };
+        // Column decoders may read up to 8 bytes past the end of a column
+        content.resize(content_size + sizeof(uint64_t));
+
+        block_columns columns { ::std::vector<::std::vector<uint64_t>>(integer_count),
+                                ::std::vector<::std::vector<double>>(value_count) };
+        size_t offset { 0 };
+        while (content_size - offset >= sizeof(uint32_t))
+        {
+            uint32_t size {};
+            ::std::memcpy(&size, content.data() + offset, sizeof(size));
+            offset += sizeof(size);
+            if (content_size - offset < size)
+            {
+                // Truncated block
+                break;
+            }
+            uint8_t const* pos { content.data() + offset };
+            auto const block_end { pos + size };
+            uint64_t ingest {};
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, size < sizeof(ingest));
+            ::std::memcpy(&ingest, pos, sizeof(ingest));
+            pos += sizeof(ingest);
+            if (!committed.contains(ingest))
+            {
+                offset += size;
+                continue;
+            }
+            auto const count { static_cast<size_t>(::read_varint(pos)) };
+            THROW_WIN32_IF(ERROR_FILE_CORRUPT, count > size || block_end - pos < 1 + 2 * ptrdiff_t { sizeof(double) });
+            auto const integral { *pos++ == 0 };
+            ::std::array<double, 2> parameters {};
+            ::std::memcpy(parameters.data(), pos, sizeof(parameters));
+            pos += sizeof(parameters);
+            for (auto& column : columns.integers)
+            {
+                column.resize(count);
+                ::decode_column(pos, block_end, column, sizeof(uint64_t));
+            }
+            ::std::vector<uint64_t> encoded(count);
+            for (auto& column : columns.values)
+            {
+                ::decode_column(pos, block_end, encoded, sizeof(uint64_t));
+                column.resize(count);
+                ::std::transform(begin(encoded), end(encoded), begin(column), [&](uint64_t const value) {
+                    return integral ? static_cast<double>(::zigzag_decode(value)) : ::std::bit_cast<double>(value);
+                });
+            }
+            f(columns, parameters[0], parameters[1]);
+            offset += size;
+        }
+    }
+
+    // Appends a block per run of samples of the same day
+    static void append_samples(::std::filesystem::path const& directory,
+                               ::std::span<timeseries_sample const> const series, uint64_t const ingest,
+                               double const scale, double const bias)
+    {
+        for (size_t first { 0 }; first < series.size();)
+        {
+            auto const day { series[first].time / k_filetime_ticks_per_day };
+            block_columns columns { { {} }, { {} } };
+            auto last { first };
+            for (; last < series.size() && series[last].time / k_filetime_ticks_per_day == day; ++last)
+            {
+                columns.integers[0].push_back(series[last].time);
+                columns.values[0].push_back(series[last].value);
+            }
+            append_block(directory / L"raw" / ::std::format(L"{}.blk", day), ingest, columns, scale, bias);
+            first = last;
+        }
+    }
+
+    // Appends a block of rollup records per partition and level. Records are computed from unscaled values.
+    static void append_rollups(::std::filesystem::path const& directory,
+                               ::std::span<timeseries_sample const> const series, uint64_t const ingest,
+                               double const scale, double const bias)
+    {
+        for (size_t level { 0 }; level < k_level_widths.size(); ++level)
+        {
+            auto const width { k_level_widths[level] };
+            auto const partition_width { width * k_buckets_per_partition };
+            ::std::map<uint64_t, ::std::map<uint64_t, rollup_bucket>> partitions {};
+            for (auto const& sample : series)
+            {
+                auto const start { sample.time / width * width };
+                partitions[sample.time / partition_width].try_emplace(start, rollup_bucket { start }).first->second.add(
+                    sample.value);
+            }
+
+            for (auto const& [p, buckets] : partitions)
+            {
+                block_columns columns { { {}, {} }, { {}, {}, {} } };
+                for (auto const& [start, bucket] : buckets)
+                {
+                    columns.integers[0].push_back(bucket.start);
+                    columns.integers[1].push_back(bucket.count);
+                    columns.values[0].push_back(bucket.min);
+                    columns.values[1].push_back(bucket.max);
+                    columns.values[2].push_back(bucket.sum);
+                }
+                append_block(partition_path(directory, static_cast<rollup_level>(level), p), ingest, columns, scale,
+                             bias);
+            }
+        }
+    }
+
+    ::std::filesystem::path root_;
+    // Serializes appends (and the duplicate checks preceding them)
+    ::std::mutex write_lock_;
+    // Generates ingest IDs; guarded by `write_lock_`
+    ::std::random_device random_ {};
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Lightweight instrumentation: scoped spans and counters, exported as Chrome trace event JSON (viewable in Perfetto or
+// chrome://tracing).
+//
+// Tracing is off by default. While off, spans and counters cost a single relaxed load. While on, every thread records
+// spans into a ring buffer of its own without taking any locks; only the most recent `k_trace_buffer_capacity` spans
+// per thread are kept.
+
+
+// Counters maintained while tracing is enabled
+enum struct trace_counter
+{
+    bytes_scanned,
+    packets_indexed,
+    cache_hits,
+    cache_misses,
+    // Allocations on hot paths: rendered rows, decoded sparse log windows, and load progress snapshots
+    allocations,
+    last_value = allocations
+};
+
+
+// Recording internals (see `trace_span`, `trace_count()`, and `chrome_trace_json()`)
+struct tracing
+{
+    static constexpr size_t k_trace_buffer_capacity { 16 * 1024 };
+
+    static constexpr ::std::array<char const*, static_cast<size_t>(trace_counter::last_value) + 1> k_counter_names {
+        "bytes_scanned", "packets_indexed", "cache_hits", "cache_misses", "allocations"
+    };
+
+    struct event
+    {
+        // Static string; must not require escaping in JSON
+        char const* name;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        uint32_t thread_id;
+    };
+
+    // Ring buffer of a single thread. Only the owning thread writes. Buffers are handed on to new threads after their
+    // owner exits (events carry the thread id), so the number of buffers is bounded by the number of concurrent
+    // threads.
+    struct buffer
+    {
+        ::std::array<event, k_trace_buffer_capacity> events {};
+        // Number of events written so far
+        ::std::atomic<uint64_t> written { 0 };
+        ::std::atomic<bool> in_use { false };
+    };
+
+    struct state
+    {
+        ::std::atomic<bool> enabled { false };
+        ::std::chrono::steady_clock::time_point const epoch { ::std::chrono::steady_clock::now() };
+        ::std::array<::std::atomic<uint64_t>, k_counter_names.size()> counters {};
+
+        // Guards `buffers` only; taken once per thread when it records its first span
+        ::std::mutex lock;
+        ::std::vector<::std::shared_ptr<buffer>> buffers;
+    };
+
+    [[nodiscard]] static state& global() noexcept
+    {
+        static state instance {};
+        return instance;
+    }
+
+    [[nodiscard]] static uint64_t now_ns() noexcept
+    {
+        return static_cast<uint64_t>(::std::chrono::duration_cast<::std::chrono::nanoseconds>(
+                                         ::std::chrono::steady_clock::now() - global().epoch)
+                                         .count());
+    }
+
+    // Returns the calling thread's buffer, acquiring one on first use
+    [[nodiscard]] static buffer& thread_buffer()
+    {
+        // Releases the buffer for reuse when the thread exits
+        struct holder
+        {
+            ::std::shared_ptr<buffer> acquired;
+            ~holder()
+            {
+                if (acquired)
+                {
+                    acquired->in_use.store(false, ::std::memory_order_release);
+                }
+            }
+        };
+        thread_local holder current {};
+        if (!current.acquired)
+        {
+            auto& s { global() };
+            ::std::scoped_lock lock { s.lock };
+            for (auto const& candidate : s.buffers)
+            {
+                if (!candidate->in_use.load(::std::memory_order_acquire))
+                {
+                    current.acquired = candidate;
+                    break;
+                }
+            }
+            if (!current.acquired)
+            {
+                current.acquired = s.buffers.emplace_back(::std::make_shared<buffer>());
+            }
+            current.acquired->in_use.store(true, ::std::memory_order_relaxed);
+        }
+        return *current.acquired;
+    }
+
+    static void record(char const* const name, uint64_t const start_ns, uint64_t const end_ns)
+    {
+        auto& b { thread_buffer() };
+        auto const index { b.written.load(::std::memory_order_relaxed) };
+        b.events[index % k_trace_buffer_capacity] = { name, start_ns, end_ns - start_ns,
+                                                      static_cast<uint32_t>(::GetCurrentThreadId()) };
+        b.written.store(index + 1, ::std::memory_order_release);
+    }
+};
+
+
+[[nodiscard]] inline bool trace_enabled() noexcept
+{
+    return ::tracing::global().enabled.load(::std::memory_order_relaxed);
+}
+
+inline void enable_tracing(bool const enabled) noexcept
+{
+    ::tracing::global().enabled.store(enabled, ::std::memory_order_relaxed);
+}
+
+
+//! \brief Adds to a counter if tracing is enabled.
+//!
+inline void trace_count(trace_counter const counter, uint64_t const value = 1) noexcept
+{
+    if (::trace_enabled())
+    {
+        ::tracing::global().counters[static_cast<size_t>(counter)].fetch_add(value, ::std::memory_order_relaxed);
+    }
+}
+
+
+// Records the time between construction and destruction as a span, if tracing was enabled on construction. `name`
+// must be a string literal (or otherwise outlive the trace).
+struct trace_span
+{
+    explicit trace_span(char const* const name) noexcept
+        : name_ { name }, start_ns_ { ::trace_enabled() ? ::tracing::now_ns() : k_disabled }
+    {
+    }
+
+    ~trace_span()
+    {
+        if (start_ns_ != k_disabled)
+        {
+            // Failing to acquire a buffer only loses this span
+            try
+            {
+                ::tracing::record(name_, start_ns_, ::tracing::now_ns());
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    trace_span(trace_span const&) = delete;
+    trace_span& operator=(trace_span const&) = delete;
+
+private:
+    static constexpr uint64_t k_disabled { UINT64_MAX };
+
+    char const* name_;
+    uint64_t start_ns_;
+};
+
+
+//! \brief Renders the recorded spans and the current counter values as Chrome
+//!        trace event JSON.
+//!
+//! \remark Spans that are overwritten while their buffer is read are skipped.
+//!         Spans still open aren't included.
+//!
+[[nodiscard]] inline ::std::string chrome_trace_json()
+{
+    auto& s { ::tracing::global() };
+    ::std::vector<::std::shared_ptr<::tracing::buffer>> buffers {};
+    {
+        ::std::scoped_lock lock { s.lock };
+        buffers = s.buffers;
+    }
+
+    ::std::string json { "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" };
+    auto first { true };
+    auto const append_separator = [&] {
+        if (!::std::exchange(first, false))
+        {
+            json += ',';
+        }
+    };
+    // Trace event timestamps are in (fractional) microseconds
+    auto const append_us = [&](uint64_t const ns) {
+        json += ::std::to_string(ns / 1000);
+        json += '.';
+        auto const fraction { ::std::to_string(ns % 1000) };
+        json.append(3 - fraction.size(), '0');
+        json += fraction;
+    };
+
+    for (auto const& b : buffers)
+    {
+        auto const end { b->written.load(::std::memory_order_acquire) };
+        auto const begin { end > ::tracing::k_trace_buffer_capacity ? end - ::tracing::k_trace_buffer_capacity : 0 };
+        ::std::vector<::tracing::event> events {};
+        events.reserve(static_cast<size_t>(end - begin));
+        for (auto index { begin }; index < end; ++index)
+        {
+            events.push_back(b->events[index % ::tracing::k_trace_buffer_capacity]);
+        }
+        // Drop events the owning thread may have overwritten in the meantime
+        auto const written { b->written.load(::std::memory_order_acquire) };
+        auto const valid_from { written >= ::tracing::k_trace_buffer_capacity
+                                    ? written - ::tracing::k_trace_buffer_capacity + 1
+                                    : 0 };
+        auto const skip { static_cast<size_t>(::std::min(::std::max(valid_from, begin) - begin, end - begin)) };
+
+        for (size_t i { skip }; i < events.size(); ++i)
+        {
+            auto const& e { events[i] };
+            append_separator();
+            json += "{\"name\":\"";
+            json += e.name;
+            json += "\",\"cat\":\"msbsla\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            json += ::std::to_string(e.thread_id);
+            json += ",\"ts\":";
+            append_us(e.start_ns);
+            json += ",\"dur\":";
+            append_us(e.duration_ns);
+            json += '}';
+        }
+    }
+
+    auto const now { ::tracing::now_ns() };
+    for (size_t counter { 0 }; counter < s.counters.size(); ++counter)
+    {
+        append_separator();
+        json += "{\"name\":\"";
+        json += ::tracing::k_counter_names[counter];
+        json += "\",\"cat\":\"msbsla\",\"ph\":\"C\",\"pid\":1,\"ts\":";
+        append_us(now);
+        json += ",\"args\":{\"value\":";
+        json += ::std::to_string(s.counters[counter].load(::std::memory_order_relaxed));
+        json += "}}";
+    }
+
+    json += "]}";
+    return json;
+}
+
+
+//! \brief Writes the trace to a file (see `chrome_trace_json()`).
+//!
+inline void write_chrome_trace(::std::filesystem::path const& target)
+{
+    auto const json { ::chrome_trace_json() };
+    ::std::ofstream out { target, ::std::ios::binary | ::std::ios::trunc };
+    THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+    out.write(json.data(), static_cast<::std::streamsize>(json.size()));
+    THROW_WIN32_IF(ERROR_WRITE_FAULT, !out);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "model.h"
+
+#include <algorithm>
+#include <bitset>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+
+// Sorts and filters a model on a background thread, so that large logs don't block the UI.
+//
+// The worker tracks the requested filter and sort order; every request supersedes any request that hasn't completed
+// yet. Completed views are published to the model (see `model::publish_view()`) and reported through the callback,
+// which runs on the worker thread. Until then, readers keep using the previous view. The results of superseded requests
+// are discarded rather than published.
+//
+// The model must outlive the worker.
+struct view_worker
+{
+    using callback_type = ::std::function<void(::std::shared_ptr<model_view const>)>;
+
+    view_worker(::model& m, callback_type callback) : model_ { m }, callback_ { ::std::move(callback) }
+    {
+        auto const current { m.view() };
+        types_ = current->types;
+        selection_ = current->selection;
+        pred_ = current->pred;
+        dir_ = current->dir;
+        worker_ = ::std::jthread { [this](::std::stop_token const stop) { run(stop); } };
+    }
+
+    ~view_worker()
+    {
+        worker_.request_stop();
+        // `worker_` joins on destruction
+    }
+
+    view_worker(view_worker const&) = delete;
+    view_worker& operator=(view_worker const&) = delete;
+
+    // Requests a sort order, keeping the requested filter
+    void sort(sort_predicate const pred, sort_direction const dir)
+    {
+        {
+            ::std::scoped_lock lock { lock_ };
+            pred_ = pred;
+            dir_ = dir;
+            ++requested_;
+        }
+        request_available_.notify_one();
+    }
+
+    // Requests a filter (`nullopt` for all packets), keeping the requested sort order
+    void filter(::std::optional<::std::bitset<256>> const& types)
+    {
+        {
+            ::std::scoped_lock lock { lock_ };
+            types_ = types;
+            ++requested_;
+        }
+        request_available_.notify_one();
+    }
+
+    // Requests a selection (`nullptr` for all packets), keeping the requested filter and sort order
+    void select(::std::shared_ptr<packet_bitmap const> selection)
+    {
+        {
+            ::std::scoped_lock lock { lock_ };
+            selection_ = ::std::move(selection);
+            ++requested_;
+        }
+        request_available_.notify_one();
+    }
+
+    // Blocks until all requests issued so far have completed
+    void wait_idle()
+    {
+        ::std::unique_lock lock { lock_ };
+        idle_.wait(lock, [&] { return completed_ == requested_; });
+    }
+
+private:
+    [[nodiscard]] bool superseded(uint64_t const request)
+    {
+        ::std::scoped_lock lock { lock_ };
+        return request != requested_;
+    }
+
+    void run(::std::stop_token const stop)
+    {
+        ::std::unique_lock lock { lock_ };
+        while (!stop.stop_requested())
+        {
+            request_available_.wait(lock, stop, [&] { return completed_ != requested_; });
+            if (stop.stop_requested())
+            {
+                return;
+            }
+
+            auto const request { requested_ };
+            auto const types { types_ };
+            auto const selection { selection_ };
+            auto const pred { pred_ };
+            auto const dir { dir_ };
+            lock.unlock();
+
+            // Retry if the model's view was replaced by someone else (e.g. `model::sort()` on another thread)
+            for (;;)
+            {
+                auto const base { model_.view() };
+                auto next { model_.make_view(*base, types, selection, pred, dir) };
+                if (stop.stop_requested() || superseded(request))
+                {
+                    break;
+                }
+                if (model_.publish_view(base, next))
+                {
+                    callback_(::std::move(next));
+                    break;
+                }
+            }
+
+            lock.lock();
+            completed_ = ::std::max(completed_, request);
+            idle_.notify_all();
+        }
+    }
+
+    ::model& model_;
+    callback_type callback_;
+
+    ::std::mutex lock_;
+    ::std::condition_variable_any request_available_;
+    ::std::condition_variable idle_;
+    // Requested view
+    ::std::optional<::std::bitset<256>> types_;
+    ::std::shared_ptr<packet_bitmap const> selection_;
+    sort_predicate pred_ { sort_predicate::index };
+    sort_direction dir_ { sort_direction::asc };
+    uint64_t requested_ { 0 };
+    uint64_t completed_ { 0 };
+
+    // Declared last so that it stops before any of the members it uses are destroyed
+    ::std::jthread worker_;
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <wil/resource.h>
+#include <wil/result.h>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// A mapped region of a sensor log. Stays mapped for as long as anyone holds on to it.
+struct mapped_window
+{
+    // Offset of the first byte in the log
+    uint64_t offset;
+    // The mapped bytes. These extend past the window's nominal end (see `windowed_mapping`).
+    ::std::span<unsigned char const> bytes;
+    // Owns the view if mapped from a file
+    ::wil::unique_mapview_ptr<unsigned char const> view;
+};
+
+
+// Maps a sensor log in fixed-size windows on demand, so that address space usage stays bounded regardless of the size
+// of the log.
+//
+// Windows start at multiples of `window_size()`, which is a multiple of the system's allocation granularity. Each view
+// extends `k_overlap` bytes past the window's nominal end, so a packet that starts inside a window is always contained
+// in its view in full, even if it straddles the boundary to the next window.
+//
+// Clients pin a window by holding on to the `mapped_window` returned from `pin()`. The most recently used windows are
+// kept mapped even when unpinned; the others are unmapped as soon as the last pin goes away. All members are safe to
+// call concurrently.
+struct windowed_mapping
+{
+    static constexpr size_t k_default_window_size { 16 * 1024 * 1024 };
+    static constexpr size_t k_default_capacity { 4 };
+    // Maximum size of a packet (type: byte, size: byte, payload)
+    static constexpr size_t k_overlap { 2 + 0xFF };
+
+    explicit windowed_mapping(wchar_t const* path_name, size_t const window_size = k_default_window_size,
+                              size_t const capacity = k_default_capacity)
+        : capacity_ { ::std::max(capacity, size_t { 1 }) }
+    {
+        // Open file
+        wil::unique_hfile f { ::CreateFileW(path_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                            FILE_ATTRIBUTE_NORMAL, nullptr) };
+        if (!f)
+        {
+            THROW_LAST_ERROR();
+        }
+
+        LARGE_INTEGER file_size {};
+        THROW_IF_WIN32_BOOL_FALSE(::GetFileSizeEx(f.get(), &file_size));
+        size_ = static_cast<uint64_t>(file_size.QuadPart);
+        if (size_ == 0)
+        {
+            // Empty files cannot be mapped
+            return;
+        }
+
+        file_mapping_.reset(
+            ::CreateFileMapping(f.get(), nullptr, PAGE_READONLY, file_size.HighPart, file_size.LowPart, nullptr));
+        THROW_LAST_ERROR_IF(file_mapping_ == nullptr);
+
+        // Views must start at a multiple of the allocation granularity
+        SYSTEM_INFO si {};
+        ::GetSystemInfo(&si);
+        auto const granularity { static_cast<size_t>(si.dwAllocationGranularity) };
+        window_size_ = ::std::max((window_size + granularity - 1) / granularity, size_t { 1 }) * granularity;
+    }
+
+    // Takes ownership of an in-memory copy of a sensor log (e.g. decoded from an archive), which is exposed as a single
+    // window
+    explicit windowed_mapping(::std::vector<unsigned char> buffer)
+        : buffer_ { ::std::move(buffer) }, size_ { buffer_.size() }, capacity_ { 1 }
+    {
+        window_size_ = ::std::max(buffer_.size(), size_t { 1 });
+    }
+
+    windowed_mapping(windowed_mapping const&) = delete;
+    windowed_mapping& operator=(windowed_mapping const&) = delete;
+
+    // Returns the size of the log
+    [[nodiscard]] uint64_t size() const noexcept { return size_; }
+    [[nodiscard]] size_t window_size() const noexcept { return window_size_; }
+
+    // Returns the window containing `offset`, mapping it if necessary. Its bytes cover the packet starting at `offset`
+    // (provided that the log isn't truncated).
+    [[nodiscard]] ::std::shared_ptr<mapped_window const> pin(uint64_t const offset) const
+    {
+        assert(offset < size_);
+        auto const index { offset / window_size_ };
+
+        ::std::scoped_lock lock { lock_ };
+        if (auto const it { windows_.find(index) }; it != end(windows_))
+        {
+            if (auto pinned { it->second.lock() }; pinned)
+            {
+                touch(pinned);
+                return pinned;
+            }
+        }
+
+        auto mapped { map(index) };
+        windows_.insert_or_assign(index, mapped);
+        touch(mapped);
+        return mapped;
+    }
+
+private:
+    // Requires `lock_` to be held
+    [[nodiscard]] ::std::shared_ptr<mapped_window const> map(uint64_t const index) const
+    {
+        auto const begin { index * window_size_ };
+        auto const length { static_cast<size_t>(::std::min<uint64_t>(window_size_ + k_overlap, size_ - begin)) };
+        if (!buffer_.empty())
+        {
+            return ::std::make_shared<mapped_window const>(
+                mapped_window { begin, { buffer_.data() + begin, length }, nullptr });
+        }
+
+        ::wil::unique_mapview_ptr<unsigned char const> view { static_cast<unsigned char const*>(
+            ::MapViewOfFile(file_mapping_.get(), FILE_MAP_READ, static_cast<DWORD>(begin >> 32),
+                            static_cast<DWORD>(begin & 0xFFFF'FFFF), length)) };
+        THROW_LAST_ERROR_IF_NULL(view.get());
+        ::std::span<unsigned char const> const bytes { view.get(), length };
+        return ::std::make_shared<mapped_window const>(mapped_window { begin, bytes, ::std::move(view) });
+    }
+
+    // Marks `window` as most recently used. Requires `lock_` to be held.
+    void touch(::std::shared_ptr<mapped_window const> const& window) const
+    {
+        auto const it { ::std::find(::std::begin(recent_), ::std::end(recent_), window) };
+        if (it != ::std::end(recent_))
+        {
+            recent_.splice(::std::begin(recent_), recent_, it);
+            return;
+        }
+        recent_.push_front(window);
+        while (recent_.size() > capacity_)
+        {
+            recent_.pop_back();
+        }
+        // Forget windows that have been unmapped
+        ::std::erase_if(windows_, [](auto const& entry) { return entry.second.expired(); });
+    }
+
+    ::wil::unique_handle file_mapping_;
+    // Backing store if not mapped from a file
+    ::std::vector<unsigned char> buffer_;
+    uint64_t size_ { 0 };
+    size_t window_size_ { k_default_window_size };
+    size_t capacity_;
+
+    mutable ::std::mutex lock_;
+    // Every window that is currently mapped, by index
+    mutable ::std::unordered_map<uint64_t, ::std::weak_ptr<mapped_window const>> windows_;
+    // Windows kept mapped while unpinned, most recently used first
+    mutable ::std::list<::std::shared_ptr<mapped_window const>> recent_;
+};
@@ -0,0 +1,356 @@
+#pragma once
+
+#include "chunk_utils.h"
+#include "date_time_utils.h"
+#include "model.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+// Half-open time interval [begin, end) carrying a state value. Times are raw FILETIME values.
+template <typename T>
+struct interval
+{
+    uint64_t begin;
+    uint64_t end;
+    T value;
+
+    [[nodiscard]] auto duration() const noexcept { return end - begin; }
+};
+
+
+// Sorted set of non-overlapping intervals. Adjacent intervals carrying the same value are merged on insertion, so the
+// container holds a run-length encoded representation of a state over time.
+template <typename T>
+struct interval_index
+{
+    // Inserts an interval. Parts of existing intervals overlapped by the new interval are replaced.
+    void insert(interval<T> const& iv)
+    {
+        if (iv.begin >= iv.end)
+        {
+            return;
+        }
+
+        auto first { ::std::partition_point(begin(intervals_), end(intervals_),
+                                            [&](auto const& el) { return el.end <= iv.begin; }) };
+        auto last { ::std::partition_point(first, end(intervals_), [&](auto const& el) { return el.begin < iv.end; }) };
+
+        // Collect replacements for the overlapped range
+        ::std::vector<interval<T>> replacement {};
+        if (first != last && first->begin < iv.begin)
+        {
+            replacement.push_back({ first->begin, iv.begin, first->value });
+        }
+        replacement.push_back(iv);
+        if (first != last && ::std::prev(last)->end > iv.end)
+        {
+            replacement.push_back({ iv.end, ::std::prev(last)->end, ::std::prev(last)->value });
+        }
+
+        auto const pos { static_cast<size_t>(::std::distance(begin(intervals_), first)) };
+        intervals_.erase(first, last);
+        intervals_.insert(begin(intervals_) + pos, begin(replacement), end(replacement));
+
+        // Merge with neighbors (run-length encoding)
+        auto const merge_begin { pos > 0 ? pos - 1 : 0 };
+        auto merge_end { ::std::min(pos + replacement.size() + 1, intervals_.size()) };
+        for (auto index { merge_begin }; index + 1 < merge_end;)
+        {
+            auto& lhs { intervals_[index] };
+            auto const& rhs { intervals_[index + 1] };
+            if (lhs.end == rhs.begin && lhs.value == rhs.value)
+            {
+                lhs.end = rhs.end;
+                intervals_.erase(begin(intervals_) + index + 1);
+                --merge_end;
+            }
+            else
+            {
+                ++index;
+            }
+        }
+    }
+
+    // Returns all intervals overlapping [from, to)
+    [[nodiscard]] ::std::span<interval<T> const> overlapping(uint64_t const from, uint64_t const to) const noexcept
+    {
+        auto const first { ::std::partition_point(begin(intervals_), end(intervals_),
+                                                  [&](auto const& el) { return el.end <= from; }) };
+        auto const last { ::std::partition_point(first, end(intervals_),
+                                                 [&](auto const& el) { return el.begin < to; }) };
+        return { first, last };
+    }
+
+    // Returns the interval covering a point in time (if any)
+    [[nodiscard]] interval<T> const* at(uint64_t const time) const noexcept
+    {
+        auto const result { overlapping(time, time + 1) };
+        return result.empty() ? nullptr : &result.front();
+    }
+
+    [[nodiscard]] auto const& intervals() const noexcept { return intervals_; }
+    [[nodiscard]] auto size() const noexcept { return intervals_.size(); }
+
+private:
+    ::std::vector<interval<T>> intervals_;
+};
+
+
+//! \brief Returns a time source for packets of a directory without a time
+//!        column.
+//!
+//! \return A callable mapping a packet index (natural order) to the most
+//!         recent valid [TIMESTAMP] packet at or before it within the same
+//!         chunk, if any. Packets preceding the first valid [TIMESTAMP] of
+//!         their chunk have no time. It scans forward, so it's meant for
+//!         (mostly) ascending indices; a lower index restarts the scan at the
+//!         start of the directory.
+//!
+[[nodiscard]] inline auto timestamp_packet_times(::std::span<data_proxy const> const directory)
+{
+    return [directory, scanned = size_t { 0 }, last = ::std::optional<uint64_t> {}](
+               size_t const index) mutable -> ::std::optional<uint64_t> {
+        if (index < scanned)
+        {
+            scanned = 0;
+            last.reset();
+        }
+        for (; scanned <= index; ++scanned)
+        {
+            // A [SEQUENCE_ID] packet ends its chunk, so timestamps don't carry over into the next one
+            if (scanned > 0 && directory[scanned - 1].type() == k_packet_type_sequence_id)
+            {
+                last.reset();
+            }
+            auto const& packet { directory[scanned] };
+            if (packet.type() == k_packet_type_timestamp && packet.payload_size() >= sizeof(uint64_t)
+                && ::is_plausible_timestamp(packet.value<uint64_t>(0)))
+            {
+                last = packet.value<uint64_t>(0);
+            }
+        }
+        return last;
+    };
+}
+
+
+enum struct wear_state : uint8_t
+{
+    not_worn,
+    worn
+};
+
+
+// Converts the [WORN_PERIOD] (0x81) and device state (0x0B) packet streams into interval sets.
+//
+// Each [WORN_PERIOD] sample carries a cumulative worn period (seconds) and the difference to the previous sample. The
+// worn time accumulated between two samples is placed at the end of the time span between them; the remainder is
+// reported as 'not worn'. Device state samples carry 3 flags which are combined into a bit mask (flag N in bit N).
+//
+// The timeline is incremental: Chunks are identified by their sequence ID and every chunk is processed at most once,
+// so adding overlapping log files only processes the chunks not seen before. Incomplete chunks (lacking the trailing
+// [SEQUENCE_ID] packet) are skipped.
+struct worn_timeline
+{
+    // Processes all new chunks of a loaded log, using its reconstructed packet timestamps where available
+    size_t add(model const& m)
+    {
+        if (auto const& times { m.time_column() }; times)
+        {
+            return add(m.directory(), [reader = time_column_reader { *times }](size_t const index) mutable
+                                          -> ::std::optional<uint64_t> { return reader(index); });
+        }
+        return add(m.directory());
+    }
+
+    // Processes all new chunks in `directory`, using the most recent valid [TIMESTAMP] packet of a chunk as the time of
+    // subsequent packets (see `timestamp_packet_times`). Returns the number of chunks processed. An incomplete trailing
+    // chunk is skipped without being recorded, so it's processed once a later log contains it in full.
+    size_t add(::std::span<data_proxy const> const directory)
+    {
+        // Chunks are processed in natural order, so this only ever scans forward
+        return add(directory, ::timestamp_packet_times(directory));
+    }
+
+    // Processes all new chunks in `directory`. `time_of` maps a packet index (natural order) to an optional timestamp.
+    template <typename TimeSource>
+    size_t add(::std::span<data_proxy const> const directory, TimeSource&& time_of)
+    {
+        size_t processed { 0 };
+        for (auto const& chunk : ::split_into_chunks(directory))
+        {
+            if (!chunk.is_complete() || chunks_.contains(*chunk.sequence_id))
+            {
+                continue;
+            }
+            process_chunk(directory, chunk, time_of);
+            ++processed;
+        }
+
+        if (processed > 0)
+        {
+            daily_worn_time_.reset();
+        }
+        return processed;
+    }
+
+    [[nodiscard]] auto const& wear() const noexcept { return wear_; }
+    [[nodiscard]] auto const& device_flags() const noexcept { return device_flags_; }
+    [[nodiscard]] auto counter_resets() const noexcept { return counter_resets_; }
+    [[nodiscard]] auto chunk_count() const noexcept { return chunks_.size(); }
+
+    // Returns the worn time per UTC day. Keys are the raw FILETIME values of midnight, values are worn time in seconds.
+    [[nodiscard]] ::std::map<uint64_t, uint64_t> const& daily_worn_time() const
+    {
+        if (!daily_worn_time_)
+        {
+            ::std::map<uint64_t, uint64_t> ticks_per_day {};
+            for (auto const& iv : wear_.intervals())
+            {
+                if (iv.value != wear_state::worn)
+                {
+                    continue;
+                }
+                // Split intervals that cross midnight
+                for (auto pos { iv.begin }; pos < iv.end;)
+                {
+                    auto const day { pos - pos % k_filetime_ticks_per_day };
+                    auto const next { ::std::min(iv.end, day + k_filetime_ticks_per_day) };
+                    ticks_per_day[day] += next - pos;
+                    pos = next;
+                }
+            }
+
+            auto& result { daily_worn_time_.emplace() };
+            for (auto const& [day, ticks] : ticks_per_day)
+            {
+                result.emplace(day, ticks / k_filetime_ticks_per_second);
+            }
+        }
+        return *daily_worn_time_;
+    }
+
+private:
+    struct worn_sample
+    {
+        uint64_t time;
+        uint32_t cumulative;
+        uint16_t difference;
+    };
+
+    // First and last [WORN_PERIOD] samples of a processed chunk, used to bridge adjacent chunks in any order
+    struct chunk_edges
+    {
+        ::std::optional<worn_sample> head;
+        ::std::optional<worn_sample> tail;
+    };
+
+    // Emits the wear intervals for the time span between two consecutive samples
+    void add_worn_span(worn_sample const& prev, worn_sample const& cur)
+    {
+        // Use the cumulative values unless the counter was reset, in which case the difference field is all we have
+        uint64_t worn_seconds { cur.difference };
+        if (cur.cumulative >= prev.cumulative)
+        {
+            worn_seconds = cur.cumulative - prev.cumulative;
+        }
+        else
+        {
+            ++counter_resets_;
+        }
+
+        if (cur.time <= prev.time)
+        {
+            return;
+        }
+        auto const span { cur.time - prev.time };
+        auto const worn_ticks { ::std::min(worn_seconds * k_filetime_ticks_per_second, span) };
+        wear_.insert({ prev.time, cur.time - worn_ticks, wear_state::not_worn });
+        wear_.insert({ cur.time - worn_ticks, cur.time, wear_state::worn });
+    }
+
+    template <typename TimeSource>
+    void process_chunk(::std::span<data_proxy const> const directory, chunk_info const& chunk, TimeSource& time_of)
+    {
+        auto const sequence_id { *chunk.sequence_id };
+        auto& edges { chunks_[sequence_id] };
+
+        // Seed with the preceding chunk's final sample, if that chunk has been seen already
+        ::std::optional<worn_sample> prev {};
+        if (auto const it { chunks_.find(sequence_id - 1) }; it != end(chunks_))
+        {
+            prev = it->second.tail;
+        }
+
+        ::std::optional<uint64_t> last_time {};
+        ::std::optional<::std::pair<uint64_t, uint8_t>> open_flags {};
+
+        for (auto index { chunk.begin }; index < chunk.end; ++index)
+        {
+            auto const time { time_of(index) };
+            if (!time)
+            {
+                continue;
+            }
+            last_time = time;
+
+            auto const& packet { directory[index] };
+            if (packet.type() == k_packet_type_worn_period && packet.payload_size() >= 6)
+            {
+                worn_sample const cur { *time, packet.value<uint32_t>(0), packet.value<uint16_t>(4) };
+                if (prev)
+                {
+                    add_worn_span(*prev, cur);
+                }
+                if (!edges.head)
+                {
+                    edges.head = cur;
+                }
+                prev = cur;
+            }
+            else if (packet.type() == k_packet_type_device_state && packet.payload_size() >= 3)
+            {
+                uint8_t const mask { static_cast<uint8_t>((packet.value<uint8_t>(0) != 0 ? 0x1 : 0x0)
+                                                          | (packet.value<uint8_t>(1) != 0 ? 0x2 : 0x0)
+                                                          | (packet.value<uint8_t>(2) != 0 ? 0x4 : 0x0)) };
+                if (open_flags && open_flags->second != mask)
+                {
+                    device_flags_.insert({ open_flags->first, *time, open_flags->second });
+                    open_flags.reset();
+                }
+                if (!open_flags)
+                {
+                    open_flags = { *time, mask };
+                }
+            }
+        }
+
+        // Device state is assumed to persist until the end of the chunk
+        if (open_flags && last_time)
+        {
+            device_flags_.insert({ open_flags->first, *last_time, open_flags->second });
+        }
+
+        // Chunks without samples pass on the preceding chunk's final sample
+        edges.tail = prev;
+
+        // Bridge to the following chunk, if that chunk has been seen already
+        if (auto const it { chunks_.find(sequence_id + 1) }; it != end(chunks_) && edges.tail && it->second.head)
+        {
+            add_worn_span(*edges.tail, *it->second.head);
+        }
+    }
+
+    interval_index<wear_state> wear_;
+    interval_index<uint8_t> device_flags_;
+    ::std::map<uint32_t, chunk_edges> chunks_;
+    size_t counter_resets_ { 0 };
+    // Lazily computed from `wear_`; reset whenever new chunks are processed
+    mutable ::std::optional<::std::map<uint64_t, uint64_t>> daily_worn_time_;
+};